@@ -524,7 +524,7 @@
  * necessario liberare la memoria allocata dalla struttura
  * NMXP_RAW_STREAM_DATA per mezzo della funzione nmxp_raw_stream_free().
  * Opzionalmente, prima di questa funzione pu&ograve; essere richiamata
- * nmxp_raw_manage_stream_flush() che esegue le funzioni sui pacchetti
+ * nmxp_raw_stream_manage_flush() che esegue le funzioni sui pacchetti
  * rimanenti indipendentemente dalla continuit&agrave; del dato.
  * 
  * \todo
@@ -989,6 +989,8 @@ Mail bug reports and suggestions to <quintiliani@ingv.it>.
 #include "nmxp_base.h"
 #include "nmxp_crc32.h"
 #include "nmxp_memory.h"
+#include "nmxp_steim.h"
+#include "nmxp_timer.h"
 
 #define NMXP_MAX_MSCHAN_MSEC		15000
 
@@ -1019,15 +1021,34 @@ typedef struct {
 #define NMXP_MAX_FUNC_PD 10
 #define TIME_TOLLERANCE 0.001
 
-typedef struct {
+/*! \brief Number of hole fill delays kept for tuning max_tolerable_latency */
+#define NMXP_RAW_STREAM_N_FILL_DELAYS 64
+/*! \brief Minimum number of hole fill delays before tuning max_tolerable_latency */
+#define NMXP_RAW_STREAM_MIN_FILL_DELAYS 8
+
+typedef struct NMXP_RAW_STREAM_DATA {
     int32_t last_seq_no_sent;
     double last_sample_time;
     double last_latency;
     int32_t max_pdlist_items;
     double max_tolerable_latency;
     int timeoutrecv;
-    int32_t n_pdlist;
-    NMXP_DATA_PROCESS **pdlist; /* Array for pd queue */
+    int32_t n_pdlist;			/* Number of queued packets, pdlist plus pdlist_far */
+    int32_t pdlist_size;		/* Number of slots of pdlist */
+    int32_t pdlist_head_seq_no;		/* seq_no of the oldest packet in pdlist */
+    NMXP_DATA_PROCESS **pdlist; /* Ring buffer for pd queue, seq_no from last_seq_no_sent+1 to last_seq_no_sent+pdlist_size */
+    int32_t n_pdlist_far;		/* Number of packets in pdlist_far */
+    NMXP_DATA_PROCESS **pdlist_far;	/* Packets beyond the ring, sorted by seq_no. Allocated on demand */
+    double adaptive_percentile;		/* Percentile of the hole fill delays to wait for, 0.0 if max_tolerable_latency is fixed */
+    double adaptive_latency_min;	/* Lower bound of max_tolerable_latency */
+    double adaptive_latency_max;	/* Upper bound of max_tolerable_latency */
+    int32_t skipped_seq_no_first;	/* First packet of the last hole skipped by force */
+    int32_t skipped_seq_no_last;	/* Last packet of the last hole skipped by force */
+    int32_t n_fill_delay;		/* Number of items of fill_delay */
+    int32_t i_fill_delay;		/* Next item of fill_delay to overwrite */
+    float fill_delay[NMXP_RAW_STREAM_N_FILL_DELAYS];	/* Latency of the last packets that filled a hole */
+    /* Called before pd is handled by force, the hole spans from last_sample_time to pd->time. It could be NULL */
+    void (*func_gap)(struct NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd);
 } NMXP_RAW_STREAM_DATA;
 
 
@@ -1085,6 +1106,54 @@ int nmxp_receiveChannelList(int isock, NMXP_CHAN_LIST **pchannelList);
  * \retval SOCKET_ERROR on error
  * 
  */
+/*! \brief Sends the message "AddTimeSeriesChannels" for all the channels at once
+ *
+ * \param isock A descriptor referencing the socket.
+ * \param channelList List of channel.
+ * \param shortTermCompletion Short-term-completion time = s, 1<= s <= 300 seconds.
+ * \param out_format Output format, same as nmxp_sendAddTimeSeriesChannel().
+ * \param buffer_flag Server will send or not buffered packets.
+ *
+ * \retval SOCKET_OK on success
+ * \retval SOCKET_ERROR on error
+ * 
+ */
+int nmxp_sendAddTimeSeriesChannel_raw(int isock, NMXP_CHAN_LIST_NET *channelList, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag);
+
+
+/*! \brief Same as nmxp_sendAddTimeSeriesChannel_raw() for the channels of a view of a channel list
+ *
+ * Used for requesting a list in batches, or only the channels appended to it, without copying.
+ *
+ * \param isock A descriptor referencing the socket.
+ * \param channel First channel of the view.
+ * \param number Number of channels of the view.
+ * \param shortTermCompletion Short-term-completion time = s, 1<= s <= 300 seconds.
+ * \param out_format Output format, same as nmxp_sendAddTimeSeriesChannel().
+ * \param buffer_flag Server will send or not buffered packets.
+ *
+ * \retval SOCKET_OK on success
+ * \retval SOCKET_ERROR on error
+ * 
+ */
+int nmxp_sendAddTimeSeriesChannel_view(int isock, const NMXP_CHAN_KEY_NET *channel, int32_t number, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag);
+
+
+/*! \brief Sends the message "RemoveTimeSeriesChannels" for the channels of a view of a channel list
+ *
+ * The server stops sending their packets, the other channels of the subscription are not affected.
+ *
+ * \param isock A descriptor referencing the socket.
+ * \param channel First channel of the view.
+ * \param number Number of channels of the view.
+ *
+ * \retval SOCKET_OK on success
+ * \retval SOCKET_ERROR on error
+ * 
+ */
+int nmxp_sendRemoveTimeSeriesChannel_view(int isock, const NMXP_CHAN_KEY_NET *channel, int32_t number);
+
+
 int nmxp_sendAddTimeSeriesChannel(int isock, NMXP_CHAN_LIST_NET *channelList, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag, int n_channel, int n_usec, int flag_restart);
 
 
@@ -1104,6 +1173,25 @@ int nmxp_sendAddTimeSeriesChannel(int isock, NMXP_CHAN_LIST_NET *channelList, in
 NMXP_DATA_PROCESS *nmxp_receiveData(int isock, NMXP_CHAN_LIST_NET *channelList, const char *network_code, const char *location_code, int timeoutsec, int *recv_errno );
 
 
+/*! \brief Same as nmxp_receiveData() but the packet is decoded into caller-owned buffers
+ *
+ * \param isock A descriptor referencing the socket.
+ * \param channelList Channel list.
+ * \param network_code Network code. It can be NULL.
+ * \param location_code Location code. It can be NULL.
+ * \param timeoutsec Time-out in seconds
+ * \param[out] recv_errno errno value after recv()
+ * \param[out] pd Structure to fill.
+ * \param[out] outdata Buffer for the samples.
+ * \param outdata_size Size of outdata in number of samples, usually \ref NMXP_MAX_OUTDATA.
+ *
+ * \retval pd on success
+ * \retval NULL on error
+ * 
+ */
+NMXP_DATA_PROCESS *nmxp_receiveData_r(int isock, NMXP_CHAN_LIST_NET *channelList, const char *network_code, const char *location_code, int timeoutsec, int *recv_errno, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size);
+
+
 /*! \brief Sends the message "ConnectRequest" on a socket
  *
  * \param isock A descriptor referencing the socket.
@@ -1235,14 +1323,117 @@ void nmxp_raw_stream_free(NMXP_RAW_STREAM_DATA *raw_stream_buffer);
  */
 int nmxp_raw_stream_manage(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *a_pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd);
 
+/*! \brief Same as nmxp_raw_stream_manage() but pd is queued without copying it
+ *
+ * The raw stream takes ownership of pd, which has to come from
+ * nmxp_raw_stream_pd_get(). Its reference is released after all the
+ * functions have been executed on it or when it is discarded, so the caller
+ * must not use pd after this call. A function can keep pd by nmxp_raw_stream_pd_ref().
+ *
+ * \param p pointer to NMXP_RAW_STREAM_DATA
+ * \param pd packet from nmxp_raw_stream_pd_get(), NULL for checking time-out
+ * \param p_func_pd array of functions to execute on a single item NMXP_DATA_PROCESS
+ * \param n_func_pd number of functions into the array p_func_pd 
+ *
+ */
+int nmxp_raw_stream_manage_pd(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd);
+
+/*! \brief Get a packet from the pool shared by the raw streams
+ *
+ * pDataPtr points to a buffer of \ref NMXP_MAX_OUTDATA samples owned by the packet.
+ * Packets are blocks of the slab pool (nmxp_mem_slab_alloc()), so the pool is thread safe.
+ *
+ * \return Packet to pass to nmxp_raw_stream_manage_pd() or to nmxp_raw_stream_pd_put(), NULL on error.
+ */
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_get();
+
+/*! \brief Same as nmxp_raw_stream_pd_get() but pDataPtr points to a buffer of n_samples samples
+ *
+ * \param n_samples Number of samples, the packet comes from the smallest size class that fits them.
+ *
+ * \return Packet, NULL on error.
+ */
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_get_size(int32_t n_samples);
+
+/*! \brief Add a reference to a packet of the pool
+ *
+ * A function executed by the raw stream can keep the packet after
+ * returning, until it releases the reference by nmxp_raw_stream_pd_put().
+ * Samples of a shared packet must not be modified.
+ *
+ * \param pd Packet from nmxp_raw_stream_pd_get() or passed by a raw stream.
+ *
+ * \return pd
+ */
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_ref(NMXP_DATA_PROCESS *pd);
+
+/*! \brief Release a reference to a packet of the pool, it is recycled after the last one
+ *
+ * \param pd Packet, it could be NULL.
+ */
+void nmxp_raw_stream_pd_put(NMXP_DATA_PROCESS *pd);
+
+/*! \brief Free the memory kept by the pool
+ *
+ * Packets still queued by raw streams or referenced are not affected.
+ */
+void nmxp_raw_stream_pd_pool_free();
+
+/*! \brief Check whether a packet would be discarded by nmxp_raw_stream_manage()
+ *
+ * A packet is redundant when its sequence number has already been sent
+ * or is already queued.
+ *
+ * \param p pointer to NMXP_RAW_STREAM_DATA
+ * \param seq_no sequence number of the packet
+ *
+ * \retval 1 if the packet is redundant
+ * \retval 0 otherwise
+ */
+int nmxp_raw_stream_seq_no_is_redundant(NMXP_RAW_STREAM_DATA *p, int32_t seq_no);
+
+/*! \brief Tune max_tolerable_latency of a raw stream on the observed retransmissions
+ *
+ * For each hole, the latency of the packet that fills it is recorded, also
+ * when it arrives after the hole has been skipped. After
+ * NMXP_RAW_STREAM_MIN_FILL_DELAYS holes, max_tolerable_latency is set to the
+ * given percentile of the last NMXP_RAW_STREAM_N_FILL_DELAYS delays,
+ * within min_latency and the max_tolerable_latency passed to nmxp_raw_stream_init().
+ * Ineffective when timeoutrecv is set.
+ *
+ * \param p pointer to NMXP_RAW_STREAM_DATA
+ * \param min_latency Lower bound of max_tolerable_latency
+ * \param percentile Percentage of the holes to wait for, 0 for a fixed max_tolerable_latency
+ */
+void nmxp_raw_stream_set_adaptive_latency(NMXP_RAW_STREAM_DATA *p, int32_t min_latency, int32_t percentile);
+
+/*! \brief Account a packet dropped by the caller because redundant
+ *
+ * Callers that check nmxp_raw_stream_seq_no_is_redundant() before unpacking
+ * let the raw stream know about retransmissions arrived too late.
+ *
+ * \param p pointer to NMXP_RAW_STREAM_DATA
+ * \param seq_no sequence number of the packet
+ * \param latency latency of the packet
+ */
+void nmxp_raw_stream_late_packet(NMXP_RAW_STREAM_DATA *p, int32_t seq_no, double latency);
+
 /*! \brief Execute a list of functions on remaining NMXP_DATA_PROCESS structures
+ *
+ * All queued packets are handled in seq_no order in a single pass, skipping
+ * the missing ones. The queue is left empty and last_seq_no_sent is the one
+ * of the last handled packet, so the stream can go on after a reconnection.
  *
  * \param p pointer to NMXP_RAW_STREAM_DATA
  * \param p_func_pd array of functions to execute on a single item NMXP_DATA_PROCESS
  * \param n_func_pd number of functions into the array p_func_pd 
+ * \param[out] n_gaps number of skipped gaps, it could be NULL
+ * \param[out] n_missing number of skipped packets, it could be NULL
+ *
+ * \return Number of handled packets.
  *
  */
-int nmxp_raw_stream_manage_flush(NMXP_RAW_STREAM_DATA *p, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd);
+int nmxp_raw_stream_manage_flush(NMXP_RAW_STREAM_DATA *p, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd, int32_t *n_gaps, int32_t *n_missing);
 
 #endif
 
@@ -30,6 +30,40 @@
 /*! Maximum time out for receiving data (seconds). */
 #define NMXP_HIGHEST_TIMEOUT 30
 
+/*! Maximum number of samples unpacked from a single data packet. */
+#define NMXP_MAX_OUTDATA 4096
+
+/*! \brief Header of a Compressed Data message, parsed without unpacking the data bundles */
+typedef struct {
+    int32_t oldest_seq_no;	/*!< Oldest sequence number available on the server */
+    unsigned char packet_type;	/*!< Nanometrics packet type */
+    int32_t seconds;		/*!< Time of the first sample, seconds */
+    int16_t ticks;		/*!< Time of the first sample, 1/10000 of second */
+    int16_t instr_id;		/*!< Instrument id */
+    int32_t seq_no;		/*!< Sequence number */
+    unsigned char rate_chan;	/*!< Sample rate code (high 5 bits) and channel code (low 3 bits) */
+    int32_t x0;			/*!< First sample */
+    int32_t key;		/*!< Channel key */
+    double time;		/*!< Time of the first sample */
+    int32_t sampRate;		/*!< Sample rate */
+    int32_t nSamp;		/*!< Number of samples, counted from the bundle control bytes */
+} NMXP_PACKET_HEADER;
+
+/*! Size in bytes of the read buffer used by nmxp_receiveMessage_buffer(). */
+#define NMXP_RECV_BUFFER_SIZE (256 * 1024)
+
+/*! Max number of read buffers waited together by nmxp_receiveMessage_buffers(). */
+#define NMXP_RECV_BUFFERS_MAX 8
+
+/*! \brief Read buffer of a connection, messages are framed out of it in user space */
+typedef struct {
+    int isock;			/*!< Socket descriptor */
+    char *buffer;		/*!< Received bytes */
+    int32_t size;		/*!< Size of buffer */
+    int32_t begin;		/*!< Offset of the first byte not yet returned */
+    int32_t end;		/*!< Offset after the last received byte */
+} NMXP_RECV_BUFFER;
+
 /*! \brief Looks up target host, opens a socket and connects
  *
  *  \param hostname	hostname
@@ -103,6 +137,26 @@ char *nmxp_strerror(int errno_value);
 int nmxp_recv_ctrl(int isock, void *buffer, int length, int timeoutsec, int *recv_errno );
 
 
+/*! \brief Receives length bytes in a buffer from a socket, time-out in milliseconds.
+ *
+ * When poll() is available the whole operation has to end within timeout_ms,
+ * and socket options are not changed.
+ *
+ * \param isock A descriptor referencing the socket.
+ * \param[out] buffer Data buffer.
+ * \param length Length in bytes.
+ * \param timeout_ms Time-out in milliseconds, 0 for \ref NMXP_HIGHEST_TIMEOUT seconds.
+ * \param[out] recv_errno errno value after recv()
+ *
+ * \warning Data buffer it has to be allocated before and big enough to contain length bytes!
+ *
+ * \retval NMXP_SOCKET_OK on success
+ * \retval NMXP_SOCKET_ERROR on error
+ *
+ */
+int nmxp_recv_ctrl_ms(int isock, void *buffer, int length, int timeout_ms, int *recv_errno );
+
+
 /*! \brief Sends header of a message.
  *
  * \param isock A descriptor referencing the socket.
@@ -162,6 +216,103 @@ int nmxp_sendMessage(int isock, NMXP_MSG_CLIENT type, void *buffer, int32_t leng
 int nmxp_receiveMessage(int isock, NMXP_MSG_SERVER *type, void *buffer, int32_t *length, int timeoutsec, int *recv_errno, int buffer_length);
 
 
+/*! \brief Allocates the read buffer of a connection.
+ *
+ * All the following messages of the socket have to be received by nmxp_receiveMessage_buffer().
+ *
+ * \param rb Read buffer.
+ * \param isock A descriptor referencing the socket.
+ * \param size Size in bytes of the buffer, 0 for \ref NMXP_RECV_BUFFER_SIZE.
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ *
+ */
+int nmxp_recv_buffer_init(NMXP_RECV_BUFFER *rb, int isock, int32_t size);
+
+
+/*! \brief Frees the read buffer of a connection.
+ *
+ * \param rb Read buffer.
+ *
+ */
+void nmxp_recv_buffer_free(NMXP_RECV_BUFFER *rb);
+
+
+/*! \brief Receives header and body of a message through a read buffer.
+ *
+ * Same as nmxp_receiveMessage(), but it reads from the socket as many bytes as available
+ * and returns messages already received without calling recv().
+ *
+ * \param rb Read buffer.
+ * \param[out] type Type of message within \ref NMXP_MSG_SERVER.
+ * \param[out] buffer Pointer to the body of the message inside the read buffer,
+ *                     valid until the next call.
+ * \param[out] length Length in bytes.
+ * \param timeout_ms Time-out in milliseconds for the header, 0 for \ref NMXP_HIGHEST_TIMEOUT seconds.
+ * \param[out] recv_errno errno value after recv()
+ * \param buffer_length Max length of the body.
+ *
+ * \retval NMXP_SOCKET_OK on success
+ * \retval NMXP_SOCKET_ERROR on error
+ *
+ */
+int nmxp_receiveMessage_buffer(NMXP_RECV_BUFFER *rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int timeout_ms, int *recv_errno, int buffer_length);
+
+
+/*! \brief Reads from the socket the bytes available without waiting.
+ *
+ * \param rb Read buffer.
+ * \param[out] recv_errno errno value after recv(), -100 on EOF.
+ *
+ * \retval NMXP_SOCKET_OK on success, also when no data was available
+ * \retval NMXP_SOCKET_ERROR on error or connection closed
+ *
+ */
+int nmxp_recv_buffer_read(NMXP_RECV_BUFFER *rb, int *recv_errno);
+
+
+/*! \brief Frames the next message already inside the read buffer, without reading from the socket.
+ *
+ * \param rb Read buffer.
+ * \param[out] type Type of message within \ref NMXP_MSG_SERVER.
+ * \param[out] buffer Pointer to the body of the message inside the read buffer,
+ *                     valid until the next call of nmxp_recv_buffer_read().
+ * \param[out] length Length in bytes.
+ * \param buffer_length Max length of the body.
+ *
+ * \retval 1 a message has been returned
+ * \retval 0 the message is not complete yet
+ * \retval -1 on wrong message header
+ *
+ */
+int nmxp_recv_buffer_next(NMXP_RECV_BUFFER *rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int buffer_length);
+
+
+/*! \brief Receives the next message from any of several connections.
+ *
+ * Messages already framed are returned first, scanning the buffers from the one
+ * after *i_rb. Otherwise waits until one of the sockets is readable.
+ *
+ * \param rb Array of read buffers.
+ * \param n_rb Number of read buffers, at most \ref NMXP_RECV_BUFFERS_MAX.
+ * \param[in,out] i_rb Index of the buffer of the returned message or of the connection
+ *                     in error, -1 on time-out. Pass the previous value to alternate the connections.
+ * \param[out] type Type of message within \ref NMXP_MSG_SERVER.
+ * \param[out] buffer Pointer to the body of the message inside the read buffer,
+ *                     valid until the next call.
+ * \param[out] length Length in bytes.
+ * \param timeout_ms Time-out in milliseconds, 0 for \ref NMXP_HIGHEST_TIMEOUT seconds.
+ * \param[out] recv_errno errno value after recv()
+ * \param buffer_length Max length of the body.
+ *
+ * \retval NMXP_SOCKET_OK on success
+ * \retval NMXP_SOCKET_ERROR on time-out or on error of connection *i_rb
+ *
+ */
+int nmxp_receiveMessage_buffers(NMXP_RECV_BUFFER **rb, int n_rb, int *i_rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int timeout_ms, int *recv_errno, int buffer_length);
+
+
 /*! \brief Process Compressed Data message by function func_processData().
  *
  * \param buffer_data Pointer to the data buffer containing Compressed Nanometrics packets.
@@ -190,6 +341,97 @@ NMXP_DATA_PROCESS *nmxp_processCompressedData(char* buffer_data, int length_data
 NMXP_DATA_PROCESS *nmxp_processDecompressedData(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default);
 
 
+/*! \brief Process Compressed Data message into caller-owned buffers.
+ *
+ * Same as nmxp_processCompressedData() but nothing is allocated:
+ * pd is filled and pd->pDataPtr points to outdata.
+ *
+ * \param buffer_data Pointer to the data buffer containing Compressed Nanometrics packets.
+ * \param length_data Buffer length in bytes.
+ * \param channelList Pointer to the Channel List.
+ * \param network_code_default Value of network code to assign returned structure. It should not be NULL.
+ * \param location_code_default Value of location code to assign returned structure. It should not be NULL.
+ * \param[out] pd Structure to fill.
+ * \param[out] outdata Buffer for the unpacked samples.
+ * \param outdata_size Size of outdata in number of samples, usually \ref NMXP_MAX_OUTDATA.
+ *
+ * \retval 0 on success
+ * \retval -1 on filler or malformed packet, or channel not found
+ *
+ */
+int nmxp_processCompressedData_r(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size);
+
+
+/*! \brief Parse only the header of a Compressed Data message.
+ *
+ * Reads sequence numbers, packet type, time, instrument id and rate code
+ * straight from the buffer, and counts the samples from the bundle control
+ * bytes. Decisions on duplicated or unwanted packets can be taken on the
+ * header before calling nmxp_processCompressedData_hdr().
+ *
+ * \param buffer_data Pointer to the data buffer containing Compressed Nanometrics packets.
+ * \param length_data Buffer length in bytes.
+ * \param[out] hdr Header to fill.
+ *
+ * \retval 0 on success
+ * \retval -1 on filler or truncated packet
+ *
+ */
+int nmxp_processCompressedHeader(char* buffer_data, int length_data, NMXP_PACKET_HEADER *hdr);
+
+
+/*! \brief Samples of outdata needed by nmxp_processCompressedData_hdr() for a packet of nSamp samples.
+ *
+ * The decoder checks the room for a whole bundle, 16 samples, before each
+ * bundle, also before a trailing null bundle. At that point x0 and the
+ * nSamp samples have already been written, hence nSamp + 1 + 16.
+ */
+#define NMXP_COMPRESSED_OUTDATA_SIZE(nSamp) ((nSamp) + 17)
+
+/*! \brief Samples of outdata needed by nmxp_processDecompressedData_r() for a message of length_data bytes. */
+#define NMXP_DECOMPRESSED_OUTDATA_SIZE(length_data) (((length_data) > 20)? ((length_data) - 20 + 3) / 4 : 0)
+
+
+/*! \brief Unpack a Compressed Data message whose header has already been parsed.
+ *
+ * \param buffer_data Pointer to the data buffer containing Compressed Nanometrics packets.
+ * \param length_data Buffer length in bytes.
+ * \param hdr Header filled by nmxp_processCompressedHeader().
+ * \param channelList Pointer to the Channel List.
+ * \param network_code_default Value of network code to assign returned structure. It should not be NULL.
+ * \param location_code_default Value of location code to assign returned structure. It should not be NULL.
+ * \param[out] pd Structure to fill.
+ * \param[out] outdata Buffer for the unpacked samples.
+ * \param outdata_size Size of outdata in number of samples, at least \ref NMXP_COMPRESSED_OUTDATA_SIZE(hdr->nSamp).
+ *
+ * \retval 0 on success
+ * \retval -1 on malformed packet or channel not found
+ *
+ */
+int nmxp_processCompressedData_hdr(char* buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size);
+
+
+/*! \brief Process Decompressed Data message into caller-owned buffers.
+ *
+ * Same as nmxp_processDecompressedData() but nothing is allocated:
+ * pd is filled and pd->pDataPtr points to outdata.
+ *
+ * \param buffer_data Pointer to the data buffer containing Decompressed Nanometrics packets.
+ * \param length_data Buffer length in bytes.
+ * \param channelList Pointer to the Channel List.
+ * \param network_code_default Value of network code to assign returned structure. It should not be NULL.
+ * \param location_code_default Value of location code to assign returned structure. It should not be NULL.
+ * \param[out] pd Structure to fill.
+ * \param[out] outdata Buffer for the samples.
+ * \param outdata_size Size of outdata in number of samples, at least \ref NMXP_DECOMPRESSED_OUTDATA_SIZE(length_data).
+ *
+ * \retval 0 on success
+ * \retval -1 on malformed packet or channel not found
+ *
+ */
+int nmxp_processDecompressedData_r(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size);
+
+
 /*! \brief Wrapper for functions sleep on different platforms
  *
  *  \param sleep_time time in seconds
@@ -208,5 +450,12 @@ unsigned int nmxp_sleep(unsigned int sleep_time);
  */
 unsigned int nmxp_usleep(unsigned int usleep_time);
 
+/*! \brief Current time in milliseconds, monotonic when available
+ *
+ *  Only differences between two values are significant.
+ *
+ */
+int64_t nmxp_clock_ms();
+
 #endif
 
@@ -14,18 +14,32 @@
 #ifndef NMXP_CHAN_H
 #define NMXP_CHAN_H 1
 
+#include "nmxp_data.h"
+
 #include <stdint.h>
 
 #define NMXP_CHAN_MAX_SIZE_STR_PATTERN 20
 
-/*! \brief Channel list */
-typedef struct NMXP_META_CHAN_LIST {
+/*! \brief Channel metadata, item of NMXP_META_CHAN_LIST */
+typedef struct {
     int32_t key;
     char name[12];
     int32_t start_time;
     int32_t end_time;
     char network[12];
-    struct NMXP_META_CHAN_LIST *next;
+} NMXP_META_CHAN;
+
+/*! \brief Initial number of items allocated by nmxp_meta_chan_add() */
+#define NMXP_META_CHAN_LIST_DEFAULT_SIZE 256
+
+/*! \brief Channel metadata list, allocated by nmxp_meta_chan_add() and freed by nmxp_meta_chan_free() */
+typedef struct {
+    int32_t number;			/*!< Number of channels */
+    int32_t size;			/*!< Number of items allocated for channel */
+    NMXP_META_CHAN *channel;		/*!< Channels, in order of nmxp_meta_chan_add() until nmxp_meta_chan_sort() */
+    int32_t hash_number;		/*!< Value of number when hash was built, the index is rebuilt when different */
+    int32_t hash_size;			/*!< Number of slots of hash, a power of two greater than 2 * number */
+    int32_t *hash;			/*!< Open addressing index from key to position in channel plus one, 0 for empty slot */
 } NMXP_META_CHAN_LIST;
 
 typedef enum {
@@ -36,21 +50,38 @@ typedef enum {
 } NMXP_META_CHAN_LIST_SORT_TYPE;
 
 
-/*! \brief Max number of channels */
-#define MAX_N_CHAN 2000
-
 #define NMXP_CHAN_MAX_SIZE_NAME 24
 
-/*! \brief The key/name info for one channel */
+/*! \brief Max length of a SeedLink station ID, NET.STA */
+#define NMXP_CHAN_MAX_SIZE_STATION_ID (NMXP_DATA_NETWORK_LENGTH + NMXP_DATA_STATION_LENGTH)
+
+/*! \brief The key/name info for one channel
+ *
+ * The identity fields are parsed once from name when the channel is
+ * indexed, see nmxp_chan_hash_build(). Empty fields are not present in name.
+ */
 typedef struct {
     int32_t key;
     char name[NMXP_CHAN_MAX_SIZE_NAME];
+    char network[NMXP_DATA_NETWORK_LENGTH];		/*!< Network code */
+    char station[NMXP_DATA_STATION_LENGTH];		/*!< Station code */
+    char channel[NMXP_DATA_CHANNEL_LENGTH];		/*!< Channel code */
+    char location[NMXP_DATA_LOCATION_LENGTH];		/*!< Location code */
+    char station_id[NMXP_CHAN_MAX_SIZE_STATION_ID];	/*!< SeedLink station ID NET.STA, the station alone starts at i_station_id */
+    int8_t i_station_id;				/*!< Offset of the station code within station_id */
 } NMXP_CHAN_KEY_NET;
 
-/*! \brief Channel list */
+/*! \brief Initial number of items allocated by nmxp_chan_list_net_new() when size is not given */
+#define NMXP_CHAN_LIST_NET_DEFAULT_SIZE 64
+
+/*! \brief Channel list, allocated by nmxp_chan_list_net_new() and freed by nmxp_chan_list_net_free() */
 typedef struct {
-    int32_t number;
-    NMXP_CHAN_KEY_NET channel[MAX_N_CHAN];
+    int32_t number;			/*!< Number of channels */
+    int32_t size;			/*!< Number of items allocated for channel */
+    NMXP_CHAN_KEY_NET *channel;		/*!< Channels */
+    int32_t hash_number;		/*!< Number of channels in hash, the index is used only when equal to number */
+    int32_t hash_size;			/*!< Number of slots of hash, a power of two greater than 2 * size */
+    int32_t *hash;			/*!< Open addressing index from key to position in channel plus one, 0 for empty slot */
 } NMXP_CHAN_LIST_NET;
 
 /*! \brief The key/name info for one channel */
@@ -59,10 +90,10 @@ typedef struct {
     char name[12];
 } NMXP_CHAN_KEY;
 
-/*! \brief Channel list */
+/*! \brief Channel list, as received from the server. It is allocated for number items. */
 typedef struct {
     int32_t number;
-    NMXP_CHAN_KEY channel[MAX_N_CHAN];
+    NMXP_CHAN_KEY channel[];
 } NMXP_CHAN_LIST;
 
 /*! \brief Precis Channel item */
@@ -73,10 +104,10 @@ typedef struct {
     int32_t end_time;
 } NMXP_CHAN_PRECISITEM;
 
-/*! \brief Precis Channel list */
+/*! \brief Precis Channel list, as received from the server. It is allocated for number items. */
 typedef struct {
     int32_t number;
-    NMXP_CHAN_PRECISITEM channel[MAX_N_CHAN];
+    NMXP_CHAN_PRECISITEM channel[];
 } NMXP_CHAN_PRECISLIST;
 
 /*! \brief Type of Data */
@@ -110,6 +141,33 @@ typedef struct {
 /*! \brief Character separator for channel list */
 #define sep_chan_list  ','
 
+/*! \brief Max length of a single channel pattern */
+#define NMXP_CHAN_MAX_SIZE_PATTERN (NMXP_CHAN_MAX_SIZE_STR_PATTERN * 4)
+
+/*! \brief Channel pattern compiled by nmxp_chan_pattern_compile() */
+typedef struct {
+    char pattern[NMXP_CHAN_MAX_SIZE_PATTERN];		/*!< Pattern as written in the list */
+    char network[NMXP_CHAN_MAX_SIZE_STR_PATTERN];	/*!< Network code, empty for the default */
+    char station[NMXP_CHAN_MAX_SIZE_STR_PATTERN];	/*!< Station glob */
+    char channel[NMXP_CHAN_MAX_SIZE_STR_PATTERN];	/*!< Channel glob */
+    char location[NMXP_CHAN_MAX_SIZE_STR_PATTERN];	/*!< Location code, empty for the default */
+    int station_glob;					/*!< Station contains wildcards */
+} NMXP_CHAN_PATTERN;
+
+/*! \brief List of compiled channel patterns
+ *
+ * Patterns with a literal station are sorted by station for a binary
+ * search, the others are tried in the order of the list.
+ */
+typedef struct {
+    int32_t number;			/*!< Number of valid patterns */
+    NMXP_CHAN_PATTERN *pattern;		/*!< Patterns in the order of the list */
+    int32_t n_literal;			/*!< Number of patterns with a literal station */
+    NMXP_CHAN_PATTERN **literal;	/*!< Patterns with a literal station, sorted by station and position */
+    int32_t n_glob;			/*!< Number of patterns with wildcards in the station */
+    NMXP_CHAN_PATTERN **glob;		/*!< Patterns with wildcards in the station, sorted by position */
+} NMXP_CHAN_PATTERN_LIST;
+
 
 /*! \brief Return type of data from a channel key */
 #define getDataTypeFromKey(key) ((key >> 8) & 0xff)
@@ -137,9 +195,13 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 
 
 /*! \brief Match station_dot_channel against pattern, treating errors as no match.
+ *
+ * Station and channel of the pattern are globs: '*' matches any sequence,
+ * '?' any character, [abc], [a-z] and [!abc] a character class.
+ * Station is compared ignoring case.
  *
  * \param net_dot_station_dot_channel NET.STA.CHAN format (NET. is optional)
- * \param pattern N1.STA.?HZ or N2.STA.H?Z or STA.HH? or STA.?H? or ....
+ * \param pattern N1.STA.?HZ or N2.STA.H?Z or STA.HH? or *.HH? or MN.A*.BH? or ....
  *
  * \retval 1 for match
  * \retval 0 for no match
@@ -150,6 +212,40 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 int nmxp_chan_match(const char *net_dot_station_dot_channel, char *pattern);
 
 
+/*! \brief Compile a list of channel patterns
+ *
+ * Invalid patterns are logged and skipped.
+ *
+ * \param plist Compiled pattern list, it has to be freed by nmxp_chan_pattern_free().
+ * \param sta_chan_list String list of patterns, separated by comma. See nmxp_chan_match().
+ *
+ * \return Number of valid patterns, -1 on error.
+ *
+ */
+int nmxp_chan_pattern_compile(NMXP_CHAN_PATTERN_LIST *plist, const char *sta_chan_list);
+
+
+/*! \brief Free a compiled pattern list
+ *
+ * \param plist Compiled pattern list.
+ *
+ */
+void nmxp_chan_pattern_free(NMXP_CHAN_PATTERN_LIST *plist);
+
+
+/*! \brief Look up the first pattern of the list after a given position matching a channel
+ *
+ * \param plist Compiled pattern list.
+ * \param station_code Station code of the channel.
+ * \param channel_code Channel code of the channel.
+ * \param after Position of the last pattern already considered, -1 to start from the first one.
+ *
+ * \return Position of the pattern in plist->pattern. -1 if no pattern matches.
+ *
+ */
+int nmxp_chan_pattern_match_next(const NMXP_CHAN_PATTERN_LIST *plist, const char *station_code, const char *channel_code, int after);
+
+
 
 /*! \brief Looks up a channel key in the list using the name
  *
@@ -162,7 +258,68 @@ int nmxp_chan_match(const char *net_dot_station_dot_channel, char *pattern);
 int nmxp_chan_lookupKey(char* name, NMXP_CHAN_LIST *channelList);
 
 
-/*! \brief Looks up a channel name in the list using a key
+/*! \brief Allocate an empty channel list
+ *
+ * \param size Number of channels allocated at first, the list grows when needed. 0 for a default size.
+ *
+ * \return Channel list, it has to be freed by nmxp_chan_list_net_free(). NULL on error.
+ *
+ */
+NMXP_CHAN_LIST_NET *nmxp_chan_list_net_new(int32_t size);
+
+
+/*! \brief Append a channel to a channel list, growing it when needed
+ *
+ * The channel is indexed, see nmxp_chan_hash_build().
+ *
+ * \param channelList Channel list.
+ * \param key Channel key.
+ * \param name Channel name NET.STA.CHAN.LOC.
+ *
+ * \return Index of the channel in the list. -1 on error or if key is already in the list.
+ *
+ */
+int nmxp_chan_list_net_add(NMXP_CHAN_LIST_NET *channelList, int32_t key, const char *name);
+
+
+/*! \brief Remove a channel from a channel list in constant time
+ *
+ * The last channel is moved into the place of the removed one, the caller
+ * has to move in the same way any array indexed like the channel list.
+ *
+ * \param channelList Channel list.
+ * \param i_chan Index of the channel to remove.
+ *
+ * \return Former index of the channel moved into i_chan, equal to i_chan when the last channel has been removed. -1 on error.
+ *
+ */
+int nmxp_chan_list_net_remove(NMXP_CHAN_LIST_NET *channelList, int i_chan);
+
+
+/*! \brief Free a channel list allocated by nmxp_chan_list_net_new()
+ *
+ * \param pchannelList Pointer to the channel list, it is set to NULL.
+ *
+ */
+void nmxp_chan_list_net_free(NMXP_CHAN_LIST_NET **pchannelList);
+
+
+/*! \brief Build the key index and the channel identities of a channel list
+ *
+ * Lists filled by nmxp_chan_list_net_add() are already indexed. Lists whose
+ * channel items are changed by the caller have to be indexed again, otherwise
+ * nmxp_chan_lookupKeyIndex() falls back to a linear scan and the decoders
+ * parse the channel name of each packet.
+ *
+ * \param channelList Channel list.
+ *
+ */
+void nmxp_chan_hash_build(NMXP_CHAN_LIST_NET *channelList);
+
+
+/*! \brief Looks up a channel in the list using a key
+ *
+ * Constant time when the list is indexed, see nmxp_chan_hash_build().
  *
  * \param key Channel key.
  * \param channelList Channel list.
@@ -170,7 +327,7 @@ int nmxp_chan_lookupKey(char* name, NMXP_CHAN_LIST *channelList);
  * \return Index of channel with key. -1 on error.
  *
  */
-int nmxp_chan_lookupKeyIndex(int32_t key, NMXP_CHAN_LIST_NET *channelList);
+int nmxp_chan_lookupKeyIndex(int32_t key, const NMXP_CHAN_LIST_NET *channelList);
 
 
 /*! \brief Looks up a channel name in the list using a key
@@ -180,7 +337,7 @@ int nmxp_chan_lookupKeyIndex(int32_t key, NMXP_CHAN_LIST_NET *channelList);
  *
  * \return Name of channel with key. NULL on error.
  *
- * \warning Returned value will need to be freed!
+ * \warning Returned value will need to be freed! Use nmxp_chan_lookupKeyIndex() to avoid the allocation.
  *
  */
 char *nmxp_chan_lookupName(int32_t key, NMXP_CHAN_LIST_NET *channelList);
@@ -209,7 +366,7 @@ NMXP_CHAN_LIST *nmxp_chan_getType(NMXP_CHAN_LIST *channelList, NMXP_DATATYPE dat
  *
  * \return Channel list with specified dataType. It will need to be freed!
  *
- * \warning Returned value will need to be freed!
+ * \warning Returned value will need to be freed by nmxp_chan_list_net_free()!
  *
  */
 NMXP_CHAN_LIST_NET *nmxp_chan_subset(NMXP_CHAN_LIST *channelList, NMXP_DATATYPE dataType, char *sta_chan_list, const char *network_code_default, const char *location_code_default);
@@ -258,17 +415,59 @@ void nmxp_chan_print_channelList_with_match(NMXP_CHAN_LIST *channelList, char *s
 void nmxp_chan_print_netchannelList(NMXP_CHAN_LIST_NET *channelList);
 
 
+/*! \brief Free a channel metadata list
+ *
+ * \param chan_list Pointer to the list, set to NULL. It could point to NULL.
+ */
 void nmxp_meta_chan_free(NMXP_META_CHAN_LIST **chan_list);
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_add(NMXP_META_CHAN_LIST **chan_list, int32_t key, char *name, int32_t start_time, int32_t end_time, char *network, NMXP_META_CHAN_LIST_SORT_TYPE sorttype);
+/*! \brief Append a channel to a metadata list
+ *
+ * Items are appended, call nmxp_meta_chan_sort() once after the last one.
+ *
+ * \param chan_list Pointer to the list, allocated when it points to NULL.
+ * \param key Channel key.
+ * \param name Channel name, it could be NULL.
+ * \param start_time Start time.
+ * \param end_time End time.
+ * \param network Network code, it could be NULL.
+ *
+ * \return Added item, valid until the next nmxp_meta_chan_add(). NULL on error.
+ */
+NMXP_META_CHAN *nmxp_meta_chan_add(NMXP_META_CHAN_LIST **chan_list, int32_t key, char *name, int32_t start_time, int32_t end_time, char *network);
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_search_key(NMXP_META_CHAN_LIST *chan_list, int32_t key);
+/*! \brief Sort a channel metadata list
+ *
+ * \param chan_list Channel metadata list, it could be NULL.
+ * \param sorttype Sort criterion, equal items are ordered by key.
+ */
+void nmxp_meta_chan_sort(NMXP_META_CHAN_LIST *chan_list, NMXP_META_CHAN_LIST_SORT_TYPE sorttype);
+
+/*! \brief First item of a channel metadata list
+ *
+ * Iterate by for(iter = nmxp_meta_chan_first(chan_list); iter; iter = nmxp_meta_chan_next(chan_list, iter)).
+ *
+ * \return First item, NULL if the list is empty.
+ */
+NMXP_META_CHAN *nmxp_meta_chan_first(NMXP_META_CHAN_LIST *chan_list);
+
+/*! \brief Item following iter in a channel metadata list
+ *
+ * \return Next item, NULL after the last one.
+ */
+NMXP_META_CHAN *nmxp_meta_chan_next(NMXP_META_CHAN_LIST *chan_list, NMXP_META_CHAN *iter);
+
+/*! \brief Search a channel by key, the key index is built on first use
+ *
+ * \return Found item, NULL if key is not in the list.
+ */
+NMXP_META_CHAN *nmxp_meta_chan_search_key(NMXP_META_CHAN_LIST *chan_list, int32_t key);
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_name(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *name);
+NMXP_META_CHAN *nmxp_meta_chan_set_name(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *name);
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_times(NMXP_META_CHAN_LIST *chan_list, int32_t key, int32_t start_time, int32_t end_time);
+NMXP_META_CHAN *nmxp_meta_chan_set_times(NMXP_META_CHAN_LIST *chan_list, int32_t key, int32_t start_time, int32_t end_time);
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_network(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *network);
+NMXP_META_CHAN *nmxp_meta_chan_set_network(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *network);
 
 void nmxp_meta_chan_print(NMXP_META_CHAN_LIST *chan_list);
 
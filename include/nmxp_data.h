@@ -117,6 +117,7 @@ typedef struct {
 /*! \brief Parameter structure for functions that process data */
 typedef struct {
     int32_t key;			/*!< \brief Channel Key */
+    int32_t chan_index;			/*!< \brief Index of the channel in the list used for decoding, -1 if unknown */
     char network[NMXP_DATA_NETWORK_LENGTH];	/*!< \brief Network code */
     char station[NMXP_DATA_STATION_LENGTH];	/*!< \brief Station code */
     char channel[NMXP_DATA_CHANNEL_LENGTH];	/*!< \brief Channel code */
@@ -176,6 +177,9 @@ int nmxp_data_init(NMXP_DATA_PROCESS *pd);
  *
  * \return Number of unpacked data samples, -1 if null bundle. 
  *
+ * On x86 CPUs supporting SSE4.1 the bundle is decoded in vector registers,
+ * otherwise the scalar decoder is used. Both give the same output.
+ *
  * Author:  Doug Neuhauser
  *          UC Berkeley Seismological Laboratory
  *          doug@seismo.berkeley.edu
@@ -184,6 +188,17 @@ int nmxp_data_init(NMXP_DATA_PROCESS *pd);
 int nmxp_data_unpack_bundle (int32_t *outdata, unsigned char *indata, int32_t *prev);
 
 
+/*! \brief Unpack the differences of a 17-byte Nanometrics compressed data bundle, without integrating them.
+ *
+ * \param[out] outdiff At least 16 differences.
+ * \param indata
+ *
+ * \return Number of unpacked differences, -1 if null bundle. 
+ *
+ */
+int nmxp_data_unpack_bundle_diff (int32_t *outdiff, unsigned char *indata);
+
+
 /* \brief Value for parameter exclude_bitmap in the function nmxp_data_trim() */
 #define NMXP_DATA_TRIM_EXCLUDE_FIRST 2
 
@@ -330,6 +345,26 @@ int nmxp_data_seed_fclose_all(NMXP_DATA_SEED *data_seed);
 int nmxp_data_get_filename_ms(NMXP_DATA_SEED *data_seed, char *dirseedchan, char *filenameseed);
 
 
+/*! \brief Append a packed mini-SEED record to its file within the SDS or BUD structure.
+ *
+ * The file name is built from the header in pmsr, so records not packed
+ * by nmxp_data_msr_pack(), e.g. by the transcoder in nmxp_steim.h, can be
+ * archived after msr_unpack().
+ *
+ * \param data_seed Pointer to struct NMXP_DATA_SEED.
+ * \param pmsr Pointer to the mini-SEED record header of record.
+ * \param record Packed record.
+ * \param reclen Record length in bytes.
+ *
+ * \warning pmsr is used like (void *) but it has to be a pointer to MSRecord !!!
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ *
+ */
+int nmxp_data_seed_write_record(NMXP_DATA_SEED *data_seed, void *pmsr, char *record, int reclen);
+
+
 /*! \brief Write mini-seed records from a NMXP_DATA_PROCESS structure.
  *
  * \param pd Pointer to struct NMXP_DATA_PROCESS. If it is NULL then flush all data into mini-SEED file.
@@ -14,6 +14,8 @@
 #ifndef NMXP_MEMORY_H
 #define NMXP_MEMORY_H 1
 
+#include <stdlib.h>
+
 #ifndef NMXP_MEM_DEBUG
 
 #define NMXP_MEM_MALLOC(size) malloc(size)
@@ -33,50 +35,112 @@ int nmxp_mem_null_function();
 
 #define NMXP_MEM_MALLOC(size) nmxp_mem_malloc(size, __FILE__, __LINE__)
 #define NMXP_MEM_STRDUP(str) nmxp_mem_strdup(str, __FILE__, __LINE__)
-#define NMXP_MEM_FREE(ptr) nmxp_mem_free(ptr, __FILE__, __LINE__)
+#define NMXP_MEM_FREE(ptr) nmxp_mem_free(ptr, __FILE__, __LINE__); ptr=NULL;
 #define NMXP_MEM_PRINT_PTR(print_items, print_sfs) nmxp_mem_print_ptr(print_items, print_sfs, __FILE__, __LINE__)
 #define NMXP_MEM_PRINT_SFS() nmxp_mem_print_sfs(__FILE__, __LINE__)
 
 
-#include <stdlib.h>
+/*! \brief Same as malloc(), the block is accounted to the call site source_file:line
+ *
+ * Blocks are tracked by a lock-striped hash table keyed by pointer, so
+ * the cost does not depend on the number of blocks and it is thread safe.
+ *
+ * \param size Number of bytes.
+ * \param source_file Source file of the call site, __FILE__.
+ * \param line Line of the call site, __LINE__.
+ *
+ */
+void *nmxp_mem_malloc(size_t size, char *source_file, int line);
 
-/*! \brief 
+
+/*! \brief Same as strdup(), the block is accounted to the call site source_file:line
  *
- * \param 
- * \param 
+ * \param str String to copy.
+ * \param source_file Source file of the call site, __FILE__.
+ * \param line Line of the call site, __LINE__.
  *
  */
-inline void *nmxp_mem_malloc(size_t size, char *source_file, int line);
+char *nmxp_mem_strdup(const char *str, char *source_file, int line);
 
 
-/*! \brief 
+/*! \brief Same as free(), blocks not allocated by nmxp_mem_malloc() or nmxp_mem_strdup() are logged
  *
- * \param 
- * \param 
+ * \param ptr Block, it could be NULL.
+ * \param source_file Source file of the call site, __FILE__.
+ * \param line Line of the call site, __LINE__.
  *
  */
-inline char *nmxp_mem_strdup(const char *str, char *source_file, int line);
+void nmxp_mem_free(void *ptr, char *source_file, int line);
 
 
-/*! \brief 
+/*! \brief Print the blocks not freed
  *
- * \param 
- * \param 
+ * \param print_items Print every block, only when the total has changed since the last call.
+ * \param print_sfs Print the accounting of the call sites, as nmxp_mem_print_sfs().
+ * \param source_file Source file of the caller, __FILE__.
+ * \param line Line of the caller, __LINE__.
  *
+ * \return Total bytes not freed.
  */
-inline void nmxp_mem_free(void *ptr, char *source_file, int line);
+int nmxp_mem_print_ptr(int print_items, int print_sfs, char *source_file, int line);
 
 
-/*! \brief 
+/*! \brief Print number of blocks and bytes not freed and number of allocations of each call site
  *
- * \param 
- * \param 
+ * Call sites are sorted by bytes not freed, the largest first.
  *
+ * \param source_file Source file of the caller, __FILE__.
+ * \param line Line of the caller, __LINE__.
+ *
+ * \return Total bytes not freed.
  */
-inline int nmxp_mem_print_ptr(int print_items, int print_sfs, char *source_file, int line);
+int nmxp_mem_print_sfs(char *source_file, int line);
 
 
 #endif
 
+
+/*! \brief Number of size classes of the slab pool */
+#define NMXP_MEM_SLAB_N_CLASSES 4
+
+/*! \brief Approximate size in bytes of a slab, blocks of a size class are allocated a slab at a time */
+#define NMXP_MEM_SLAB_SIZE (64 * 1024)
+
+/*! \brief Allocate a block from the slab pool, the caller holds the only reference
+ *
+ * Blocks are taken from the smallest size class that fits size and are
+ * recycled when the last reference is released, so the memory of the
+ * pool grows up to the peak usage and stays there. Blocks larger than
+ * the largest size class are allocated one by one. Thread safe.
+ *
+ * \param size Number of bytes.
+ *
+ * \return Block to release by nmxp_mem_slab_unref(), NULL on error.
+ */
+void *nmxp_mem_slab_alloc(size_t size);
+
+/*! \brief Add a reference to a block of the slab pool
+ *
+ * \param ptr Block from nmxp_mem_slab_alloc().
+ *
+ * \return ptr
+ */
+void *nmxp_mem_slab_ref(void *ptr);
+
+/*! \brief Release a reference to a block of the slab pool, the block is recycled after the last one
+ *
+ * \param ptr Block from nmxp_mem_slab_alloc(), it could be NULL.
+ */
+void nmxp_mem_slab_unref(void *ptr);
+
+/*! \brief Free the slabs whose blocks are all unused
+ *
+ * Blocks still referenced are not affected.
+ */
+void nmxp_mem_slab_trim();
+
+/*! \brief Log the number of slabs and of blocks in use for each size class */
+void nmxp_mem_slab_print();
+
 #endif
 
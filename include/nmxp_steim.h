@@ -0,0 +1,152 @@
+/*! \file
+ *
+ * \brief Steim1/Steim2 transcoder for Nanometrics Protocol Library
+ *
+ * Nanometrics bundles and Steim frames are both difference based.
+ * Differences unpacked from the bundles are packed straight into Steim
+ * frames, without integrating them into 32-bit samples and differencing
+ * them again. X0 and Xn are carried across packets.
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#ifndef NMXP_STEIM_H
+#define NMXP_STEIM_H 1
+
+#include "nmxp_base.h"
+
+/*! \brief SEED data encoding format Steim1 */
+#define NMXP_STEIM1 10
+
+/*! \brief SEED data encoding format Steim2 */
+#define NMXP_STEIM2 11
+
+/*! \brief Size in bytes of the fixed header plus blockette 1000, data begins after it */
+#define NMXP_STEIM_HEADER_LENGTH 64
+
+/*! \brief Size in bytes of a Steim frame */
+#define NMXP_STEIM_FRAME_LENGTH 64
+
+/*! \brief Smallest record length in bytes */
+#define NMXP_STEIM_RECLEN_MINIMUM 256
+
+/*! \brief Largest record length in bytes */
+#define NMXP_STEIM_RECLEN_MAXIMUM 8192
+
+/*! \brief Max number of differences packed into a single word (Steim2, seven 4-bit differences) */
+#define NMXP_STEIM_MAX_PENDING 7
+
+/*! \brief State of a Steim transcoder for a single channel */
+typedef struct {
+    char network[NMXP_DATA_NETWORK_LENGTH];
+    char station[NMXP_DATA_STATION_LENGTH];
+    char channel[NMXP_DATA_CHANNEL_LENGTH];
+    char location[NMXP_DATA_LOCATION_LENGTH];
+    char quality_indicator;
+    int encoding;
+    int reclen;
+    int32_t record_seq_no;
+
+    /* Function called for each completed record */
+    int (*func_record)(char *record, int reclen, void *handlerdata);
+    void *handlerdata;
+
+    /* Record under construction */
+    char *record;
+    int nframes;
+    int iframe;
+    int iword;
+    uint32_t ctrl_word;
+    int nsamples;
+    double record_start_time;
+    int32_t record_x0;
+
+    /* Differences waiting to be packed */
+    int32_t pending[NMXP_STEIM_MAX_PENDING];
+    int npending;
+
+    /* Continuous stream */
+    int stream_open;
+    double stream_start_time;
+    int32_t sampRate;
+    int32_t stream_count_packed;
+    int32_t stream_count_fed;
+    int32_t x_packed;
+    int32_t x_fed;
+} NMXP_STEIM;
+
+
+/*! \brief Initialize a Steim transcoder
+ *
+ * \param st Transcoder to initialize.
+ * \param network Network code.
+ * \param station Station code.
+ * \param channel Channel code.
+ * \param location Location code.
+ * \param encoding \ref NMXP_STEIM1 or \ref NMXP_STEIM2.
+ * \param reclen Record length in bytes, power of 2 from 256 to 8192.
+ * \param func_record Function called for each completed record.
+ * \param handlerdata Pointer passed to func_record.
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int nmxp_steim_init(NMXP_STEIM *st, const char *network, const char *station, const char *channel, const char *location,
+	int encoding, int reclen, int (*func_record)(char *record, int reclen, void *handlerdata), void *handlerdata);
+
+
+/*! \brief Flush pending differences and free the record buffer
+ *
+ * \param st Transcoder.
+ */
+void nmxp_steim_free(NMXP_STEIM *st);
+
+
+/*! \brief Feed a Nanometrics compressed packet into the transcoder
+ *
+ * The bundles are unpacked into differences only. If the packet is not
+ * contiguous with the previous one, the current record is flushed and
+ * a new one is started.
+ *
+ * \param st Transcoder.
+ * \param buffer_data Pointer to the data buffer containing Compressed Nanometrics packets.
+ * \param length_data Buffer length in bytes.
+ * \param hdr Header filled by nmxp_processCompressedHeader().
+ *
+ * \return Number of completed records, -1 on error.
+ */
+int nmxp_steim_feed_compressed(NMXP_STEIM *st, char *buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr);
+
+
+/*! \brief Feed samples given as first value plus differences
+ *
+ * Samples are x0, x0+diff[0], ..., x0+diff[0]+...+diff[nsamples-2].
+ *
+ * \param st Transcoder.
+ * \param time Time of the first sample.
+ * \param sampRate Sample rate.
+ * \param x0 First sample.
+ * \param diff Differences between consecutive samples, nsamples-1 items.
+ * \param nsamples Number of samples.
+ *
+ * \return Number of completed records, -1 on error.
+ */
+int nmxp_steim_feed_diff(NMXP_STEIM *st, double time, int32_t sampRate, int32_t x0, const int32_t *diff, int nsamples);
+
+
+/*! \brief Pack pending differences and emit the partial record, if any
+ *
+ * \param st Transcoder.
+ *
+ * \return Number of completed records, -1 on error.
+ */
+int nmxp_steim_flush(NMXP_STEIM *st);
+
+#endif
+
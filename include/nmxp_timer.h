@@ -0,0 +1,117 @@
+/*! \file
+ *
+ * \brief Time-outs of many items for Nanometrics Protocol Library
+ *
+ * Binary min-heap keyed by deadline. Each item is identified by an index
+ * from 0 to n_ids-1, for instance the index of a channel, so that setting
+ * or cancelling its deadline costs O(log n) and only the expired items
+ * are visited.
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#ifndef NMXP_TIMER_H
+#define NMXP_TIMER_H 1
+
+#include "nmxp_base.h"
+
+/*! \brief Item of the heap */
+typedef struct {
+    int64_t deadline_ms;	/*!< Deadline in milliseconds, same clock of nmxp_clock_ms() */
+    int32_t id;			/*!< Item identifier */
+} NMXP_TIMER_ITEM;
+
+/*! \brief Set of time-outs */
+typedef struct {
+    int32_t n_ids;		/*!< Number of identifiers */
+    int32_t n_items;		/*!< Number of armed time-outs */
+    NMXP_TIMER_ITEM *heap;	/*!< Min-heap of armed time-outs */
+    int32_t *pos;		/*!< Position in heap of each identifier, -1 if not armed */
+} NMXP_TIMER;
+
+
+/*! \brief Initialize a set of time-outs, none of them is armed
+ *
+ * \param t Set of time-outs.
+ * \param n_ids Number of identifiers.
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int nmxp_timer_init(NMXP_TIMER *t, int32_t n_ids);
+
+
+/*! \brief Grow a set of time-outs, the new identifiers are not armed
+ *
+ * \param t Set of time-outs.
+ * \param n_ids New number of identifiers, nothing is done if it is not greater than the current one.
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int nmxp_timer_resize(NMXP_TIMER *t, int32_t n_ids);
+
+
+/*! \brief Free a set of time-outs
+ *
+ * \param t Set of time-outs.
+ */
+void nmxp_timer_free(NMXP_TIMER *t);
+
+
+/*! \brief Arm or move the time-out of an identifier
+ *
+ * \param t Set of time-outs.
+ * \param id Identifier.
+ * \param deadline_ms Deadline in milliseconds.
+ */
+void nmxp_timer_set(NMXP_TIMER *t, int32_t id, int64_t deadline_ms);
+
+
+/*! \brief Disarm the time-out of an identifier
+ *
+ * \param t Set of time-outs.
+ * \param id Identifier.
+ */
+void nmxp_timer_cancel(NMXP_TIMER *t, int32_t id);
+
+
+/*! \brief Move the time-out of an identifier to another one
+ *
+ * The time-out of new_id is replaced, id is not armed anymore.
+ *
+ * \param t Set of time-outs.
+ * \param id Identifier.
+ * \param new_id New identifier.
+ */
+void nmxp_timer_move(NMXP_TIMER *t, int32_t id, int32_t new_id);
+
+
+/*! \brief Disarm and return an expired time-out
+ *
+ * Call it until it returns -1 to get all the expired time-outs, earliest first.
+ *
+ * \param t Set of time-outs.
+ * \param now_ms Current time in milliseconds.
+ *
+ * \return Identifier of an expired time-out, -1 if none.
+ */
+int32_t nmxp_timer_expired(NMXP_TIMER *t, int64_t now_ms);
+
+
+/*! \brief Earliest armed deadline
+ *
+ * \param t Set of time-outs.
+ *
+ * \return Deadline in milliseconds, -1 if no time-out is armed.
+ */
+int64_t nmxp_timer_next_deadline(NMXP_TIMER *t);
+
+#endif
+
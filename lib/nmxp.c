@@ -40,56 +40,88 @@ int nmxp_sendTerminateSubscription(int isock, NMXP_SHUTDOWN_REASON reason, char
     return nmxp_sendMessage(isock, NMXP_MSG_TERMINATESUBSCRIPTION, message, ((message)? strlen(message)-1 : 0));
 }
 
+/* Receive a message into a buffer allocated with the length of its body,
+ * channel lists of any size do not fit into NMXP_MAX_LENGTH_DATA_BUFFER */
+static int nmxp_receiveMessage_alloc(int isock, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int *recv_errno) {
+    int ret;
+
+    *buffer = NULL;
+    *length = 0;
+
+    ret = nmxp_receiveHeader(isock, type, length, 0, recv_errno);
+
+    if(ret == NMXP_SOCKET_OK  &&  *length > 0) {
+	*buffer = (char *) NMXP_MEM_MALLOC(*length);
+	if(*buffer == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_receiveMessage_alloc() Error allocating %d bytes!\n", *length);
+	    ret = NMXP_SOCKET_ERROR;
+	} else {
+	    ret = nmxp_recv_ctrl(isock, *buffer, *length, 0, recv_errno);
+	    if(ret != NMXP_SOCKET_OK) {
+		NMXP_MEM_FREE(*buffer);
+		*buffer = NULL;
+	    }
+	}
+    }
+
+    return ret;
+}
+
+
 int nmxp_receiveChannelList(int isock, NMXP_CHAN_LIST **pchannelList) {
     int ret;
     int i;
     int recv_errno;
 
     NMXP_MSG_SERVER type;
-    char buffer[NMXP_MAX_LENGTH_DATA_BUFFER]={0};
+    char *buffer = NULL;
     int32_t length;
 
     *pchannelList = NULL;
 
-    ret = nmxp_receiveMessage(isock, &type, buffer, &length, 0, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+    ret = nmxp_receiveMessage_alloc(isock, &type, &buffer, &length, &recv_errno);
     
     /*TODO controllare ret*/
     if (ret == NMXP_SOCKET_OK) {
         if(type != NMXP_MSG_CHANNELLIST) {
             nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Type %d is not NMXP_MSG_CHANNELLIST!\n", type);
+        } else if(buffer == NULL  ||  length < (int32_t) sizeof(int32_t)) {
+            nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "nmxp_receiveChannelList() Empty channel list!\n");
+            ret = NMXP_SOCKET_ERROR;
         } else {
-            (*pchannelList) = (NMXP_CHAN_LIST *) NMXP_MEM_MALLOC(length);
-
-            if( (*pchannelList) != NULL) {
-
-                memmove((*pchannelList), buffer, length);
-
-                (*pchannelList)->number = ntohl((*pchannelList)->number);
-
-                nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "number of channels %d\n", (*pchannelList)->number);
+            (*pchannelList) = (NMXP_CHAN_LIST *) buffer;
+            buffer = NULL;
+
+            (*pchannelList)->number = ntohl((*pchannelList)->number);
+            if((*pchannelList)->number < 0
+                    ||  (*pchannelList)->number > (int32_t) ((length - sizeof(int32_t)) / sizeof(NMXP_CHAN_KEY))) {
+                nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "nmxp_receiveChannelList() %d channels do not fit into %d bytes!\n",
+                        (*pchannelList)->number, length);
+                (*pchannelList)->number = (length - sizeof(int32_t)) / sizeof(NMXP_CHAN_KEY);
+            }
 
-                /* TODO check*/
+            nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "number of channels %d\n", (*pchannelList)->number);
 
-                for(i=0; i < (*pchannelList)->number; i++) {
-                    (*pchannelList)->channel[i].key = ntohl((*pchannelList)->channel[i].key);
-                    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "%12d %s\n",
-                            (*pchannelList)->channel[i].key,
-                            NMXP_LOG_STR((*pchannelList)->channel[i].name));
-                }
-            } else {
-                nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "nmxp_receiveChannelList() Error allocating pchannelList!\n");
-                ret = NMXP_SOCKET_ERROR;
+            for(i=0; i < (*pchannelList)->number; i++) {
+                (*pchannelList)->channel[i].key = ntohl((*pchannelList)->channel[i].key);
+                nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "%12d %s\n",
+                        (*pchannelList)->channel[i].key,
+                        NMXP_LOG_STR((*pchannelList)->channel[i].name));
             }
         }
     }
 
+    if(buffer) {
+	NMXP_MEM_FREE(buffer);
+    }
+
     return ret;
 }
 
 
-int nmxp_sendAddTimeSeriesChannel_raw(int isock, NMXP_CHAN_LIST_NET *channelList, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag) {
+int nmxp_sendAddTimeSeriesChannel_view(int isock, const NMXP_CHAN_KEY_NET *channel, int32_t number, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag) {
     int ret = NMXP_SOCKET_OK;
-    int32_t buffer_length = 16 + (4 * channelList->number); 
+    int32_t buffer_length = 16 + (4 * number); 
     char *buffer = NULL;
     int32_t app, i, disp;
 
@@ -99,12 +131,12 @@ int nmxp_sendAddTimeSeriesChannel_raw(int isock, NMXP_CHAN_LIST_NET *channelList
 
 	disp=0;
 
-	app = htonl(channelList->number);
+	app = htonl(number);
 	memcpy(&buffer[disp], &app, 4);
 	disp+=4;
 
-	for(i=0; i < channelList->number; i++) {
-	    app = htonl(channelList->channel[i].key);
+	for(i=0; i < number; i++) {
+	    app = htonl(channel[i].key);
 	    memcpy(&buffer[disp], &app, 4);
 	    disp+=4;
 	}
@@ -134,6 +166,47 @@ int nmxp_sendAddTimeSeriesChannel_raw(int isock, NMXP_CHAN_LIST_NET *channelList
     return ret;
 }
 
+
+int nmxp_sendAddTimeSeriesChannel_raw(int isock, NMXP_CHAN_LIST_NET *channelList, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag) {
+    return nmxp_sendAddTimeSeriesChannel_view(isock, channelList->channel, channelList->number, shortTermCompletion, out_format, buffer_flag);
+}
+
+
+int nmxp_sendRemoveTimeSeriesChannel_view(int isock, const NMXP_CHAN_KEY_NET *channel, int32_t number) {
+    int ret = NMXP_SOCKET_OK;
+    int32_t buffer_length = 4 + (4 * number); 
+    char *buffer = NULL;
+    int32_t app, i, disp;
+
+    if(number > 0) {
+
+	buffer = NMXP_MEM_MALLOC(buffer_length);
+
+	disp=0;
+
+	app = htonl(number);
+	memcpy(&buffer[disp], &app, 4);
+	disp+=4;
+
+	for(i=0; i < number; i++) {
+	    app = htonl(channel[i].key);
+	    memcpy(&buffer[disp], &app, 4);
+	    disp+=4;
+	}
+
+	ret = nmxp_sendMessage(isock, NMXP_MSG_REMOVETIMESERIESCHANNELS, buffer, buffer_length);
+
+	if(buffer) {
+	    NMXP_MEM_FREE(buffer);
+	    buffer = NULL;
+	}
+    } else {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "nmxp_sendRemoveTimeSeriesChannel_view() number of channels = %d.\n", number);
+    }
+
+    return ret;
+}
+
 #define MAX_LEN_S_CHANNELS 4096
 int nmxp_sendAddTimeSeriesChannel(int isock, NMXP_CHAN_LIST_NET *channelList, int32_t shortTermCompletion, int32_t out_format, NMXP_BUFFER_FLAG buffer_flag, int n_channel, int n_usec, int flag_restart) {
     static int i = 0;
@@ -144,7 +217,7 @@ int nmxp_sendAddTimeSeriesChannel(int isock, NMXP_CHAN_LIST_NET *channelList, in
     char s_channels[MAX_LEN_S_CHANNELS];
     int j;
     int ret = 0;
-    NMXP_CHAN_LIST_NET split_channelList;
+    int32_t split_first, split_number;
     long diff_usec;
     struct timeval tp_now;
     double estimated_time = 0.0;
@@ -194,23 +267,22 @@ int nmxp_sendAddTimeSeriesChannel(int isock, NMXP_CHAN_LIST_NET *channelList, in
 	    }
 	    if(diff_usec >= n_usec) {
 		    /* while(ret == 0  &&  i <  channelList->number) { */
-		    split_channelList.number = 0;
-		    while(split_channelList.number < n_channel  &&  i < channelList->number) {
-			    split_channelList.channel[split_channelList.number].key = channelList->channel[i].key;
-			    /* Not necessary, but it could help for debugging */
-			    strncpy(split_channelList.channel[split_channelList.number].name, channelList->channel[i].name, NMXP_CHAN_MAX_SIZE_NAME);
-			    split_channelList.number++;
-			    i++;
+		    /* Next batch is a view of channelList, no copy */
+		    split_first = i;
+		    split_number = channelList->number - i;
+		    if(split_number > n_channel) {
+			split_number = n_channel;
 		    }
-		    if(split_channelList.number > 0) {
+		    i += split_number;
+		    if(split_number > 0) {
 			snprintf(s_channels, MAX_LEN_S_CHANNELS, "%.0f/%d chan %d of %d:",
-				(double)diff_usec/1000.0, split_channelList.number, i, channelList->number);
-			    for(j=0; j < split_channelList.number; j++) {
+				(double)diff_usec/1000.0, split_number, i, channelList->number);
+			    for(j=0; j < split_number; j++) {
 				strncat(s_channels, " ", MAX_LEN_S_CHANNELS - strlen(s_channels));
-				strncat(s_channels, NMXP_LOG_STR(split_channelList.channel[j].name), MAX_LEN_S_CHANNELS - strlen(s_channels));
+				strncat(s_channels, NMXP_LOG_STR(channelList->channel[split_first + j].name), MAX_LEN_S_CHANNELS - strlen(s_channels));
 			    }
 			    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "%s\n", s_channels);
-			    ret = nmxp_sendAddTimeSeriesChannel_raw(isock, &split_channelList, shortTermCompletion, out_format, buffer_flag);
+			    ret = nmxp_sendAddTimeSeriesChannel_view(isock, channelList->channel + split_first, split_number, shortTermCompletion, out_format, buffer_flag);
 		    }
 		    /* } */
 		    last_tp_now.tv_sec = tp_now.tv_sec;
@@ -244,6 +316,32 @@ NMXP_DATA_PROCESS *nmxp_receiveData(int isock, NMXP_CHAN_LIST_NET *channelList,
 }
 
 
+NMXP_DATA_PROCESS *nmxp_receiveData_r(int isock, NMXP_CHAN_LIST_NET *channelList, const char *network_code, const char *location_code, int timeoutsec, int *recv_errno, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size) {
+    NMXP_MSG_SERVER type;
+    char buffer[NMXP_MAX_LENGTH_DATA_BUFFER];
+    int32_t length;
+    NMXP_DATA_PROCESS *ret = NULL;
+
+    if(nmxp_receiveMessage(isock, &type, buffer, &length, timeoutsec, recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER) == NMXP_SOCKET_OK) {
+	if(type == NMXP_MSG_COMPRESSED) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Type %d is NMXP_MSG_COMPRESSED!\n", type);
+	    if(nmxp_processCompressedData_r(buffer, length, channelList, network_code, location_code, pd, outdata, outdata_size) == 0) {
+		ret = pd;
+	    }
+	} else if(type == NMXP_MSG_DECOMPRESSED) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Type %d is NMXP_MSG_DECOMPRESSED!\n", type);
+	    if(nmxp_processDecompressedData_r(buffer, length, channelList, network_code, location_code, pd, outdata, outdata_size) == 0) {
+		ret = pd;
+	    }
+	} else {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Type %d is not NMXP_MSG_COMPRESSED or NMXP_MSG_DECOMPRESSED!\n", type);
+	}
+    }
+
+    return ret;
+}
+
+
 int nmxp_sendConnectRequest(int isock, char *naqs_username, char *naqs_password, int32_t connection_time) {
     int ret;
     int i;
@@ -544,7 +642,7 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
     NMXP_CHAN_PRECISLIST *precisChannelList = NULL;
     NMXP_CHAN_LIST *channelList = NULL;
     NMXP_META_CHAN_LIST *chan_list = NULL;
-    NMXP_META_CHAN_LIST *iter = NULL;
+    NMXP_META_CHAN *iter = NULL;
     int i = 0;
     int32_t connection_time;
     int ret_sock;
@@ -552,6 +650,7 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
     
     NMXP_MSG_SERVER type;
     char buffer[NMXP_MAX_LENGTH_DATA_BUFFER];
+    char *msg_buffer = NULL;
     int32_t length;
     NMXP_PRECISLISTREQUEST precisListRequestBody;
     NMXP_CHANNELINFOREQUEST channelInfoRequestBody;
@@ -589,7 +688,7 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
     nmxp_sendHeader(naqssock, NMXP_MSG_CHANNELLISTREQUEST, 0);
 
     /* DAP Step 6: Receive Data until receiving a Ready message */
-    ret_sock = nmxp_receiveMessage(naqssock, &type, buffer, &length, 0, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+    ret_sock = nmxp_receiveMessage_alloc(naqssock, &type, &msg_buffer, &length, &recv_errno);
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "ret_sock = %d, type = %d, length = %d\n", ret_sock, type, length);
 
     while(ret_sock == NMXP_SOCKET_OK   &&    type != NMXP_MSG_READY) {
@@ -597,29 +696,38 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
 	    NMXP_MEM_FREE(channelList);
 	    channelList = NULL;
 	}
-	channelList = (NMXP_CHAN_LIST *) NMXP_MEM_MALLOC(length);
-	if(channelList) {
-	    memmove(channelList, buffer, length);
+	channelList = (NMXP_CHAN_LIST *) msg_buffer;
+	msg_buffer = NULL;
+	if(channelList  &&  length >= (int32_t) sizeof(int32_t)) {
 
 	    channelList->number = ntohl(channelList->number);
+	    if(channelList->number < 0  ||  channelList->number > (int32_t) ((length - sizeof(int32_t)) / sizeof(NMXP_CHAN_KEY))) {
+		channelList->number = (length - sizeof(int32_t)) / sizeof(NMXP_CHAN_KEY);
+	    }
 
 	    for(i = 0; i < channelList->number; i++) {
 		channelList->channel[i].key = ntohl(channelList->channel[i].key);
 		if(getDataTypeFromKey(channelList->channel[i].key) == datatype) {
-		    nmxp_meta_chan_add(&chan_list, channelList->channel[i].key, channelList->channel[i].name, 0, 0, NULL, NMXP_META_SORT_NAME);
+		    nmxp_meta_chan_add(&chan_list, channelList->channel[i].key, channelList->channel[i].name, 0, 0, NULL);
 		}
 	    }
 	} else {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_getMetaChannelList() Error allocating channelList.\n");
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_getMetaChannelList() Empty channelList.\n");
 	}
 
 	/* Receive Message */
-	ret_sock = nmxp_receiveMessage(naqssock, &type, buffer, &length, 0, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+	ret_sock = nmxp_receiveMessage_alloc(naqssock, &type, &msg_buffer, &length, &recv_errno);
 	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "ret_sock = %d, type = %d, length = %d\n", ret_sock, type, length);
     }
+    if(msg_buffer) {
+	NMXP_MEM_FREE(msg_buffer);
+    }
 
     *pchannelList = channelList;
 
+    /* Sorted once, the following replies are matched by the key index */
+    nmxp_meta_chan_sort(chan_list, NMXP_META_SORT_NAME);
+
     /* DAP Step 5: Send Data Request */
     precisListRequestBody.instr_id = htonl(-1);
     precisListRequestBody.datatype = htonl(NMXP_DATA_TIMESERIES);
@@ -628,7 +736,7 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
 
 
     /* DAP Step 6: Receive Data until receiving a Ready message */
-    ret_sock = nmxp_receiveMessage(naqssock, &type, buffer, &length, 0, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+    ret_sock = nmxp_receiveMessage_alloc(naqssock, &type, &msg_buffer, &length, &recv_errno);
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "ret_sock = %d, type = %d, length = %d\n", ret_sock, type, length);
 
     while(ret_sock == NMXP_SOCKET_OK   &&    type != NMXP_MSG_READY) {
@@ -636,11 +744,14 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
 	    NMXP_MEM_FREE(precisChannelList);
 	    precisChannelList = NULL;
 	}
-	precisChannelList = (NMXP_CHAN_PRECISLIST *) NMXP_MEM_MALLOC(length);
-	if(precisChannelList) {
-	    memmove(precisChannelList, buffer, length);
+	precisChannelList = (NMXP_CHAN_PRECISLIST *) msg_buffer;
+	msg_buffer = NULL;
+	if(precisChannelList  &&  length >= (int32_t) sizeof(int32_t)) {
 
 	    precisChannelList->number = ntohl(precisChannelList->number);
+	    if(precisChannelList->number < 0  ||  precisChannelList->number > (int32_t) ((length - sizeof(int32_t)) / sizeof(NMXP_CHAN_PRECISITEM))) {
+		precisChannelList->number = (length - sizeof(int32_t)) / sizeof(NMXP_CHAN_PRECISITEM);
+	    }
 	    for(i = 0; i < precisChannelList->number; i++) {
 		precisChannelList->channel[i].key = ntohl(precisChannelList->channel[i].key);
 		precisChannelList->channel[i].start_time = ntohl(precisChannelList->channel[i].start_time);
@@ -663,17 +774,20 @@ NMXP_META_CHAN_LIST *nmxp_getMetaChannelList(char * hostname, int portnum, NMXP_
 		   */
 	    }
 	} else {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_getMetaChannelList() Error allocating precisChannelList.\n");
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_getMetaChannelList() Empty precisChannelList.\n");
 	}
 
 	/* Receive Message */
-	ret_sock = nmxp_receiveMessage(naqssock, &type, buffer, &length, 0, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+	ret_sock = nmxp_receiveMessage_alloc(naqssock, &type, &msg_buffer, &length, &recv_errno);
 	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "ret_sock = %d, type = %d, length = %d\n", ret_sock, type, length);
     }
+    if(msg_buffer) {
+	NMXP_MEM_FREE(msg_buffer);
+    }
 
 
     if(flag_request_channelinfo) {
-	for(iter = chan_list; iter != NULL; iter = iter->next) {
+	for(iter = nmxp_meta_chan_first(chan_list); iter != NULL; iter = nmxp_meta_chan_next(chan_list, iter)) {
 
 	    if(getChannelNumberFromKey(iter->key) == 0) {
 		/* DAP Step 5: Send Data Request */
@@ -761,76 +875,377 @@ void nmxp_raw_stream_init(NMXP_RAW_STREAM_DATA *raw_stream_buffer, int32_t max_t
     raw_stream_buffer->timeoutrecv = timeoutrecv;
     raw_stream_buffer->n_pdlist = 0;
 
+    /* The ring covers the seq_no from last_seq_no_sent+1 to last_seq_no_sent+pdlist_size */
+    raw_stream_buffer->pdlist_size = (raw_stream_buffer->max_pdlist_items > 0)? raw_stream_buffer->max_pdlist_items : 1;
+    raw_stream_buffer->pdlist_head_seq_no = 0;
+    raw_stream_buffer->n_pdlist_far = 0;
+    raw_stream_buffer->pdlist_far = NULL;
+
+    raw_stream_buffer->adaptive_percentile = 0.0;
+    raw_stream_buffer->adaptive_latency_min = max_tolerable_latency;
+    raw_stream_buffer->adaptive_latency_max = max_tolerable_latency;
+    raw_stream_buffer->skipped_seq_no_first = 0;
+    raw_stream_buffer->skipped_seq_no_last = -1;
+    raw_stream_buffer->n_fill_delay = 0;
+    raw_stream_buffer->i_fill_delay = 0;
+    raw_stream_buffer->func_gap = NULL;
+
     raw_stream_buffer->pdlist=NULL;
-    raw_stream_buffer->pdlist = (NMXP_DATA_PROCESS **) NMXP_MEM_MALLOC(raw_stream_buffer->max_pdlist_items * sizeof(NMXP_DATA_PROCESS *));
-    for(j=0; j<raw_stream_buffer->max_pdlist_items; j++) {
+    raw_stream_buffer->pdlist = (NMXP_DATA_PROCESS **) NMXP_MEM_MALLOC(raw_stream_buffer->pdlist_size * sizeof(NMXP_DATA_PROCESS *));
+    for(j=0; j<raw_stream_buffer->pdlist_size; j++) {
 	raw_stream_buffer->pdlist[j] = NULL;
     }
 
 }
 
 
+/* Packets are blocks of the slab pool, samples follow the packet */
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_get_size(int32_t n_samples) {
+    NMXP_DATA_PROCESS *pd;
+
+    if(n_samples < 0) {
+	n_samples = 0;
+    }
+
+    pd = (NMXP_DATA_PROCESS *) nmxp_mem_slab_alloc(sizeof(NMXP_DATA_PROCESS) + n_samples * sizeof(int32_t));
+    if(pd == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_RAWSTREAM, "nmxp_raw_stream_pd_get(): Error allocating memory\n");
+	return NULL;
+    }
+    memset(pd, 0, sizeof(NMXP_DATA_PROCESS));
+    pd->pDataPtr = (int *) (pd + 1);
+
+    return pd;
+}
+
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_get() {
+    return nmxp_raw_stream_pd_get_size(NMXP_MAX_OUTDATA);
+}
+
+NMXP_DATA_PROCESS *nmxp_raw_stream_pd_ref(NMXP_DATA_PROCESS *pd) {
+    return (NMXP_DATA_PROCESS *) nmxp_mem_slab_ref(pd);
+}
+
+void nmxp_raw_stream_pd_put(NMXP_DATA_PROCESS *pd) {
+    nmxp_mem_slab_unref(pd);
+}
+
+void nmxp_raw_stream_pd_pool_free() {
+    nmxp_mem_slab_trim();
+}
+
+
+static void nmxp_raw_stream_free_pd(NMXP_DATA_PROCESS *pd) {
+    nmxp_raw_stream_pd_put(pd);
+}
+
+
 void nmxp_raw_stream_free(NMXP_RAW_STREAM_DATA *raw_stream_buffer) {
     int j;
     if(raw_stream_buffer) {
 	if(raw_stream_buffer->pdlist) {
-	    for(j=0; j<raw_stream_buffer->n_pdlist; j++) {
-		if(raw_stream_buffer->pdlist[j]) {
-		    if(raw_stream_buffer->pdlist[j]->pDataPtr) {
-			NMXP_MEM_FREE(raw_stream_buffer->pdlist[j]->pDataPtr);
-			raw_stream_buffer->pdlist[j]->pDataPtr = NULL;
-		    }
-		    NMXP_MEM_FREE(raw_stream_buffer->pdlist[j]);
-		    raw_stream_buffer->pdlist[j] = NULL;
-		}
+	    for(j=0; j<raw_stream_buffer->pdlist_size; j++) {
+		nmxp_raw_stream_free_pd(raw_stream_buffer->pdlist[j]);
+		raw_stream_buffer->pdlist[j] = NULL;
 	    }
 	    NMXP_MEM_FREE(raw_stream_buffer->pdlist);
 	    raw_stream_buffer->pdlist = NULL;
 	}
+	if(raw_stream_buffer->pdlist_far) {
+	    for(j=0; j<raw_stream_buffer->n_pdlist_far; j++) {
+		nmxp_raw_stream_free_pd(raw_stream_buffer->pdlist_far[j]);
+		raw_stream_buffer->pdlist_far[j] = NULL;
+	    }
+	    NMXP_MEM_FREE(raw_stream_buffer->pdlist_far);
+	    raw_stream_buffer->pdlist_far = NULL;
+	}
+	raw_stream_buffer->n_pdlist = 0;
+	raw_stream_buffer->n_pdlist_far = 0;
     }
 }
 
 
-int nmxp_raw_stream_manage(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *a_pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
-    int ret = 0;
-    int send_again = 1;
+/* Slot of the ring buffer for a sequence number */
+#define NMXP_RAW_STREAM_SLOT(p, seq_no) ( (int32_t) ( (uint32_t) (seq_no) % (uint32_t) (p)->pdlist_size ) )
+
+/* Number of packets queued into the ring buffer */
+#define NMXP_RAW_STREAM_N_RING(p) ( (p)->n_pdlist - (p)->n_pdlist_far )
+
+/* Oldest queued packet, p->n_pdlist has to be greater than zero */
+#define NMXP_RAW_STREAM_HEAD(p) ( (NMXP_RAW_STREAM_N_RING(p) > 0)? \
+	(p)->pdlist[NMXP_RAW_STREAM_SLOT(p, (p)->pdlist_head_seq_no)] : (p)->pdlist_far[0] )
+
+/* Index of seq_no in pdlist_far, or of the first item with greater seq_no */
+static int32_t nmxp_raw_stream_far_search(NMXP_RAW_STREAM_DATA *p, int32_t seq_no) {
+    int32_t lo = 0, hi = p->n_pdlist_far, mid;
+
+    while(lo < hi) {
+	mid = (lo + hi) / 2;
+	if(p->pdlist_far[mid]->seq_no - seq_no < 0) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+
+    return lo;
+}
+
+static void nmxp_raw_stream_ring_put(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd) {
+    if(NMXP_RAW_STREAM_N_RING(p) == 0  ||  pd->seq_no - p->pdlist_head_seq_no < 0) {
+	p->pdlist_head_seq_no = pd->seq_no;
+    }
+    p->pdlist[NMXP_RAW_STREAM_SLOT(p, pd->seq_no)] = pd;
+    p->n_pdlist++;
+}
+
+/* Move into the ring the packets of pdlist_far that now fall within its window */
+static void nmxp_raw_stream_far_to_ring(NMXP_RAW_STREAM_DATA *p) {
+    int32_t i, j = 0;
+
+    while(j < p->n_pdlist_far  &&  p->pdlist_far[j]->seq_no - p->last_seq_no_sent <= p->pdlist_size) {
+	j++;
+    }
+    for(i=0; i < j; i++) {
+	p->n_pdlist_far--;
+	p->n_pdlist--;
+	nmxp_raw_stream_ring_put(p, p->pdlist_far[i]);
+    }
+    if(j > 0) {
+	memmove(p->pdlist_far, p->pdlist_far + j, p->n_pdlist_far * sizeof(NMXP_DATA_PROCESS *));
+    }
+}
+
+/* Remove the oldest queued packet */
+static NMXP_DATA_PROCESS *nmxp_raw_stream_pop_head(NMXP_RAW_STREAM_DATA *p) {
+    NMXP_DATA_PROCESS *pd = NULL;
+    int32_t slot;
+
+    if(NMXP_RAW_STREAM_N_RING(p) > 0) {
+	slot = NMXP_RAW_STREAM_SLOT(p, p->pdlist_head_seq_no);
+	pd = p->pdlist[slot];
+	p->pdlist[slot] = NULL;
+	p->n_pdlist--;
+	if(NMXP_RAW_STREAM_N_RING(p) > 0) {
+	    do {
+		p->pdlist_head_seq_no++;
+	    } while(p->pdlist[NMXP_RAW_STREAM_SLOT(p, p->pdlist_head_seq_no)] == NULL);
+	}
+    } else if(p->n_pdlist_far > 0) {
+	pd = p->pdlist_far[0];
+	p->n_pdlist_far--;
+	p->n_pdlist--;
+	memmove(p->pdlist_far, p->pdlist_far + 1, p->n_pdlist_far * sizeof(NMXP_DATA_PROCESS *));
+    }
+
+    nmxp_raw_stream_far_to_ring(p);
+
+    return pd;
+}
+
+static int nmxp_raw_stream_fill_delay_compare(const void *a, const void *b) {
+    float fa = *((const float *) a);
+    float fb = *((const float *) b);
+    return (fa > fb) - (fa < fb);
+}
+
+/* Record the latency of a packet that filled a hole and tune max_tolerable_latency */
+static void nmxp_raw_stream_fill_delay(NMXP_RAW_STREAM_DATA *p, int32_t seq_no, double latency) {
+    float sorted[NMXP_RAW_STREAM_N_FILL_DELAYS];
+    int32_t i;
+    double max_tolerable_latency;
+
+    if(p->adaptive_percentile <= 0.0) {
+	return;
+    }
+
+    p->fill_delay[p->i_fill_delay] = (float) latency;
+    p->i_fill_delay = (p->i_fill_delay + 1) % NMXP_RAW_STREAM_N_FILL_DELAYS;
+    if(p->n_fill_delay < NMXP_RAW_STREAM_N_FILL_DELAYS) {
+	p->n_fill_delay++;
+    }
+    if(p->n_fill_delay < NMXP_RAW_STREAM_MIN_FILL_DELAYS) {
+	return;
+    }
+
+    memcpy(sorted, p->fill_delay, p->n_fill_delay * sizeof(float));
+    qsort(sorted, p->n_fill_delay, sizeof(float), nmxp_raw_stream_fill_delay_compare);
+    i = (int32_t) (p->adaptive_percentile * (double) p->n_fill_delay / 100.0 + 0.999999) - 1;
+    if(i < 0) {
+	i = 0;
+    } else if(i >= p->n_fill_delay) {
+	i = p->n_fill_delay - 1;
+    }
+
+    /* Latency is computed on whole seconds, wait one more */
+    max_tolerable_latency = (double) ((int32_t) sorted[i] + 1);
+    if(max_tolerable_latency < p->adaptive_latency_min) {
+	max_tolerable_latency = p->adaptive_latency_min;
+    } else if(max_tolerable_latency > p->adaptive_latency_max) {
+	max_tolerable_latency = p->adaptive_latency_max;
+    }
+
+    if(max_tolerable_latency != p->max_tolerable_latency) {
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_RAWSTREAM,
+		"[%d] max_tolerable_latency from %.0f to %.0f sec. (%.0f%% of last %d holes filled within %.1f sec.)\n",
+		seq_no, p->max_tolerable_latency, max_tolerable_latency,
+		p->adaptive_percentile, p->n_fill_delay, sorted[i]);
+	p->max_tolerable_latency = max_tolerable_latency;
+    }
+}
+
+/* Execute the functions on pd and update the state of the stream */
+static void nmxp_raw_stream_send(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    int i_func_pd;
+
+    for(i_func_pd=0; i_func_pd<n_func_pd; i_func_pd++) {
+	(*p_func_pd[i_func_pd])(pd);
+    }
+    p->last_seq_no_sent = pd->seq_no;
+    p->last_sample_time = (pd->time + ((double) pd->nSamp / (double) pd->sampRate ));
+    p->last_latency = nmxp_data_latency(pd);
+}
+
+/* Handle the oldest queued packet even if previous ones are missing, and free it */
+static void nmxp_raw_stream_force_head(NMXP_RAW_STREAM_DATA *p, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    NMXP_DATA_PROCESS *pd = NMXP_RAW_STREAM_HEAD(p);
     int seq_no_diff;
     double time_diff;
-    double latency = 0.0;
-    int j=0, k=0;
-    int i_func_pd;
+    double latency;
     char str_time[NMXP_DATA_MAX_SIZE_DATE];
-    NMXP_DATA_PROCESS *pd = NULL;
-    int y, w;
-    int count_null_element = 0;
-    char netstachan[100];
 
-    /* Allocate pd copy value from a_pd */
-    if(a_pd) {
-	/*
-	if(a_pd->packet_type == 33 || a_pd->packet_type == 97) {
-	    nmxp_data_log(a_pd);
+    seq_no_diff = pd->seq_no - p->last_seq_no_sent;
+    time_diff = pd->time - p->last_sample_time;
+    latency = nmxp_data_latency(pd);
+    nmxp_data_to_str(str_time, pd->time);
+    if( seq_no_diff > 0) {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
+		"%s.%s.%s [%d, %d] (%s + %.2f sec.) * Force handling packet * n_pdlist=%d  seq_no_diff=%d  time_diff=%.2fs  lat. %.1fs!\n",
+		NMXP_LOG_STR(pd->network), NMXP_LOG_STR(pd->station), NMXP_LOG_STR(pd->channel),
+		pd->packet_type, pd->seq_no,
+		NMXP_LOG_STR(str_time), (double) pd->nSamp / (double) pd->sampRate,
+		p->n_pdlist,
+		seq_no_diff, time_diff, latency);
+	if(seq_no_diff > 1) {
+	    /* A retransmission of these packets could still arrive */
+	    p->skipped_seq_no_first = p->last_seq_no_sent + 1;
+	    p->skipped_seq_no_last = pd->seq_no - 1;
+	    /* last_sample_time is not significant before the first packet when timeoutrecv is set */
+	    if(p->func_gap  &&  p->last_sample_time > 0.0) {
+		p->func_gap(p, pd);
+	    }
+	}
+	nmxp_raw_stream_send(p, pd, p_func_pd, n_func_pd);
+    } else {
+	/* It should not occur */
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_RAWSTREAM,
+		"%s.%s.%s [%d, %d] (%s + %.2f sec.) * SHOULD NOT OCCUR packet discarded * n_pdlist=%d  seq_no_diff=%d  time_diff=%.2fs  lat. %.1fs!\n",
+		NMXP_LOG_STR(pd->network), NMXP_LOG_STR(pd->station), NMXP_LOG_STR(pd->channel),
+		pd->packet_type, pd->seq_no,
+		NMXP_LOG_STR(str_time), (double) pd->nSamp / (double) pd->sampRate,
+		p->n_pdlist,
+		seq_no_diff, time_diff, latency);
+    }
+
+    nmxp_raw_stream_free_pd(nmxp_raw_stream_pop_head(p));
+}
+
+static void nmxp_raw_stream_log_discarded(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd) {
+    char str_time[NMXP_DATA_MAX_SIZE_DATE];
+
+    nmxp_data_to_str(str_time, pd->time);
+    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
+	    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * Packet discarded * seq_no_diff=%d  time_diff=%.2fs  lat %.1fs\n",
+	    NMXP_LOG_STR(pd->network), NMXP_LOG_STR(pd->station), NMXP_LOG_STR(pd->channel),
+	    pd->packet_type, pd->seq_no, 
+	    NMXP_LOG_STR(str_time), (double) pd->nSamp / (double) pd->sampRate,
+	    pd->seq_no - p->last_seq_no_sent, pd->time - p->last_sample_time, nmxp_data_latency(pd));
+}
+
+/* Queue pd, packets already sent or queued are discarded.
+ * Packets beyond the window of the ring are kept sorted into pdlist_far. */
+static void nmxp_raw_stream_insert(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    NMXP_DATA_PROCESS *pd_slot;
+    int32_t j;
+
+    if(pd->seq_no - p->last_seq_no_sent <= 0) {
+	/* Duplicated packets: Discarded */
+	nmxp_raw_stream_log_discarded(p, pd);
+	nmxp_raw_stream_late_packet(p, pd->seq_no, nmxp_data_latency(pd));
+	nmxp_raw_stream_free_pd(pd);
+	return;
+    }
+
+    if(pd->seq_no - p->last_seq_no_sent <= p->pdlist_size) {
+	pd_slot = p->pdlist[NMXP_RAW_STREAM_SLOT(p, pd->seq_no)];
+	if(pd_slot) {
+	    /* Duplicated packets: Discarded */
+	    nmxp_raw_stream_log_discarded(p, pd);
+	    nmxp_raw_stream_free_pd(pd);
+	} else {
+	    nmxp_raw_stream_ring_put(p, pd);
 	}
-	*/
+	return;
+    }
 
-	/* Allocate memory for pd and copy a_pd */
-	pd = (NMXP_DATA_PROCESS *) NMXP_MEM_MALLOC(sizeof(NMXP_DATA_PROCESS));
+    if(p->pdlist_far == NULL) {
+	p->pdlist_far = (NMXP_DATA_PROCESS **) NMXP_MEM_MALLOC(p->pdlist_size * sizeof(NMXP_DATA_PROCESS *));
+    }
+    j = nmxp_raw_stream_far_search(p, pd->seq_no);
+    if(j < p->n_pdlist_far  &&  p->pdlist_far[j]->seq_no == pd->seq_no) {
+	/* Duplicated packets: Discarded */
+	nmxp_raw_stream_log_discarded(p, pd);
+	nmxp_raw_stream_free_pd(pd);
+	return;
+    }
+    if(p->n_pdlist_far >= p->pdlist_size) {
+	/* It should not occur, the queue never holds more than max_pdlist_items packets */
+	nmxp_raw_stream_force_head(p, p_func_pd, n_func_pd);
+	nmxp_raw_stream_insert(p, pd, p_func_pd, n_func_pd);
+	return;
+    }
+    memmove(p->pdlist_far + j + 1, p->pdlist_far + j, (p->n_pdlist_far - j) * sizeof(NMXP_DATA_PROCESS *));
+    p->pdlist_far[j] = pd;
+    p->n_pdlist_far++;
+    p->n_pdlist++;
+}
+
+
+int nmxp_raw_stream_manage(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *a_pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    NMXP_DATA_PROCESS *pd = NULL;
+    int *pDataPtr;
+
+    /* Copy a_pd into a packet of the pool, sized for its samples */
+    if(a_pd) {
+	pd = nmxp_raw_stream_pd_get_size(a_pd->nSamp);
 	if (pd == NULL) {
 	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_RAWSTREAM,"nmxp_raw_stream_manage(): Error allocating memory\n");
 	    exit(-1);
 	}
+	pDataPtr = pd->pDataPtr;
 	memcpy(pd, a_pd, sizeof(NMXP_DATA_PROCESS));
-	if(a_pd->nSamp *  sizeof(int) > 0) {
-	    pd->pDataPtr = (int *) NMXP_MEM_MALLOC(a_pd->nSamp * sizeof(int));
+	pd->pDataPtr = pDataPtr;
+	if(a_pd->nSamp > 0) {
 	    memcpy(pd->pDataPtr, a_pd->pDataPtr, a_pd->nSamp * sizeof(int));
-	} else {
-	    pd->pDataPtr = NULL;
 	}
-    } else {
+    }
+
+    return nmxp_raw_stream_manage_pd(p, pd, p_func_pd, n_func_pd);
+}
+
+
+int nmxp_raw_stream_manage_pd(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    int ret = 0;
+    int seq_no_diff;
+    double time_diff;
+    double latency = 0.0;
+    char str_time[NMXP_DATA_MAX_SIZE_DATE];
+    NMXP_DATA_PROCESS *pd_head = NULL;
+
+    if(pd == NULL) {
 	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
 		"nmxp_raw_stream_manage() passing NMXP_DATA_PROCESS pointer equal to NULL\n");
     }
-    /* From here, use only pd */
 
     /* First time */
     if(p->last_seq_no_sent == -1  &&  pd != NULL) {
@@ -853,224 +1268,162 @@ int nmxp_raw_stream_manage(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *a_pd, int
     }
 
     if(p->n_pdlist > 0) {
-	latency = nmxp_data_latency(p->pdlist[0]);
+	latency = nmxp_data_latency(NMXP_RAW_STREAM_HEAD(p));
     }
 
-    /* Add pd and sort array, in case handle the first item */
+    /* Queue full or too late: handle the first item */
     if( ( (p->n_pdlist >= p->max_pdlist_items || latency >= p->max_tolerable_latency) && p->timeoutrecv <= 0 ) 
 	    ||
 	    ( p->n_pdlist >= p->max_pdlist_items &&  p->timeoutrecv > 0)
 	    ) {
-
-	/* Supposing p->pdlist is ordered, handle the first item and over write it.  */
-	if(p->n_pdlist > 0) {
-	    seq_no_diff = p->pdlist[0]->seq_no - p->last_seq_no_sent;
-	    time_diff = p->pdlist[0]->time - p->last_sample_time;
-	    latency = nmxp_data_latency(p->pdlist[0]);
-	    nmxp_data_to_str(str_time, p->pdlist[0]->time);
-	    if( seq_no_diff > 0) {
-		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
-			"%s.%s.%s [%d, %d] (%s + %.2f sec.) * Force handling packet * n_pdlist=%d  seq_no_diff=%d  time_diff=%.2fs  lat. %.1fs!\n",
-			NMXP_LOG_STR(p->pdlist[0]->network), NMXP_LOG_STR(p->pdlist[0]->station), NMXP_LOG_STR(p->pdlist[0]->channel),
-			p->pdlist[0]->packet_type, p->pdlist[0]->seq_no,
-			NMXP_LOG_STR(str_time), (double) p->pdlist[0]->nSamp / (double) p->pdlist[0]->sampRate,
-			p->n_pdlist,
-			seq_no_diff, time_diff, latency);
-		for(i_func_pd=0; i_func_pd<n_func_pd; i_func_pd++) {
-		    (*p_func_pd[i_func_pd])(p->pdlist[0]);
-		}
-		p->last_seq_no_sent = (p->pdlist[0]->seq_no);
-		p->last_sample_time = (p->pdlist[0]->time + ((double) p->pdlist[0]->nSamp / (double) p->pdlist[0]->sampRate ));
-		p->last_latency = nmxp_data_latency(p->pdlist[0]);
-	    } else {
-		/* It should not occur */
-		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_RAWSTREAM,
-			"%s.%s.%s [%d, %d] (%s + %.2f sec.) * SHOULD NOT OCCUR packet discarded * n_pdlist=%d  seq_no_diff=%d  time_diff=%.2fs  lat. %.1fs!\n",
-			NMXP_LOG_STR(p->pdlist[0]->network), NMXP_LOG_STR(p->pdlist[0]->station), NMXP_LOG_STR(p->pdlist[0]->channel),
-			p->pdlist[0]->packet_type, p->pdlist[0]->seq_no,
-			NMXP_LOG_STR(str_time), (double) p->pdlist[0]->nSamp / (double) p->pdlist[0]->sampRate,
-			p->n_pdlist,
-			seq_no_diff, time_diff, latency);
-	    }
-
-	    /* Free handled packet */
-	    if(p->pdlist[0]->pDataPtr) {
-		NMXP_MEM_FREE(p->pdlist[0]->pDataPtr);
-		p->pdlist[0]->pDataPtr = NULL;
-	    }
-	    if(p->pdlist[0]) {
-		NMXP_MEM_FREE(p->pdlist[0]);
-		p->pdlist[0] = NULL;
-	    }
-	    if(pd) {
-		p->pdlist[0] = pd;
-	    }
-	} else {
-	    if(pd) {
-		p->n_pdlist = 1;
-		p->pdlist[0] = pd;
-	    }
-	}
-    } else {
-	if(pd != NULL) {
-	    p->pdlist[p->n_pdlist] = pd;
-            p->n_pdlist++;
-	}
-    }
-
-    /* Check if some element in pdlist is NULL and remove it */
-    count_null_element = 0;
-    y=0;
-    while(y < p->n_pdlist) {
-	if(p->pdlist[y] == NULL) {
-	    count_null_element++;
-	    /* Shift array */
-	    for(w=y+1; w < p->n_pdlist; w++) {
-		p->pdlist[w-1] = p->pdlist[w];
-	     }
-	    p->n_pdlist--;
-	} else {
-	    y++;
-	}
-    }
-
-    if(count_null_element > 0) {
 	if(p->n_pdlist > 0) {
-	    snprintf(netstachan, 100, "%s.%s.%s",
-		    NMXP_LOG_STR(p->pdlist[0]->network),
-		    NMXP_LOG_STR(p->pdlist[0]->station),
-		    NMXP_LOG_STR(p->pdlist[0]->channel));
-	} else {
-	    strncpy(netstachan, "Unknown", 100);
+	    nmxp_raw_stream_force_head(p, p_func_pd, n_func_pd);
 	}
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
-		"nmxp_raw_stream_manage() %d NULL elements in pdlist for %s.\n",
-		count_null_element, netstachan);
     }
 
-    /* Sort array */
-    qsort(p->pdlist, p->n_pdlist, sizeof(NMXP_DATA_PROCESS *), nmxp_raw_stream_seq_no_compare);
-
-    /* TODO Check for packet duplication in pd->pdlist*/
-
-    /* Print array, only for debugging */
-    /*
-    if(p->n_pdlist > 1) {
-	int y = 0;
-	for(y=0; y < p->n_pdlist; y++) {
-	    nmxp_data_to_str(str_time, p->pdlist[y]->time);
-	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
-		    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * %02d n_pdlist=%d\n",
-		    NMXP_LOG_STR(p->pdlist[y]->network), NMXP_LOG_STR(p->pdlist[y]->station), NMXP_LOG_STR(p->pdlist[y]->channel),
-		    p->pdlist[y]->packet_type, p->pdlist[y]->seq_no,
-		    NMXP_LOG_STR(str_time), (double) p->pdlist[y]->nSamp / (double) p->pdlist[y]->sampRate,
-		    y, p->n_pdlist);
+    /* Add pd */
+    if(pd) {
+	if(p->n_pdlist > 0  &&  pd->seq_no - p->last_seq_no_sent == 1
+		&&  NMXP_RAW_STREAM_HEAD(p)->seq_no - pd->seq_no == 1) {
+	    /* pd fills the hole in front of the queue */
+	    nmxp_raw_stream_fill_delay(p, pd->seq_no, nmxp_data_latency(pd));
 	}
+	nmxp_raw_stream_insert(p, pd, p_func_pd, n_func_pd);
     }
-    */
 
     /* Condition for time-out (pd is NULL) */
     if(pd == NULL && p->n_pdlist > 0) {
+	pd_head = NMXP_RAW_STREAM_HEAD(p);
 	/* Log before changing values */
-	nmxp_data_to_str(str_time, p->pdlist[0]->time);
+	nmxp_data_to_str(str_time, pd_head->time);
 	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
 		"%s.%s.%s [%d, %d] (%s + %.2f sec.) * pd is NULL and n_pdlist = %d > 0 *  last_seq_no_sent=%d, last_sample_time=%.2f\n",
-		NMXP_LOG_STR(p->pdlist[0]->network), NMXP_LOG_STR(p->pdlist[0]->station), NMXP_LOG_STR(p->pdlist[0]->channel),
-		p->pdlist[0]->packet_type, p->pdlist[0]->seq_no,
-		NMXP_LOG_STR(str_time), (double) p->pdlist[0]->nSamp / (double) p->pdlist[0]->sampRate,
+		NMXP_LOG_STR(pd_head->network), NMXP_LOG_STR(pd_head->station), NMXP_LOG_STR(pd_head->channel),
+		pd_head->packet_type, pd_head->seq_no,
+		NMXP_LOG_STR(str_time), (double) pd_head->nSamp / (double) pd_head->sampRate,
 		p->n_pdlist,
 		p->last_seq_no_sent, p->last_sample_time);
 
 	/* Changing values */
-	p->last_seq_no_sent = p->pdlist[0]->seq_no - 1;
-	p->last_sample_time = p->pdlist[0]->time;
-	p->last_latency = nmxp_data_latency(p->pdlist[0]);
-    }
-
-    /* Manage array and execute func_pd() */
-    j=0;
-    send_again = 1;
-    while(send_again  &&  j < p->n_pdlist) {
-	send_again = 0;
-	seq_no_diff = p->pdlist[j]->seq_no - p->last_seq_no_sent;
-	time_diff = p->pdlist[j]->time - p->last_sample_time;
-	latency = nmxp_data_latency(p->pdlist[j]);
-	nmxp_data_to_str(str_time, p->pdlist[j]->time);
-	if(seq_no_diff <= 0) {
-	    /* Duplicated packets: Discarded */
-	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
-		    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * Packet discarded * seq_no_diff=%d  time_diff=%.2fs  lat %.1fs\n",
-		    NMXP_LOG_STR(p->pdlist[j]->network), NMXP_LOG_STR(p->pdlist[j]->station), NMXP_LOG_STR(p->pdlist[j]->channel),
-		    p->pdlist[j]->packet_type, p->pdlist[j]->seq_no, 
-		    NMXP_LOG_STR(str_time), (double) p->pdlist[j]->nSamp / (double) p->pdlist[j]->sampRate,
-		    seq_no_diff, time_diff, latency);
-	    send_again = 1;
-	    j++;
-	} else if(seq_no_diff == 1) {
-	    /* Handle current packet j */
-	    for(i_func_pd=0; i_func_pd<n_func_pd; i_func_pd++) {
-		(*p_func_pd[i_func_pd])(p->pdlist[j]);
-	    }
+	p->last_seq_no_sent = pd_head->seq_no - 1;
+	p->last_sample_time = pd_head->time;
+	p->last_latency = nmxp_data_latency(pd_head);
+	nmxp_raw_stream_far_to_ring(p);
+    }
+
+    /* Handle queued packets while they are contiguous */
+    while(p->n_pdlist > 0) {
+	pd_head = NMXP_RAW_STREAM_HEAD(p);
+	seq_no_diff = pd_head->seq_no - p->last_seq_no_sent;
+	time_diff = pd_head->time - p->last_sample_time;
+	latency = nmxp_data_latency(pd_head);
+	nmxp_data_to_str(str_time, pd_head->time);
+	if(seq_no_diff == 1) {
+	    /* Handle current packet */
+	    nmxp_raw_stream_send(p, pd_head, p_func_pd, n_func_pd);
 	    if(time_diff > TIME_TOLLERANCE || time_diff < -TIME_TOLLERANCE) {
 		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
 			"%s.%s.%s [%d, %d] (%s + %.2f sec.) * Time is not correct * last_seq_no_sent=%d  seq_no_diff=%d  time_diff=%.2fs  lat. %.1fs\n",
-		    NMXP_LOG_STR(p->pdlist[j]->network), NMXP_LOG_STR(p->pdlist[j]->station), NMXP_LOG_STR(p->pdlist[j]->channel), 
-		    p->pdlist[j]->packet_type, p->pdlist[j]->seq_no,
-		    str_time, (double) p->pdlist[j]->nSamp /  (double) p->pdlist[j]->sampRate,
-		    p->last_seq_no_sent,
+		    NMXP_LOG_STR(pd_head->network), NMXP_LOG_STR(pd_head->station), NMXP_LOG_STR(pd_head->channel), 
+		    pd_head->packet_type, pd_head->seq_no,
+		    str_time, (double) pd_head->nSamp /  (double) pd_head->sampRate,
+		    pd_head->seq_no - 1,
 		    seq_no_diff, time_diff, latency);
 	    }
-	    p->last_seq_no_sent = p->pdlist[j]->seq_no;
-	    p->last_sample_time = (p->pdlist[j]->time + ((double) p->pdlist[j]->nSamp / (double) p->pdlist[j]->sampRate ));
-	    p->last_latency = nmxp_data_latency(p->pdlist[j]);
-	    send_again = 1;
-	    j++;
+	    nmxp_raw_stream_free_pd(nmxp_raw_stream_pop_head(p));
 	} else {
+	    /* Queued packets are always newer than last_seq_no_sent */
 	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
-		    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * seq_no_diff=%d > 1 * last_seq_no_sent=%d  j=%d  n_pdlist=%2d  time_diff=%.2fs  lat. %.1fs\n",
-		    NMXP_LOG_STR(p->pdlist[j]->network), NMXP_LOG_STR(p->pdlist[j]->station), NMXP_LOG_STR(p->pdlist[j]->channel), 
-		    p->pdlist[j]->packet_type, p->pdlist[j]->seq_no,
-		    str_time, (double) p->pdlist[j]->nSamp /  (double) p->pdlist[j]->sampRate,
-		    seq_no_diff, p->last_seq_no_sent, j, p->n_pdlist,
+		    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * seq_no_diff=%d > 1 * last_seq_no_sent=%d  n_pdlist=%2d  time_diff=%.2fs  lat. %.1fs\n",
+		    NMXP_LOG_STR(pd_head->network), NMXP_LOG_STR(pd_head->station), NMXP_LOG_STR(pd_head->channel), 
+		    pd_head->packet_type, pd_head->seq_no,
+		    str_time, (double) pd_head->nSamp /  (double) pd_head->sampRate,
+		    seq_no_diff, p->last_seq_no_sent, p->n_pdlist,
 		    time_diff, latency);
+	    break;
 	}
     }
 
-    /* Shift and free j handled elements */
-    if(j > 0) {
-	for(k=0; k < p->n_pdlist; k++) {
-	    if(k < j) {
-		if(p->pdlist[k]->pDataPtr) {
-		    NMXP_MEM_FREE(p->pdlist[k]->pDataPtr);
-		    p->pdlist[k]->pDataPtr = NULL;
-		}
-		if(p->pdlist[k]) {
-		    NMXP_MEM_FREE(p->pdlist[k]);
-		    p->pdlist[k] = NULL;
-                    /*nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_RAWSTREAM, "Freeing p->pdlist[%d]\n", k);*/
-		}
-	    }
-	    if(k + j < p->n_pdlist) {
-		p->pdlist[k] = p->pdlist[k+j];
-                p->pdlist[k+j]=NULL;
-	    } else {
-		p->pdlist[k] = NULL;
-	    }
+    return ret;
+}
+
+
+int nmxp_raw_stream_seq_no_is_redundant(NMXP_RAW_STREAM_DATA *p, int32_t seq_no) {
+    int ret = 0;
+    int32_t j;
+    NMXP_DATA_PROCESS *pd;
+
+    if(p->last_seq_no_sent != -1) {
+	if(seq_no - p->last_seq_no_sent <= 0) {
+	    ret = 1;
+	} else if(seq_no - p->last_seq_no_sent <= p->pdlist_size) {
+	    pd = p->pdlist[NMXP_RAW_STREAM_SLOT(p, seq_no)];
+	    ret = (pd != NULL);
+	} else if(p->n_pdlist_far > 0) {
+	    j = nmxp_raw_stream_far_search(p, seq_no);
+	    ret = (j < p->n_pdlist_far  &&  p->pdlist_far[j]->seq_no == seq_no);
 	}
-	p->n_pdlist = p->n_pdlist - j;
     }
 
-    /* TOREMOVE
-    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_RAWSTREAM, "j=%d  p->n_pdlist=%d FINAL\n", j, p->n_pdlist);
-       */
-
     return ret;
 }
 
 
-/* TODO */
-int nmxp_raw_stream_manage_flush(NMXP_RAW_STREAM_DATA *p, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+void nmxp_raw_stream_set_adaptive_latency(NMXP_RAW_STREAM_DATA *p, int32_t min_latency, int32_t percentile) {
+    p->adaptive_percentile = (percentile > 100)? 100.0 : (double) percentile;
+    p->adaptive_latency_min = (min_latency < p->adaptive_latency_max)? (double) min_latency : p->adaptive_latency_max;
+    p->n_fill_delay = 0;
+    p->i_fill_delay = 0;
+}
+
+
+void nmxp_raw_stream_late_packet(NMXP_RAW_STREAM_DATA *p, int32_t seq_no, double latency) {
+    if(seq_no - p->skipped_seq_no_first >= 0  &&  p->skipped_seq_no_last - seq_no >= 0) {
+	/* Only the first packet of the skipped hole is significant */
+	p->skipped_seq_no_first = 0;
+	p->skipped_seq_no_last = -1;
+	nmxp_raw_stream_fill_delay(p, seq_no, latency);
+    }
+}
+
+
+int nmxp_raw_stream_manage_flush(NMXP_RAW_STREAM_DATA *p, int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd, int32_t *n_gaps, int32_t *n_missing) {
     int ret = 0;
+    int seq_no_diff;
+    int32_t gaps = 0;
+    int32_t missing = 0;
+    char str_time[NMXP_DATA_MAX_SIZE_DATE];
+    NMXP_DATA_PROCESS *pd_head;
+
+    /* last_seq_no_sent is not significant before the first packet has been handled when timeoutrecv is set */
+    int last_seq_no_known = (p->last_seq_no_sent != -1  &&  !(p->last_seq_no_sent == 0  &&  p->last_sample_time == 0.0));
+
+    while(p->n_pdlist > 0) {
+	pd_head = NMXP_RAW_STREAM_HEAD(p);
+	seq_no_diff = pd_head->seq_no - p->last_seq_no_sent;
+	if(seq_no_diff > 1  &&  last_seq_no_known) {
+	    gaps++;
+	    missing += seq_no_diff - 1;
+	    nmxp_data_to_str(str_time, pd_head->time);
+	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_RAWSTREAM,
+		    "%s.%s.%s [%d, %d] (%s + %.2f sec.) * Flush skips %d packets * last_seq_no_sent=%d  time_diff=%.2fs\n",
+		    NMXP_LOG_STR(pd_head->network), NMXP_LOG_STR(pd_head->station), NMXP_LOG_STR(pd_head->channel),
+		    pd_head->packet_type, pd_head->seq_no,
+		    NMXP_LOG_STR(str_time), (double) pd_head->nSamp / (double) pd_head->sampRate,
+		    seq_no_diff - 1, p->last_seq_no_sent, pd_head->time - p->last_sample_time);
+	}
+	nmxp_raw_stream_send(p, pd_head, p_func_pd, n_func_pd);
+	nmxp_raw_stream_free_pd(nmxp_raw_stream_pop_head(p));
+	last_seq_no_known = 1;
+	ret++;
+    }
+
+    if(n_gaps) {
+	*n_gaps = gaps;
+    }
+    if(n_missing) {
+	*n_missing = missing;
+    }
 
     return ret;
 }
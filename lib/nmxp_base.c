@@ -34,9 +34,18 @@
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/time.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#endif
+
+#if defined(HAVE_POLL_H) && defined(HAVE_POLL) && defined(MSG_DONTWAIT) && !defined(HAVE_WINDOWS_H)
+/* Time-outs are managed by poll() against a deadline, socket options are never changed */
+#define NMXP_RECV_POLL 1
 #endif
 
-#define MAX_OUTDATA 4096
+#define MAX_OUTDATA NMXP_MAX_OUTDATA
 
 int nmxp_openSocket(char *hostname, int portNum, int (*func_cond)(void))
 {
@@ -276,14 +285,77 @@ char *nmxp_strerror(int errno_value) {
 }
 
 
+/* Time-out in milliseconds, zero or negative means the highest one */
+static int nmxp_recv_timeout_ms(int timeout_ms) {
+    return (timeout_ms > 0)? timeout_ms : NMXP_HIGHEST_TIMEOUT * 1000;
+}
+
+/* Current time in milliseconds, monotonic when available */
+int64_t nmxp_clock_ms() {
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+#ifdef NMXP_RECV_POLL
+/* Same as recv() without blocking after deadline_ms. Return -2 on time-out. */
+static int nmxp_recv_deadline(int isock, char *buf, int len, int64_t deadline_ms) {
+    struct pollfd pfd;
+    int64_t remaining_ms;
+    int cc, n;
+
+    pfd.fd = isock;
+    pfd.events = POLLIN;
+
+    while(1) {
+	errno = 0;
+	cc = recv(isock, buf, len, MSG_DONTWAIT);
+	if(cc >= 0) {
+	    errno = 0;
+	    return cc;
+	}
+	if(errno != EAGAIN  &&  errno != EWOULDBLOCK  &&  errno != EINTR) {
+	    return cc;
+	}
+	remaining_ms = deadline_ms - nmxp_clock_ms();
+	if(remaining_ms <= 0) {
+	    return -2; /* timeout! */
+	}
+	n = poll(&pfd, 1, (int) remaining_ms);
+	if(n == 0) return -2; /* timeout! */
+	if(n == -1) {
+	    if(errno == EINTR) return -2; /* timeout! "Interrupted system call" */
+	    return -1; /* error*/
+	}
+    }
+}
+#endif
+
 int nmxp_recv_ctrl(int isock, void *buffer, int length, int timeoutsec, int *recv_errno )
+{
+    return nmxp_recv_ctrl_ms(isock, buffer, length, timeoutsec * 1000, recv_errno);
+}
+
+
+int nmxp_recv_ctrl_ms(int isock, void *buffer, int length, int timeout_ms, int *recv_errno )
 {
   int recvCount;
   int cc;
   char *buffer_char = buffer;
   char *recv_errno_str = NULL;
+#ifdef NMXP_RECV_POLL
+  int64_t deadline_ms = nmxp_clock_ms() + nmxp_recv_timeout_ms(timeout_ms);
+#else
+  int timeoutsec = (timeout_ms > 0)? (timeout_ms + 999) / 1000 : 0;
 
   nmxp_setsockopt_RCVTIMEO(isock, timeoutsec);
+#endif
   
   cc = 1;
   *recv_errno  = 0;
@@ -293,7 +365,9 @@ int nmxp_recv_ctrl(int isock, void *buffer, int length, int timeoutsec, int *rec
       /* TODO some operating system could not reset errno */
       errno = 0;
 
-#ifdef HAVE_BROKEN_SO_RCVTIMEO
+#if defined(NMXP_RECV_POLL)
+      cc = nmxp_recv_deadline(isock, buffer_char + recvCount, length - recvCount, deadline_ms);
+#elif defined(HAVE_BROKEN_SO_RCVTIMEO)
       cc = nmxp_recv_select_timeout(isock, buffer_char + recvCount, length - recvCount, timeoutsec);
 #else
       cc = recv(isock, buffer_char + recvCount, length - recvCount, 0);
@@ -318,7 +392,9 @@ int nmxp_recv_ctrl(int isock, void *buffer, int length, int timeoutsec, int *rec
       }
   }
 
+#ifndef NMXP_RECV_POLL
   nmxp_setsockopt_RCVTIMEO(isock, 0);
+#endif
 
   if (recvCount != length  ||  *recv_errno != 0  ||  cc <= 0) {
 
@@ -424,6 +500,32 @@ int32_t nmxp_display_error_from_server(char *buffer, int32_t length) {
     return reason;
 }
 
+static void nmxp_receiveMessage_log_body(NMXP_MSG_SERVER type, char *buffer, int32_t length) {
+    if(type == NMXP_MSG_TERMINATESUBSCRIPTION) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Received TerminateSubscritption.\n");
+	nmxp_display_error_from_server(buffer, length);
+    } else if(type == NMXP_MSG_ERROR) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Received ErrorMessage: %s\n", NMXP_LOG_STR(buffer));
+    } else {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_PACKETMAN, "Received message type: %d  length=%d\n", type, length);
+    }
+}
+
+static void nmxp_receiveMessage_log_errno(int recv_errno) {
+    if(recv_errno != 0) {
+#ifdef HAVE_WINDOWS_H
+	if(recv_errno == WSAEWOULDBLOCK  ||  recv_errno == WSAETIMEDOUT) {
+#else
+	if(recv_errno == EWOULDBLOCK) {
+#endif
+	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_DOD, "Timeout receiving in nmxp_receiveMessage()\n");
+	} else {
+	    /* Log message is not necessary because managed by nmxp_recv_ctrl() */
+	    /* nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Error in nmxp_receiveMessage()\n"); */
+	}
+    }
+}
+
 int nmxp_receiveMessage(int isock, NMXP_MSG_SERVER *type, void *buffer, int32_t *length, int timeoutsec, int *recv_errno, int buffer_length) {
     int ret;
     *length = 0;
@@ -438,71 +540,517 @@ int nmxp_receiveMessage(int isock, NMXP_MSG_SERVER *type, void *buffer, int32_t
 	    ret = NMXP_SOCKET_ERROR;
 	} else if (*length > 0) {
 	    ret = nmxp_recv_ctrl(isock, buffer, *length, 0, recv_errno);
+	    nmxp_receiveMessage_log_body(*type, buffer, *length);
+	}
+    }
 
-	    if(*type == NMXP_MSG_TERMINATESUBSCRIPTION) {
-		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Received TerminateSubscritption.\n");
-		nmxp_display_error_from_server(buffer, *length);
-	    } else if(*type == NMXP_MSG_ERROR) {
-		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Received ErrorMessage: %s\n", NMXP_LOG_STR(buffer));
-	    } else {
-		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_PACKETMAN, "Received message type: %d  length=%d\n", *type, *length);
-	    }
+    nmxp_receiveMessage_log_errno(*recv_errno);
+
+    return ret;
+}
 
+
+int nmxp_recv_buffer_init(NMXP_RECV_BUFFER *rb, int isock, int32_t size) {
+    if(size <= 0) {
+	size = NMXP_RECV_BUFFER_SIZE;
+    }
+    rb->isock = isock;
+    rb->begin = 0;
+    rb->end = 0;
+    rb->buffer = (char *) NMXP_MEM_MALLOC(size);
+    if(rb->buffer == NULL) {
+	rb->size = 0;
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "nmxp_recv_buffer_init(): can not allocate %d bytes.\n", size);
+	return -1;
+    }
+    rb->size = size;
+#ifndef NMXP_RECV_POLL
+    /* Same resting time-out set by nmxp_recv_ctrl() */
+    nmxp_setsockopt_RCVTIMEO(isock, 0);
+#endif
+    return 0;
+}
+
+
+void nmxp_recv_buffer_free(NMXP_RECV_BUFFER *rb) {
+    if(rb->buffer) {
+	NMXP_MEM_FREE(rb->buffer);
+	rb->buffer = NULL;
+    }
+    rb->size = 0;
+    rb->begin = 0;
+    rb->end = 0;
+}
+
+
+/* Receive until at least length bytes are available from rb->begin.
+ * Each recv() asks for all the free space, so several messages are usually read at once.
+ * Without poll() the socket time-out is changed only when it differs from the resting one. */
+static int nmxp_recv_buffer_fill(NMXP_RECV_BUFFER *rb, int32_t length, int timeout_ms, int *recv_errno) {
+    int cc = 1;
+    char *recv_errno_str = NULL;
+#ifdef NMXP_RECV_POLL
+    int64_t deadline_ms;
+#else
+    int timeoutsec = (timeout_ms > 0)? (timeout_ms + 999) / 1000 : 0;
+#endif
+
+    *recv_errno = 0;
+
+    if(rb->end - rb->begin >= length) {
+	return NMXP_SOCKET_OK;
+    }
+
+    if(rb->size - rb->begin < length) {
+	/* Move the partial message at the beginning of the buffer */
+	memmove(rb->buffer, rb->buffer + rb->begin, rb->end - rb->begin);
+	rb->end -= rb->begin;
+	rb->begin = 0;
+    }
+
+#ifdef NMXP_RECV_POLL
+    deadline_ms = nmxp_clock_ms() + nmxp_recv_timeout_ms(timeout_ms);
+#else
+    if(timeoutsec != 0) {
+	nmxp_setsockopt_RCVTIMEO(rb->isock, timeoutsec);
+    }
+#endif
+
+    while(cc > 0 && *recv_errno == 0  && rb->end - rb->begin < length) {
+
+	errno = 0;
+
+#if defined(NMXP_RECV_POLL)
+	cc = nmxp_recv_deadline(rb->isock, rb->buffer + rb->end, rb->size - rb->end, deadline_ms);
+#elif defined(HAVE_BROKEN_SO_RCVTIMEO)
+	cc = nmxp_recv_select_timeout(rb->isock, rb->buffer + rb->end, rb->size - rb->end, timeoutsec);
+#else
+	cc = recv(rb->isock, rb->buffer + rb->end, rb->size - rb->end, 0);
+#endif
+
+#ifdef HAVE_WINDOWS_H
+	*recv_errno  = WSAGetLastError();
+#else
+	if(cc == -2) {
+	    *recv_errno  = EWOULDBLOCK;
+	} else {
+	    *recv_errno  = errno;
+	}
+#endif
+	if(cc > 0) {
+	    rb->end += cc;
 	}
     }
 
-    if(*recv_errno != 0) {
+#ifndef NMXP_RECV_POLL
+    if(timeoutsec != 0) {
+	nmxp_setsockopt_RCVTIMEO(rb->isock, 0);
+    }
+#endif
+
+    if(rb->end - rb->begin < length) {
+
+	recv_errno_str = nmxp_strerror(*recv_errno);
+
 #ifdef HAVE_WINDOWS_H
-	if(*recv_errno == WSAEWOULDBLOCK  ||  *recv_errno == WSAETIMEDOUT) {
+	if(*recv_errno != WSAEWOULDBLOCK  &&  *recv_errno != WSAETIMEDOUT)
 #else
-	if(*recv_errno == EWOULDBLOCK) {
+	if(*recv_errno != EWOULDBLOCK)
 #endif
-	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_DOD, "Timeout receiving in nmxp_receiveMessage()\n");
-	} else {
-	    /* Log message is not necessary because managed by nmxp_recv_ctrl() */
-	    /* nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Error in nmxp_receiveMessage()\n"); */
+	{
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "nmxp_recv_buffer_fill(): %s (errno=%d available=%d length=%d cc=%d)\n",
+		    NMXP_LOG_STR(recv_errno_str), *recv_errno, rb->end - rb->begin, length, cc);
 	}
+	NMXP_MEM_FREE(recv_errno_str);
+
+	if(cc == 0  &&  *recv_errno == 0) {
+	    *recv_errno = -100;
+	}
+
+	return NMXP_SOCKET_ERROR;
+    }
+
+    /* Data received, errno of a previous recv() does not matter */
+    *recv_errno = 0;
+
+    return NMXP_SOCKET_OK;
+}
+
+
+/* Check the message header at rb->begin, at least its size has to be available.
+ * Return 0 when msg is valid, 1 for a null header and -1 on error.
+ * Null and wrong headers are consumed. */
+static int nmxp_recv_buffer_header(NMXP_RECV_BUFFER *rb, NMXP_MESSAGE_HEADER *msg, int buffer_length) {
+    memcpy(msg, rb->buffer + rb->begin, sizeof(NMXP_MESSAGE_HEADER));
+
+    if(msg->type == 0) {
+	rb->begin += sizeof(NMXP_MESSAGE_HEADER);
+	return 1;
     }
 
+    msg->signature = ntohl(msg->signature);
+    msg->type      = ntohl(msg->type);
+    msg->length    = ntohl(msg->length);
+
+    if (msg->signature != NMX_SIGNATURE) {
+	rb->begin += sizeof(NMXP_MESSAGE_HEADER);
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW,
+		"nmxp_receiveMessage_buffer(): signature mismatches. signature = %d, type = %d, length = %d\n",
+		msg->signature, msg->type, msg->length);
+	return -1;
+    }
+
+    if(msg->length > buffer_length  ||  msg->length < 0
+	    ||  msg->length > rb->size - (int32_t) sizeof(NMXP_MESSAGE_HEADER)) {
+	rb->begin += sizeof(NMXP_MESSAGE_HEADER);
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_receiveMessage_buffer(): size of received messagge is bigger than buffer. (%d > %d). \n",
+		msg->length, buffer_length);
+	return -1;
+    }
+
+    return 0;
+}
+
+/* Consume header and body of msg, they have to be available */
+static void nmxp_recv_buffer_take(NMXP_RECV_BUFFER *rb, const NMXP_MESSAGE_HEADER *msg, NMXP_MSG_SERVER *type, char **buffer, int32_t *length) {
+    rb->begin += sizeof(NMXP_MESSAGE_HEADER);
+    *type = msg->type;
+    *length = msg->length;
+    if(*length > 0) {
+	*buffer = rb->buffer + rb->begin;
+	rb->begin += *length;
+	nmxp_receiveMessage_log_body(*type, *buffer, *length);
+    }
+}
+
+
+int nmxp_receiveMessage_buffer(NMXP_RECV_BUFFER *rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int timeout_ms, int *recv_errno, int buffer_length) {
+    int ret;
+    NMXP_MESSAGE_HEADER msg;
+
+    *type = 0;
+    *length = 0;
+    *buffer = NULL;
+
+    ret = nmxp_recv_buffer_fill(rb, sizeof(NMXP_MESSAGE_HEADER), timeout_ms, recv_errno);
+
+    if(ret == NMXP_SOCKET_OK) {
+	switch(nmxp_recv_buffer_header(rb, &msg, buffer_length)) {
+	    case 0:
+		/* Header is consumed only with its body, a time-out does not lose the framing */
+		ret = nmxp_recv_buffer_fill(rb, sizeof(NMXP_MESSAGE_HEADER) + msg.length, 0, recv_errno);
+		if(ret == NMXP_SOCKET_OK) {
+		    nmxp_recv_buffer_take(rb, &msg, type, buffer, length);
+		}
+		break;
+	    case 1:
+		break;
+	    default:
+		ret = NMXP_SOCKET_ERROR;
+		break;
+	}
+    }
+
+    if(rb->begin == rb->end) {
+	rb->begin = 0;
+	rb->end = 0;
+    }
+
+    nmxp_receiveMessage_log_errno(*recv_errno);
+
     return ret;
 }
 
 
-NMXP_DATA_PROCESS *nmxp_processDecompressedData(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default)
+int nmxp_recv_buffer_read(NMXP_RECV_BUFFER *rb, int *recv_errno) {
+    int cc;
+    int flags = 0;
+
+#ifdef MSG_DONTWAIT
+    flags = MSG_DONTWAIT;
+#endif
+
+    *recv_errno = 0;
+
+    if(rb->begin > 0  &&  (rb->begin == rb->end  ||  rb->end == rb->size)) {
+	memmove(rb->buffer, rb->buffer + rb->begin, rb->end - rb->begin);
+	rb->end -= rb->begin;
+	rb->begin = 0;
+    }
+
+    if(rb->end == rb->size) {
+	/* Full of data not yet framed */
+	return NMXP_SOCKET_OK;
+    }
+
+    errno = 0;
+    cc = recv(rb->isock, rb->buffer + rb->end, rb->size - rb->end, flags);
+
+    if(cc > 0) {
+	rb->end += cc;
+	return NMXP_SOCKET_OK;
+    }
+
+#ifdef HAVE_WINDOWS_H
+    *recv_errno  = WSAGetLastError();
+    if(cc < 0  &&  *recv_errno == WSAEWOULDBLOCK) {
+	*recv_errno = 0;
+	return NMXP_SOCKET_OK;
+    }
+#else
+    *recv_errno  = errno;
+    if(cc < 0  &&  (*recv_errno == EWOULDBLOCK  ||  *recv_errno == EAGAIN  ||  *recv_errno == EINTR)) {
+	*recv_errno = 0;
+	return NMXP_SOCKET_OK;
+    }
+#endif
+
+    if(cc == 0) {
+	/* TCP FIN or EOF received */
+	*recv_errno = -100;
+    }
+
+    return NMXP_SOCKET_ERROR;
+}
+
+
+int nmxp_recv_buffer_next(NMXP_RECV_BUFFER *rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int buffer_length) {
+    int ret = 0;
+    NMXP_MESSAGE_HEADER msg;
+
+    *type = 0;
+    *length = 0;
+    *buffer = NULL;
+
+    while(ret == 0  &&  rb->end - rb->begin >= (int32_t) sizeof(NMXP_MESSAGE_HEADER)) {
+	switch(nmxp_recv_buffer_header(rb, &msg, buffer_length)) {
+	    case 0:
+		if(rb->end - rb->begin < (int32_t) sizeof(NMXP_MESSAGE_HEADER) + msg.length) {
+		    /* Wait for the body */
+		    return 0;
+		}
+		nmxp_recv_buffer_take(rb, &msg, type, buffer, length);
+		ret = 1;
+		break;
+	    case 1:
+		break;
+	    default:
+		ret = -1;
+		break;
+	}
+    }
+
+    return ret;
+}
+
+
+/* Wait until one of the sockets is readable or deadline_ms. Set ready[i] for readable sockets.
+ * Return number of readable sockets, 0 on time-out, -1 on error. */
+static int nmxp_recv_buffers_wait(NMXP_RECV_BUFFER **rb, int n_rb, int64_t deadline_ms, int *ready) {
+    int n, i;
+    int64_t remaining_ms = deadline_ms - nmxp_clock_ms();
+#ifdef NMXP_RECV_POLL
+    struct pollfd pfd[NMXP_RECV_BUFFERS_MAX];
+#else
+    fd_set fds;
+    int maxfd = 0;
+    struct timeval tv;
+#endif
+
+    if(remaining_ms <= 0) {
+	return 0;
+    }
+
+#ifdef NMXP_RECV_POLL
+    for(i=0; i < n_rb; i++) {
+	pfd[i].fd = rb[i]->isock;
+	pfd[i].events = POLLIN;
+	pfd[i].revents = 0;
+    }
+    n = poll(pfd, n_rb, (int) remaining_ms);
+    if(n > 0) {
+	for(i=0; i < n_rb; i++) {
+	    ready[i] = (pfd[i].revents != 0);
+	}
+    }
+#else
+    FD_ZERO(&fds);
+    for(i=0; i < n_rb; i++) {
+	FD_SET(rb[i]->isock, &fds);
+	if(rb[i]->isock > maxfd) {
+	    maxfd = rb[i]->isock;
+	}
+    }
+    tv.tv_sec = remaining_ms / 1000;
+    tv.tv_usec = (remaining_ms % 1000) * 1000;
+    n = select(maxfd+1, &fds, NULL, NULL, &tv);
+    if(n > 0) {
+	for(i=0; i < n_rb; i++) {
+	    ready[i] = FD_ISSET(rb[i]->isock, &fds);
+	}
+    }
+#endif
+
+    if(n == -1  &&  errno == EINTR) {
+	/* timeout! "Interrupted system call" */
+	n = 0;
+    }
+
+    return n;
+}
+
+
+int nmxp_receiveMessage_buffers(NMXP_RECV_BUFFER **rb, int n_rb, int *i_rb, NMXP_MSG_SERVER *type, char **buffer, int32_t *length, int timeout_ms, int *recv_errno, int buffer_length) {
+    int ret = NMXP_SOCKET_OK;
+    int i, k, n;
+    int ready[NMXP_RECV_BUFFERS_MAX];
+    int64_t deadline_ms = nmxp_clock_ms() + nmxp_recv_timeout_ms(timeout_ms);
+
+    *type = 0;
+    *length = 0;
+    *buffer = NULL;
+    *recv_errno = 0;
+
+    if(n_rb <= 0  ||  n_rb > NMXP_RECV_BUFFERS_MAX) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "nmxp_receiveMessage_buffers(): wrong number of buffers %d.\n", n_rb);
+	*i_rb = -1;
+	return NMXP_SOCKET_ERROR;
+    }
+
+    while(1) {
+	/* Messages already received, starting after the buffer of the last one returned */
+	for(k=1; k <= n_rb; k++) {
+	    i = (*i_rb + k + n_rb) % n_rb;
+	    n = nmxp_recv_buffer_next(rb[i], type, buffer, length, buffer_length);
+	    if(n != 0) {
+		*i_rb = i;
+		return (n == 1)? NMXP_SOCKET_OK : NMXP_SOCKET_ERROR;
+	    }
+	}
+
+	n = nmxp_recv_buffers_wait(rb, n_rb, deadline_ms, ready);
+	if(n == 0) {
+#ifdef HAVE_WINDOWS_H
+	    *recv_errno = WSAEWOULDBLOCK;
+#else
+	    *recv_errno = EWOULDBLOCK;
+#endif
+	    nmxp_receiveMessage_log_errno(*recv_errno);
+	    *i_rb = -1;
+	    return NMXP_SOCKET_ERROR;
+	} else if(n < 0) {
+	    *recv_errno = errno;
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "nmxp_receiveMessage_buffers(): waiting for data failed (errno=%d).\n", *recv_errno);
+	    *i_rb = -1;
+	    return NMXP_SOCKET_ERROR;
+	}
+
+	for(i=0; i < n_rb; i++) {
+	    if(ready[i]) {
+		ret = nmxp_recv_buffer_read(rb[i], recv_errno);
+		if(ret != NMXP_SOCKET_OK) {
+		    /* Caller decides whether going on with the other connections */
+		    *i_rb = i;
+		    return ret;
+		}
+	    }
+	}
+    }
+
+    return ret;
+}
+
+
+static int nmxp_process_set_channel(NMXP_DATA_PROCESS *pd, int32_t pKey, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default)
+{
+    int i_chan;
+    const NMXP_CHAN_KEY_NET *chan;
+    char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char network_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char location_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+
+    i_chan = nmxp_chan_lookupKeyIndex(pKey, channelList);
+    if(i_chan == -1) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not found for key %d\n", pKey);
+	return -1;
+    }
+
+    pd->key = pKey;
+    pd->chan_index = i_chan;
+
+    /* Identity parsed once when the list has been indexed */
+    if(channelList->hash_number == channelList->number) {
+	chan = &(channelList->channel[i_chan]);
+	if(chan->network[0] != 0) {
+	    memcpy(pd->network, chan->network, NMXP_DATA_NETWORK_LENGTH);
+	} else {
+	    strncpy(pd->network, network_code_default, NMXP_DATA_NETWORK_LENGTH);
+	}
+	if(chan->station[0] != 0) {
+	    memcpy(pd->station, chan->station, NMXP_DATA_STATION_LENGTH);
+	}
+	if(chan->channel[0] != 0) {
+	    memcpy(pd->channel, chan->channel, NMXP_DATA_CHANNEL_LENGTH);
+	}
+	if(chan->location[0] != 0) {
+	    memcpy(pd->location, chan->location, NMXP_DATA_LOCATION_LENGTH);
+	} else {
+	    strncpy(pd->location, location_code_default, NMXP_DATA_LOCATION_LENGTH);
+	}
+	return 0;
+    }
+
+    if(!nmxp_chan_cpy_sta_chan(channelList->channel[i_chan].name, station_code, channel_code, network_code, location_code)) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not in STA.CHAN format: %s\n",
+		NMXP_LOG_STR(channelList->channel[i_chan].name));
+    }
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Channel key %d for %s.%s\n",
+	    pKey, NMXP_LOG_STR(station_code), NMXP_LOG_STR(channel_code));
+
+    if(network_code[0] != 0) {
+	strncpy(pd->network, network_code, NMXP_DATA_NETWORK_LENGTH);
+    } else {
+	strncpy(pd->network, network_code_default, NMXP_DATA_NETWORK_LENGTH);
+    }
+    if(station_code[0] != 0) {
+	strncpy(pd->station, station_code, NMXP_DATA_STATION_LENGTH);
+    }
+    if(channel_code[0] != 0) {
+	strncpy(pd->channel, channel_code, NMXP_DATA_CHANNEL_LENGTH);
+    }
+    if(location_code[0] != 0) {
+	strncpy(pd->location, location_code, NMXP_DATA_LOCATION_LENGTH);
+    } else {
+	strncpy(pd->location, location_code_default, NMXP_DATA_LOCATION_LENGTH);
+    }
+
+    return 0;
+}
+
+
+int nmxp_processDecompressedData_r(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size)
 {
   int32_t   netInt    = 0;
   int32_t   pKey      = 0;
   double    pTime     = 0.0;
   int32_t   pNSamp    = 0;
   int32_t   pSampRate = 0;
-  int32_t  *pDataPtr  = NULL;
   int       swap      = 0;
   int       idx;
-  int32_t  *outdata   = NULL;
-
-
-  char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-  char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-  char network_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-  char location_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
 
-  char *nmxp_channel_name = NULL;
-  NMXP_DATA_PROCESS *pd   = NULL;
-
-  pd= (NMXP_DATA_PROCESS *) NMXP_MEM_MALLOC(sizeof(NMXP_DATA_PROCESS));
   memset(pd,0,sizeof(NMXP_DATA_PROCESS));
-
+  nmxp_data_init(pd);
 
   /* copy the header contents into local fields and swap */
   memcpy(&netInt, &buffer_data[0], 4);
   pKey = ntohl(netInt);
   if ( pKey != netInt ) { swap = 1; }
 
-  nmxp_data_init(pd);
-  outdata = (int32_t *) NMXP_MEM_MALLOC(MAX_OUTDATA*sizeof(int32_t));
-  nmxp_channel_name = nmxp_chan_lookupName(pKey, channelList);
-
-  if(nmxp_channel_name != NULL) {
+  if(nmxp_process_set_channel(pd, pKey, channelList, network_code_default, location_code_default) != 0) {
+      return -1;
+  }
 
   memcpy(&pTime, &buffer_data[4], 8);
   if ( swap ) { nmxp_data_swap_8b(&pTime); }
@@ -513,187 +1061,171 @@ NMXP_DATA_PROCESS *nmxp_processDecompressedData(char* buffer_data, int length_da
   pSampRate = ntohl(netInt);
 
   /* There should be (length_data - 20) bytes of data as 32-bit ints here */
+  if(length_data - 20 > outdata_size * (int) sizeof(int32_t)  ||  pNSamp * (int) sizeof(int32_t) > length_data - 20) {
+      nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Decompressed packet for key %d has %d samples in %d bytes, buffer size %d\n",
+	      pKey, pNSamp, length_data - 20, outdata_size);
+      return -1;
+  }
   memcpy(outdata , (int32_t *) &buffer_data[20], length_data - 20);
-  pDataPtr = outdata;
 
   /* Swap the data samples to host order */
   for ( idx=0; idx < pNSamp; idx++ ) {
-      netInt = ntohl(pDataPtr[idx]);
-      pDataPtr[idx] = netInt;
-  }
-
-  if(!nmxp_chan_cpy_sta_chan(nmxp_channel_name, station_code, channel_code, network_code, location_code)) {
-    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not in STA.CHAN format: %s\n",
-	    NMXP_LOG_STR(nmxp_channel_name));
+      netInt = ntohl(outdata[idx]);
+      outdata[idx] = netInt;
   }
 
-  pd->key = pKey;
-  if(network_code[0] != 0) {
-      strncpy(pd->network, network_code, NMXP_DATA_NETWORK_LENGTH);
-  } else {
-      strncpy(pd->network, network_code_default, NMXP_DATA_NETWORK_LENGTH);
-  }
-  if(station_code[0] != 0) {
-      strncpy(pd->station, station_code, NMXP_DATA_STATION_LENGTH);
-  }
-  if(channel_code[0] != 0) {
-      strncpy(pd->channel, channel_code, NMXP_DATA_CHANNEL_LENGTH);
-  }
-  if(location_code[0] != 0) {
-      strncpy(pd->location, location_code, NMXP_DATA_LOCATION_LENGTH);
-  } else {
-      strncpy(pd->location, location_code_default, NMXP_DATA_LOCATION_LENGTH);
-  }
   pd->packet_type = NMXP_MSG_DECOMPRESSED;
   pd->x0 = -1;
   pd->xn = -1;
   pd->x0n_significant = 0;
   pd->time = pTime;
   pd->nSamp = pNSamp;
-  pd->pDataPtr = pDataPtr;
+  pd->pDataPtr = outdata;
   pd->sampRate = pSampRate;
 
-
-
   /* TODO*/
   /* pd.oldest_seq_no = ;*/
   /* pd.seq_no = ;*/
 
-  NMXP_MEM_FREE(nmxp_channel_name);
-  } else {
-      nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not found for key %d\n", pKey);
-  }
-
-  return pd;
+  return 0;
 }
 
 
-NMXP_DATA_PROCESS *nmxp_processCompressedData(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default)
+NMXP_DATA_PROCESS *nmxp_processDecompressedData(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default)
 {
-    int32_t   pKey      = 0;
-    double    pTime     = 0.0;
-    int32_t   pNSamp    = 0;
-    int32_t   pSampRate = 0;
-    int32_t  *pDataPtr  = NULL;
+    NMXP_DATA_PROCESS *pd = NULL;
+    int32_t *outdata = NULL;
 
-    char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char network_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char location_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    pd = (NMXP_DATA_PROCESS *) NMXP_MEM_MALLOC(sizeof(NMXP_DATA_PROCESS));
+    outdata = (int32_t *) NMXP_MEM_MALLOC(MAX_OUTDATA*sizeof(int32_t));
 
-    NMXP_DATA_PROCESS *pd = NULL;
+    if(nmxp_processDecompressedData_r(buffer_data, length_data, channelList, network_code_default, location_code_default, pd, outdata, MAX_OUTDATA) != 0) {
+	NMXP_MEM_FREE(outdata);
+	pd->pDataPtr = NULL;
+    }
 
+    return pd;
+}
 
 
+int nmxp_processCompressedHeader(char* buffer_data, int length_data, NMXP_PACKET_HEADER *hdr)
+{
     int32_t nmx_rate_code_to_sample_rate[32] = {
 	0,1,2,5,10,20,40,50,
 	80,100,125,200,250,500,1000,25,
 	120,0,0,0,0,0,0,0,
 	0,0,0,0,0,0,0,0};
 
-	int32_t nmx_oldest_sequence_number;
-	char nmx_hdr[25];
-	unsigned char nmx_ptype;
-	int32_t nmx_seconds;
-	double nmx_seconds_double;
-	int16_t nmx_ticks, nmx_instr_id;
-	int32_t nmx_seqno;
-	unsigned char nmx_sample_rate;
-	int32_t nmx_x0;
-	int32_t rate_code, chan_code, this_sample_rate;
-
-	int32_t comp_bytecount;
-	unsigned char *indata;
-        int32_t * outdata = NULL;
+	/* Number of differences for each compression code */
+	const int32_t ndiff[4] = {0, 4, 2, 1};
 
-	int32_t nout, i, k;
-	int32_t prev_xn;
+	char *nmx_hdr;
+	unsigned char cbits;
+	int32_t rate_code, chan_code;
+	int32_t comp_bytecount, i;
 	const uint32_t high_scale = 4096 * 2048;
 	const uint32_t high_scale_p = 4096 * 4096;
 
-	char *nmxp_channel_name = NULL;
-
-        pd= (NMXP_DATA_PROCESS *) NMXP_MEM_MALLOC(sizeof(NMXP_DATA_PROCESS));
-        memset(pd,0,sizeof(NMXP_DATA_PROCESS));
-
-	/* TOREMOVE int my_order = get_my_wordorder();*/
-	int my_host_is_bigendian = nmxp_data_bigendianhost();
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "my_host_is_bigendian %d\n", my_host_is_bigendian);
-
-	memcpy(&nmx_oldest_sequence_number, buffer_data, 4);
-	if (my_host_is_bigendian) {
-	    nmxp_data_swap_4b (&nmx_oldest_sequence_number);
+	if(length_data < 21) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Compressed packet too short (%d bytes)\n", length_data);
+	    return -1;
 	}
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Oldest sequence number = %d\n", nmx_oldest_sequence_number);
 
-	memcpy(nmx_hdr, buffer_data+4, 17);
+	memcpy(&hdr->oldest_seq_no, buffer_data, 4);
+#ifdef WORDS_BIGENDIAN
+	nmxp_data_swap_4b (&hdr->oldest_seq_no);
+#endif
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Oldest sequence number = %d\n", hdr->oldest_seq_no);
+
 	/* Decode the Nanometrics packet header bundle. */
-	memcpy (&nmx_ptype, nmx_hdr+0, 1);
-	if ( (nmx_ptype & 0xf) == 9) {
+	nmx_hdr = buffer_data+4;
+	memcpy (&hdr->packet_type, nmx_hdr+0, 1);
+	if ( (hdr->packet_type & 0xf) == 9) {
 	    /* Filler packet.  Discard entire packet.   */
 	    nmxp_log (NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Filler packet - discarding\n");
-	    /*m continue;*/
-	    exit(0);
+	    return -1;
 	}
 
-	nmx_x0 = 0;
-	memcpy (&nmx_seconds, nmx_hdr+1, 4);
-	memcpy (&nmx_ticks, nmx_hdr+5, 2);
-	memcpy (&nmx_instr_id, nmx_hdr+7, 2);
-	memcpy (&nmx_seqno, nmx_hdr+9, 4);
-	memcpy (&nmx_sample_rate, nmx_hdr+13, 1);
-	memcpy (&nmx_x0, nmx_hdr+14, 3);
-
-	if (my_host_is_bigendian) {
-	    nmxp_data_swap_4b ((int32_t *)&nmx_seconds);
-	    nmxp_data_swap_2b (&nmx_ticks);
-	    nmxp_data_swap_2b (&nmx_instr_id);
-	    nmxp_data_swap_4b (&nmx_seqno);
-	    nmxp_data_swap_4b (&nmx_x0);
-	}
+	hdr->x0 = 0;
+	memcpy (&hdr->seconds, nmx_hdr+1, 4);
+	memcpy (&hdr->ticks, nmx_hdr+5, 2);
+	memcpy (&hdr->instr_id, nmx_hdr+7, 2);
+	memcpy (&hdr->seq_no, nmx_hdr+9, 4);
+	memcpy (&hdr->rate_chan, nmx_hdr+13, 1);
+	memcpy (&hdr->x0, nmx_hdr+14, 3);
+
+#ifdef WORDS_BIGENDIAN
+	nmxp_data_swap_4b (&hdr->seconds);
+	nmxp_data_swap_2b (&hdr->ticks);
+	nmxp_data_swap_2b (&hdr->instr_id);
+	nmxp_data_swap_4b (&hdr->seq_no);
+	nmxp_data_swap_4b (&hdr->x0);
+#endif
 
 	/* check if nmx_x0 is negative like as signed 3-byte int */
-	if( (nmx_x0 & high_scale) ==  high_scale) {
-	    /* nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "WARNING: changed nmx_x0, old value = %d\n",  nmx_x0);*/
-	    nmx_x0 -= high_scale_p;
+	if( (hdr->x0 & high_scale) ==  high_scale) {
+	    hdr->x0 -= high_scale_p;
 	}
 
-	nmx_seconds_double = (double) nmx_seconds + ( (double) nmx_ticks / 10000.0 );
-	rate_code = nmx_sample_rate>>3;
-	chan_code = nmx_sample_rate&7;
-	this_sample_rate = nmx_rate_code_to_sample_rate[rate_code];
+	hdr->time = (double) hdr->seconds + ( (double) hdr->ticks / 10000.0 );
+	rate_code = hdr->rate_chan>>3;
+	chan_code = hdr->rate_chan&7;
+	hdr->sampRate = nmx_rate_code_to_sample_rate[rate_code];
+	hdr->key = (hdr->instr_id << 16) | ( 1 << 8) | ( chan_code);
 
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_ptype          = %d\n", nmx_ptype);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seconds        = %d\n", nmx_seconds);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_ticks          = %d\n", nmx_ticks);
+	/* Count samples from the control bytes, up to the first null bundle */
+	comp_bytecount = length_data-21;
+	hdr->nSamp = 0;
+	for (i=0; i+17<=comp_bytecount; i+=17) {
+	    cbits = (unsigned char) buffer_data[21+i];
+	    if (cbits == 9) break;
+	    hdr->nSamp += ndiff[(cbits>>6) & 3] + ndiff[(cbits>>4) & 3] + ndiff[(cbits>>2) & 3] + ndiff[cbits & 3];
+	}
 
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seconds_double = %f\n", nmx_seconds_double);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_x0             = %d\n", nmx_x0);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_ptype          = %d\n", hdr->packet_type);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seconds        = %d\n", hdr->seconds);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_ticks          = %d\n", hdr->ticks);
 
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_instr_id       = %d\n", nmx_instr_id);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seqno          = %d\n", nmx_seqno);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_sample_rate    = %d\n", nmx_sample_rate);
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "this_sample_rate   = %d\n", this_sample_rate);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seconds_double = %f\n", hdr->time);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_x0             = %d\n", hdr->x0);
 
-	pKey = (nmx_instr_id << 16) | ( 1 << 8) | ( chan_code);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_instr_id       = %d\n", hdr->instr_id);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_seqno          = %d\n", hdr->seq_no);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "nmx_sample_rate    = %d\n", hdr->rate_chan);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "this_sample_rate   = %d\n", hdr->sampRate);
+
+	return 0;
+}
 
-	pTime = nmx_seconds_double;
 
-	pSampRate = this_sample_rate;
+int nmxp_processCompressedData_r(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size)
+{
+    NMXP_PACKET_HEADER hdr;
 
+    if(nmxp_processCompressedHeader(buffer_data, length_data, &hdr) != 0) {
+	memset(pd,0,sizeof(NMXP_DATA_PROCESS));
 	nmxp_data_init(pd);
-        outdata = (int32_t *) NMXP_MEM_MALLOC(MAX_OUTDATA*sizeof(int32_t));
-	nmxp_channel_name = nmxp_chan_lookupName(pKey, channelList);
+	return -1;
+    }
+
+    return nmxp_processCompressedData_hdr(buffer_data, length_data, &hdr, channelList, network_code_default, location_code_default, pd, outdata, outdata_size);
+}
 
-	if(nmxp_channel_name) {
 
-	if(!nmxp_chan_cpy_sta_chan(nmxp_channel_name, station_code, channel_code, network_code, location_code)) {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not in STA.CHAN format: %s\n",
-		    NMXP_LOG_STR(nmxp_channel_name));
+int nmxp_processCompressedData_hdr(char* buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default, NMXP_DATA_PROCESS *pd, int32_t *outdata, int outdata_size)
+{
+	int32_t comp_bytecount;
+	unsigned char *indata;
+
+	int32_t nout, i, k;
+	int32_t prev_xn;
+
+        memset(pd,0,sizeof(NMXP_DATA_PROCESS));
+	nmxp_data_init(pd);
+
+	if(nmxp_process_set_channel(pd, hdr->key, channelList, network_code_default, location_code_default) != 0) {
+	    return -1;
 	}
-  
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Channel key %d for %s.%s\n",
-		pKey, NMXP_LOG_STR(station_code), NMXP_LOG_STR(channel_code));
 
 	comp_bytecount = length_data-21;
 	indata = (unsigned char *) buffer_data + 21;
@@ -701,24 +1233,24 @@ NMXP_DATA_PROCESS *nmxp_processCompressedData(char* buffer_data, int length_data
 	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "comp_bytecount     = %d  (N = %.2f)\n", comp_bytecount, (double) comp_bytecount / 17.0);
 
 	/* Unpack the data bundles, each 17 bytes long. */
-	prev_xn = nmx_x0;
-	outdata[0] = nmx_x0;
+	prev_xn = hdr->x0;
+	outdata[0] = hdr->x0;
 	nout = 1;
 	for (i=0; i<comp_bytecount; i+=17) {
 	    if (i+17>comp_bytecount) {
 		nmxp_log (NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "comp_bytecount = %d, i+17 = %d\n",
 			comp_bytecount, i+17);
-		exit(1);
+		return -1;
 	    }
-	    if (nout+16 > MAX_OUTDATA)  {
+	    if (nout+16 > outdata_size)  {
 		nmxp_log (NMXP_LOG_ERR,  NMXP_LOG_D_PACKETMAN, "Output buffer size too small\n");
-		exit(1);
+		return -1;
 	    }
 	    k = nmxp_data_unpack_bundle (outdata+nout,indata+i,&prev_xn);
 	    if (k < 0) nmxp_log (NMXP_LOG_WARN, NMXP_LOG_D_PACKETMAN, "Null bundle: %s.%s.%s (k=%d) %s %d\n",
-		    NMXP_LOG_STR(network_code),
-		    NMXP_LOG_STR(station_code),
-		    NMXP_LOG_STR(channel_code), k,
+		    NMXP_LOG_STR(pd->network),
+		    NMXP_LOG_STR(pd->station),
+		    NMXP_LOG_STR(pd->channel), k,
 		    __FILE__,  __LINE__);
 	    if (k < 0) break;
 	    nout += k;
@@ -728,44 +1260,35 @@ NMXP_DATA_PROCESS *nmxp_processCompressedData(char* buffer_data, int length_data
 
 	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Unpacked %d samples.\n", nout);
 
-	pDataPtr = outdata;
-	pNSamp = nout;
-
-        pd->key = pKey;
-	if(network_code[0] != 0) {
-	    strncpy(pd->network, network_code, NMXP_DATA_NETWORK_LENGTH);
-	} else {
-	    strncpy(pd->network, network_code_default, NMXP_DATA_NETWORK_LENGTH);
-	}
-	if(station_code[0] != 0) {
-	    strncpy(pd->station, station_code, NMXP_DATA_STATION_LENGTH);
-	}
-	if(channel_code[0] != 0) {
-	    strncpy(pd->channel, channel_code, NMXP_DATA_CHANNEL_LENGTH);
-	}
-	if(location_code[0] != 0) {
-	    strncpy(pd->location, location_code, NMXP_DATA_LOCATION_LENGTH);
-	} else {
-	    strncpy(pd->location, location_code_default, NMXP_DATA_LOCATION_LENGTH);
-	}
-	pd->packet_type = nmx_ptype;
-	pd->x0 = nmx_x0;
-	pd->xn = pDataPtr[nout];
+	pd->packet_type = hdr->packet_type;
+	pd->x0 = hdr->x0;
+	pd->xn = outdata[nout];
 	pd->x0n_significant = 1;
-	pd->oldest_seq_no = nmx_oldest_sequence_number;
-	pd->seq_no = nmx_seqno;
-	pd->time = pTime;
-	pd->nSamp = pNSamp;
-	pd->pDataPtr = pDataPtr;
-	pd->sampRate = pSampRate;
-
-	NMXP_MEM_FREE(nmxp_channel_name);
-	} else {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Channel name not found for key %d\n", pKey);
-	}
+	pd->oldest_seq_no = hdr->oldest_seq_no;
+	pd->seq_no = hdr->seq_no;
+	pd->time = hdr->time;
+	pd->nSamp = nout;
+	pd->pDataPtr = outdata;
+	pd->sampRate = hdr->sampRate;
+
+	return 0;
+}
+
+
+NMXP_DATA_PROCESS *nmxp_processCompressedData(char* buffer_data, int length_data, NMXP_CHAN_LIST_NET *channelList, const char *network_code_default, const char *location_code_default)
+{
+    NMXP_DATA_PROCESS *pd = NULL;
+    int32_t *outdata = NULL;
 
-	return pd;
+    pd = (NMXP_DATA_PROCESS *) NMXP_MEM_MALLOC(sizeof(NMXP_DATA_PROCESS));
+    outdata = (int32_t *) NMXP_MEM_MALLOC(MAX_OUTDATA*sizeof(int32_t));
+
+    if(nmxp_processCompressedData_r(buffer_data, length_data, channelList, network_code_default, location_code_default, pd, outdata, MAX_OUTDATA) != 0) {
+	NMXP_MEM_FREE(outdata);
+	pd->pDataPtr = NULL;
+    }
 
+    return pd;
 }
 
 
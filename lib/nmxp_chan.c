@@ -17,13 +17,14 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *station_code, char *channel_code, char *network_code, char *location_code) {
     int ret = 0;
     int errors = 0;
     int i;
     char *period1 = NULL, *period2 = NULL, *period3 = NULL;
-    char *tmp_name = NULL;
+    char tmp_name[NMXP_CHAN_MAX_SIZE_STR_PATTERN * 4];
 
     if(net_dot_station_dot_channel || station_code || channel_code || network_code || location_code) {
 
@@ -32,10 +33,11 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 	network_code[0] = 0;
 	location_code[0] = 0;
 
-	tmp_name = NMXP_MEM_STRDUP(net_dot_station_dot_channel);
+	strncpy(tmp_name, net_dot_station_dot_channel, sizeof(tmp_name) - 1);
+	tmp_name[sizeof(tmp_name) - 1] = 0;
 	/* count '.' */
 	i=0;
-	while(i < strlen(tmp_name)  && !errors) {
+	while(tmp_name[i] != 0  && !errors) {
 	    if(tmp_name[i] == '.') {
 		if(!period1) {
 		    period1 = tmp_name+i;
@@ -68,13 +70,14 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 		/* STA.CHAN.LOC */
 		*period1++ = '\0';
 		*period2++ = '\0';
-		if( strlen(period1) == 3 && strlen(period2) == 2) {
+		/* Channel patterns with '*' or classes have not fixed length */
+		if( (strlen(period1) == 3 || strpbrk(period1, "*[")) && strlen(period2) == 2) {
 		    /* STA.CHAN.LOC */
 		    strncpy(station_code, tmp_name, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
 		    strncpy(channel_code, period1, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
 		    strncpy(location_code, period2, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
 		} else
-		if( strlen(tmp_name) == 2 && strlen(period2) == 3) {
+		if( strlen(tmp_name) == 2 && (strlen(period2) == 3 || strpbrk(period2, "*["))) {
 		    /* NET.STA.CHAN */
 		    strncpy(network_code, tmp_name, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
 		    strncpy(station_code, period1, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
@@ -94,11 +97,6 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 		    NMXP_LOG_STR(net_dot_station_dot_channel));
 	}
 
-	if(tmp_name) {
-	    NMXP_MEM_FREE(tmp_name);
-	    tmp_name = NULL;
-	}
-
     } else {
 	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Some parameter is NULL in nmxp_chan_cpy_sta_chan() %s.\n",
 		NMXP_LOG_STR(net_dot_station_dot_channel));
@@ -108,139 +106,357 @@ int nmxp_chan_cpy_sta_chan(const char *net_dot_station_dot_channel, char *statio
 }
 
 
-/*
- * Match string against the extended regular expression in
- * pattern, treating errors as no match.
- *
- * return 1 for match, 0 for no match, -1 on error for invalid pattern, -2 on error for invalid station_dot_channel
- */
-int nmxp_chan_match(const char *net_dot_station_dot_channel, char *pattern)
+/* Match of one character c against the pattern token at *pp: '?', a class
+ * [abc], [a-z], [!abc] or a literal character. *pp is moved after the token. */
+static int nmxp_chan_glob_char(const char **pp, char c, int nocase)
 {
-    int ret = 0;
-    int i, l;
-    char sta_pattern[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char cha_pattern[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char net_pattern[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char loc_pattern[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char sta_sdc[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char *cha_sdc;
+    const char *p = *pp;
+    int match = 0;
+    int negate = 0;
+    char lo, hi;
 
-    /* validate pattern channel */
-    if(!nmxp_chan_cpy_sta_chan(pattern, sta_pattern, cha_pattern, net_pattern, loc_pattern)) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s is not in STA.CHAN format!\n",
-		NMXP_LOG_STR(pattern));
-	return -1;
+    if(*p == 0) {
+	return 0;
     }
 
-    l = strlen(loc_pattern);
-    i = 0;
-    while(i < l  &&  ret != -1) {
-	if(  !(
-		(loc_pattern[i] >= 'A'  &&  loc_pattern[i] <= 'Z')
-		|| (loc_pattern[i] >= 'a'  &&  loc_pattern[i] <= 'z')
-		|| (loc_pattern[i] >= '0'  &&  loc_pattern[i] <= '9')
-		|| (loc_pattern[i] == '-')
-		)
-	  ) {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid LOC format!\n",
-		    NMXP_LOG_STR(pattern));
-	    return -1;
+    if(nocase) {
+	c = toupper((unsigned char) c);
+    }
+
+    if(*p == '?') {
+	*pp = p + 1;
+	return 1;
+    }
+
+    if(*p == '['  &&  strchr(p + 1, ']') != NULL) {
+	p++;
+	if(*p == '!') {
+	    negate = 1;
+	    p++;
+	}
+	while(*p != ']'  &&  *p != 0) {
+	    lo = hi = *p++;
+	    if(*p == '-'  &&  p[1] != ']'  &&  p[1] != 0) {
+		hi = p[1];
+		p += 2;
+	    }
+	    if(nocase) {
+		lo = toupper((unsigned char) lo);
+		hi = toupper((unsigned char) hi);
+	    }
+	    if(c >= lo  &&  c <= hi) {
+		match = 1;
+	    }
 	}
-	i++;
+	*pp = (*p == ']')? p + 1 : p;
+	return (match != negate);
     }
-    
-    l = strlen(net_pattern);
-    i = 0;
-    while(i < l  &&  ret != -1) {
-	if(  !(
-		(net_pattern[i] >= 'A'  &&  net_pattern[i] <= 'Z')
-		|| (net_pattern[i] >= 'a'  &&  net_pattern[i] <= 'z')
-		|| (net_pattern[i] >= '0'  &&  net_pattern[i] <= '9')
-		)
-	  ) {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid NET format!\n",
-		    NMXP_LOG_STR(pattern));
-	    return -1;
+
+    *pp = p + 1;
+    return ((nocase)? toupper((unsigned char) *p) : *p) == c;
+}
+
+
+/* Glob matching of s against p, '*' backtracks to the last star only */
+static int nmxp_chan_glob(const char *p, const char *s, int nocase)
+{
+    const char *p_star = NULL;
+    const char *s_star = NULL;
+    const char *q;
+
+    while(*s != 0) {
+	if(*p == '*') {
+	    while(*p == '*') {
+		p++;
+	    }
+	    p_star = p;
+	    s_star = s;
+	} else {
+	    q = p;
+	    if(nmxp_chan_glob_char(&q, *s, nocase)) {
+		p = q;
+		s++;
+	    } else if(p_star) {
+		p = p_star;
+		s = ++s_star;
+	    } else {
+		return 0;
+	    }
 	}
-	i++;
     }
-    
-    l = strlen(sta_pattern);
-    if(((l == 1) && sta_pattern[0] == '*')) {
-	/* do nothing */
-    } else {
-    i = 0;
-    while(i < l  &&  ret != -1) {
+
+    while(*p == '*') {
+	p++;
+    }
+
+    return (*p == 0);
+}
+
+
+/* Check characters of a pattern field, glob characters are allowed when glob is not NULL */
+static int nmxp_chan_pattern_valid(const char *field, const char *extra, const char *glob)
+{
+    int i;
+
+    for(i = 0; field[i] != 0; i++) {
 	if(  !(
-		(sta_pattern[i] >= 'A'  &&  sta_pattern[i] <= 'Z')
-		|| (sta_pattern[i] >= 'a'  &&  sta_pattern[i] <= 'z')
-		|| (sta_pattern[i] >= '0'  &&  sta_pattern[i] <= '9')
-		|| (sta_pattern[i] == '_' )
-	     )
+		    (field[i] >= 'A'  &&  field[i] <= 'Z')
+		    || (field[i] >= 'a'  &&  field[i] <= 'z')
+		    || strchr(extra, field[i]) != NULL
+		    || (glob  &&  strchr(glob, field[i]) != NULL)
+	      )
 	  ) {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid STA format!\n",
-		    NMXP_LOG_STR(pattern));
-	    return -1;
+	    return 0;
 	}
-	i++;
     }
+
+    return 1;
+}
+
+
+/* Parse and validate a single pattern. Return 1 on success, 0 for invalid pattern */
+static int nmxp_chan_pattern_set(NMXP_CHAN_PATTERN *pat, const char *pattern)
+{
+    strncpy(pat->pattern, pattern, NMXP_CHAN_MAX_SIZE_PATTERN - 1);
+    pat->pattern[NMXP_CHAN_MAX_SIZE_PATTERN - 1] = 0;
+
+    /* validate pattern channel */
+    if(!nmxp_chan_cpy_sta_chan(pattern, pat->station, pat->channel, pat->network, pat->location)) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s is not in STA.CHAN format!\n",
+		NMXP_LOG_STR(pattern));
+	return 0;
+    }
+    pat->station[NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1] = 0;
+    pat->channel[NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1] = 0;
+    pat->network[NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1] = 0;
+    pat->location[NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1] = 0;
+
+    if(!nmxp_chan_pattern_valid(pat->location, "0123456789-", NULL)) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid LOC format!\n",
+		NMXP_LOG_STR(pattern));
+	return 0;
+    }
+
+    if(!nmxp_chan_pattern_valid(pat->network, "0123456789", NULL)) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid NET format!\n",
+		NMXP_LOG_STR(pattern));
+	return 0;
+    }
+
+    if(pat->station[0] == 0  ||  !nmxp_chan_pattern_valid(pat->station, "0123456789_", "*?[]!-")) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid STA format!\n",
+		NMXP_LOG_STR(pattern));
+	return 0;
     }
-    
-    l = strlen(cha_pattern);
-    if(l != 3) {
+
+    /* Without '*' or classes a channel pattern matches exactly three characters */
+    if( (strpbrk(pat->channel, "*[") == NULL  &&  strlen(pat->channel) != 3)
+	    ||  !nmxp_chan_pattern_valid(pat->channel, "_?", "*[]!-") ) {
 	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid CHAN format!\n",
 		NMXP_LOG_STR(pattern));
+	return 0;
+    }
+
+    pat->station_glob = (strpbrk(pat->station, "*?[") != NULL);
+
+    return 1;
+}
+
+
+/* Split a channel name STA.CHAN. Return 1 on success, 0 if not in STA.CHAN format, -1 for invalid CHAN */
+static int nmxp_chan_split_name(const char *name, char *station_code, char *channel_code)
+{
+    const char *period = strchr(name, '.');
+    int l;
+
+    if(period == NULL) {
+	return 0;
+    }
+
+    l = period - name;
+    if(l >= NMXP_CHAN_MAX_SIZE_STR_PATTERN) {
+	l = NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1;
+    }
+    strncpy(station_code, name, l);
+    station_code[l] = 0;
+    strncpy(channel_code, period + 1, NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1);
+    channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN - 1] = 0;
+
+    if(strlen(channel_code) != 3) {
 	return -1;
     }
-    i = 0;
-    while(i < l  &&  ret != -1) {
-	if(  !(
-		    (cha_pattern[i] >= 'A'  &&  cha_pattern[i] <= 'Z')
-		    || (cha_pattern[i] >= 'a'  &&  cha_pattern[i] <= 'z')
-		    || (cha_pattern[i] == '_' )
-		    || (cha_pattern[i] == '?' )
-	      )
-	  ) {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel pattern %s has not valid CHAN format!\n",
-		    NMXP_LOG_STR(pattern));
-	    return -1;
+
+    return 1;
+}
+
+
+/* Comparison of patterns with literal station, by station and then by position */
+static int chan_pattern_literal_compare(const void *a, const void *b)
+{
+    const NMXP_CHAN_PATTERN *pa = *((const NMXP_CHAN_PATTERN **) a);
+    const NMXP_CHAN_PATTERN *pb = *((const NMXP_CHAN_PATTERN **) b);
+    int ret = strcasecmp(pa->station, pb->station);
+
+    if(ret == 0) {
+	ret = (pa < pb)? -1 : ((pa > pb)? 1 : 0);
+    }
+    return ret;
+}
+
+
+int nmxp_chan_pattern_compile(NMXP_CHAN_PATTERN_LIST *plist, const char *sta_chan_list)
+{
+    int istalist, ista;
+    int n_max = 1;
+    char sta_chan_code_pattern[NMXP_CHAN_MAX_SIZE_PATTERN];
+    NMXP_CHAN_PATTERN *pat;
+
+    plist->number = 0;
+    plist->pattern = NULL;
+    plist->n_literal = 0;
+    plist->literal = NULL;
+    plist->n_glob = 0;
+    plist->glob = NULL;
+
+    for(istalist = 0; sta_chan_list[istalist] != 0; istalist++) {
+	if(sta_chan_list[istalist] == sep_chan_list) {
+	    n_max++;
 	}
-	i++;
     }
 
-    strncpy(sta_sdc, net_dot_station_dot_channel, NMXP_CHAN_MAX_SIZE_STR_PATTERN);
-    if( (cha_sdc = strchr(sta_sdc, '.')) == NULL ) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel %s is not in STA.CHAN format!\n",
-		NMXP_LOG_STR(net_dot_station_dot_channel));
-	return -2;
+    plist->pattern = (NMXP_CHAN_PATTERN *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_PATTERN) * n_max);
+    plist->literal = (NMXP_CHAN_PATTERN **) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_PATTERN *) * n_max);
+    plist->glob = (NMXP_CHAN_PATTERN **) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_PATTERN *) * n_max);
+    if(plist->pattern == NULL  ||  plist->literal == NULL  ||  plist->glob == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating %d channel patterns.\n", n_max);
+	nmxp_chan_pattern_free(plist);
+	return -1;
     }
-    if(cha_sdc) {
-	*cha_sdc++ = '\0';
+
+    istalist = 0;
+    while(sta_chan_list[istalist] != 0) {
+
+	/* Build sta_chan_code_pattern from sta_chan_list */
+	ista = 0;
+	while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0) {
+	    if(ista < NMXP_CHAN_MAX_SIZE_PATTERN - 1) {
+		sta_chan_code_pattern[ista++] = sta_chan_list[istalist];
+	    }
+	    istalist++;
+	}
+	sta_chan_code_pattern[ista] = 0;
+	if(sta_chan_list[istalist] == sep_chan_list) {
+	    istalist++;
+	}
+
+	if(ista > 0) {
+	    pat = &(plist->pattern[plist->number]);
+	    if(nmxp_chan_pattern_set(pat, sta_chan_code_pattern)) {
+		if(pat->station_glob) {
+		    plist->glob[plist->n_glob++] = pat;
+		} else {
+		    plist->literal[plist->n_literal++] = pat;
+		}
+		plist->number++;
+	    }
+	}
     }
-    l = strlen(cha_sdc);
-    if(l != 3) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel %s has not valid CHAN format!\n",
-		NMXP_LOG_STR(net_dot_station_dot_channel));
-	return -1;
+
+    qsort(plist->literal, plist->n_literal, sizeof(NMXP_CHAN_PATTERN *), chan_pattern_literal_compare);
+
+    return plist->number;
+}
+
+
+void nmxp_chan_pattern_free(NMXP_CHAN_PATTERN_LIST *plist)
+{
+    if(plist->pattern) {
+	NMXP_MEM_FREE(plist->pattern);
     }
+    if(plist->literal) {
+	NMXP_MEM_FREE(plist->literal);
+    }
+    if(plist->glob) {
+	NMXP_MEM_FREE(plist->glob);
+    }
+    plist->number = 0;
+    plist->n_literal = 0;
+    plist->n_glob = 0;
+}
 
-    l = strlen(sta_pattern);
-    if ( (strcasecmp(sta_sdc, sta_pattern) == 0) 
-	    || ((l == 1) && sta_pattern[0] == '*')) {
-	/* matching CHAN */
-	ret = 1;
-	i = 0;
-	while(i < 3  &&  ret != 0) {
-	    ret = ((cha_pattern[i] == '?')? 1 : (cha_pattern[i] == cha_sdc[i]));
-	    i++;
+
+int nmxp_chan_pattern_match_next(const NMXP_CHAN_PATTERN_LIST *plist, const char *station_code, const char *channel_code, int after)
+{
+    int ret = -1;
+    int i, idx, lo, hi, mid;
+
+    /* Patterns with literal station, binary search of the first one equal to station_code */
+    lo = 0;
+    hi = plist->n_literal;
+    while(lo < hi) {
+	mid = (lo + hi) / 2;
+	if(strcasecmp(plist->literal[mid]->station, station_code) < 0) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    for(i = lo; ret == -1  &&  i < plist->n_literal  &&  strcasecmp(plist->literal[i]->station, station_code) == 0; i++) {
+	idx = plist->literal[i] - plist->pattern;
+	if(idx > after  &&  nmxp_chan_glob(plist->literal[i]->channel, channel_code, 0)) {
+	    ret = idx;
 	}
     }
 
+    /* Patterns with wildcards in the station, in the order of the list */
+    for(i = 0; i < plist->n_glob; i++) {
+	idx = plist->glob[i] - plist->pattern;
+	if(ret != -1  &&  idx >= ret) {
+	    break;
+	}
+	if(idx > after
+		&&  nmxp_chan_glob(plist->glob[i]->station, station_code, 1)
+		&&  nmxp_chan_glob(plist->glob[i]->channel, channel_code, 0)) {
+	    ret = idx;
+	}
+    }
 
     return ret;
 }
 
 
+/*
+ * Match string against the extended regular expression in
+ * pattern, treating errors as no match.
+ *
+ * return 1 for match, 0 for no match, -1 on error for invalid pattern, -2 on error for invalid station_dot_channel
+ */
+int nmxp_chan_match(const char *net_dot_station_dot_channel, char *pattern)
+{
+    NMXP_CHAN_PATTERN pat;
+    char sta_sdc[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char cha_sdc[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    int ret;
+
+    if(!nmxp_chan_pattern_set(&pat, pattern)) {
+	return -1;
+    }
+
+    ret = nmxp_chan_split_name(net_dot_station_dot_channel, sta_sdc, cha_sdc);
+    if(ret == 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel %s is not in STA.CHAN format!\n",
+		NMXP_LOG_STR(net_dot_station_dot_channel));
+	return -2;
+    } else if(ret == -1) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel %s has not valid CHAN format!\n",
+		NMXP_LOG_STR(net_dot_station_dot_channel));
+	return -1;
+    }
+
+    return (nmxp_chan_glob(pat.station, sta_sdc, 1)  &&  nmxp_chan_glob(pat.channel, cha_sdc, 0));
+}
+
+
 int nmxp_chan_lookupKey(char* name, NMXP_CHAN_LIST *channelList)
 {
     int chan_number = channelList->number;
@@ -256,44 +472,296 @@ int nmxp_chan_lookupKey(char* name, NMXP_CHAN_LIST *channelList)
 }
 
 
-int nmxp_chan_lookupKeyIndex(int32_t key, NMXP_CHAN_LIST_NET *channelList)
+/* Multiplicative hashing, upper bits folded into the lower ones addressing hash_size slots */
+#define NMXP_CHAN_HASH_SLOT(key, hash_size) ((int) ((((uint32_t) (key) * 2654435761U) ^ (((uint32_t) (key) * 2654435761U) >> 16)) & ((hash_size) - 1)))
+
+static void nmxp_chan_identity_set(NMXP_CHAN_KEY_NET *chan)
 {
-    int i_chan = 0;
-    int ret = -1;
+    char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char network_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char location_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
 
-    i_chan = 0;
-    while(i_chan < channelList->number  &&  ret == -1)
-    {
-	if ( key == channelList->channel[i_chan].key ) {
-	    ret = i_chan;
+    if(!nmxp_chan_cpy_sta_chan(chan->name, station_code, channel_code, network_code, location_code)) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel name not in STA.CHAN format: %s\n",
+		NMXP_LOG_STR(chan->name));
+    }
+
+    snprintf(chan->network, NMXP_DATA_NETWORK_LENGTH, "%.*s", NMXP_DATA_NETWORK_LENGTH - 1, network_code);
+    snprintf(chan->station, NMXP_DATA_STATION_LENGTH, "%.*s", NMXP_DATA_STATION_LENGTH - 1, station_code);
+    snprintf(chan->channel, NMXP_DATA_CHANNEL_LENGTH, "%.*s", NMXP_DATA_CHANNEL_LENGTH - 1, channel_code);
+    snprintf(chan->location, NMXP_DATA_LOCATION_LENGTH, "%.*s", NMXP_DATA_LOCATION_LENGTH - 1, location_code);
+
+    if(chan->network[0] != 0) {
+	snprintf(chan->station_id, NMXP_CHAN_MAX_SIZE_STATION_ID, "%s.%s", chan->network, chan->station);
+	chan->i_station_id = strlen(chan->network) + 1;
+    } else {
+	snprintf(chan->station_id, NMXP_CHAN_MAX_SIZE_STATION_ID, "%s", chan->station);
+	chan->i_station_id = 0;
+    }
+}
+
+
+static void nmxp_chan_hash_add(NMXP_CHAN_LIST_NET *channelList, int i_chan)
+{
+    int slot = NMXP_CHAN_HASH_SLOT(channelList->channel[i_chan].key, channelList->hash_size);
+
+    nmxp_chan_identity_set(&(channelList->channel[i_chan]));
+
+    while(channelList->hash[slot] != 0) {
+	slot = (slot + 1) & (channelList->hash_size - 1);
+    }
+    channelList->hash[slot] = i_chan + 1;
+    channelList->hash_number++;
+}
+
+
+/* Slot of the hash containing i_chan, -1 if not found */
+static int nmxp_chan_hash_find(const NMXP_CHAN_LIST_NET *channelList, int i_chan)
+{
+    int slot = NMXP_CHAN_HASH_SLOT(channelList->channel[i_chan].key, channelList->hash_size);
+
+    while(channelList->hash[slot] != 0  &&  channelList->hash[slot] != i_chan + 1) {
+	slot = (slot + 1) & (channelList->hash_size - 1);
+    }
+
+    return (channelList->hash[slot] != 0)? slot : -1;
+}
+
+
+/* Empty a slot of the hash and move back the following items of the same
+ * cluster that would not be reached anymore by linear probing */
+static void nmxp_chan_hash_del(NMXP_CHAN_LIST_NET *channelList, int slot)
+{
+    int mask = channelList->hash_size - 1;
+    int next = slot;
+    int home;
+
+    channelList->hash[slot] = 0;
+    channelList->hash_number--;
+
+    next = (next + 1) & mask;
+    while(channelList->hash[next] != 0) {
+	home = NMXP_CHAN_HASH_SLOT(channelList->channel[channelList->hash[next] - 1].key, channelList->hash_size);
+	/* Move it when home is not cyclically in (slot, next] */
+	if( (slot <= next)? (home <= slot  ||  home > next) : (home <= slot  &&  home > next) ) {
+	    channelList->hash[slot] = channelList->hash[next];
+	    channelList->hash[next] = 0;
+	    slot = next;
 	}
-	i_chan++;
+	next = (next + 1) & mask;
     }
+}
 
-    return ret;
+
+/* Allocate channel items for size channels at least and index them. Return 0 on success. */
+static int nmxp_chan_list_net_reserve(NMXP_CHAN_LIST_NET *channelList, int32_t size)
+{
+    NMXP_CHAN_KEY_NET *channel = NULL;
+
+    if(size <= channelList->size) {
+	return 0;
+    }
+
+    channel = (NMXP_CHAN_KEY_NET *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_KEY_NET) * size);
+    if(channel == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel list of %d items.\n", size);
+	return -1;
+    }
+
+    if(channelList->channel) {
+	memcpy(channel, channelList->channel, sizeof(NMXP_CHAN_KEY_NET) * channelList->number);
+	NMXP_MEM_FREE(channelList->channel);
+    }
+    channelList->channel = channel;
+    channelList->size = size;
+
+    nmxp_chan_hash_build(channelList);
+
+    return (channelList->hash_number == channelList->number)? 0 : -1;
 }
 
 
-char *nmxp_chan_lookupName(int32_t key, NMXP_CHAN_LIST_NET *channelList)
+NMXP_CHAN_LIST_NET *nmxp_chan_list_net_new(int32_t size)
 {
-    int i_chan = 0;
-    char *ret = (char *) NMXP_MEM_MALLOC(NMXP_CHAN_MAX_SIZE_NAME);
+    NMXP_CHAN_LIST_NET *channelList = (NMXP_CHAN_LIST_NET *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_LIST_NET));
 
-    ret[0] = 0;
+    if(channelList == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel list.\n");
+	return NULL;
+    }
 
-    for (i_chan = 0; i_chan < channelList->number; i_chan++)
-    {
+    channelList->number = 0;
+    channelList->size = 0;
+    channelList->channel = NULL;
+    channelList->hash_number = 0;
+    channelList->hash_size = 0;
+    channelList->hash = NULL;
+
+    if(nmxp_chan_list_net_reserve(channelList, (size > 0)? size : NMXP_CHAN_LIST_NET_DEFAULT_SIZE) != 0) {
+	nmxp_chan_list_net_free(&channelList);
+	return NULL;
+    }
+
+    return channelList;
+}
+
+
+int nmxp_chan_list_net_add(NMXP_CHAN_LIST_NET *channelList, int32_t key, const char *name)
+{
+    int i_chan = channelList->number;
+
+    if(i_chan >= channelList->size) {
+	if(nmxp_chan_list_net_reserve(channelList, channelList->size * 2) != 0) {
+	    return -1;
+	}
+    }
+
+    /* The index has to be complete before adding the new item */
+    if(channelList->hash_number != channelList->number) {
+	nmxp_chan_hash_build(channelList);
+	if(channelList->hash_number != channelList->number) {
+	    return -1;
+	}
+    }
+
+    if(nmxp_chan_lookupKeyIndex(key, channelList) != -1) {
+	return -1;
+    }
+
+    channelList->channel[i_chan].key = key;
+    strncpy(channelList->channel[i_chan].name, name, NMXP_CHAN_MAX_SIZE_NAME - 1);
+    channelList->channel[i_chan].name[NMXP_CHAN_MAX_SIZE_NAME - 1] = 0;
+    nmxp_chan_hash_add(channelList, i_chan);
+    channelList->number++;
+
+    return i_chan;
+}
+
+
+int nmxp_chan_list_net_remove(NMXP_CHAN_LIST_NET *channelList, int i_chan)
+{
+    int i_last = channelList->number - 1;
+    int indexed;
+    int slot;
+
+    if(i_chan < 0  ||  i_chan > i_last) {
+	return -1;
+    }
+
+    indexed = (channelList->hash != NULL  &&  channelList->hash_number == channelList->number);
+
+    if(indexed) {
+	slot = nmxp_chan_hash_find(channelList, i_chan);
+	if(slot != -1) {
+	    nmxp_chan_hash_del(channelList, slot);
+	}
+	if(i_last != i_chan) {
+	    slot = nmxp_chan_hash_find(channelList, i_last);
+	    if(slot != -1) {
+		channelList->hash[slot] = i_chan + 1;
+	    }
+	}
+    }
+
+    if(i_last != i_chan) {
+	channelList->channel[i_chan] = channelList->channel[i_last];
+    }
+    channelList->number--;
+
+    if(!indexed) {
+	channelList->hash_number = -1;
+    }
+
+    return i_last;
+}
+
+
+void nmxp_chan_list_net_free(NMXP_CHAN_LIST_NET **pchannelList)
+{
+    if(*pchannelList) {
+	if((*pchannelList)->channel) {
+	    NMXP_MEM_FREE((*pchannelList)->channel);
+	}
+	if((*pchannelList)->hash) {
+	    NMXP_MEM_FREE((*pchannelList)->hash);
+	}
+	NMXP_MEM_FREE(*pchannelList);
+	*pchannelList = NULL;
+    }
+}
+
+
+void nmxp_chan_hash_build(NMXP_CHAN_LIST_NET *channelList)
+{
+    int i_chan;
+    int32_t hash_size = 1;
+
+    channelList->hash_number = -1;
+
+    /* Keep less than half of the slots used, for short probe sequences */
+    if(channelList->hash_size <= 2 * channelList->size  ||  channelList->hash_size <= 2 * channelList->number) {
+	while(hash_size <= 2 * channelList->size  ||  hash_size <= 2 * channelList->number) {
+	    hash_size *= 2;
+	}
+	if(channelList->hash) {
+	    NMXP_MEM_FREE(channelList->hash);
+	}
+	channelList->hash_size = 0;
+	channelList->hash = (int32_t *) NMXP_MEM_MALLOC(sizeof(int32_t) * hash_size);
+	if(channelList->hash == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel index of %d slots.\n", hash_size);
+	    return;
+	}
+	channelList->hash_size = hash_size;
+    }
+
+    memset(channelList->hash, 0, sizeof(int32_t) * channelList->hash_size);
+    channelList->hash_number = 0;
+    for(i_chan = 0; i_chan < channelList->number; i_chan++) {
+	nmxp_chan_hash_add(channelList, i_chan);
+    }
+}
+
+
+int nmxp_chan_lookupKeyIndex(int32_t key, const NMXP_CHAN_LIST_NET *channelList)
+{
+    int i_chan = 0;
+    int slot;
+
+    if(channelList->hash  &&  channelList->hash_number == channelList->number) {
+	slot = NMXP_CHAN_HASH_SLOT(key, channelList->hash_size);
+	while(channelList->hash[slot] != 0) {
+	    i_chan = channelList->hash[slot] - 1;
+	    if(i_chan < channelList->number  &&  key == channelList->channel[i_chan].key) {
+		return i_chan;
+	    }
+	    slot = (slot + 1) & (channelList->hash_size - 1);
+	}
+	return -1;
+    }
+
+    for(i_chan = 0; i_chan < channelList->number; i_chan++) {
 	if ( key == channelList->channel[i_chan].key ) {
-	    strncpy(ret, channelList->channel[i_chan].name, NMXP_CHAN_MAX_SIZE_NAME);
+	    return i_chan;
 	}
     }
 
-    if(ret[0] == 0) {
-	NMXP_MEM_FREE(ret);
-	return NULL;
-    } else {
-	return ret;
+    return -1;
+}
+
+
+char *nmxp_chan_lookupName(int32_t key, NMXP_CHAN_LIST_NET *channelList)
+{
+    int i_chan = nmxp_chan_lookupKeyIndex(key, channelList);
+    char *ret = NULL;
+
+    if(i_chan != -1) {
+	ret = (char *) NMXP_MEM_MALLOC(NMXP_CHAN_MAX_SIZE_NAME);
+	strncpy(ret, channelList->channel[i_chan].name, NMXP_CHAN_MAX_SIZE_NAME);
     }
+
+    return ret;
 }
 
 
@@ -303,14 +771,15 @@ NMXP_CHAN_LIST *nmxp_chan_getType(NMXP_CHAN_LIST *channelList, NMXP_DATATYPE dat
     int chan_number = channelList->number;
     int i_chan = 0;
 
-    ret_channelList = (NMXP_CHAN_LIST *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_LIST));
+    ret_channelList = (NMXP_CHAN_LIST *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_LIST) + sizeof(NMXP_CHAN_KEY) * chan_number);
     ret_channelList->number = 0;
 
     for (i_chan = 0; i_chan < chan_number; i_chan++)
     {
 	if ( getDataTypeFromKey(channelList->channel[i_chan].key) == dataType) {
 	    ret_channelList->channel[ret_channelList->number].key = channelList->channel[i_chan].key;
-	    strncpy(ret_channelList->channel[ret_channelList->number].name, channelList->channel[i_chan].name, NMXP_CHAN_MAX_SIZE_NAME);
+	    memcpy(ret_channelList->channel[ret_channelList->number].name, channelList->channel[i_chan].name,
+		    sizeof(channelList->channel[i_chan].name));
 	    ret_channelList->number++;
 	}
     }
@@ -321,88 +790,104 @@ NMXP_CHAN_LIST *nmxp_chan_getType(NMXP_CHAN_LIST *channelList, NMXP_DATATYPE dat
 
 NMXP_CHAN_LIST_NET *nmxp_chan_subset(NMXP_CHAN_LIST *channelList, NMXP_DATATYPE dataType, char *sta_chan_list, const char *network_code_default, const char *location_code_default) {
     NMXP_CHAN_LIST_NET *ret_channelList = NULL;
-    int istalist, ista;
-    char sta_chan_code_pattern[100];
-    int i_chan, ret_match;
-    char network_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    NMXP_CHAN_PATTERN_LIST plist;
+    NMXP_CHAN_PATTERN *pat;
     char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
     char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    char location_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
-    int i_chan_found = -1;
-    int i_chan_duplicated = -1;
-    char *nmxp_channel_name = NULL;
-    char nmxp_channel_name_duplicated[50];
+    int i_chan, i_pat, i_dup;
+    int *chan_pattern = NULL;	/* Pattern kept for each channel, -1 for none */
+    int *pat_found = NULL;	/* Number of channels kept by each pattern, then position of its first one */
+    int *pat_duplicated = NULL;	/* Number of channels of each pattern kept by a previous one */
+    int *chan_order = NULL;
+    int n_found = 0;
+    char name[NMXP_CHAN_MAX_SIZE_NAME];
+
+    ret_channelList = nmxp_chan_list_net_new(0);
+    if(ret_channelList == NULL) {
+	return NULL;
+    }
 
-    ret_channelList = (NMXP_CHAN_LIST_NET *) NMXP_MEM_MALLOC(sizeof(NMXP_CHAN_LIST_NET));
-    ret_channelList->number = 0;
+    if(nmxp_chan_pattern_compile(&plist, sta_chan_list) <= 0) {
+	nmxp_chan_pattern_free(&plist);
+	return ret_channelList;
+    }
 
-    istalist = 0;
-    while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0) {
-	
-	/* Build sta_chan_code_pattern from sta_chan_list */
-	ista = 0;
-	while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0) {
-	    sta_chan_code_pattern[ista++] = sta_chan_list[istalist++];
+    chan_pattern = (int *) NMXP_MEM_MALLOC(sizeof(int) * (channelList->number + 1));
+    chan_order = (int *) NMXP_MEM_MALLOC(sizeof(int) * (channelList->number + 1));
+    pat_found = (int *) NMXP_MEM_MALLOC(sizeof(int) * (plist.number + 1));
+    pat_duplicated = (int *) NMXP_MEM_MALLOC(sizeof(int) * plist.number);
+    memset(pat_found, 0, sizeof(int) * (plist.number + 1));
+    memset(pat_duplicated, 0, sizeof(int) * plist.number);
+
+    /* Single pass over the channel list, each channel is kept by the first pattern matching it */
+    for(i_chan = 0; i_chan < channelList->number; i_chan++) {
+	chan_pattern[i_chan] = -1;
+	if(getDataTypeFromKey(channelList->channel[i_chan].key) != dataType
+		||  nmxp_chan_split_name(channelList->channel[i_chan].name, station_code, channel_code) != 1) {
+	    continue;
 	}
-	sta_chan_code_pattern[ista] = 0;
-	if(sta_chan_list[istalist] == sep_chan_list) {
-	    istalist++;
+	i_pat = nmxp_chan_pattern_match_next(&plist, station_code, channel_code, -1);
+	if(i_pat != -1) {
+	    chan_pattern[i_chan] = i_pat;
+	    pat_found[i_pat]++;
+	    n_found++;
+	    i_dup = i_pat;
+	    while( (i_dup = nmxp_chan_pattern_match_next(&plist, station_code, channel_code, i_dup)) != -1) {
+		/* Warning message for duplication */
+		pat = &(plist.pattern[i_pat]);
+		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "Pattern %s duplicates %s. Kept %s.%s.%s (%d, Key %d).\n",
+			plist.pattern[i_dup].pattern,
+			channelList->channel[i_chan].name,
+			(pat->network[0] != 0)? pat->network : network_code_default,
+			channelList->channel[i_chan].name,
+			(pat->location[0] != 0)? pat->location : location_code_default,
+			i_chan, channelList->channel[i_chan].key);
+		pat_duplicated[i_dup]++;
+	    }
 	}
+    }
 
-	/* Match name to sta_chan_code_pattern and set i_chan_found */
-	nmxp_channel_name = NULL;
-	nmxp_channel_name_duplicated[0] = 0;
-	i_chan_found = -1;
-	i_chan_duplicated = -1;
-	ret_match = 1;
-	i_chan = 0;
-	while(i_chan < channelList->number && ret_match != -1) {
-	    ret_match = nmxp_chan_match(channelList->channel[i_chan].name, sta_chan_code_pattern);
-	    if(ret_match == 1) {
-		    if(getDataTypeFromKey(channelList->channel[i_chan].key) == dataType) {
-			/* Check for channel duplication */
-			nmxp_channel_name = nmxp_chan_lookupName(channelList->channel[i_chan].key, ret_channelList);
-			if(nmxp_channel_name == NULL) {
-			    /* Add channel */
-			    i_chan_found = i_chan;
-			    ret_channelList->channel[ret_channelList->number].key =        channelList->channel[i_chan_found].key;
-			    strncpy(ret_channelList->channel[ret_channelList->number].name, channelList->channel[i_chan_found].name, NMXP_CHAN_MAX_SIZE_NAME);
-			    nmxp_chan_cpy_sta_chan(sta_chan_code_pattern, station_code, channel_code, network_code, location_code);
-			    snprintf(ret_channelList->channel[ret_channelList->number].name, NMXP_CHAN_MAX_SIZE_NAME, "%s.%s.%s",
-				    (network_code[0] != 0)? network_code : network_code_default, channelList->channel[i_chan_found].name,
-				    (location_code[0] != 0)? location_code : location_code_default );
-			    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Added %s for %s .\n",
-				    ret_channelList->channel[ret_channelList->number].name, sta_chan_code_pattern);
-			    ret_channelList->number++;
-			} else {
-			    strncpy(nmxp_channel_name_duplicated, nmxp_channel_name, 50);
-			    i_chan_duplicated = i_chan;
-
-			    if(i_chan_duplicated != -1) {
-				/* Warning message for duplication */
-				nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "Pattern %s duplicates %s. Kept %s. (%d, Key %d).\n",
-					sta_chan_code_pattern,
-					channelList->channel[i_chan_duplicated].name,
-					NMXP_LOG_STR(nmxp_channel_name_duplicated),
-					i_chan_duplicated, channelList->channel[i_chan_duplicated].key);
-			    }
-
-			    NMXP_MEM_FREE(nmxp_channel_name);
-			    nmxp_channel_name = NULL;
-			}
-		    }
-	    }
-	    i_chan++;
+    /* Channels grouped by pattern in the order of the list, as requested */
+    for(i_pat = plist.number; i_pat > 0; i_pat--) {
+	pat_found[i_pat] = pat_found[i_pat - 1];
+    }
+    pat_found[0] = 0;
+    for(i_pat = 1; i_pat <= plist.number; i_pat++) {
+	pat_found[i_pat] += pat_found[i_pat - 1];
+    }
+    for(i_chan = 0; i_chan < channelList->number; i_chan++) {
+	if(chan_pattern[i_chan] != -1) {
+	    chan_order[pat_found[chan_pattern[i_chan]]++] = i_chan;
+	}
+    }
+
+    for(i_pat = 0; i_pat < n_found; i_pat++) {
+	i_chan = chan_order[i_pat];
+	pat = &(plist.pattern[chan_pattern[i_chan]]);
+	snprintf(name, NMXP_CHAN_MAX_SIZE_NAME, "%s.%s.%s",
+		(pat->network[0] != 0)? pat->network : network_code_default, channelList->channel[i_chan].name,
+		(pat->location[0] != 0)? pat->location : location_code_default );
+	if(nmxp_chan_list_net_add(ret_channelList, channelList->channel[i_chan].key, name) != -1) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Added %s for %s .\n",
+		    NMXP_LOG_STR(name), pat->pattern);
 	}
+    }
 
-	if(i_chan_found == -1  &&  i_chan_duplicated == -1) {
+    /* pat_found[i_pat] is now the end of the channels of i_pat, the start of i_pat + 1 */
+    for(i_pat = 0; i_pat < plist.number; i_pat++) {
+	if(pat_found[i_pat] == ((i_pat > 0)? pat_found[i_pat - 1] : 0)  &&  pat_duplicated[i_pat] == 0) {
 	    /* Error message for channel not found of channel is not dataType */
 	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Pattern %s does not match to any key.\n",
-		    sta_chan_code_pattern);
+		    plist.pattern[i_pat].pattern);
 	}
-
     }
-    
+
+    NMXP_MEM_FREE(chan_pattern);
+    NMXP_MEM_FREE(chan_order);
+    NMXP_MEM_FREE(pat_found);
+    NMXP_MEM_FREE(pat_duplicated);
+    nmxp_chan_pattern_free(&plist);
+
     return ret_channelList;
 }
 
@@ -468,10 +953,14 @@ void nmxp_chan_print_channelList_with_match(NMXP_CHAN_LIST *channelList, char *s
     int chan_number = 0;
     int i_chan = 0;
     int ret_match = 0;
-    int istalist, ista;
-    char sta_chan_code_pattern[100];
+    NMXP_CHAN_PATTERN_LIST plist;
+    char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
 
     if(channelList) {
+	if(sta_chan_list) {
+	    nmxp_chan_pattern_compile(&plist, sta_chan_list);
+	}
 	chan_number = channelList->number;
 	nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_CHANNEL, "%04d channels:\n", chan_number);
 
@@ -479,22 +968,8 @@ void nmxp_chan_print_channelList_with_match(NMXP_CHAN_LIST *channelList, char *s
 	{
 	    if(sta_chan_list) {
 
-		ret_match = 0;
-		istalist = 0;
-		while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0  &&  ret_match == 0) {
-
-		    /* Build sta_chan_code_pattern from sta_chan_list */
-		    ista = 0;
-		    while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0) {
-			sta_chan_code_pattern[ista++] = sta_chan_list[istalist++];
-		    }
-		    sta_chan_code_pattern[ista] = 0;
-		    if(sta_chan_list[istalist] == sep_chan_list) {
-			istalist++;
-		    }
-
-		    ret_match = nmxp_chan_match(channelList->channel[i_chan].name, sta_chan_code_pattern);
-		}
+		ret_match = (nmxp_chan_split_name(channelList->channel[i_chan].name, station_code, channel_code) == 1
+			&&  nmxp_chan_pattern_match_next(&plist, station_code, channel_code, -1) != -1);
 
 	    } else {
 		ret_match = 1;
@@ -515,6 +990,9 @@ void nmxp_chan_print_channelList_with_match(NMXP_CHAN_LIST *channelList, char *s
 		}
 	    }
 	}
+	if(sta_chan_list) {
+	    nmxp_chan_pattern_free(&plist);
+	}
     } else {
 	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel list is NULL.\n");
     }
@@ -539,32 +1017,26 @@ void nmxp_chan_print_netchannelList(NMXP_CHAN_LIST_NET *channelList) {
 
 
 void nmxp_meta_chan_free(NMXP_META_CHAN_LIST **chan_list) {
-    NMXP_META_CHAN_LIST *iter = *chan_list;
-    NMXP_META_CHAN_LIST *iter_next = NULL;
 
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_free()\n");
 
-    if(iter) {
-	iter_next = iter->next;
-	while(iter) {
-	    NMXP_MEM_FREE(iter);
-	    iter = iter_next;
-	    iter_next = iter->next;
+    if(*chan_list) {
+	if((*chan_list)->channel) {
+	    NMXP_MEM_FREE((*chan_list)->channel);
+	}
+	if((*chan_list)->hash) {
+	    NMXP_MEM_FREE((*chan_list)->hash);
 	}
+	NMXP_MEM_FREE(*chan_list);
 	*chan_list = NULL;
     }
 
 }
 
-int nmxp_meta_chan_compare(NMXP_META_CHAN_LIST *item1, NMXP_META_CHAN_LIST *item2, NMXP_META_CHAN_LIST_SORT_TYPE sorttype) {
+int nmxp_meta_chan_compare(const NMXP_META_CHAN *item1, const NMXP_META_CHAN *item2, NMXP_META_CHAN_LIST_SORT_TYPE sorttype) {
     int ret = 0;
     switch(sorttype) {
 	case NMXP_META_SORT_KEY:
-	    if(item1->key > item2->key) {
-		ret = 1;
-	    } else if(item1->key < item2->key) {
-		ret = -1;
-	    }
 	    break;
 	case NMXP_META_SORT_NAME:
 	    ret = strcmp(item1->name, item2->name);
@@ -587,85 +1059,206 @@ int nmxp_meta_chan_compare(NMXP_META_CHAN_LIST *item1, NMXP_META_CHAN_LIST *item
 	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Sort type %d not defined!\n", sorttype);
 	    break;
     }
+    /* Equal items ordered by key, qsort() is not stable */
+    if(ret == 0) {
+	if(item1->key > item2->key) {
+	    ret = 1;
+	} else if(item1->key < item2->key) {
+	    ret = -1;
+	}
+    }
     return ret;
 }
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_add(NMXP_META_CHAN_LIST **chan_list, int32_t key, char *name, int32_t start_time, int32_t end_time, char *network, NMXP_META_CHAN_LIST_SORT_TYPE sorttype) {
-    NMXP_META_CHAN_LIST *iter = NULL;
-    NMXP_META_CHAN_LIST *new_item = NULL;
+static int nmxp_meta_chan_compare_key(const void *a, const void *b) {
+    return nmxp_meta_chan_compare((const NMXP_META_CHAN *) a, (const NMXP_META_CHAN *) b, NMXP_META_SORT_KEY);
+}
+
+static int nmxp_meta_chan_compare_name(const void *a, const void *b) {
+    return nmxp_meta_chan_compare((const NMXP_META_CHAN *) a, (const NMXP_META_CHAN *) b, NMXP_META_SORT_NAME);
+}
+
+static int nmxp_meta_chan_compare_start_time(const void *a, const void *b) {
+    return nmxp_meta_chan_compare((const NMXP_META_CHAN *) a, (const NMXP_META_CHAN *) b, NMXP_META_SORT_START_TIME);
+}
+
+static int nmxp_meta_chan_compare_end_time(const void *a, const void *b) {
+    return nmxp_meta_chan_compare((const NMXP_META_CHAN *) a, (const NMXP_META_CHAN *) b, NMXP_META_SORT_END_TIME);
+}
+
+NMXP_META_CHAN *nmxp_meta_chan_add(NMXP_META_CHAN_LIST **chan_list, int32_t key, char *name, int32_t start_time, int32_t end_time, char *network) {
+    NMXP_META_CHAN *new_item = NULL;
+    NMXP_META_CHAN *channel = NULL;
+    int32_t size;
 
-    if(sorttype != NMXP_META_SORT_KEY  &&  sorttype != NMXP_META_SORT_NAME) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL,
-		"nmxp_meta_chan_add() can only accept NMXP_META_SORT_KEY or NMXP_META_SORT_NAME. Fixed NMXP_META_SORT_KEY!\n");
-	sorttype = NMXP_META_SORT_KEY;
+    if(*chan_list == NULL) {
+	*chan_list = (NMXP_META_CHAN_LIST *) NMXP_MEM_MALLOC(sizeof(NMXP_META_CHAN_LIST));
+	if(*chan_list == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel metadata list.\n");
+	    return NULL;
+	}
+	(*chan_list)->number = 0;
+	(*chan_list)->size = 0;
+	(*chan_list)->channel = NULL;
+	(*chan_list)->hash_number = -1;
+	(*chan_list)->hash_size = 0;
+	(*chan_list)->hash = NULL;
     }
 
-    new_item = (NMXP_META_CHAN_LIST *) NMXP_MEM_MALLOC(sizeof(NMXP_META_CHAN_LIST));
-    new_item->key = 0;
-    new_item->name[0] = 0;
-    new_item->start_time = 0;
-    new_item->end_time = 0;
-    new_item->network[0] = 0;
-    new_item->next = NULL;
+    if((*chan_list)->number >= (*chan_list)->size) {
+	size = ((*chan_list)->size > 0)? (*chan_list)->size * 2 : NMXP_META_CHAN_LIST_DEFAULT_SIZE;
+	channel = (NMXP_META_CHAN *) NMXP_MEM_MALLOC(sizeof(NMXP_META_CHAN) * size);
+	if(channel == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel metadata list of %d items.\n", size);
+	    return NULL;
+	}
+	if((*chan_list)->channel) {
+	    memcpy(channel, (*chan_list)->channel, sizeof(NMXP_META_CHAN) * (*chan_list)->number);
+	    NMXP_MEM_FREE((*chan_list)->channel);
+	}
+	(*chan_list)->channel = channel;
+	(*chan_list)->size = size;
+    }
+
+    new_item = &((*chan_list)->channel[(*chan_list)->number]);
+    memset(new_item, 0, sizeof(NMXP_META_CHAN));
     new_item->key = key;
     if(name) {
-	strncpy(new_item->name, name, 12);
+	strncpy(new_item->name, name, 11);
     }
     new_item->start_time = start_time;
     new_item->end_time = end_time;
     if(network) {
-	strncpy(new_item->network, network, 12);
+	strncpy(new_item->network, network, 11);
     }
+    (*chan_list)->number++;
 
+    return new_item;
+}
 
-    if(*chan_list == NULL) {
-	*chan_list = new_item;
-    } else {
-	if(nmxp_meta_chan_compare(new_item, *chan_list, sorttype) < 0) {
-	    new_item->next = *chan_list;
-	    *chan_list = new_item;
-	} else {
-	    for(iter = *chan_list; iter->next != NULL  && nmxp_meta_chan_compare(new_item, iter->next, sorttype) > 0; iter = iter->next) {
-	    }
-	    new_item->next = iter->next;
-	    iter->next = new_item;
+void nmxp_meta_chan_sort(NMXP_META_CHAN_LIST *chan_list, NMXP_META_CHAN_LIST_SORT_TYPE sorttype) {
+    int (*compare)(const void *, const void *) = NULL;
+
+    if(chan_list == NULL) {
+	return;
+    }
+
+    switch(sorttype) {
+	case NMXP_META_SORT_KEY:
+	    compare = nmxp_meta_chan_compare_key;
+	    break;
+	case NMXP_META_SORT_NAME:
+	    compare = nmxp_meta_chan_compare_name;
+	    break;
+	case NMXP_META_SORT_START_TIME:
+	    compare = nmxp_meta_chan_compare_start_time;
+	    break;
+	case NMXP_META_SORT_END_TIME:
+	    compare = nmxp_meta_chan_compare_end_time;
+	    break;
+	default:
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Sort type %d not defined!\n", sorttype);
+	    return;
+    }
+
+    qsort(chan_list->channel, chan_list->number, sizeof(NMXP_META_CHAN), compare);
+
+    /* Positions have changed */
+    chan_list->hash_number = -1;
+}
+
+NMXP_META_CHAN *nmxp_meta_chan_first(NMXP_META_CHAN_LIST *chan_list) {
+    return (chan_list  &&  chan_list->number > 0)? chan_list->channel : NULL;
+}
+
+NMXP_META_CHAN *nmxp_meta_chan_next(NMXP_META_CHAN_LIST *chan_list, NMXP_META_CHAN *iter) {
+    return (iter + 1 < chan_list->channel + chan_list->number)? iter + 1 : NULL;
+}
+
+static void nmxp_meta_chan_hash_build(NMXP_META_CHAN_LIST *chan_list) {
+    int32_t hash_size = 1;
+    int i_chan;
+    int slot;
+
+    chan_list->hash_number = -1;
+
+    /* Keep less than half of the slots used, for short probe sequences */
+    if(chan_list->hash_size <= 2 * chan_list->number) {
+	while(hash_size <= 2 * chan_list->number) {
+	    hash_size *= 2;
+	}
+	if(chan_list->hash) {
+	    NMXP_MEM_FREE(chan_list->hash);
+	}
+	chan_list->hash_size = 0;
+	chan_list->hash = (int32_t *) NMXP_MEM_MALLOC(sizeof(int32_t) * hash_size);
+	if(chan_list->hash == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating channel metadata index of %d slots.\n", hash_size);
+	    return;
 	}
+	chan_list->hash_size = hash_size;
     }
 
-    return new_item;
+    memset(chan_list->hash, 0, sizeof(int32_t) * chan_list->hash_size);
+    /* Reverse order, so the first of equal keys is found first as by a linear scan */
+    for(i_chan = chan_list->number - 1; i_chan >= 0; i_chan--) {
+	slot = NMXP_CHAN_HASH_SLOT(chan_list->channel[i_chan].key, chan_list->hash_size);
+	while(chan_list->hash[slot] != 0  &&  chan_list->channel[chan_list->hash[slot] - 1].key != chan_list->channel[i_chan].key) {
+	    slot = (slot + 1) & (chan_list->hash_size - 1);
+	}
+	chan_list->hash[slot] = i_chan + 1;
+    }
+    chan_list->hash_number = chan_list->number;
 }
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_search_key(NMXP_META_CHAN_LIST *chan_list, int32_t key) {
-    NMXP_META_CHAN_LIST *iter = chan_list;
-    int found = 0;
+NMXP_META_CHAN *nmxp_meta_chan_search_key(NMXP_META_CHAN_LIST *chan_list, int32_t key) {
+    int slot;
+    int i_chan;
 
     /* nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_search_key()\n"); */
 
-    while(iter != NULL  &&  !found) {
-	if(iter->key == key) {
-	    found = 1;
-	} else {
-	    iter = iter->next;
+    if(chan_list == NULL  ||  chan_list->number == 0) {
+	return NULL;
+    }
+
+    if(chan_list->hash_number != chan_list->number) {
+	nmxp_meta_chan_hash_build(chan_list);
+    }
+
+    if(chan_list->hash_number == chan_list->number) {
+	slot = NMXP_CHAN_HASH_SLOT(key, chan_list->hash_size);
+	while(chan_list->hash[slot] != 0) {
+	    if(chan_list->channel[chan_list->hash[slot] - 1].key == key) {
+		return &(chan_list->channel[chan_list->hash[slot] - 1]);
+	    }
+	    slot = (slot + 1) & (chan_list->hash_size - 1);
+	}
+    } else {
+	/* Index not available */
+	for(i_chan = 0; i_chan < chan_list->number; i_chan++) {
+	    if(chan_list->channel[i_chan].key == key) {
+		return &(chan_list->channel[i_chan]);
+	    }
 	}
     }
 
-    return iter;
+    return NULL;
 }
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_name(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *name) {
-    NMXP_META_CHAN_LIST *ret = NULL;
+NMXP_META_CHAN *nmxp_meta_chan_set_name(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *name) {
+    NMXP_META_CHAN *ret = NULL;
 
     nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_set_name()\n");
 
     if( (ret = nmxp_meta_chan_search_key(chan_list, key)) ) {
-	strncpy(ret->name, name, 12);
+	strncpy(ret->name, name, 11);
     }
 
     return ret;
 }
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_times(NMXP_META_CHAN_LIST *chan_list, int32_t key, int32_t start_time, int32_t end_time) {
-    NMXP_META_CHAN_LIST *ret = NULL;
+NMXP_META_CHAN *nmxp_meta_chan_set_times(NMXP_META_CHAN_LIST *chan_list, int32_t key, int32_t start_time, int32_t end_time) {
+    NMXP_META_CHAN *ret = NULL;
 
     /* nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_set_times()\n"); */
 
@@ -677,20 +1270,20 @@ NMXP_META_CHAN_LIST *nmxp_meta_chan_set_times(NMXP_META_CHAN_LIST *chan_list, in
     return ret;
 }
 
-NMXP_META_CHAN_LIST *nmxp_meta_chan_set_network(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *network) {
-    NMXP_META_CHAN_LIST *ret = NULL;
+NMXP_META_CHAN *nmxp_meta_chan_set_network(NMXP_META_CHAN_LIST *chan_list, int32_t key, char *network) {
+    NMXP_META_CHAN *ret = NULL;
 
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_set_network()\n");
 
     if( (ret = nmxp_meta_chan_search_key(chan_list, key)) ) {
-	strncpy(ret->network, network, 12);
+	strncpy(ret->network, network, 11);
     }
 
     return ret;
 }
 
 void nmxp_meta_chan_print(NMXP_META_CHAN_LIST *chan_list) {
-    NMXP_META_CHAN_LIST *iter = chan_list;
+    NMXP_META_CHAN *iter = nmxp_meta_chan_first(chan_list);
     char str_start_time[NMXP_DATA_MAX_SIZE_DATE], str_end_time[NMXP_DATA_MAX_SIZE_DATE];
     int i_chan = 0;
 
@@ -712,47 +1305,38 @@ void nmxp_meta_chan_print(NMXP_META_CHAN_LIST *chan_list) {
 		NMXP_LOG_STR(str_start_time),
 		NMXP_LOG_STR(str_end_time)
 		);
-	iter = iter->next;
+	iter = nmxp_meta_chan_next(chan_list, iter);
 	i_chan++;
     }
 }
 
 
 void nmxp_meta_chan_print_with_match(NMXP_META_CHAN_LIST *chan_list, char *sta_chan_list) {
-    NMXP_META_CHAN_LIST *iter = chan_list;
+    NMXP_META_CHAN *iter = nmxp_meta_chan_first(chan_list);
     char str_start_time[NMXP_DATA_MAX_SIZE_DATE], str_end_time[NMXP_DATA_MAX_SIZE_DATE];
     int i_chan = 0;
     int ret_match = 0;
-    int istalist, ista;
-    char sta_chan_code_pattern[100];
+    NMXP_CHAN_PATTERN_LIST plist;
+    char station_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
+    char channel_code[NMXP_CHAN_MAX_SIZE_STR_PATTERN];
 
     str_start_time[0] = 0;
     str_end_time[0] = 0;
 
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "nmxp_meta_chan_print()\n");
 
+    if(sta_chan_list) {
+	nmxp_chan_pattern_compile(&plist, sta_chan_list);
+    }
+
     while(iter != NULL) {
 	nmxp_data_to_str(str_start_time, iter->start_time);
 	nmxp_data_to_str(str_end_time,   iter->end_time);
 
 	if(sta_chan_list) {
 
-	    ret_match = 0;
-	    istalist = 0;
-	    while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0  &&  ret_match == 0) {
-
-		/* Build sta_chan_code_pattern from sta_chan_list */
-		ista = 0;
-		while(sta_chan_list[istalist] != sep_chan_list  &&  sta_chan_list[istalist] != 0) {
-		    sta_chan_code_pattern[ista++] = sta_chan_list[istalist++];
-		}
-		sta_chan_code_pattern[ista] = 0;
-		if(sta_chan_list[istalist] == sep_chan_list) {
-		    istalist++;
-		}
-
-		ret_match = nmxp_chan_match(iter->name, sta_chan_code_pattern);
-	    }
+	    ret_match = (nmxp_chan_split_name(iter->name, station_code, channel_code) == 1
+		    &&  nmxp_chan_pattern_match_next(&plist, station_code, channel_code, -1) != -1);
 
 	} else {
 	    ret_match = 1;
@@ -768,9 +1352,13 @@ void nmxp_meta_chan_print_with_match(NMXP_META_CHAN_LIST *chan_list, char *sta_c
 		    NMXP_LOG_STR(str_end_time)
 		    );
 	}
-	iter = iter->next;
+	iter = nmxp_meta_chan_next(chan_list, iter);
 	i_chan++;
     }
+
+    if(sta_chan_list) {
+	nmxp_chan_pattern_free(&plist);
+    }
 }
 
 
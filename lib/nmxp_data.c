@@ -34,6 +34,14 @@
 #include <libmseed.h>
 #endif
 
+#ifdef HAVE_SSE41_INTRINSICS
+#include <smmintrin.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 /*
 For a portable version of timegm(), set the TZ environment variable  to
 UTC, call mktime() and restore the value of TZ.  Something like
@@ -79,6 +87,7 @@ time_t my_timegm (struct tm *tm) {
 
 int nmxp_data_init(NMXP_DATA_PROCESS *pd) {
     pd->key = -1;
+    pd->chan_index = -1;
     pd->network[0] = 0;
     pd->station[0] = 0;
     pd->channel[0] = 0;
@@ -98,77 +107,180 @@ int nmxp_data_init(NMXP_DATA_PROCESS *pd) {
 }
 
 
-int nmxp_data_unpack_bundle (int32_t *outdata, unsigned char *indata, int32_t *prev)
-{         
+/* Layout of the 16 data bytes of a bundle for a given control byte:
+ * number of samples, byte offset of each difference and the shift
+ * needed to sign-extend it from its width to 32 bits. */
+typedef struct {
+    int nsamples;
+    unsigned char offset[16];
+    unsigned char shift[16];
+} NMXP_DATA_BUNDLE_LAYOUT;
+
+static NMXP_DATA_BUNDLE_LAYOUT nmxp_data_bundle_layout[256];
+
+static void nmxp_data_bundle_layout_init()
+{
+	/* Width in bytes and number of differences for each compression code */
+	const int width[4] = {0, 1, 2, 4};
+	const int ndiff[4] = {0, 4, 2, 1};
+	int cbits, i, j, k, cb, n;
+
+	for (cbits=0; cbits<256; cbits++) {
+		n = 0;
+		for (i=0,j=6; j>=0; i++,j-=2) {
+			cb = (cbits>>j) & 3;
+			for (k=0; k<ndiff[cb]; k++) {
+				nmxp_data_bundle_layout[cbits].offset[n] = i*4 + k*width[cb];
+				nmxp_data_bundle_layout[cbits].shift[n] = 32 - 8*width[cb];
+				n++;
+			}
+		}
+		nmxp_data_bundle_layout[cbits].nsamples = n;
+	}
+}
+
+
+/* Table-driven decoder. Differences are read as little-endian words
+ * byte by byte, so the result does not depend on the host byte order,
+ * and sign extension is done by shifting, without branching on the
+ * compression codes. */
+static int nmxp_data_unpack_bundle_scalar (int32_t *outdata, unsigned char *indata, int32_t *prev)
+{
+	const NMXP_DATA_BUNDLE_LAYOUT *layout = &nmxp_data_bundle_layout[indata[0]];
+	unsigned char data[20];
+	const unsigned char *p;
+	uint32_t w;
+	int32_t x = *prev;
+	int i;
+
+	/* Padding allows reading a full word at any offset */
+	memcpy (data, indata+1, 16);
+	memset (data+16, 0, 4);
+
+	for (i=0; i<layout->nsamples; i++) {
+		p = data + layout->offset[i];
+		w = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+		x = (int32_t) ((uint32_t) x + (uint32_t) ((int32_t) (w << layout->shift[i]) >> layout->shift[i]));
+		outdata[i] = x;
+	}
+
+	*prev = x;
+	return (layout->nsamples);
+}
+
+
+#ifdef HAVE_SSE41_INTRINSICS
+
+/* Shuffle masks indexed by compression code. Each difference is moved
+ * into the most significant bytes of its 32-bit lane, so that an arithmetic
+ * right shift sign-extends it. Bytes set to 0x80 are zeroed by pshufb. */
+static const unsigned char nmxp_data_sse41_shuffle[4][16] = {
+    /* 0: not used */
+    {0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80},
+    /* 1: four 8-bit diffs */
+    {0x80,0x80,0x80,0,    0x80,0x80,0x80,1,    0x80,0x80,0x80,2,    0x80,0x80,0x80,3},
+    /* 2: two 16-bit diffs */
+    {0x80,0x80,0,1,       0x80,0x80,2,3,       0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80},
+    /* 3: one 32-bit diff */
+    {0,1,2,3,             0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80, 0x80,0x80,0x80,0x80}
+};
+static const int nmxp_data_sse41_shift[4] = {0, 24, 16, 0};
+static const int nmxp_data_sse41_nsamples[4] = {0, 4, 2, 1};
+
+/* Same result as nmxp_data_unpack_bundle_scalar(). Each 4-byte group is
+ * expanded and sign-extended without branching, then the running sum is
+ * computed in two shift-and-add steps and carried by the last lane. */
+__attribute__((target("sse4.1")))
+static int nmxp_data_unpack_bundle_sse41 (int32_t *outdata, unsigned char *indata, int32_t *prev)
+{
+	int32_t tmp[20];
 	int32_t nsamples = 0;
-	int32_t d4[4];
-	int16_t d2[2];
-	int32_t cb[4];  
-	int32_t i, j, k=0;
+	int32_t w;
+	int j, cb;
 	unsigned char cbits;
-	/* TOREMOVE int my_order = get_my_wordorder(); */
-	int my_host_is_bigendian = nmxp_data_bigendianhost();
+	__m128i d, carry;
 
 	cbits = (unsigned char)indata[0];
-	if (cbits == 9) return (-1);
 	++indata;
-
-	/* Get the compression bits for the bundle. */
-	for (i=0,j=6; j>=0; i++,j-=2) {
-		cb[i] = (cbits>>j) & 3;
-	}       
-
-	for (j=0; j<4; j++) {
-		/*
-		nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "cb[%d]=%d\n", j, cb[j]);
-		*/
-		switch (cb[j]) 
-		{   
-			case 0:       /* not used     */
-				k=0;
-				break;       
-			case 1:       /* 4 byte diffs */
-				d4[0] = (signed char)indata[0];
-				d4[1] = (signed char)indata[1];
-				d4[2] = (signed char)indata[2];
-				d4[3] = (signed char)indata[3];
-				k=4;
-				break;
-			case 2:       /* 2 16-bit diffs */
-				memcpy (&d2[0],indata,2);
-				memcpy (&d2[1],indata+2,2);
-				/* TOREMOVE if (my_order != SEED_LITTLE_ENDIAN) { */
-				if (my_host_is_bigendian) {
-					nmxp_data_swap_2b (&d2[0]);
-					nmxp_data_swap_2b (&d2[1]);
-				}
-				d4[0] = d2[0];
-				d4[1] = d2[1];
-				k=2;
-				break;
-			case 3:       /* 1 32-bit diff */
-				memcpy (&d4[0],indata,4);
-				/* TOREMOVE if (my_order != SEED_LITTLE_ENDIAN) { */
-				if (my_host_is_bigendian) {
-					nmxp_data_swap_4b (&d4[0]);
-				}
-				k=1;
-				break;
-		}
+	carry = _mm_set1_epi32(*prev);
+
+	for (j=6; j>=0; j-=2) {
+		cb = (cbits>>j) & 3;
+		memcpy (&w, indata, 4);
+		d = _mm_shuffle_epi8(_mm_cvtsi32_si128(w),
+			_mm_loadu_si128((const __m128i *) nmxp_data_sse41_shuffle[cb]));
+		d = _mm_sra_epi32(d, _mm_cvtsi32_si128(nmxp_data_sse41_shift[cb]));
+		d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+		d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+		d = _mm_add_epi32(d, carry);
+		_mm_storeu_si128((__m128i *) (tmp + nsamples), d);
+		carry = _mm_shuffle_epi32(d, 0xFF);
+		nsamples += nmxp_data_sse41_nsamples[cb];
 		indata += 4;
+	}
 
-		for (i=0; i<k; i++) {
-			*outdata = *prev + d4[i];
-			/* nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "val = %d, diff[%d] = %d, *prev = %d\n",
-				*outdata, i, d4[i], *prev);
-				*/
-			*prev = *outdata;
+	*prev = _mm_cvtsi128_si32(carry);
+	memcpy (outdata, tmp, nsamples * sizeof(int32_t));
+	return (nsamples);
+}
 
-			outdata++;
-			++nsamples;
-		}
+#endif
+
+
+/* Bundle decoder in use, selected from CPUID by nmxp_data_unpack_bundle_select() */
+static int (*nmxp_data_unpack_bundle_func) (int32_t *outdata, unsigned char *indata, int32_t *prev) = nmxp_data_unpack_bundle_scalar;
+
+/* Build the layout table and select the decoder, executed once */
+static void nmxp_data_unpack_bundle_select ()
+{
+	nmxp_data_bundle_layout_init();
+#ifdef HAVE_SSE41_INTRINSICS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1")) {
+		nmxp_data_unpack_bundle_func = nmxp_data_unpack_bundle_sse41;
 	}
-	return (nsamples);
+#endif
+}
+
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t nmxp_data_unpack_bundle_once = PTHREAD_ONCE_INIT;
+#define NMXP_DATA_UNPACK_BUNDLE_INIT() pthread_once(&nmxp_data_unpack_bundle_once, nmxp_data_unpack_bundle_select)
+#else
+static int nmxp_data_unpack_bundle_ready = 0;
+#define NMXP_DATA_UNPACK_BUNDLE_INIT() if (!nmxp_data_unpack_bundle_ready) { nmxp_data_unpack_bundle_select(); nmxp_data_unpack_bundle_ready = 1; }
+#endif
+
+
+int nmxp_data_unpack_bundle (int32_t *outdata, unsigned char *indata, int32_t *prev)
+{
+	if (indata[0] == 9) return (-1);
+	NMXP_DATA_UNPACK_BUNDLE_INIT();
+	return nmxp_data_unpack_bundle_func(outdata, indata, prev);
+}
+
+
+int nmxp_data_unpack_bundle_diff (int32_t *outdiff, unsigned char *indata)
+{
+	const NMXP_DATA_BUNDLE_LAYOUT *layout;
+	unsigned char data[20];
+	const unsigned char *p;
+	uint32_t w;
+	int i;
+
+	if (indata[0] == 9) return (-1);
+	NMXP_DATA_UNPACK_BUNDLE_INIT();
+	layout = &nmxp_data_bundle_layout[indata[0]];
+
+	memcpy (data, indata+1, 16);
+	memset (data+16, 0, 4);
+
+	for (i=0; i<layout->nsamples; i++) {
+		p = data + layout->offset[i];
+		w = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+		outdiff[i] = (int32_t) (w << layout->shift[i]) >> layout->shift[i];
+	}
+
+	return (layout->nsamples);
 }
 
 
@@ -992,15 +1104,15 @@ int nmxp_data_get_filename_ms(NMXP_DATA_SEED *data_seed, char *dirseedchan, char
 }
 
 
-/* Private function for writing mini-seed records */
-static void nmxp_data_msr_write_handler (char *record, int reclen, void *pdata_seed) {
+int nmxp_data_seed_write_record(NMXP_DATA_SEED *data_seed, void *pmsr, char *record, int reclen) {
     int err = 0;
-    NMXP_DATA_SEED *data_seed = pdata_seed;
-    MSRecord *msr = data_seed->pmsr;
 
-    if(msr == NULL) {
+    /* Set pointer to the header used for the file name */
+    data_seed->pmsr = pmsr;
+
+    if(pmsr == NULL) {
 	err++;
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_EXTRA, "msr is NULL in nmxp_data_msr_write_handler()!\n");
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_EXTRA, "msr is NULL in nmxp_data_seed_write_record()!\n");
     }
 
     if(err==0) {
@@ -1010,12 +1122,23 @@ static void nmxp_data_msr_write_handler (char *record, int reclen, void *pdata_s
 	if(err==0) {
 	    if( data_seed->outfile_mseed[data_seed->cur_open_file] ) {
 		if ( fwrite(record, reclen, 1, data_seed->outfile_mseed[data_seed->cur_open_file]) != 1 ) {
+		    err++;
 		    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN,
 			    "Error writing %s to output file\n", data_seed->filename_mseed[data_seed->cur_open_file]);
 		}
 	    }
 	}
     }
+
+    return (err==0)? 0 : -1;
+}
+
+
+/* Private function for writing mini-seed records */
+static void nmxp_data_msr_write_handler (char *record, int reclen, void *pdata_seed) {
+    NMXP_DATA_SEED *data_seed = pdata_seed;
+
+    nmxp_data_seed_write_record(data_seed, data_seed->pmsr, record, reclen);
 }
 
 
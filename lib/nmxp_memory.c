@@ -11,7 +11,20 @@
  *
  */
 
+#include "config.h"
 #include "nmxp_memory.h"
+#include "nmxp_base.h"
+#include "nmxp_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #ifndef NMXP_MEM_DEBUG
 
@@ -21,223 +34,433 @@ int nmxp_mem_null_function() {
 
 #else
 
-#include "nmxp_log.h"
+/* Set debug_log_single to 1 for logging malloc(), strdup() and free() calls */
+static int debug_log_single = 0;
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/time.h>
+/* Allocations are tracked by a hash table keyed by pointer, split into
+ * stripes with their own lock, so threads freeing different pointers do
+ * not wait for each other. Call sites (file and line) are interned once
+ * into a striped table holding the accounting of each site. Tables are
+ * allocated by plain malloc() and are not tracked. */
 
-#include "config.h"
+/* Number of stripes of the pointer table, a power of two */
+#define NMXP_MEM_PTR_STRIPES 64
 
-/* Set debug_log_single to 1 for logging malloc(), strdup() and free() calls */
-static int debug_log_single = 0;
+/* Initial number of slots of a stripe of the pointer table, a power of two */
+#define NMXP_MEM_PTR_SLOTS 1024
+
+/* Number of stripes of the call site table, a power of two */
+#define NMXP_MEM_SITE_STRIPES 16
 
-#define MAX_LEN_SOURCE_FILE_LINE 100
+/* Number of slots of a stripe of the call site table, a power of two */
+#define NMXP_MEM_SITE_SLOTS 256
 
 typedef struct {
     void *p;
-    int size;
-    char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
+    size_t size;
+    int32_t site;
     struct timeval tv;
 } NMXP_MEM_STRUCT;
 
 typedef struct {
-    char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
-    long int times;
-} NMXP_MEM_SOURCE_FILE_LINE_STAT;
+    int32_t number;
+    int32_t n_slots;
+    NMXP_MEM_STRUCT *slot;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+#endif
+} NMXP_MEM_PTR_STRIPE;
+
+typedef struct {
+    const char *source_file;
+    int line;
+    long int live;		/* Number of blocks not freed */
+    long int bytes;		/* Bytes of the blocks not freed */
+    long int times;		/* Number of allocations */
+} NMXP_MEM_SITE;
+
+typedef struct {
+    int32_t number;
+    NMXP_MEM_SITE site[NMXP_MEM_SITE_SLOTS];
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+#endif
+} NMXP_MEM_SITE_STRIPE;
 
-#define MAX_MEM_STRUCTS (4096 * 16)
+static NMXP_MEM_PTR_STRIPE nmxp_mem_ptr[NMXP_MEM_PTR_STRIPES];
+static NMXP_MEM_SITE_STRIPE nmxp_mem_site[NMXP_MEM_SITE_STRIPES];
 
-static NMXP_MEM_STRUCT nms[MAX_MEM_STRUCTS];
-static int i_nms = 0;
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t nmxp_mem_once = PTHREAD_ONCE_INIT;
+#define NMXP_MEM_LOCK(stripe) pthread_mutex_lock(&(stripe)->mutex)
+#define NMXP_MEM_UNLOCK(stripe) pthread_mutex_unlock(&(stripe)->mutex)
+#else
+static int nmxp_mem_initialized = 0;
+#define NMXP_MEM_LOCK(stripe)
+#define NMXP_MEM_UNLOCK(stripe)
+#endif
 
-#define MAX_MEM_SFS (1024)
-static NMXP_MEM_SOURCE_FILE_LINE_STAT sfs[MAX_MEM_SFS];
-static int i_sfs = 0;
+/* Multiplicative hashing, upper bits folded into the lower ones */
+#define NMXP_MEM_HASH(x) ((uint32_t) (((uint32_t) (x) * 2654435761U) ^ (((uint32_t) (x) * 2654435761U) >> 16)))
+#define NMXP_MEM_PTR_HASH(p) NMXP_MEM_HASH(((uintptr_t) (p) >> 4) ^ ((uintptr_t) (p) >> 20))
 
+/* The upper bits of the hash select the stripe, the lower ones the slot */
+#define NMXP_MEM_PTR_STRIPE_OF(h) (((h) >> 26) & (NMXP_MEM_PTR_STRIPES - 1))
 
-inline long int nmxp_mem_add_sfs(char *source_file_line, int t) {
-    long int cur_times;
+/* Call site identifier from stripe and slot */
+#define NMXP_MEM_SITE_ID(i_stripe, i_slot) ((i_stripe) * NMXP_MEM_SITE_SLOTS + (i_slot))
+#define NMXP_MEM_SITE_OF(site_id) (&nmxp_mem_site[(site_id) / NMXP_MEM_SITE_SLOTS].site[(site_id) % NMXP_MEM_SITE_SLOTS])
+
+
+static void nmxp_mem_init_once() {
     int i;
-    i=0;
-    while(i < i_sfs
-	    && i < MAX_MEM_SFS
-	    &&  strcmp(sfs[i].source_file_line, source_file_line)!=0) {
-	i++;
-    }
-    if(i >= i_sfs) {
-	if(i_sfs < MAX_MEM_SFS) {
-	    strncpy(sfs[i_sfs].source_file_line, source_file_line, MAX_LEN_SOURCE_FILE_LINE);
-	    sfs[i_sfs].times=t;
-	    i_sfs++;
-	    cur_times = t;
-	} else {
-	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_add_sfs i_sfs > MAX_MEM_SFS %d > %d\n", i_sfs, MAX_MEM_SFS);
-	    cur_times = -1000000;
-	}
-    } else {
-	sfs[i].times+=t;
-	cur_times = sfs[i].times;
+
+    for(i = 0; i < NMXP_MEM_PTR_STRIPES; i++) {
+	nmxp_mem_ptr[i].number = 0;
+	nmxp_mem_ptr[i].n_slots = 0;
+	nmxp_mem_ptr[i].slot = NULL;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&nmxp_mem_ptr[i].mutex, NULL);
+#endif
+    }
+    for(i = 0; i < NMXP_MEM_SITE_STRIPES; i++) {
+	nmxp_mem_site[i].number = 0;
+	memset(nmxp_mem_site[i].site, 0, sizeof(nmxp_mem_site[i].site));
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&nmxp_mem_site[i].mutex, NULL);
+#endif
     }
-    return cur_times;
 }
 
-inline void nmxp_mem_print_sfs() {
-    int i;
-    i=0;
-    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "\n");
-    while(i < i_sfs) {
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "%4d: %10ld %s\n",
-		i+1, sfs[i].times, sfs[i].source_file_line
-		);
-	i++;
+static void nmxp_mem_init() {
+#ifdef HAVE_PTHREAD_H
+    pthread_once(&nmxp_mem_once, nmxp_mem_init_once);
+#else
+    if(!nmxp_mem_initialized) {
+	nmxp_mem_init_once();
+	nmxp_mem_initialized = 1;
     }
+#endif
 }
 
-inline int nmxp_mem_add_ptr(void *ptr, size_t size, char *source_file_line, struct timeval *tv) {
-    int ret = -1;
-    if(i_nms < MAX_MEM_STRUCTS) {
-	nmxp_mem_add_sfs(source_file_line, 1);
-	nms[i_nms].p = ptr;
-	nms[i_nms].size = size;
-	strncpy(nms[i_nms].source_file_line, source_file_line, MAX_LEN_SOURCE_FILE_LINE);
-	nms[i_nms].tv.tv_sec = tv->tv_sec;
-	nms[i_nms].tv.tv_usec = tv->tv_usec;
-	ret = i_nms;
-	i_nms++;
-    } else {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_add_ptr i_nms > MAX_MEM_STRUCTS %d > %d\n", i_nms, MAX_MEM_STRUCTS);
-	ret = -1;
+
+/* Intern a call site and account an allocation of size bytes, -1 if the table is full */
+static int32_t nmxp_mem_site_add(const char *source_file, int line, size_t size) {
+    uint32_t h = NMXP_MEM_HASH((uint32_t) line ^ ((uint32_t) strlen(source_file) << 12) ^ ((uint32_t) source_file[0] << 20));
+    int i_stripe = (h >> 24) & (NMXP_MEM_SITE_STRIPES - 1);
+    int i_slot = h & (NMXP_MEM_SITE_SLOTS - 1);
+    NMXP_MEM_SITE_STRIPE *stripe = &nmxp_mem_site[i_stripe];
+    NMXP_MEM_SITE *site;
+    int32_t ret = -1;
+
+    NMXP_MEM_LOCK(stripe);
+    /* The same file name could come from different pointers */
+    while(stripe->site[i_slot].source_file != NULL
+	    &&  (stripe->site[i_slot].line != line
+		||  (stripe->site[i_slot].source_file != source_file  &&  strcmp(stripe->site[i_slot].source_file, source_file) != 0))) {
+	i_slot = (i_slot + 1) & (NMXP_MEM_SITE_SLOTS - 1);
+    }
+    site = &stripe->site[i_slot];
+    /* One slot is always left empty to end the probe sequences */
+    if(site->source_file == NULL  &&  stripe->number < NMXP_MEM_SITE_SLOTS - 1) {
+	site->source_file = source_file;
+	site->line = line;
+	stripe->number++;
     }
+    if(site->source_file != NULL) {
+	site->live++;
+	site->bytes += size;
+	site->times++;
+	ret = NMXP_MEM_SITE_ID(i_stripe, i_slot);
+    }
+    NMXP_MEM_UNLOCK(stripe);
+
     return ret;
 }
 
+/* Account a free of size bytes allocated by a call site */
+static void nmxp_mem_site_rem(int32_t site_id, size_t size) {
+    NMXP_MEM_SITE_STRIPE *stripe;
+    NMXP_MEM_SITE *site;
 
-inline int nmxp_mem_rem_ptr(void *ptr, struct timeval *tv, int *size) {
-    int i, j;
+    if(site_id < 0) {
+	return;
+    }
+    stripe = &nmxp_mem_site[site_id / NMXP_MEM_SITE_SLOTS];
+    site = NMXP_MEM_SITE_OF(site_id);
+
+    NMXP_MEM_LOCK(stripe);
+    site->live--;
+    site->bytes -= size;
+    NMXP_MEM_UNLOCK(stripe);
+}
+
+
+/* Double the slots of a stripe, called holding its lock */
+static int nmxp_mem_ptr_grow(NMXP_MEM_PTR_STRIPE *stripe) {
+    NMXP_MEM_STRUCT *old_slot = stripe->slot;
+    int32_t old_n_slots = stripe->n_slots;
+    int32_t n_slots = (old_n_slots > 0)? old_n_slots * 2 : NMXP_MEM_PTR_SLOTS;
+    int32_t i, j;
+
+    stripe->slot = (NMXP_MEM_STRUCT *) calloc(n_slots, sizeof(NMXP_MEM_STRUCT));
+    if(stripe->slot == NULL) {
+	stripe->slot = old_slot;
+	return -1;
+    }
+    stripe->n_slots = n_slots;
+
+    for(i = 0; i < old_n_slots; i++) {
+	if(old_slot[i].p) {
+	    j = NMXP_MEM_PTR_HASH(old_slot[i].p) & (n_slots - 1);
+	    while(stripe->slot[j].p) {
+		j = (j + 1) & (n_slots - 1);
+	    }
+	    stripe->slot[j] = old_slot[i];
+	}
+    }
+    if(old_slot) {
+	free(old_slot);
+    }
+
+    return 0;
+}
+
+static int nmxp_mem_add_ptr(void *ptr, size_t size, int32_t site, struct timeval *tv) {
+    uint32_t h = NMXP_MEM_PTR_HASH(ptr);
+    NMXP_MEM_PTR_STRIPE *stripe = &nmxp_mem_ptr[NMXP_MEM_PTR_STRIPE_OF(h)];
+    int32_t i;
+    int ret = -1;
+
+    NMXP_MEM_LOCK(stripe);
+    /* Keep less than half of the slots used, for short probe sequences */
+    if(2 * (stripe->number + 1) <= stripe->n_slots  ||  nmxp_mem_ptr_grow(stripe) == 0) {
+	i = h & (stripe->n_slots - 1);
+	while(stripe->slot[i].p) {
+	    i = (i + 1) & (stripe->n_slots - 1);
+	}
+	stripe->slot[i].p = ptr;
+	stripe->slot[i].size = size;
+	stripe->slot[i].site = site;
+	stripe->slot[i].tv = *tv;
+	stripe->number++;
+	ret = 0;
+    }
+    NMXP_MEM_UNLOCK(stripe);
+
+    if(ret != 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_add_ptr error allocating the table for %p\n", ptr);
+    }
+
+    return ret;
+}
+
+/* Remove ptr from the pointer table and from the accounting of its call site, -1 if not found */
+static int nmxp_mem_rem_ptr(void *ptr, struct timeval *tv, size_t *size) {
+    uint32_t h = NMXP_MEM_PTR_HASH(ptr);
+    NMXP_MEM_PTR_STRIPE *stripe = &nmxp_mem_ptr[NMXP_MEM_PTR_STRIPE_OF(h)];
+    int32_t site = -1;
+    int32_t mask;
+    int32_t i, next, home;
+    int ret = -1;
 
     tv->tv_sec = 0;
     tv->tv_usec = 0;
     *size = 0;
 
-    i = 0;
-    while(i < i_nms && nms[i].p != ptr) {
-	i++;
+    NMXP_MEM_LOCK(stripe);
+    if(stripe->n_slots > 0) {
+	mask = stripe->n_slots - 1;
+	i = h & mask;
+	while(stripe->slot[i].p  &&  stripe->slot[i].p != ptr) {
+	    i = (i + 1) & mask;
+	}
+	if(stripe->slot[i].p) {
+	    *tv = stripe->slot[i].tv;
+	    *size = stripe->slot[i].size;
+	    site = stripe->slot[i].site;
+	    stripe->slot[i].p = NULL;
+	    stripe->number--;
+	    ret = 0;
+
+	    /* Move back the following items that would not be found across the empty slot */
+	    next = (i + 1) & mask;
+	    while(stripe->slot[next].p) {
+		home = NMXP_MEM_PTR_HASH(stripe->slot[next].p) & mask;
+		if(((next - home) & mask) >= ((next - i) & mask)) {
+		    stripe->slot[i] = stripe->slot[next];
+		    stripe->slot[next].p = NULL;
+		    i = next;
+		}
+		next = (next + 1) & mask;
+	    }
+	}
     }
+    NMXP_MEM_UNLOCK(stripe);
 
-    if(i >= i_nms  ||  i > MAX_MEM_STRUCTS) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_rem_ptr %010p not found i=%d\n", ptr, i);
-	i = -1;
-    } else {
-	nmxp_mem_add_sfs(nms[i].source_file_line, -1);
-	/* shift */
-	tv->tv_sec = nms[i].tv.tv_sec;
-	tv->tv_usec = nms[i].tv.tv_usec;
-	*size = nms[i].size;
-	j = i;
-	while(j < i_nms-1) {
-	    nms[j].p = nms[j+1].p;
-	    nms[j].size = nms[j+1].size;
-	    strncpy(nms[j].source_file_line, nms[j+1].source_file_line, MAX_LEN_SOURCE_FILE_LINE);;
-	    nms[j].tv.tv_sec = nms[j+1].tv.tv_sec;
-	    nms[j].tv.tv_usec = nms[j+1].tv.tv_usec;
-	    j++;
+    if(ret == 0) {
+	nmxp_mem_site_rem(site, *size);
+    }
+
+    return ret;
+}
+
+
+/* Sort call sites by bytes not freed, the largest first */
+static int nmxp_mem_site_compare(const void *a, const void *b) {
+    const NMXP_MEM_SITE *sa = (const NMXP_MEM_SITE *) a;
+    const NMXP_MEM_SITE *sb = (const NMXP_MEM_SITE *) b;
+    return (sa->bytes < sb->bytes)? 1 : ((sa->bytes > sb->bytes)? -1 : 0);
+}
+
+/* Copy the call sites if psites is not NULL and sum their bytes.
+ * nmxp_log() is never called holding a lock of the tables. */
+static int32_t nmxp_mem_site_snapshot(NMXP_MEM_SITE **psites, long int *tot_bytes) {
+    NMXP_MEM_SITE *sites = NULL;
+    int32_t n_sites = 0;
+    int i, j;
+
+    *tot_bytes = 0;
+    if(psites) {
+	*psites = sites = (NMXP_MEM_SITE *) malloc(sizeof(NMXP_MEM_SITE) * NMXP_MEM_SITE_STRIPES * NMXP_MEM_SITE_SLOTS);
+    }
+    for(i = 0; i < NMXP_MEM_SITE_STRIPES; i++) {
+	NMXP_MEM_LOCK(&nmxp_mem_site[i]);
+	for(j = 0; j < NMXP_MEM_SITE_SLOTS; j++) {
+	    if(nmxp_mem_site[i].site[j].source_file) {
+		*tot_bytes += nmxp_mem_site[i].site[j].bytes;
+		if(sites) {
+		    sites[n_sites] = nmxp_mem_site[i].site[j];
+		}
+		n_sites++;
+	    }
 	}
-	i_nms--;
+	NMXP_MEM_UNLOCK(&nmxp_mem_site[i]);
     }
-    return i;
+    return n_sites;
 }
 
 
-inline int nmxp_mem_print_ptr(int print_items, int print_sfs, char *source_file, int line) {
+int nmxp_mem_print_sfs(char *source_file, int line) {
+    NMXP_MEM_SITE *sites = NULL;
+    int32_t n_sites;
+    long int tot_bytes;
+    long int tot_live = 0;
     int i;
-    static int old_tot_size = 0;
-    int tot_size;
 
-    tot_size = 0;
-    for(i=0; i < i_nms  &&  i_nms < MAX_MEM_STRUCTS; i++) {
-	tot_size += nms[i].size;
+    nmxp_mem_init();
+
+    n_sites = nmxp_mem_site_snapshot(&sites, &tot_bytes);
+    if(sites) {
+	qsort(sites, n_sites, sizeof(NMXP_MEM_SITE), nmxp_mem_site_compare);
+	nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "%4s  %10s %12s %10s %s\n", "", "live", "bytes", "allocs", "site");
+	for(i = 0; i < n_sites; i++) {
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "%4d: %10ld %12ld %10ld %s:%d\n",
+		    i+1, sites[i].live, sites[i].bytes, sites[i].times, sites[i].source_file, sites[i].line);
+	    tot_live += sites[i].live;
+	}
+	free(sites);
     }
 
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_print_sfs() %d sites, live %ld, tot %ld  %s:%d\n",
+	    n_sites, tot_live, tot_bytes, source_file, line);
+
+    return (int) tot_bytes;
+}
+
+
+int nmxp_mem_print_ptr(int print_items, int print_sfs, char *source_file, int line) {
+    static long int old_tot_size = 0;
+    NMXP_MEM_STRUCT *items;
+    NMXP_MEM_SITE *site;
+    int32_t n_items;
+    long int tot_size;
+    int i, j;
+
+    nmxp_mem_init();
+
+    nmxp_mem_site_snapshot(NULL, &tot_size);
+
     if(tot_size != old_tot_size) {
 	if(print_items) {
-	    i=0;
-	    while(i<i_nms  && i_nms < MAX_MEM_STRUCTS) {
-		nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "%d %d.%d %010p %d %s\n",
-			i,
-			nms[i].tv.tv_sec,
-			nms[i].tv.tv_usec,
-			nms[i].p,
-			nms[i].size,
-			nms[i].source_file_line
-			);
-		i++;
+	    for(i = 0; i < NMXP_MEM_PTR_STRIPES; i++) {
+		NMXP_MEM_LOCK(&nmxp_mem_ptr[i]);
+		n_items = 0;
+		items = (NMXP_MEM_STRUCT *) malloc(sizeof(NMXP_MEM_STRUCT) * (nmxp_mem_ptr[i].number + 1));
+		for(j = 0; items  &&  j < nmxp_mem_ptr[i].n_slots; j++) {
+		    if(nmxp_mem_ptr[i].slot[j].p) {
+			items[n_items++] = nmxp_mem_ptr[i].slot[j];
+		    }
+		}
+		NMXP_MEM_UNLOCK(&nmxp_mem_ptr[i]);
+
+		for(j = 0; j < n_items; j++) {
+		    site = (items[j].site >= 0)? NMXP_MEM_SITE_OF(items[j].site) : NULL;
+		    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "%d %ld.%06ld %p %ld %s:%d\n",
+			    i, (long int) items[j].tv.tv_sec, (long int) items[j].tv.tv_usec,
+			    items[j].p, (long int) items[j].size,
+			    (site)? site->source_file : "?", (site)? site->line : 0);
+		}
+		if(items) {
+		    free(items);
+		}
 	    }
 	}
 	old_tot_size = tot_size;
     }
 
     if(print_sfs) {
-	nmxp_mem_print_sfs();
+	nmxp_mem_print_sfs(source_file, line);
     }
 
-    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_print_ptr() tot %d  %s:%d\n", tot_size, source_file, line);
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_print_ptr() tot %ld  %s:%d\n", tot_size, source_file, line);
 
-    return tot_size;
+    return (int) tot_size;
 }
 
 
-inline char *nmxp_mem_source_file_line(char *source_file, int line) {
-    static char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
-    snprintf(source_file_line, MAX_LEN_SOURCE_FILE_LINE, "%s:%d", source_file, line);
-    return source_file_line;
-}
-
-
-#define NMXP_SEG_MALLOC 1024
-inline void *nmxp_mem_malloc(size_t size, char *source_file, int line) {
-    void *ret = NULL;
+/* Track a new block */
+static void nmxp_mem_add(void *ptr, size_t size, char *source_file, int line, const char *func_name) {
     struct timeval tv;
+    int32_t site;
     int i;
-    char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
-    size_t old_size;
 
-    old_size = size;
-    size = ( ( ( (old_size - 1) / NMXP_SEG_MALLOC ) ) + 1) * NMXP_SEG_MALLOC;
+    nmxp_mem_init();
 
     gettimeofday(&tv, NULL);
-    ret = malloc(size);
-    strncpy(source_file_line, nmxp_mem_source_file_line(source_file, line), MAX_LEN_SOURCE_FILE_LINE);
-    i = nmxp_mem_add_ptr(ret, size, source_file_line, &tv);
+    site = nmxp_mem_site_add(source_file, line, size);
+    i = nmxp_mem_add_ptr(ptr, size, site, &tv);
+    if(site == -1) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "%s call site table full, %s:%d not accounted\n", func_name, source_file, line);
+    }
     if(debug_log_single  ||  i == -1) {
-	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_malloc %d.%d %010p+%d %s_%d\n", tv.tv_sec, tv.tv_usec, ret, size, source_file_line, i);
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "%s %ld.%06ld %p+%ld %s:%d\n", func_name,
+		(long int) tv.tv_sec, (long int) tv.tv_usec, ptr, (long int) size, source_file, line);
+    }
+}
+
+
+void *nmxp_mem_malloc(size_t size, char *source_file, int line) {
+    void *ret = NULL;
+
+    ret = malloc(size);
+    if(ret) {
+	nmxp_mem_add(ret, size, source_file, line, "nmxp_mem_malloc");
     }
     return ret;
 }
 
 
-inline char *nmxp_mem_strdup(const char *str, char *source_file, int line) {
+char *nmxp_mem_strdup(const char *str, char *source_file, int line) {
     char *ret = NULL;
-    int size;
-    struct timeval tv;
-    int i;
-    char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
-    size_t old_size;
-
-    gettimeofday(&tv, NULL);
+    size_t size;
 
     if(str) {
-	old_size = strlen(str) + 1;
-	size = ( ( ( (old_size - 1) / NMXP_SEG_MALLOC ) ) + 1) * NMXP_SEG_MALLOC;
-
+	size = strlen(str) + 1;
 	ret = (char *) malloc(size);
-	strcpy(ret, str);
-
-	strncpy(source_file_line, nmxp_mem_source_file_line(source_file, line), MAX_LEN_SOURCE_FILE_LINE);
-	i = nmxp_mem_add_ptr(ret, size, source_file_line, &tv);
-	if(debug_log_single  ||  i == -1) {
-	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_strdup %d.%d %010p+%d %s_%d\n", tv.tv_sec, tv.tv_usec, ret, size, source_file_line, i);
+	if(ret) {
+	    memcpy(ret, str, size);
+	    nmxp_mem_add(ret, size, source_file, line, "nmxp_mem_strdup");
 	}
     }
 
@@ -245,23 +468,245 @@ inline char *nmxp_mem_strdup(const char *str, char *source_file, int line) {
 }
 
 
-inline void nmxp_mem_free(void *ptr, char *source_file, int line) {
+void nmxp_mem_free(void *ptr, char *source_file, int line) {
     int i;
     struct timeval tv;
-    int size;
-    char source_file_line[MAX_LEN_SOURCE_FILE_LINE];
+    size_t size;
 
     if(ptr) {
+	nmxp_mem_init();
 	i = nmxp_mem_rem_ptr(ptr, &tv, &size);
-	strncpy(source_file_line, nmxp_mem_source_file_line(source_file, line), MAX_LEN_SOURCE_FILE_LINE);
 	if(debug_log_single  ||  i == -1) {
-	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_free   %d.%d %010p+%d %s_%d\n", tv.tv_sec, tv.tv_usec, ptr, size, source_file_line, i);
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "nmxp_mem_free   %ld.%06ld %p+%ld %s:%d%s\n",
+		    (long int) tv.tv_sec, (long int) tv.tv_usec, ptr, (long int) size, source_file, line,
+		    (i == -1)? " not found" : "");
 	}
 	free(ptr);
-	/* prevents double frees, added 2010-07-26, RR */
-	ptr = NULL;
     }
 }
 
 #endif
 
+
+/* Slab, NMXP_MEM_SLAB_HEADER bytes followed by n_blocks blocks */
+typedef struct NMXP_MEM_SLAB {
+    struct NMXP_MEM_SLAB *next;
+    int32_t n_used;
+} NMXP_MEM_SLAB;
+
+/* Header of a block, the caller gets the memory following it */
+typedef struct NMXP_MEM_SLAB_BLOCK {
+    struct NMXP_MEM_SLAB_BLOCK *next;	/* Next free block of the same class */
+    NMXP_MEM_SLAB *slab;		/* NULL for blocks larger than the largest class */
+    int32_t i_class;
+    int32_t refcount;
+} NMXP_MEM_SLAB_BLOCK;
+
+typedef struct {
+    size_t size;			/* Bytes available to the caller */
+    NMXP_MEM_SLAB *slabs;
+    NMXP_MEM_SLAB_BLOCK *free_blocks;
+    int32_t n_slabs;
+    int32_t n_used;
+} NMXP_MEM_SLAB_CLASS;
+
+#define NMXP_MEM_SLAB_ALIGN 16
+#define NMXP_MEM_SLAB_ROUND(size) (((size) + NMXP_MEM_SLAB_ALIGN - 1) & ~((size_t) NMXP_MEM_SLAB_ALIGN - 1))
+#define NMXP_MEM_SLAB_HEADER NMXP_MEM_SLAB_ROUND(sizeof(NMXP_MEM_SLAB))
+#define NMXP_MEM_SLAB_BLOCK_HEADER NMXP_MEM_SLAB_ROUND(sizeof(NMXP_MEM_SLAB_BLOCK))
+
+/* Packet followed by its samples */
+#define NMXP_MEM_SLAB_PD_SIZE(n_samples) NMXP_MEM_SLAB_ROUND(sizeof(NMXP_DATA_PROCESS) + (n_samples) * sizeof(int32_t))
+
+/* Size classes, packets are sized by their callers:
+ * - compressed packets of up to three bundles, NMXP_COMPRESSED_OUTDATA_SIZE(48),
+ *   and the copies of short packets;
+ * - a full compressed packet, NMXP_COMPRESSED_OUTDATA_SIZE() of 17 bundles of
+ *   at most 16 differences, and the packets recovered by the gap-fill;
+ * - decompressed messages, NMXP_DECOMPRESSED_OUTDATA_SIZE() of their length;
+ * - NMXP_MAX_OUTDATA, nmxp_raw_stream_pd_get() */
+static NMXP_MEM_SLAB_CLASS nmxp_mem_slab_class[NMXP_MEM_SLAB_N_CLASSES] = {
+    { NMXP_MEM_SLAB_PD_SIZE(NMXP_COMPRESSED_OUTDATA_SIZE(3 * 16)),  NULL, NULL, 0, 0 },
+    { NMXP_MEM_SLAB_PD_SIZE(NMXP_COMPRESSED_OUTDATA_SIZE(17 * 16)), NULL, NULL, 0, 0 },
+    { NMXP_MEM_SLAB_PD_SIZE(1024),                                  NULL, NULL, 0, 0 },
+    { NMXP_MEM_SLAB_PD_SIZE(NMXP_MAX_OUTDATA),                      NULL, NULL, 0, 0 }
+};
+
+static int32_t nmxp_mem_slab_n_large = 0;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t nmxp_mem_slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define NMXP_MEM_SLAB_LOCK() pthread_mutex_lock(&nmxp_mem_slab_mutex)
+#define NMXP_MEM_SLAB_UNLOCK() pthread_mutex_unlock(&nmxp_mem_slab_mutex)
+#else
+#define NMXP_MEM_SLAB_LOCK()
+#define NMXP_MEM_SLAB_UNLOCK()
+#endif
+
+#define NMXP_MEM_SLAB_PTR(block) ((void *) ((char *) (block) + NMXP_MEM_SLAB_BLOCK_HEADER))
+#define NMXP_MEM_SLAB_BLOCK_OF(ptr) ((NMXP_MEM_SLAB_BLOCK *) ((char *) (ptr) - NMXP_MEM_SLAB_BLOCK_HEADER))
+
+
+/* Add a slab to a class, called holding the mutex */
+static int nmxp_mem_slab_grow(int i_class) {
+    NMXP_MEM_SLAB_CLASS *c = &nmxp_mem_slab_class[i_class];
+    NMXP_MEM_SLAB *slab;
+    NMXP_MEM_SLAB_BLOCK *block;
+    size_t block_size = NMXP_MEM_SLAB_BLOCK_HEADER + c->size;
+    int32_t n_blocks = NMXP_MEM_SLAB_SIZE / block_size;
+    int32_t i;
+
+    if(n_blocks < 4) {
+	n_blocks = 4;
+    }
+
+    slab = (NMXP_MEM_SLAB *) NMXP_MEM_MALLOC(NMXP_MEM_SLAB_HEADER + n_blocks * block_size);
+    if(slab == NULL) {
+	return -1;
+    }
+    slab->n_used = 0;
+    slab->next = c->slabs;
+    c->slabs = slab;
+    c->n_slabs++;
+
+    for(i = n_blocks - 1; i >= 0; i--) {
+	block = (NMXP_MEM_SLAB_BLOCK *) ((char *) slab + NMXP_MEM_SLAB_HEADER + i * block_size);
+	block->slab = slab;
+	block->i_class = i_class;
+	block->refcount = 0;
+	block->next = c->free_blocks;
+	c->free_blocks = block;
+    }
+
+    return 0;
+}
+
+
+void *nmxp_mem_slab_alloc(size_t size) {
+    NMXP_MEM_SLAB_CLASS *c;
+    NMXP_MEM_SLAB_BLOCK *block = NULL;
+    int i_class = 0;
+
+    while(i_class < NMXP_MEM_SLAB_N_CLASSES  &&  nmxp_mem_slab_class[i_class].size < size) {
+	i_class++;
+    }
+
+    NMXP_MEM_SLAB_LOCK();
+    if(i_class < NMXP_MEM_SLAB_N_CLASSES) {
+	c = &nmxp_mem_slab_class[i_class];
+	if(c->free_blocks != NULL  ||  nmxp_mem_slab_grow(i_class) == 0) {
+	    block = c->free_blocks;
+	    c->free_blocks = block->next;
+	    block->slab->n_used++;
+	    c->n_used++;
+	}
+    } else {
+	block = (NMXP_MEM_SLAB_BLOCK *) NMXP_MEM_MALLOC(NMXP_MEM_SLAB_BLOCK_HEADER + size);
+	if(block) {
+	    block->slab = NULL;
+	    block->i_class = -1;
+	    nmxp_mem_slab_n_large++;
+	}
+    }
+    if(block) {
+	block->next = NULL;
+	block->refcount = 1;
+    }
+    NMXP_MEM_SLAB_UNLOCK();
+
+    if(block == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_slab_alloc(): Error allocating %d bytes\n", (int) size);
+	return NULL;
+    }
+
+    return NMXP_MEM_SLAB_PTR(block);
+}
+
+
+void *nmxp_mem_slab_ref(void *ptr) {
+    NMXP_MEM_SLAB_LOCK();
+    NMXP_MEM_SLAB_BLOCK_OF(ptr)->refcount++;
+    NMXP_MEM_SLAB_UNLOCK();
+    return ptr;
+}
+
+
+void nmxp_mem_slab_unref(void *ptr) {
+    NMXP_MEM_SLAB_BLOCK *block;
+    NMXP_MEM_SLAB_CLASS *c;
+
+    if(ptr == NULL) {
+	return;
+    }
+
+    block = NMXP_MEM_SLAB_BLOCK_OF(ptr);
+
+    NMXP_MEM_SLAB_LOCK();
+    block->refcount--;
+    if(block->refcount == 0) {
+	if(block->slab) {
+	    c = &nmxp_mem_slab_class[block->i_class];
+	    block->next = c->free_blocks;
+	    c->free_blocks = block;
+	    block->slab->n_used--;
+	    c->n_used--;
+	} else {
+	    nmxp_mem_slab_n_large--;
+	    NMXP_MEM_FREE(block);
+	}
+    } else if(block->refcount < 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_mem_slab_unref(): Block %p released too many times\n", ptr);
+    }
+    NMXP_MEM_SLAB_UNLOCK();
+}
+
+
+void nmxp_mem_slab_trim() {
+    NMXP_MEM_SLAB_CLASS *c;
+    NMXP_MEM_SLAB_BLOCK **pblock;
+    NMXP_MEM_SLAB **pslab;
+    NMXP_MEM_SLAB *slab;
+    int i_class;
+
+    NMXP_MEM_SLAB_LOCK();
+    for(i_class = 0; i_class < NMXP_MEM_SLAB_N_CLASSES; i_class++) {
+	c = &nmxp_mem_slab_class[i_class];
+
+	/* Unlink the free blocks of the unused slabs */
+	pblock = &c->free_blocks;
+	while(*pblock) {
+	    if((*pblock)->slab->n_used == 0) {
+		*pblock = (*pblock)->next;
+	    } else {
+		pblock = &(*pblock)->next;
+	    }
+	}
+
+	pslab = &c->slabs;
+	while(*pslab) {
+	    if((*pslab)->n_used == 0) {
+		slab = *pslab;
+		*pslab = slab->next;
+		NMXP_MEM_FREE(slab);
+		c->n_slabs--;
+	    } else {
+		pslab = &(*pslab)->next;
+	    }
+	}
+    }
+    NMXP_MEM_SLAB_UNLOCK();
+}
+
+
+void nmxp_mem_slab_print() {
+    int i_class;
+
+    NMXP_MEM_SLAB_LOCK();
+    for(i_class = 0; i_class < NMXP_MEM_SLAB_N_CLASSES; i_class++) {
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Slab pool: class %d of %d bytes, %d slabs, %d blocks in use\n",
+		i_class, (int) nmxp_mem_slab_class[i_class].size,
+		nmxp_mem_slab_class[i_class].n_slabs, nmxp_mem_slab_class[i_class].n_used);
+    }
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Slab pool: %d larger blocks in use\n", nmxp_mem_slab_n_large);
+    NMXP_MEM_SLAB_UNLOCK();
+}
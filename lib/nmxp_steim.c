@@ -0,0 +1,462 @@
+/*! \file
+ *
+ * \brief Steim1/Steim2 transcoder for Nanometrics Protocol Library
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#include "config.h"
+#include "nmxp_steim.h"
+#include "nmxp_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* Wrap-around addition, as for 32-bit samples */
+#define NMXP_STEIM_ADD(a, b) ( (int32_t) ((uint32_t) (a) + (uint32_t) (b)) )
+
+/* A way of packing differences into a 32-bit data word */
+typedef struct {
+    int ndiff;
+    int nbits;
+    uint32_t nib;
+    int dnib;
+} NMXP_STEIM_PACKING;
+
+/* From the densest to the sparsest packing */
+static const NMXP_STEIM_PACKING nmxp_steim1_packing[] = {
+    {4,  8, 1, -1},
+    {2, 16, 2, -1},
+    {1, 32, 3, -1},
+    {0,  0, 0, -1}
+};
+
+static const NMXP_STEIM_PACKING nmxp_steim2_packing[] = {
+    {7,  4, 3,  2},
+    {6,  5, 3,  1},
+    {5,  6, 3,  0},
+    {4,  8, 1, -1},
+    {3, 10, 2,  3},
+    {2, 15, 2,  2},
+    {1, 30, 2,  1},
+    {0,  0, 0, -1}
+};
+
+
+static void nmxp_steim_put_be32(char *p, uint32_t v) {
+    p[0] = (char) ((v >> 24) & 0xff);
+    p[1] = (char) ((v >> 16) & 0xff);
+    p[2] = (char) ((v >> 8) & 0xff);
+    p[3] = (char) (v & 0xff);
+}
+
+
+static void nmxp_steim_put_be16(char *p, uint16_t v) {
+    p[0] = (char) ((v >> 8) & 0xff);
+    p[1] = (char) (v & 0xff);
+}
+
+
+/* Copy a code padded with spaces */
+static void nmxp_steim_put_code(char *p, const char *code, int size) {
+    int i = 0;
+    while(i < size  &&  code[i] != 0) {
+	p[i] = code[i];
+	i++;
+    }
+    while(i < size) {
+	p[i] = ' ';
+	i++;
+    }
+}
+
+
+static char *nmxp_steim_word(NMXP_STEIM *st, int iframe, int iword) {
+    return st->record + NMXP_STEIM_HEADER_LENGTH + (iframe * NMXP_STEIM_FRAME_LENGTH) + (iword * 4);
+}
+
+
+static void nmxp_steim_record_reset(NMXP_STEIM *st) {
+    memset(st->record, 0, st->reclen);
+    st->iframe = 0;
+    st->iword = 3;
+    st->ctrl_word = 0;
+    st->nsamples = 0;
+}
+
+
+/* Fixed section of data header and blockette 1000 */
+static void nmxp_steim_write_header(NMXP_STEIM *st) {
+    char *h = st->record;
+    char seq_no_str[12];
+    time_t t;
+    struct tm tm_t;
+    int fract;
+    int exponent = 0;
+
+    t = (time_t) floor(st->record_start_time);
+    fract = (int) ((st->record_start_time - (double) t) * 10000.0 + 0.5);
+    if(fract >= 10000) {
+	t++;
+	fract -= 10000;
+    }
+    gmtime_r(&t, &tm_t);
+
+    snprintf(seq_no_str, 12, "%06d", st->record_seq_no % 1000000);
+    memcpy(h, seq_no_str, 6);
+    h[6] = st->quality_indicator;
+    h[7] = ' ';
+    nmxp_steim_put_code(h + 8, st->station, 5);
+    nmxp_steim_put_code(h + 13, st->location, 2);
+    nmxp_steim_put_code(h + 15, st->channel, 3);
+    nmxp_steim_put_code(h + 18, st->network, 2);
+
+    /* BTIME */
+    nmxp_steim_put_be16(h + 20, (uint16_t) (tm_t.tm_year + 1900));
+    nmxp_steim_put_be16(h + 22, (uint16_t) (tm_t.tm_yday + 1));
+    h[24] = (char) tm_t.tm_hour;
+    h[25] = (char) tm_t.tm_min;
+    h[26] = (char) tm_t.tm_sec;
+    h[27] = 0;
+    nmxp_steim_put_be16(h + 28, (uint16_t) fract);
+
+    nmxp_steim_put_be16(h + 30, (uint16_t) st->nsamples);
+    nmxp_steim_put_be16(h + 32, (uint16_t) st->sampRate);
+    nmxp_steim_put_be16(h + 34, 1);
+    h[36] = 0;
+    h[37] = 0;
+    h[38] = 0;
+    h[39] = 1;
+    nmxp_steim_put_be32(h + 40, 0);
+    nmxp_steim_put_be16(h + 44, NMXP_STEIM_HEADER_LENGTH);
+    nmxp_steim_put_be16(h + 46, 48);
+
+    /* Blockette 1000 */
+    while((1 << exponent) < st->reclen) {
+	exponent++;
+    }
+    nmxp_steim_put_be16(h + 48, 1000);
+    nmxp_steim_put_be16(h + 50, 0);
+    h[52] = (char) st->encoding;
+    h[53] = 1;
+    h[54] = (char) exponent;
+    h[55] = 0;
+}
+
+
+/* Complete the current record and pass it to func_record() */
+static int nmxp_steim_close_record(NMXP_STEIM *st) {
+    if(st->nsamples <= 0) {
+	return 0;
+    }
+
+    /* Control word of the last frame, even if partial */
+    if(st->iframe < st->nframes) {
+	nmxp_steim_put_be32(nmxp_steim_word(st, st->iframe, 0), st->ctrl_word);
+    }
+
+    /* Forward and reverse integration constants */
+    nmxp_steim_put_be32(nmxp_steim_word(st, 0, 1), (uint32_t) st->record_x0);
+    nmxp_steim_put_be32(nmxp_steim_word(st, 0, 2), (uint32_t) st->x_packed);
+
+    nmxp_steim_write_header(st);
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_PACKETMAN, "Steim record %06d for %s.%s.%s, %d samples in %d frames\n",
+	    st->record_seq_no, NMXP_LOG_STR(st->network), NMXP_LOG_STR(st->station), NMXP_LOG_STR(st->channel),
+	    st->nsamples, st->iframe + ((st->iword > 1)? 1 : 0));
+
+    if(st->func_record) {
+	st->func_record(st->record, st->reclen, st->handlerdata);
+    }
+
+    st->record_seq_no++;
+    if(st->record_seq_no > 999999) {
+	st->record_seq_no = 1;
+    }
+
+    nmxp_steim_record_reset(st);
+
+    return 1;
+}
+
+
+/* Pack the first pending differences into one data word.
+ * Return the number of completed records, -1 on error. */
+static int nmxp_steim_pack_word(NMXP_STEIM *st) {
+    const NMXP_STEIM_PACKING *packing;
+    const NMXP_STEIM_PACKING *pk;
+    int32_t min, max;
+    uint32_t word = 0;
+    uint32_t mask;
+    int i, fit;
+
+    packing = (st->encoding == NMXP_STEIM1)? nmxp_steim1_packing : nmxp_steim2_packing;
+
+    /* First packing whose differences are all available and fit */
+    pk = packing;
+    fit = 0;
+    while(pk->ndiff > 0  &&  !fit) {
+	if(pk->ndiff <= st->npending) {
+	    fit = 1;
+	    if(pk->nbits < 32) {
+		max = (int32_t) ((1U << (pk->nbits - 1)) - 1);
+		min = -max - 1;
+		for(i=0; i < pk->ndiff  &&  fit; i++) {
+		    if(st->pending[i] < min  ||  st->pending[i] > max) {
+			fit = 0;
+		    }
+		}
+	    }
+	}
+	if(!fit) {
+	    pk++;
+	}
+    }
+
+    if(!fit) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Difference %d for %s.%s.%s can not be encoded in Steim2!\n",
+		st->pending[0], NMXP_LOG_STR(st->network), NMXP_LOG_STR(st->station), NMXP_LOG_STR(st->channel));
+	return -1;
+    }
+
+    mask = (pk->nbits < 32)? ((1U << pk->nbits) - 1) : 0xffffffffU;
+    for(i=0; i < pk->ndiff; i++) {
+	word |= ((uint32_t) st->pending[i] & mask) << (pk->nbits * (pk->ndiff - 1 - i));
+    }
+    if(pk->dnib >= 0) {
+	word |= ((uint32_t) pk->dnib) << 30;
+    }
+
+    /* First sample of the record */
+    if(st->nsamples == 0) {
+	st->record_x0 = NMXP_STEIM_ADD(st->x_packed, st->pending[0]);
+	st->record_start_time = st->stream_start_time + ((double) st->stream_count_packed / (double) st->sampRate);
+    }
+
+    for(i=0; i < pk->ndiff; i++) {
+	st->x_packed = NMXP_STEIM_ADD(st->x_packed, st->pending[i]);
+    }
+    st->stream_count_packed += pk->ndiff;
+    st->nsamples += pk->ndiff;
+    for(i=pk->ndiff; i < st->npending; i++) {
+	st->pending[i - pk->ndiff] = st->pending[i];
+    }
+    st->npending -= pk->ndiff;
+
+    nmxp_steim_put_be32(nmxp_steim_word(st, st->iframe, st->iword), word);
+    st->ctrl_word |= pk->nib << (30 - (2 * st->iword));
+    st->iword++;
+    if(st->iword >= 16) {
+	nmxp_steim_put_be32(nmxp_steim_word(st, st->iframe, 0), st->ctrl_word);
+	st->ctrl_word = 0;
+	st->iframe++;
+	st->iword = 1;
+    }
+
+    if(st->iframe >= st->nframes) {
+	return nmxp_steim_close_record(st);
+    }
+
+    return 0;
+}
+
+
+static int nmxp_steim_push_diff(NMXP_STEIM *st, int32_t diff) {
+    int max_pending = (st->encoding == NMXP_STEIM1)? 4 : NMXP_STEIM_MAX_PENDING;
+
+    st->pending[st->npending] = diff;
+    st->npending++;
+
+    if(st->npending >= max_pending) {
+	return nmxp_steim_pack_word(st);
+    }
+
+    return 0;
+}
+
+
+/* Push the first sample of a packet, starting a new stream if it is not contiguous */
+static int nmxp_steim_begin_packet(NMXP_STEIM *st, double time, int32_t sampRate, int32_t x0) {
+    int ret = 0;
+    int r;
+    double expected_time;
+
+    if(sampRate <= 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Sample rate %d not valid for %s.%s.%s!\n",
+		sampRate, NMXP_LOG_STR(st->network), NMXP_LOG_STR(st->station), NMXP_LOG_STR(st->channel));
+	return -1;
+    }
+
+    if(st->stream_open  &&  st->sampRate == sampRate) {
+	expected_time = st->stream_start_time + ((double) st->stream_count_fed / (double) st->sampRate);
+	if(fabs(time - expected_time) < 0.5 / (double) sampRate) {
+	    r = nmxp_steim_push_diff(st, NMXP_STEIM_ADD(x0, -st->x_fed));
+	    st->x_fed = x0;
+	    st->stream_count_fed++;
+	    return r;
+	}
+    }
+
+    /* Gap, overlap or first packet */
+    if(st->stream_open) {
+	ret = nmxp_steim_flush(st);
+	if(ret < 0) {
+	    return ret;
+	}
+    }
+    st->stream_open = 1;
+    st->stream_start_time = time;
+    st->sampRate = sampRate;
+    st->stream_count_packed = 0;
+    st->stream_count_fed = 1;
+    st->x_packed = x0;
+    st->x_fed = x0;
+
+    r = nmxp_steim_push_diff(st, 0);
+    return (r < 0)? r : ret + r;
+}
+
+
+int nmxp_steim_init(NMXP_STEIM *st, const char *network, const char *station, const char *channel, const char *location,
+	int encoding, int reclen, int (*func_record)(char *record, int reclen, void *handlerdata), void *handlerdata) {
+
+    memset(st, 0, sizeof(NMXP_STEIM));
+
+    if(encoding != NMXP_STEIM1  &&  encoding != NMXP_STEIM2) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Encoding %d is not Steim1 or Steim2!\n", encoding);
+	return -1;
+    }
+    if(reclen < NMXP_STEIM_RECLEN_MINIMUM  ||  reclen > NMXP_STEIM_RECLEN_MAXIMUM  ||  (reclen & (reclen - 1)) != 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Record length %d is not a power of 2 between %d and %d!\n",
+		reclen, NMXP_STEIM_RECLEN_MINIMUM, NMXP_STEIM_RECLEN_MAXIMUM);
+	return -1;
+    }
+
+    strncpy(st->network, network, NMXP_DATA_NETWORK_LENGTH - 1);
+    strncpy(st->station, station, NMXP_DATA_STATION_LENGTH - 1);
+    strncpy(st->channel, channel, NMXP_DATA_CHANNEL_LENGTH - 1);
+    strncpy(st->location, location, NMXP_DATA_LOCATION_LENGTH - 1);
+    st->quality_indicator = 'D';
+    st->encoding = encoding;
+    st->reclen = reclen;
+    st->record_seq_no = 1;
+    st->func_record = func_record;
+    st->handlerdata = handlerdata;
+
+    st->record = (char *) NMXP_MEM_MALLOC(reclen);
+    if(st->record == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_steim_init(): Error allocating memory\n");
+	return -1;
+    }
+    st->nframes = (reclen - NMXP_STEIM_HEADER_LENGTH) / NMXP_STEIM_FRAME_LENGTH;
+    nmxp_steim_record_reset(st);
+
+    return 0;
+}
+
+
+void nmxp_steim_free(NMXP_STEIM *st) {
+    if(st->record) {
+	nmxp_steim_flush(st);
+	NMXP_MEM_FREE(st->record);
+	st->record = NULL;
+    }
+}
+
+
+int nmxp_steim_flush(NMXP_STEIM *st) {
+    int ret = 0;
+    int r;
+
+    while(st->npending > 0) {
+	r = nmxp_steim_pack_word(st);
+	if(r < 0) {
+	    return r;
+	}
+	ret += r;
+    }
+    ret += nmxp_steim_close_record(st);
+
+    return ret;
+}
+
+
+int nmxp_steim_feed_diff(NMXP_STEIM *st, double time, int32_t sampRate, int32_t x0, const int32_t *diff, int nsamples) {
+    int ret = 0;
+    int r;
+    int i;
+
+    if(nsamples <= 0) {
+	return 0;
+    }
+
+    r = nmxp_steim_begin_packet(st, time, sampRate, x0);
+    if(r < 0) {
+	return r;
+    }
+    ret += r;
+
+    for(i=0; i < nsamples - 1; i++) {
+	r = nmxp_steim_push_diff(st, diff[i]);
+	if(r < 0) {
+	    return r;
+	}
+	ret += r;
+	st->x_fed = NMXP_STEIM_ADD(st->x_fed, diff[i]);
+	st->stream_count_fed++;
+    }
+
+    return ret;
+}
+
+
+int nmxp_steim_feed_compressed(NMXP_STEIM *st, char *buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr) {
+    int ret = 0;
+    int r;
+    int32_t diff[16];
+    int32_t remaining;
+    int32_t comp_bytecount;
+    int i, j, k;
+
+    if(hdr->nSamp <= 0) {
+	return 0;
+    }
+
+    r = nmxp_steim_begin_packet(st, hdr->time, hdr->sampRate, hdr->x0);
+    if(r < 0) {
+	return r;
+    }
+    ret += r;
+
+    /* The last difference of a packet leads to the first sample of the next one */
+    remaining = hdr->nSamp - 1;
+    comp_bytecount = length_data - 21;
+    for(i=0; i+17 <= comp_bytecount  &&  remaining > 0; i+=17) {
+	k = nmxp_data_unpack_bundle_diff(diff, (unsigned char *) buffer_data + 21 + i);
+	if(k < 0) {
+	    break;
+	}
+	for(j=0; j < k  &&  remaining > 0; j++) {
+	    r = nmxp_steim_push_diff(st, diff[j]);
+	    if(r < 0) {
+		return r;
+	    }
+	    ret += r;
+	    st->x_fed = NMXP_STEIM_ADD(st->x_fed, diff[j]);
+	    st->stream_count_fed++;
+	    remaining--;
+	}
+    }
+
+    return ret;
+}
+
@@ -0,0 +1,215 @@
+/*! \file
+ *
+ * \brief Time-outs of many items for Nanometrics Protocol Library
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#include "config.h"
+#include "nmxp_timer.h"
+#include "nmxp_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static void nmxp_timer_swap(NMXP_TIMER *t, int32_t i, int32_t j) {
+    NMXP_TIMER_ITEM item = t->heap[i];
+    t->heap[i] = t->heap[j];
+    t->heap[j] = item;
+    t->pos[t->heap[i].id] = i;
+    t->pos[t->heap[j].id] = j;
+}
+
+static void nmxp_timer_up(NMXP_TIMER *t, int32_t i) {
+    int32_t parent;
+
+    while(i > 0) {
+	parent = (i - 1) / 2;
+	if(t->heap[parent].deadline_ms <= t->heap[i].deadline_ms) {
+	    break;
+	}
+	nmxp_timer_swap(t, i, parent);
+	i = parent;
+    }
+}
+
+static void nmxp_timer_down(NMXP_TIMER *t, int32_t i) {
+    int32_t child;
+
+    while( (child = 2 * i + 1) < t->n_items) {
+	if(child + 1 < t->n_items  &&  t->heap[child + 1].deadline_ms < t->heap[child].deadline_ms) {
+	    child++;
+	}
+	if(t->heap[i].deadline_ms <= t->heap[child].deadline_ms) {
+	    break;
+	}
+	nmxp_timer_swap(t, i, child);
+	i = child;
+    }
+}
+
+/* Replace item i with the last one and restore the heap */
+static void nmxp_timer_remove_at(NMXP_TIMER *t, int32_t i) {
+    int32_t moved_id;
+
+    t->pos[t->heap[i].id] = -1;
+    t->n_items--;
+    if(i != t->n_items) {
+	t->heap[i] = t->heap[t->n_items];
+	moved_id = t->heap[i].id;
+	t->pos[moved_id] = i;
+	nmxp_timer_up(t, i);
+	nmxp_timer_down(t, t->pos[moved_id]);
+    }
+}
+
+
+int nmxp_timer_init(NMXP_TIMER *t, int32_t n_ids) {
+    int32_t i;
+
+    t->n_ids = n_ids;
+    t->n_items = 0;
+    t->heap = (NMXP_TIMER_ITEM *) NMXP_MEM_MALLOC(sizeof(NMXP_TIMER_ITEM) * (n_ids + 1));
+    t->pos = (int32_t *) NMXP_MEM_MALLOC(sizeof(int32_t) * (n_ids + 1));
+    if(t->heap == NULL  ||  t->pos == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_timer_init(): error allocating memory.\n");
+	nmxp_timer_free(t);
+	return -1;
+    }
+    for(i=0; i < n_ids; i++) {
+	t->pos[i] = -1;
+    }
+
+    return 0;
+}
+
+
+int nmxp_timer_resize(NMXP_TIMER *t, int32_t n_ids) {
+    int32_t i;
+    NMXP_TIMER_ITEM *heap = NULL;
+    int32_t *pos = NULL;
+
+    if(n_ids <= t->n_ids) {
+	return 0;
+    }
+
+    heap = (NMXP_TIMER_ITEM *) NMXP_MEM_MALLOC(sizeof(NMXP_TIMER_ITEM) * (n_ids + 1));
+    pos = (int32_t *) NMXP_MEM_MALLOC(sizeof(int32_t) * (n_ids + 1));
+    if(heap == NULL  ||  pos == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_timer_resize(): error allocating memory.\n");
+	if(heap) {
+	    NMXP_MEM_FREE(heap);
+	}
+	if(pos) {
+	    NMXP_MEM_FREE(pos);
+	}
+	return -1;
+    }
+
+    for(i=0; i < t->n_items; i++) {
+	heap[i] = t->heap[i];
+    }
+    for(i=0; i < n_ids; i++) {
+	pos[i] = (i < t->n_ids)? t->pos[i] : -1;
+    }
+
+    if(t->heap) {
+	NMXP_MEM_FREE(t->heap);
+    }
+    if(t->pos) {
+	NMXP_MEM_FREE(t->pos);
+    }
+    t->heap = heap;
+    t->pos = pos;
+    t->n_ids = n_ids;
+
+    return 0;
+}
+
+
+void nmxp_timer_free(NMXP_TIMER *t) {
+    if(t->heap) {
+	NMXP_MEM_FREE(t->heap);
+	t->heap = NULL;
+    }
+    if(t->pos) {
+	NMXP_MEM_FREE(t->pos);
+	t->pos = NULL;
+    }
+    t->n_ids = 0;
+    t->n_items = 0;
+}
+
+
+void nmxp_timer_set(NMXP_TIMER *t, int32_t id, int64_t deadline_ms) {
+    int32_t i;
+
+    if(id < 0  ||  id >= t->n_ids) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxp_timer_set(): wrong identifier %d.\n", id);
+	return;
+    }
+
+    i = t->pos[id];
+    if(i == -1) {
+	i = t->n_items++;
+	t->heap[i].id = id;
+	t->heap[i].deadline_ms = deadline_ms;
+	t->pos[id] = i;
+	nmxp_timer_up(t, i);
+    } else if(deadline_ms < t->heap[i].deadline_ms) {
+	t->heap[i].deadline_ms = deadline_ms;
+	nmxp_timer_up(t, i);
+    } else {
+	t->heap[i].deadline_ms = deadline_ms;
+	nmxp_timer_down(t, i);
+    }
+}
+
+
+void nmxp_timer_cancel(NMXP_TIMER *t, int32_t id) {
+    if(id >= 0  &&  id < t->n_ids  &&  t->pos[id] != -1) {
+	nmxp_timer_remove_at(t, t->pos[id]);
+    }
+}
+
+
+void nmxp_timer_move(NMXP_TIMER *t, int32_t id, int32_t new_id) {
+    int32_t i;
+
+    if(id < 0  ||  id >= t->n_ids  ||  new_id < 0  ||  new_id >= t->n_ids  ||  id == new_id) {
+	return;
+    }
+
+    nmxp_timer_cancel(t, new_id);
+    i = t->pos[id];
+    if(i != -1) {
+	t->heap[i].id = new_id;
+	t->pos[new_id] = i;
+	t->pos[id] = -1;
+    }
+}
+
+
+int32_t nmxp_timer_expired(NMXP_TIMER *t, int64_t now_ms) {
+    int32_t id = -1;
+
+    if(t->n_items > 0  &&  t->heap[0].deadline_ms <= now_ms) {
+	id = t->heap[0].id;
+	nmxp_timer_remove_at(t, 0);
+    }
+
+    return id;
+}
+
+
+int64_t nmxp_timer_next_deadline(NMXP_TIMER *t) {
+    return (t->n_items > 0)? t->heap[0].deadline_ms : -1;
+}
+
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 #include <signal.h>
 
@@ -26,6 +27,7 @@
 #include "nmxptool_chanseq.h"
 #include "nmxptool_sigcondition.h"
 #include <nmxptool_listen.h>
+#include "nmxptool_gapfill.h"
 
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
@@ -51,6 +53,11 @@
 
 #define TIMES_FLOW_EXIT 100
 
+/* First wait before a fast reconnect to NaqsServer (msec.) */
+#define NMXPTOOL_RECONNECT_FIRST_MS 10
+/* Waits before a reconnect are checked for exit conditions every (msec.) */
+#define NMXPTOOL_RECONNECT_STEP_MS 200
+
 int if_dap_condition_only_one_time = 0;
 
 #define DAP_CONDITION(params_struct) (params_struct.start_time != 0.0 || params_struct.delay > 0)
@@ -71,22 +78,36 @@ int if_dap_condition_only_one_time = 0;
 static void ShutdownHandler(int sig);
 static void nmxptool_AlarmHandler(int sig);
 static void CloseConnectionHandler(int sig);
+static void ReloadHandler(int sig);
 
 int nmxptool_exitcondition_on_open_socket();
+int nmxptool_connect_standby();
+int nmxptool_pds_reconnect(int *isock, char *hostname, NMXP_RECV_BUFFER *rb, int *wait_ms, int (*func_cond)(void));
+int nmxptool_sendAddTimeSeriesChannel(int isock, NMXP_BUFFER_FLAG buffer_flag);
 
 void flushing_raw_data_stream();
+double nmxptool_after_start_time(int cur_chan);
+int nmxptool_drop_packet(NMXP_PACKET_HEADER *hdr);
 
 void *nmxptool_print_info_raw_stream(void *arg);
 int nmxptool_print_seq_no(NMXP_DATA_PROCESS *pd);
 void nmxptool_str_time_to_filename(char *str_time);
+int nmxptool_chan_index(NMXP_DATA_PROCESS *pd);
+void nmxptool_chanmod_apply(NMXP_TIMER *timer);
 
 #ifdef HAVE_SEEDLINK
 #define MAX_LEN_STATION_ID 64
-int seedlink_station_id(NMXP_DATA_PROCESS *pd, NMXPTOOL_PARAMS *params, char *station_id, int size);
+const char *seedlink_station_id(NMXP_DATA_PROCESS *pd, NMXPTOOL_PARAMS *params, char *station_id, int size);
 #endif
 
 #ifdef HAVE_LIBMSEED
+int nmxptool_msr_init(MSRecord **msr_list, int i_chan);
+int nmxptool_msr_list_init(MSRecord ***pmsr_list);
+void nmxptool_msr_list_free(MSRecord ***pmsr_list);
 int nmxptool_write_miniseed(NMXP_DATA_PROCESS *pd);
+int nmxptool_steim_init(int i_chan);
+void nmxptool_steim_free(int i_chan);
+int nmxptool_steim_feed(NMXP_DATA_PROCESS *pd, char *buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr);
 int nmxptool_log_miniseed(const char *s);
 int nmxptool_logerr_miniseed(const char *s);
 #endif
@@ -110,6 +131,23 @@ void *status_thread;
 void *p_nmxp_sendAddTimeSeriesChannel(void *arg);
 #endif
 
+#ifdef HAVE_PTHREAD_H
+/* Background reconnection of the NaqsServer lost in hot-standby mode */
+typedef struct {
+    int i_server;	/* 0 is params.hostname, 1 is params.hostname_standby */
+    NMXP_RECV_BUFFER *rb;	/* Read buffer of the server, set up again on success */
+    int started;	/* Thread started and not yet joined */
+    int result;		/* 0 running, 1 reconnected, -1 given up */
+    int stop;		/* The PDS flow is ending */
+    pthread_t thread;
+} NMXPTOOL_RECONNECT_LOST;
+
+pthread_mutex_t mutex_reconnect_lost = PTHREAD_MUTEX_INITIALIZER;
+NMXPTOOL_RECONNECT_LOST reconnect_lost = {0};
+void nmxptool_reconnect_lost_start(int i_server, NMXP_RECV_BUFFER *rb);
+int nmxptool_reconnect_lost_join(int stop);
+#endif
+
 #ifdef HAVE_PTHREAD_H
 pthread_t thread_socket_listen;
 pthread_attr_t attr_socket_listen;
@@ -123,6 +161,7 @@ NMXPTOOL_PARAMS params={0};
 
 
 int naqssock = 0;
+int naqssock_standby = 0;
 int flag_force_close_connection = 0;
 FILE *outfile = NULL;
 NMXP_CHAN_LIST *channelList = NULL;
@@ -132,6 +171,31 @@ NMXPTOOL_CHAN_SEQ *channelList_Seq = NULL;
 NMXP_META_CHAN_LIST *meta_channelList = NULL;
 int n_func_pd = 0;
 int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *);
+/* Functions executed on the packets as soon as they arrive, used by --dualoutput */
+int n_func_pd_first = 0;
+int (*p_func_pd_first[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *);
+
+/* Items allocated for channelList_Seq, msr_list_chan, msr_list_chan_slink and the time-outs of the raw streams */
+int32_t channelList_Seq_size = 0;
+
+/* Channel changes requested at runtime, applied by the main thread within the PDS loop */
+#define NMXPTOOL_CHANMOD_MAX_QUEUE 16
+typedef struct {
+    int action;
+    char *patterns;
+} NMXPTOOL_CHANMOD;
+NMXPTOOL_CHANMOD chanmod_queue[NMXPTOOL_CHANMOD_MAX_QUEUE];
+int n_chanmod = 0;
+volatile sig_atomic_t flag_reload_statefile = 0;
+#ifdef HAVE_PTHREAD_H
+pthread_mutex_t mutex_chanmod = PTHREAD_MUTEX_INITIALIZER;
+/* Held by the main thread while changing channelList_subset, by other threads while reading it */
+pthread_mutex_t mutex_channelList_subset = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Packets used and dropped as redundant, coming from the primary [0] and the hot-standby [1] NaqsServer */
+int32_t pds_server_packets[2] = {0, 0};
+int32_t pds_server_dropped[2] = {0, 0};
 
 time_t lasttime_pds_receiveddata;
 time_t timeout_pds_receiveddata = (NMXP_HIGHEST_TIMEOUT * 2);
@@ -139,7 +203,22 @@ time_t timeout_pds_receiveddata = (NMXP_HIGHEST_TIMEOUT * 2);
 #ifdef HAVE_LIBMSEED
 /* Mini-SEED variables */
 NMXP_DATA_SEED data_seed;
-MSRecord *msr_list_chan[MAX_N_CHAN];
+MSRecord **msr_list_chan = NULL;
+/* Records of the immediate SeedLink output, -K, not shared with the ordered mini-SEED files */
+MSRecord **msr_list_chan_slink = NULL;
+
+/* Steim transcoder of a channel, used by --transcode */
+typedef struct {
+    NMXP_STEIM st;
+    MSRecord *msr;		/* header of the last record, gives the file name */
+    int32_t *check_samples;	/* decoded samples not yet found in a record, for --transcode_check */
+    double *check_time;		/* time of each item of check_samples */
+    int32_t check_n;
+    int32_t check_size;
+} NMXPTOOL_STEIM_CHAN;
+NMXPTOOL_STEIM_CHAN **steim_list_chan = NULL;
+int32_t steim_check_records = 0;
+int32_t steim_check_errors = 0;
 #endif
 
 int ew_check_flag_terminate = 0;
@@ -152,10 +231,12 @@ int main (int argc, char **argv) {
 #endif
     int cur_chan = 0;
     int to_cur_chan = 0;
+    int i_func_pd;
     int request_chan;
     int exitpdscondition;
     int exitdapcondition;
-    time_t timeout_for_channel;
+    NMXP_TIMER timer_raw_stream = {0};
+    int64_t now_ms;
 
     int time_to_sleep = 0;
 
@@ -164,6 +245,15 @@ int main (int argc, char **argv) {
 
     NMXP_MSG_SERVER type;
     char buffer[NMXP_MAX_LENGTH_DATA_BUFFER]={0};
+    NMXP_RECV_BUFFER recv_buffer = {0};
+    NMXP_RECV_BUFFER recv_buffer_standby = {0};
+    NMXP_RECV_BUFFER *recv_buffers[2];
+    int recv_server[2];
+    int n_recv_buffers = 0;
+    int i_recv_buffer = -1;
+    int i_server = 0;
+    int reconnect_wait_ms = NMXPTOOL_RECONNECT_FIRST_MS;
+    char *msg_buffer = NULL;
     int32_t length;
     int ret;
     int main_ret = 0;
@@ -189,9 +279,17 @@ int main (int argc, char **argv) {
     char start_time_str[30], end_time_str[30], default_start_time_str[30];
 
     NMXP_DATA_PROCESS *pd = NULL;
+    /* Caller-owned buffers reused for every received packet */
+    NMXP_DATA_PROCESS pd_buf;
+    int32_t pd_samples[NMXP_MAX_OUTDATA];
+    /* Packet from the pool, handed over to the raw stream without copying */
+    NMXP_DATA_PROCESS *pd_pool = NULL;
+    NMXP_PACKET_HEADER pkt_hdr;
+    int flag_packet_dropped = 0;
 
 #ifdef HAVE_PTHREAD_H
     pthread_mutex_init(&mutex_sendAddTimeSeriesChannel, NULL);
+    pthread_mutex_init(&mutex_reconnect_lost, NULL);
 #endif
 
 #ifndef HAVE_WINDOWS_H
@@ -211,8 +309,10 @@ int main (int argc, char **argv) {
     sigaction(SIGQUIT, &sa, NULL); 
     sigaction(SIGTERM, &sa, NULL);
 
-    sa.sa_handler = SIG_IGN;
+    sa.sa_handler = ReloadHandler;
     sigaction(SIGHUP, &sa, NULL);
+
+    sa.sa_handler = SIG_IGN;
     sigaction(SIGPIPE, &sa, NULL); 
 #else
     /* Signal handling, use function signal() */
@@ -277,6 +377,7 @@ int main (int argc, char **argv) {
 
 	    /* nmxp_meta_chan_print(meta_channelList); */
 	    nmxp_meta_chan_print_with_match(meta_channelList, params.channels);
+	    nmxp_meta_chan_free(&meta_channelList);
 
 	    return 1;
 
@@ -323,8 +424,8 @@ int main (int argc, char **argv) {
 	}
 
 #ifdef HAVE_LIBMSEED
-	/* Write Mini-SEED record */
-	if(params.type_writeseed) {
+	/* Write Mini-SEED record, unless the packets are transcoded as they arrive */
+	if(params.type_writeseed  &&  !params.flag_transcode) {
 	    p_func_pd[n_func_pd++] = nmxptool_write_miniseed;
 	}
 #endif
@@ -332,7 +433,11 @@ int main (int argc, char **argv) {
 #ifdef HAVE_SEEDLINK
 	/* Send data to SeedLink Server */
 	if(params.flag_slink) {
-	    p_func_pd[n_func_pd++] = nmxptool_send_raw_depoch;
+	    if(params.flag_dualoutput) {
+		p_func_pd_first[n_func_pd_first++] = nmxptool_send_raw_depoch;
+	    } else {
+		p_func_pd[n_func_pd++] = nmxptool_send_raw_depoch;
+	    }
 	}
 #endif
 
@@ -340,14 +445,22 @@ int main (int argc, char **argv) {
 #ifdef HAVE_SEEDLINK
 	/* Send data to SeedLink Server */
 	if(params.flag_slinkms) {
-	    p_func_pd[n_func_pd++] = nmxptool_msr_send_mseed;
+	    if(params.flag_dualoutput) {
+		p_func_pd_first[n_func_pd_first++] = nmxptool_msr_send_mseed;
+	    } else {
+		p_func_pd[n_func_pd++] = nmxptool_msr_send_mseed;
+	    }
 	}
 #endif
 #endif
 
 #ifdef HAVE_EARTHWORMOBJS
 	if(params.ew_configuration_file) {
-	    p_func_pd[n_func_pd++] = nmxptool_ew_nmx2ew;
+	    if(params.flag_dualoutput) {
+		p_func_pd_first[n_func_pd_first++] = nmxptool_ew_nmx2ew;
+	    } else {
+		p_func_pd[n_func_pd++] = nmxptool_ew_nmx2ew;
+	    }
 	}
 #endif
 
@@ -399,47 +512,54 @@ int main (int argc, char **argv) {
 	nmxp_chan_print_netchannelList(channelList_subset);
 
 	nmxptool_chanseq_init(&channelList_Seq, channelList_subset->number, DEFAULT_BUFFERED_TIME, params.max_tolerable_latency, params.timeoutrecv);
+	channelList_Seq_size = channelList_subset->number;
+	if(nmxp_timer_init(&timer_raw_stream, channelList_subset->number) != 0) {
+	    return 1;
+	}
+	if(params.adapt_latency_percentile > 0) {
+	    for(to_cur_chan = 0; to_cur_chan < channelList_subset->number; to_cur_chan++) {
+		nmxp_raw_stream_set_adaptive_latency(&(channelList_Seq[to_cur_chan].raw_stream_buffer),
+			params.adapt_latency_min, params.adapt_latency_percentile);
+	    }
+	}
+	if(params.gapfill_workers > 0) {
+	    if(nmxptool_gapfill_init(&params, channelList_subset) != 0) {
+		return 1;
+	    }
+	    for(to_cur_chan = 0; to_cur_chan < channelList_subset->number; to_cur_chan++) {
+		channelList_Seq[to_cur_chan].raw_stream_buffer.func_gap = nmxptool_gapfill_raw_stream_gap;
+	    }
+	}
 
 #ifdef HAVE_LIBMSEED
-	if(params.type_writeseed  ||  params.flag_slinkms) {
+	if(params.type_writeseed) {
 	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Init mini-SEED record list.\n");
+	    if(nmxptool_msr_list_init(&msr_list_chan) != 0) {
+		return 1;
+	    }
+	}
 
-	    /* Init mini-SEED record list */
-	    for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
-
-		nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA,
-			"Init mini-SEED record for %s\n", NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
-
-		msr_list_chan[i_chan] = msr_init(NULL);
-
-		/* Separate station_code and channel_code */
-		if(nmxp_chan_cpy_sta_chan(channelList_subset->channel[i_chan].name, station_code, channel_code, network_code, location_code)) {
-
-		    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "%s.%s.%s\n",
-			    NMXP_LOG_STR(NETCODE_OR_CURRENT_NETWORK), NMXP_LOG_STR(station_code), NMXP_LOG_STR(channel_code));
-		    strncpy(msr_list_chan[i_chan]->network, NETCODE_OR_CURRENT_NETWORK, 11);
-		    strncpy(msr_list_chan[i_chan]->station, station_code, 11);
-		    strncpy(msr_list_chan[i_chan]->channel, channel_code, 11);
-		    if(location_code[0] != 0) {
-		      if(strcmp(location_code, DEFAULT_NULL_LOCATION) != 0) {
-			strncpy(msr_list_chan[i_chan]->location, location_code, 11);
-		      }
-		    }
-
-		    msr_list_chan[i_chan]->reclen   = params.reclen;     /* Byte record length */
-		    msr_list_chan[i_chan]->encoding = params.encoding;  /* Steim 1 compression by default */
+	if(params.flag_slinkms) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Init mini-SEED record list for SeedLink.\n");
+	    if(nmxptool_msr_list_init(&msr_list_chan_slink) != 0) {
+		return 1;
+	    }
+	}
 
-		    /* Reset some values */
-		    msr_list_chan[i_chan]->sequence_number = 0;
-		    msr_list_chan[i_chan]->datasamples = NULL;
-		    msr_list_chan[i_chan]->numsamples = 0;
+	if(params.flag_transcode) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Init Steim transcoder list.\n");
 
-		} else {
-		    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL,
-			    "Channels %s error in format!\n", NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
+	    /* Init Steim transcoder list */
+	    steim_list_chan = (NMXPTOOL_STEIM_CHAN **) NMXP_MEM_MALLOC(sizeof(NMXPTOOL_STEIM_CHAN *) * (channelList_subset->number + 1));
+	    if(steim_list_chan == NULL) {
+		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating Steim transcoder list!\n");
+		exit(-1);
+	    }
+	    memset(steim_list_chan, 0, sizeof(NMXPTOOL_STEIM_CHAN *) * (channelList_subset->number + 1));
+	    for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
+		if(nmxptool_steim_init(i_chan) != 0) {
 		    return 1;
 		}
-
 	    }
 	}
 #endif
@@ -633,16 +753,12 @@ int main (int argc, char **argv) {
 #endif
 			 ) {
 			/* Process a packet and return value in NMXP_DATA_PROCESS structure */ /*STEFANO*/
-                        
-			if (pd != NULL) {
-			    if (pd->pDataPtr != NULL) {
-				NMXP_MEM_FREE(pd->pDataPtr);
-			    }
-			    NMXP_MEM_FREE(pd);
+			pd = NULL;
+			if(nmxp_processCompressedData_r(buffer, length, channelList_subset, NETCODE_OR_CURRENT_NETWORK, LOCCODE_OR_CURRENT_LOCATION,
+				    &pd_buf, pd_samples, NMXP_MAX_OUTDATA) == 0) {
+			    pd = &pd_buf;
 			}
 
-			pd = nmxp_processCompressedData(buffer, length, channelList_subset, NETCODE_OR_CURRENT_NETWORK, LOCCODE_OR_CURRENT_LOCATION);
-
 			/* Force value for timing_quality if declared in the command-line */
 			if(pd && params.timing_quality != -1) {
 			    pd->timing_quality = params.timing_quality;
@@ -654,10 +770,12 @@ int main (int argc, char **argv) {
                         }
 			                                                                          
 
-			nmxp_data_trim(pd, params.start_time, params.end_time, 0);
+			if(pd) {
+			    nmxp_data_trim(pd, params.start_time, params.end_time, 0);
+			}
 
 			/* To prevent to manage a packet with zero sample after nmxp_data_trim() */
-			if(pd->nSamp > 0) {
+			if(pd  &&  pd->nSamp > 0) {
 
 			/* Log contents of last packet */
 			if(params.flag_logdata) {
@@ -665,7 +783,7 @@ int main (int argc, char **argv) {
 			}
 
 			/* Set cur_chan */
-			cur_chan = nmxp_chan_lookupKeyIndex(pd->key, channelList_subset);
+			cur_chan = nmxptool_chan_index(pd);
 
 			/* It is not the channel I have requested or error from nmxp_chan_lookupKeyIndex() */
 			if(request_chan != cur_chan  &&  cur_chan != -1) {
@@ -797,7 +915,7 @@ int main (int argc, char **argv) {
 
 #ifdef HAVE_LIBMSEED
 	if(params.type_writeseed) {
-	    if(*msr_list_chan) {
+	    if(msr_list_chan) {
 		for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
 		    if(msr_list_chan[i_chan]) {
 			/* Flush remaining samples */
@@ -851,16 +969,11 @@ int main (int argc, char **argv) {
 	/* Get a subset of channel from arguments, in respect to the step 3 of PDS */
 	channelList_subset_waste = nmxp_chan_subset(channelList, NMXP_DATA_TIMESERIES, params.channels, CURRENT_NETWORK, CURRENT_LOCATION);
 
-	/* Free the complete channel list */
-	if(channelList) {
-	    NMXP_MEM_FREE(channelList);
-	    channelList = NULL;
-	}
+	/* The complete channel list is kept for the channels added at runtime */
 
 	/* TODO check if channelList_subset_waste is equal to channelList_subset and free */
 	if(channelList_subset_waste) {
-	    NMXP_MEM_FREE(channelList_subset_waste);
-	    channelList_subset_waste = NULL;
+	    nmxp_chan_list_net_free(&channelList_subset_waste);
 	}
 
 	/* PDS Step 4: Send a Request Pending (optional) */
@@ -891,10 +1004,46 @@ int main (int argc, char **argv) {
 #endif
 #endif
 
+	/* Hot-standby NaqsServer: same subscription, duplicated packets are dropped by seq_no */
+	naqssock_standby = 0;
+	if(params.hostname_standby) {
+	    naqssock_standby = nmxptool_connect_standby();
+	    if(naqssock_standby == NMXP_SOCKET_ERROR) {
+		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_CONNFLOW, "Hot-standby %s not available, going on with %s only.\n",
+			NMXP_LOG_STR(params.hostname_standby), NMXP_LOG_STR(params.hostname));
+		naqssock_standby = 0;
+	    }
+	}
+
 	/* PDS Step 6: Repeat until finished: receive and handle packets */
 
 	/* TODO*/
 	exitpdscondition = 1;
+	n_recv_buffers = 0;
+	i_recv_buffer = -1;
+	reconnect_wait_ms = NMXPTOOL_RECONNECT_FIRST_MS;
+	pds_server_packets[0] = pds_server_packets[1] = 0;
+	pds_server_dropped[0] = pds_server_dropped[1] = 0;
+	if(nmxp_recv_buffer_init(&recv_buffer, naqssock, NMXP_RECV_BUFFER_SIZE) != 0) {
+	    exitpdscondition = 0;
+	} else {
+	    recv_buffers[n_recv_buffers] = &recv_buffer;
+	    recv_server[n_recv_buffers++] = 0;
+	}
+	if(naqssock_standby > 0) {
+	    if(nmxp_recv_buffer_init(&recv_buffer_standby, naqssock_standby, NMXP_RECV_BUFFER_SIZE) != 0) {
+		exitpdscondition = 0;
+	    } else {
+		recv_buffers[n_recv_buffers] = &recv_buffer_standby;
+		recv_server[n_recv_buffers++] = 1;
+	    }
+	}
+#ifdef HAVE_PTHREAD_H
+	/* Hot-standby not available, keep on trying in background */
+	if(params.hostname_standby  &&  naqssock_standby <= 0  &&  exitpdscondition) {
+	    nmxptool_reconnect_lost_start(1, &recv_buffer_standby);
+	}
+#endif
 	flag_force_close_connection = 0;
 
 	skip_current_packet = 0;
@@ -909,21 +1058,85 @@ int main (int argc, char **argv) {
 #endif
 	     ) {
 	    
-	    /* added 2010-07-26, RR */
-            if (pd != NULL) {
-              if (pd->pDataPtr != NULL) {
-                NMXP_MEM_FREE(pd->pDataPtr);
-              }
-              NMXP_MEM_FREE(pd);
-            } 
-	    /* Process Compressed or Decompressed Data */
-	    pd = nmxp_receiveData(naqssock, channelList_subset, NETCODE_OR_CURRENT_NETWORK, LOCCODE_OR_CURRENT_LOCATION, params.timeoutrecv, &recv_errno);
-
-	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_EXTRA, "Received %s packet.\n", (pd)? "not null" : "null");
+#ifdef HAVE_PTHREAD_H
+	    /* The lost NaqsServer is back, receive again from both */
+	    if(n_recv_buffers == 1  &&  (i_server = nmxptool_reconnect_lost_join(0)) != -1) {
+		recv_buffers[n_recv_buffers] = (i_server == 0)? &recv_buffer : &recv_buffer_standby;
+		recv_server[n_recv_buffers++] = i_server;
+		i_recv_buffer = -1;
+		nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Going on with %s and %s.\n",
+			NMXP_LOG_STR(params.hostname), NMXP_LOG_STR(params.hostname_standby));
+	    }
+#endif
+
+	    /* Receive Compressed or Decompressed Data */
+	    pd = NULL;
+	    flag_packet_dropped = 0;
+	    if(nmxp_receiveMessage_buffers(recv_buffers, n_recv_buffers, &i_recv_buffer, &type, &msg_buffer, &length,
+			params.timeoutrecv * 1000, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER) == NMXP_SOCKET_OK) {
+		i_server = recv_server[i_recv_buffer];
+		/* The packet of the previous message has not been handed over to the raw stream */
+		if(pd_pool) {
+		    nmxp_raw_stream_pd_put(pd_pool);
+		    pd_pool = NULL;
+		}
+		if(type == NMXP_MSG_COMPRESSED) {
+		    /* Look at the header and unpack only packets that will be used,
+		     * into a block of the pool sized for their samples */
+		    if(nmxp_processCompressedHeader(msg_buffer, length, &pkt_hdr) == 0) {
+			if(nmxptool_drop_packet(&pkt_hdr)) {
+			    flag_packet_dropped = 1;
+			} else if( (pd_pool = nmxp_raw_stream_pd_get_size(NMXP_COMPRESSED_OUTDATA_SIZE(pkt_hdr.nSamp))) != NULL
+				&&  nmxp_processCompressedData_hdr(msg_buffer, length, &pkt_hdr, channelList_subset, NETCODE_OR_CURRENT_NETWORK, LOCCODE_OR_CURRENT_LOCATION,
+				    pd_pool, (int32_t *) pd_pool->pDataPtr, NMXP_COMPRESSED_OUTDATA_SIZE(pkt_hdr.nSamp)) == 0) {
+			    pd = pd_pool;
+#ifdef HAVE_LIBMSEED
+			    if(steim_list_chan) {
+				nmxptool_steim_feed(pd, msg_buffer, length, &pkt_hdr);
+			    }
+#endif
+			}
+		    }
+		} else if(type == NMXP_MSG_DECOMPRESSED) {
+		    if( (pd_pool = nmxp_raw_stream_pd_get_size(NMXP_DECOMPRESSED_OUTDATA_SIZE(length))) != NULL
+			    &&  nmxp_processDecompressedData_r(msg_buffer, length, channelList_subset, NETCODE_OR_CURRENT_NETWORK, LOCCODE_OR_CURRENT_LOCATION,
+				pd_pool, (int32_t *) pd_pool->pDataPtr, NMXP_DECOMPRESSED_OUTDATA_SIZE(length)) == 0) {
+			pd = pd_pool;
+		    }
+		} else {
+		    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Type %d is not NMXP_MSG_COMPRESSED or NMXP_MSG_DECOMPRESSED!\n", type);
+		}
+		if(pd) {
+		    pds_server_packets[i_server]++;
+		} else if(flag_packet_dropped) {
+		    pds_server_dropped[i_server]++;
+		}
+	    } else if(n_recv_buffers > 1  &&  i_recv_buffer >= 0) {
+		/* One of the two servers has been lost, go on with the other one */
+		i_server = recv_server[i_recv_buffer];
+		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_CONNFLOW, "Connection to %s lost (recv_errno=%d), going on with %s.\n",
+			NMXP_LOG_STR(((i_server == 0)? params.hostname : params.hostname_standby)), recv_errno,
+			NMXP_LOG_STR(((i_server == 0)? params.hostname_standby : params.hostname)));
+		nmxp_recv_buffer_free(recv_buffers[i_recv_buffer]);
+		if(i_recv_buffer == 0) {
+		    recv_buffers[0] = recv_buffers[1];
+		    recv_server[0] = recv_server[1];
+		}
+		n_recv_buffers = 1;
+		i_recv_buffer = -1;
+		recv_errno = 0;
+#ifdef HAVE_PTHREAD_H
+		/* Its socket is closed and opened again by the background reconnection */
+		nmxptool_reconnect_lost_start(i_server, (i_server == 0)? &recv_buffer : &recv_buffer_standby);
+#endif
+	    }
+
+	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_EXTRA, "Received %s packet.\n", (pd)? "not null" : ((flag_packet_dropped)? "dropped" : "null"));
 
 	    /* Get time when receive some data */
-	    if(pd) {
+	    if(pd  ||  flag_packet_dropped) {
 		time(&lasttime_pds_receiveddata);
+		reconnect_wait_ms = NMXPTOOL_RECONNECT_FIRST_MS;
 	    }
 
 	    if ( (time(NULL) - lasttime_pds_receiveddata) >= timeout_pds_receiveddata ) {
@@ -942,7 +1155,7 @@ int main (int argc, char **argv) {
               pd->quality_indicator = params.quality_indicator;
             }
                                                                                                             
-	    if(!pd) {
+	    if(!pd  &&  !flag_packet_dropped) {
 		pd_null_count++;
 		if((pd_null_count * params.timeoutrecv) >= timeoutrecv_warning) {
 		    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "Received %d times a null packet. (%d sec.)\n",
@@ -975,12 +1188,25 @@ int main (int argc, char **argv) {
 		    }
 #endif
 		    exitpdscondition = 0;
+
+		    /* Fast reconnect, channel list and raw stream states are kept */
+		    if(!nmxptool_sigcondition_read()) {
+			i_server = recv_server[0];
+			if(nmxptool_pds_reconnect((i_server == 0)? &naqssock : &naqssock_standby,
+				    (i_server == 0)? params.hostname : params.hostname_standby, recv_buffers[0], &reconnect_wait_ms,
+				    nmxptool_exitcondition_on_open_socket) == 0) {
+			    i_recv_buffer = -1;
+			    recv_errno = 0;
+			    time(&lasttime_pds_receiveddata);
+			    exitpdscondition = 1;
+			}
+		    }
 		}
 	    }
 
 	    if(pd) {
 		/* Set cur_chan */
-		cur_chan = nmxp_chan_lookupKeyIndex(pd->key, channelList_subset);
+		cur_chan = nmxptool_chan_index(pd);
 		if(cur_chan == -1) {
 		    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Key %d not found in channelList_subset!\n",
 			    pd->key);
@@ -997,13 +1223,7 @@ int main (int argc, char **argv) {
 		    (params.statefile  ||  params.buffered_time) &&
 		    ( params.timeoutrecv <= 0 )
 	      )	{
-		if(params.statefile && channelList_Seq[cur_chan].after_start_time > 0.0) {
-		    cur_after_start_time = channelList_Seq[cur_chan].after_start_time;
-		} else if(params.buffered_time) {
-		    cur_after_start_time = params.buffered_time;
-		} else {
-		    cur_after_start_time = DEFAULT_BUFFERED_TIME;
-		}
+		cur_after_start_time = nmxptool_after_start_time(cur_chan);
 		nmxp_data_to_str(cur_after_start_time_str, cur_after_start_time);
 		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_PACKETMAN, "cur_chan %d, cur_after_start_time %f, cur_after_start_time_str %s\n",
 			cur_chan, cur_after_start_time, NMXP_LOG_STR(cur_after_start_time_str));
@@ -1033,25 +1253,42 @@ int main (int argc, char **argv) {
 		/* Manage Raw Stream */
 		if(params.stc == -1) {
 
+		    now_ms = nmxp_clock_ms();
+
 		    /* cur_char is computed only for pd != NULL */
 		    if(pd) {
-			nmxp_raw_stream_manage(&(channelList_Seq[cur_chan].raw_stream_buffer), pd, p_func_pd, n_func_pd);
+			/* Store x_1 before pd is handed over to the raw stream */
+			if(pd->nSamp > 0) {
+			    channelList_Seq[cur_chan].x_1 = pd->pDataPtr[pd->nSamp-1];
+			}
+			/* Dual output: packets newer than the last one sent are executed at once, late ones only in order */
+			if(n_func_pd_first > 0
+				&&  (channelList_Seq[cur_chan].last_seq_no_first == -1  ||  pd->seq_no > channelList_Seq[cur_chan].last_seq_no_first)) {
+			    for(i_func_pd=0; i_func_pd < n_func_pd_first; i_func_pd++) {
+				(*p_func_pd_first[i_func_pd])(pd);
+			    }
+			    channelList_Seq[cur_chan].last_seq_no_first = pd->seq_no;
+			}
+			nmxp_raw_stream_manage_pd(&(channelList_Seq[cur_chan].raw_stream_buffer), pd, p_func_pd, n_func_pd);
+			pd = NULL;
+			pd_pool = NULL;
 			channelList_Seq[cur_chan].last_time_call_raw_stream = nmxp_data_gmtime_now();
+			if(params.timeoutrecv > 0) {
+			    nmxp_timer_set(&timer_raw_stream, cur_chan, now_ms + params.timeoutrecv * 1000);
+			}
 		    }
 
-		    /* Check timeout for other channels */
+		    /* Late data recovered from DataServer */
+		    nmxptool_gapfill_inject(p_func_pd, n_func_pd);
+
+		    /* Check timeout only for expired channels */
 		    if(params.timeoutrecv > 0) {
-			to_cur_chan = 0;
-			while(to_cur_chan < channelList_subset->number) {
-			    timeout_for_channel = nmxp_data_gmtime_now() - channelList_Seq[to_cur_chan].last_time_call_raw_stream;
-			    if(channelList_Seq[to_cur_chan].last_time_call_raw_stream != 0
-				    && timeout_for_channel >= params.timeoutrecv) {
-				nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_DOD, "Timeout for channel %s (%d sec.)\n",
-					NMXP_LOG_STR(channelList_subset->channel[to_cur_chan].name), timeout_for_channel);
-				nmxp_raw_stream_manage(&(channelList_Seq[to_cur_chan].raw_stream_buffer), NULL, p_func_pd, n_func_pd);
-				channelList_Seq[to_cur_chan].last_time_call_raw_stream = nmxp_data_gmtime_now();
-			    }
-			    to_cur_chan++;
+			while( (to_cur_chan = nmxp_timer_expired(&timer_raw_stream, now_ms)) != -1) {
+			    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_DOD, "Timeout for channel %s (%d sec.)\n",
+				    NMXP_LOG_STR(channelList_subset->channel[to_cur_chan].name), params.timeoutrecv);
+			    nmxp_raw_stream_manage(&(channelList_Seq[to_cur_chan].raw_stream_buffer), NULL, p_func_pd, n_func_pd);
+			    channelList_Seq[to_cur_chan].last_time_call_raw_stream = nmxp_data_gmtime_now();
+			    nmxp_timer_set(&timer_raw_stream, to_cur_chan, now_ms + params.timeoutrecv * 1000);
 			}
 		    }
 
@@ -1118,23 +1355,21 @@ int main (int argc, char **argv) {
 	    }
 #endif
 
+	    /* Channels added or removed at runtime */
+	    nmxptool_chanmod_apply(&timer_raw_stream);
+
 	    /* Better using a Thread */
 #ifndef HAVE_PTHREAD_H
 	    nmxp_sendAddTimeSeriesChannel(naqssock, channelList_subset, params.stc, params.rate,
 		    (params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO, params.n_channel, params.usec, 0);
 #endif
 
-	    if (pd != NULL) {
-		if (pd->pDataPtr != NULL) {
-		    NMXP_MEM_FREE(pd->pDataPtr);
-		}
-		NMXP_MEM_FREE(pd);
-	    }
-            
 	} /* End main PDS loop */
 
 #ifdef HAVE_PTHREAD_H
 	// pthread_join(thread_request_channels, &status_thread);
+	/* Stop the reconnection of a lost NaqsServer, if any */
+	nmxptool_reconnect_lost_join(1);
 #endif
 
 #ifdef HAVE_PTHREAD_H
@@ -1143,12 +1378,16 @@ int main (int argc, char **argv) {
 	pthread_mutex_unlock (&mutex_sendAddTimeSeriesChannel);
 #endif
 
+	nmxp_raw_stream_pd_put(pd_pool);
+	pd_pool = NULL;
+
 	/* Flush raw data stream for each channel */
 	flushing_raw_data_stream();
+	nmxptool_gapfill_inject(p_func_pd, n_func_pd);
 
 #ifdef HAVE_LIBMSEED
 	if(params.type_writeseed) {
-	    if(*msr_list_chan) {
+	    if(msr_list_chan) {
 		for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
 		    if(msr_list_chan[i_chan]) {
 			/* Flush remaining samples */
@@ -1156,16 +1395,49 @@ int main (int argc, char **argv) {
 		    }
 		}
 	    }
+	    if(steim_list_chan) {
+		for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
+		    if(steim_list_chan[i_chan]) {
+			/* Flush remaining differences */
+			nmxp_steim_flush(&(steim_list_chan[i_chan]->st));
+		    }
+		}
+	    }
 	    nmxp_data_seed_fclose_all(&data_seed);
 	}
 #endif
 
+	if(params.hostname_standby) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Packets from %s: %d used, %d redundant. Packets from %s: %d used, %d redundant.\n",
+		    NMXP_LOG_STR(params.hostname), pds_server_packets[0], pds_server_dropped[0],
+		    NMXP_LOG_STR(params.hostname_standby), pds_server_packets[1], pds_server_dropped[1]);
+	}
+
 	/* PDS Step 7: Send Terminate Subscription */
-	nmxp_sendTerminateSubscription(naqssock, NMXP_SHUTDOWN_NORMAL, "Good Bye!");
+	if(naqssock > 0) {
+	    nmxp_sendTerminateSubscription(naqssock, NMXP_SHUTDOWN_NORMAL, "Good Bye!");
+	}
+	if(naqssock_standby > 0) {
+	    nmxp_sendTerminateSubscription(naqssock_standby, NMXP_SHUTDOWN_NORMAL, "Good Bye!");
+	}
 
 	/* PDS Step 8: Close the socket */
-	nmxp_closeSocket(naqssock);
-	naqssock = 0;
+	if(naqssock > 0) {
+	    nmxp_closeSocket(naqssock);
+	    naqssock = 0;
+	}
+	if(naqssock_standby > 0) {
+	    nmxp_closeSocket(naqssock_standby);
+	    naqssock_standby = 0;
+	}
+	nmxp_recv_buffer_free(&recv_buffer);
+	nmxp_recv_buffer_free(&recv_buffer_standby);
+
+	/* Free the complete channel list */
+	if(channelList) {
+	    NMXP_MEM_FREE(channelList);
+	    channelList = NULL;
+	}
 
 	/* *********************************************************** */
 	/* End subscription protocol "PRIVATE DATA STREAM" version 1.4 */
@@ -1191,26 +1463,40 @@ int main (int argc, char **argv) {
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "End communication.\n");
 
 #ifdef HAVE_LIBMSEED
-	if(params.type_writeseed  ||  params.flag_slinkms) {
+	if(msr_list_chan  ||  msr_list_chan_slink) {
 	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Free mini-SEED record list.\n");
-	    if(*msr_list_chan) {
-		for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
-		    if(msr_list_chan[i_chan]) {
-			msr_free(&(msr_list_chan[i_chan])); 
-		    }
-		}
+	    nmxptool_msr_list_free(&msr_list_chan);
+	    nmxptool_msr_list_free(&msr_list_chan_slink);
+	}
+
+	if(steim_list_chan) {
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "Free Steim transcoder list.\n");
+	    for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
+		nmxptool_steim_free(i_chan);
+	    }
+	    nmxp_data_seed_fclose_all(&data_seed);
+	    NMXP_MEM_FREE(steim_list_chan);
+	    steim_list_chan = NULL;
+	    if(params.flag_transcode_check) {
+		nmxp_log((steim_check_errors == 0)? NMXP_LOG_NORM : NMXP_LOG_ERR, NMXP_LOG_D_ANY,
+			"Transcoded records checked by libmseed: %d, not matching the decoded samples: %d.\n",
+			steim_check_records, steim_check_errors);
 	    }
 	}
 #endif
 
+    nmxptool_gapfill_free();
+
     if(channelList_Seq  &&  channelList_subset) {
 	nmxptool_chanseq_free(&channelList_Seq, channelList_subset->number);
     }
+    nmxp_timer_free(&timer_raw_stream);
+    nmxp_mem_slab_print();
+    nmxp_raw_stream_pd_pool_free();
 
     /* This has to be the last */
     if(channelList_subset) {
-	NMXP_MEM_FREE(channelList_subset);
-	channelList_subset = NULL;
+	nmxp_chan_list_net_free(&channelList_subset);
     }
 
     /* Same condition of while 'Exit only on request' */
@@ -1241,121 +1527,788 @@ int main (int argc, char **argv) {
 
 #ifdef HAVE_PTHREAD_H
     pthread_mutex_destroy(&mutex_sendAddTimeSeriesChannel);
+    pthread_mutex_destroy(&mutex_reconnect_lost);
 #endif
 
     return main_ret;
 } /* End MAIN */
 
 
-int nmxptool_exitcondition_on_open_socket() {
-    int ret = nmxptool_sigcondition_read();
-#ifdef HAVE_EARTHWORMOBJS
-    if(!ret) {
-	if(params.ew_configuration_file) {
-
-	    /* Check if we are being asked to terminate */
-	    if( (ret  = nmxptool_ew_check_flag_terminate()) ) {
+/* Connect to the hot-standby NaqsServer and request the same channels of the primary one.
+ * Channel keys are assumed to be the same on both servers. */
+int nmxptool_connect_standby() {
+    int isock;
+    int i_chan, j_chan, found;
+    int ret;
+    NMXP_CHAN_LIST *standby_channelList = NULL;
 
-		logit ("t", "nmxptool terminating on request\n");
-		nmxptool_ew_send_error(NMXPTOOL_EW_ERR_TERMREQ, NULL, params.hostname);
+    isock = nmxp_openSocket(params.hostname_standby, params.portnumberpds, nmxptool_exitcondition_on_open_socket);
+    if(isock == NMXP_SOCKET_ERROR) {
+	return NMXP_SOCKET_ERROR;
+    }
 
-		nmxptool_sigcondition_write(15);
+    if(nmxp_sendConnect(isock) != NMXP_SOCKET_OK
+	    ||  nmxp_receiveChannelList(isock, &standby_channelList) != NMXP_SOCKET_OK) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Error connecting to hot-standby %s.\n", NMXP_LOG_STR(params.hostname_standby));
+	nmxp_closeSocket(isock);
+	isock = NMXP_SOCKET_ERROR;
+    } else {
+	for(i_chan=0; i_chan < channelList_subset->number; i_chan++) {
+	    found = 0;
+	    for(j_chan=0; !found  &&  j_chan < standby_channelList->number; j_chan++) {
+		found = (standby_channelList->channel[j_chan].key == channelList_subset->channel[i_chan].key);
 	    }
+	    if(!found) {
+		nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_CONNFLOW, "Channel %s (key %d) not available on hot-standby %s.\n",
+			NMXP_LOG_STR(channelList_subset->channel[i_chan].name), channelList_subset->channel[i_chan].key,
+			NMXP_LOG_STR(params.hostname_standby));
+	    }
+	}
 
-	    /* Check if we need to send heartbeat message */
-	    nmxptool_ew_send_heartbeat_if_needed();
-
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&mutex_sendAddTimeSeriesChannel);
+#endif
+	ret = nmxptool_sendAddTimeSeriesChannel(isock, (params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO);
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&mutex_sendAddTimeSeriesChannel);
+#endif
+	if(ret != NMXP_SOCKET_OK) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Error requesting channels to hot-standby %s.\n", NMXP_LOG_STR(params.hostname_standby));
+	    nmxp_closeSocket(isock);
+	    isock = NMXP_SOCKET_ERROR;
 	}
     }
-#endif
-    return ret;
-}
 
+    if(standby_channelList) {
+	NMXP_MEM_FREE(standby_channelList);
+	standby_channelList = NULL;
+    }
 
+    return isock;
+}
 
-void flushing_raw_data_stream() {
-    int to_cur_chan;
 
-    if(channelList_subset == NULL  || channelList_Seq == NULL) {
-	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, " flushing_raw_data_stream() channel lists are NULL.\n");
-	return ;
+/* Reconnect to a lost NaqsServer without asking again for the channel list and without
+ * rebuilding channelList_Seq. The same channels are requested with buffered packets,
+ * packets already sent are dropped by seq_no and the raw stream goes on without gaps.
+ * Waits *wait_ms before each attempt, doubling it up to params.networkdelay seconds.
+ * The caller resets *wait_ms when data is received, so a flapping server is not hammered.
+ * The socket is swapped holding mutex_sendAddTimeSeriesChannel, so the requests of
+ * the channels, initial or at runtime, never go to a closed or half open socket.
+ * func_cond interrupts the waits, it is checked every NMXPTOOL_RECONNECT_STEP_MS. */
+int nmxptool_pds_reconnect(int *isock, char *hostname, NMXP_RECV_BUFFER *rb, int *wait_ms, int (*func_cond)(void)) {
+    int new_isock = NMXP_SOCKET_ERROR;
+    int slept_ms;
+    NMXP_CHAN_LIST *server_channelList = NULL;
+    NMXP_BUFFER_FLAG buffer_flag = (params.stc == -1  ||  params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex_sendAddTimeSeriesChannel);
+#endif
+    if(*isock > 0) {
+	nmxp_closeSocket(*isock);
+	*isock = 0;
     }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&mutex_sendAddTimeSeriesChannel);
+#endif
 
-    /* Flush raw data stream for each channel */
-    if(params.stc == -1) {
-	to_cur_chan = 0;
-	while(to_cur_chan < channelList_subset->number) {
+    while(new_isock == NMXP_SOCKET_ERROR  &&  *wait_ms <= params.networkdelay * 1000
+	    &&  !func_cond()) {
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Reconnect to %s in %d msec.\n", NMXP_LOG_STR(hostname), *wait_ms);
+	for(slept_ms = 0; slept_ms < *wait_ms  &&  !func_cond(); slept_ms += NMXPTOOL_RECONNECT_STEP_MS) {
+	    nmxp_usleep(((*wait_ms - slept_ms < NMXPTOOL_RECONNECT_STEP_MS)? *wait_ms - slept_ms : NMXPTOOL_RECONNECT_STEP_MS) * 1000);
+	}
+	*wait_ms *= 2;
+	if(func_cond()) {
+	    break;
+	}
 
-#ifdef HAVE_EARTHWORMOBJS
-	    if(params.ew_configuration_file) {
+	new_isock = nmxp_openSocket(hostname, params.portnumberpds, func_cond);
+	if(new_isock != NMXP_SOCKET_ERROR) {
+	    /* The server sends the channel list anyway, it is read and discarded */
+	    if(nmxp_sendConnect(new_isock) != NMXP_SOCKET_OK
+		    ||  nmxp_receiveChannelList(new_isock, &server_channelList) != NMXP_SOCKET_OK) {
+		nmxp_closeSocket(new_isock);
+		new_isock = NMXP_SOCKET_ERROR;
+	    }
+	    if(server_channelList) {
+		NMXP_MEM_FREE(server_channelList);
+		server_channelList = NULL;
+	    }
+	}
 
-		/* Check if we are being asked to terminate */
-		if( (ew_check_flag_terminate = nmxptool_ew_check_flag_terminate()) ) {
-		    logit ("t", "nmxptool terminating on request\n");
-		    nmxptool_ew_send_error(NMXPTOOL_EW_ERR_TERMREQ, NULL, params.hostname);
+	if(new_isock != NMXP_SOCKET_ERROR) {
+#ifdef HAVE_PTHREAD_H
+	    pthread_mutex_lock(&mutex_sendAddTimeSeriesChannel);
+#endif
+	    if(nmxptool_sendAddTimeSeriesChannel(new_isock, buffer_flag) != NMXP_SOCKET_OK) {
+		nmxp_closeSocket(new_isock);
+		new_isock = NMXP_SOCKET_ERROR;
+	    } else {
+		nmxp_recv_buffer_free(rb);
+		if(nmxp_recv_buffer_init(rb, new_isock, NMXP_RECV_BUFFER_SIZE) != 0) {
+		    nmxp_closeSocket(new_isock);
+		    new_isock = NMXP_SOCKET_ERROR;
+		} else {
+		    *isock = new_isock;
 		}
-
-		/* Check if we need to send heartbeat message */
-		nmxptool_ew_send_heartbeat_if_needed();
-
 	    }
+#ifdef HAVE_PTHREAD_H
+	    pthread_mutex_unlock(&mutex_sendAddTimeSeriesChannel);
 #endif
+	}
+    }
 
-	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_RAWSTREAM, "Flushing data for channel %s\n",
-		    NMXP_LOG_STR(channelList_subset->channel[to_cur_chan].name));
-	    nmxp_raw_stream_manage(&(channelList_Seq[to_cur_chan].raw_stream_buffer), NULL, p_func_pd, n_func_pd);
-	    to_cur_chan++;
+    if(new_isock == NMXP_SOCKET_ERROR) {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_CONNFLOW, "Fast reconnect to %s failed.\n", NMXP_LOG_STR(hostname));
+	return -1;
+    }
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Reconnected to %s.\n", NMXP_LOG_STR(hostname));
+
+    return 0;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/* Exit condition of the background reconnection */
+int nmxptool_reconnect_lost_exitcondition() {
+    int ret;
+    pthread_mutex_lock(&mutex_reconnect_lost);
+    ret = reconnect_lost.stop;
+    pthread_mutex_unlock(&mutex_reconnect_lost);
+    return ret  ||  nmxptool_sigcondition_read();
+}
+
+
+/* Reconnect the lost NaqsServer, after the fast attempts it retries every params.networkdelay seconds */
+void *p_nmxptool_reconnect_lost(void *arg) {
+    int wait_ms = NMXPTOOL_RECONNECT_FIRST_MS;
+    int ret = -1;
+    int i_server = reconnect_lost.i_server;
+
+    while(ret != 0  &&  !nmxptool_reconnect_lost_exitcondition()) {
+	ret = nmxptool_pds_reconnect((i_server == 0)? &naqssock : &naqssock_standby,
+		(i_server == 0)? params.hostname : params.hostname_standby, reconnect_lost.rb, &wait_ms,
+		nmxptool_reconnect_lost_exitcondition);
+	if(ret != 0) {
+	    wait_ms = params.networkdelay * 1000;
 	}
     }
+
+    pthread_mutex_lock(&mutex_reconnect_lost);
+    reconnect_lost.result = (ret == 0)? 1 : -1;
+    pthread_mutex_unlock(&mutex_reconnect_lost);
+
+    pthread_exit(NULL);
 }
 
 
-void *nmxptool_print_params(void *arg) {
-    /* nmxptool_log_params(&params); */
-    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
-    char *hostname: %s\n\
-    int portnumberdap: %d\n\
-    int portnumberpds: %d\n\
-",
-    NMXP_LOG_STR(params.hostname),
-    params.portnumberdap,
-    params.portnumberpds
-);
+/* Start the background reconnection of the NaqsServer i_server, rb is its read buffer */
+void nmxptool_reconnect_lost_start(int i_server, NMXP_RECV_BUFFER *rb) {
+    if(reconnect_lost.started) {
+	return;
+    }
+    reconnect_lost.i_server = i_server;
+    reconnect_lost.rb = rb;
+    reconnect_lost.result = 0;
+    reconnect_lost.stop = 0;
+    if(pthread_create(&reconnect_lost.thread, NULL, p_nmxptool_reconnect_lost, NULL) != 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Error creating the thread reconnecting %s.\n",
+		NMXP_LOG_STR(((i_server == 0)? params.hostname : params.hostname_standby)));
+    } else {
+	reconnect_lost.started = 1;
+    }
+}
 
-    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
-    char *channels: %s\n\
-",
-    NMXP_LOG_STR(params.channels)
-);
 
-    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
-    char *network: %s\n\
-    char *location: %s\n\
-    double start_time: %f\n\
-    double end_time: %f\n\
-    int32_t interval: %d\n\
-",
-    NMXP_LOG_STR(params.network),
-    NMXP_LOG_STR(params.location),
-    params.start_time,
-    params.end_time,
-    params.interval
-);
+/* Return the index of the NaqsServer reconnected in background, -1 if it is still running or it has given up.
+ * If stop is not zero the reconnection is interrupted and the thread is always joined. */
+int nmxptool_reconnect_lost_join(int stop) {
+    int result;
 
+    if(!reconnect_lost.started) {
+	return -1;
+    }
 
-    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
-    char *datas_username: %s\n\
-    char *datas_password: %s\n\
-",
-    NMXP_LOG_STR(params.datas_username),
-    NMXP_LOG_STR(params.datas_password)
-);
+    pthread_mutex_lock(&mutex_reconnect_lost);
+    if(stop) {
+	reconnect_lost.stop = 1;
+    }
+    result = reconnect_lost.result;
+    pthread_mutex_unlock(&mutex_reconnect_lost);
 
-    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
-    int32_t stc: %d\n\
-    int32_t rate: %d\n\
-    char *plugin_slink: %s\n\
-    int32_t delay: %d\n\
+    if(!stop  &&  result == 0) {
+	return -1;
+    }
+
+    pthread_join(reconnect_lost.thread, NULL);
+    reconnect_lost.started = 0;
+    result = reconnect_lost.result;
+
+    return (result == 1)? reconnect_lost.i_server : -1;
+}
+#endif
+
+
+void nmxptool_channels_lock() {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex_channelList_subset);
+#endif
+}
+
+
+void nmxptool_channels_unlock() {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&mutex_channelList_subset);
+#endif
+}
+
+
+/* Queue a change of the channel list, it can be called by any thread.
+ * Return 0 on success, -1 if the queue is full. */
+int nmxptool_chanmod_request(int action, const char *patterns) {
+    int ret = -1;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex_chanmod);
+#endif
+    if(n_chanmod < NMXPTOOL_CHANMOD_MAX_QUEUE) {
+	chanmod_queue[n_chanmod].action = action;
+	chanmod_queue[n_chanmod].patterns = (patterns)? NMXP_MEM_STRDUP(patterns) : NULL;
+	n_chanmod++;
+	ret = 0;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&mutex_chanmod);
+#endif
+
+    if(ret != 0) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Too many pending changes of the channel list!\n");
+    }
+
+    return ret;
+}
+
+
+/* Pop the oldest change of the channel list. Return 1 if there is one, 0 otherwise. */
+static int nmxptool_chanmod_get(int *action, char **patterns) {
+    int ret = 0;
+    int i;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex_chanmod);
+#endif
+    if(n_chanmod > 0) {
+	*action = chanmod_queue[0].action;
+	*patterns = chanmod_queue[0].patterns;
+	for(i=1; i < n_chanmod; i++) {
+	    chanmod_queue[i-1] = chanmod_queue[i];
+	}
+	n_chanmod--;
+	ret = 1;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&mutex_chanmod);
+#endif
+
+    return ret;
+}
+
+
+/* Grow channelList_Seq, msr_list_chan, msr_list_chan_slink, steim_list_chan and the time-outs for one more channel */
+static int nmxptool_channels_reserve(NMXP_TIMER *timer) {
+    int32_t number = channelList_subset->number;
+    int32_t size;
+#ifdef HAVE_LIBMSEED
+    MSRecord **msr_list = NULL;
+    MSRecord **msr_list_slink = NULL;
+    NMXPTOOL_STEIM_CHAN **steim_list = NULL;
+#endif
+
+    if(number < channelList_Seq_size) {
+	return 0;
+    }
+
+    size = (channelList_Seq_size > 0)? channelList_Seq_size * 2 : NMXP_CHAN_LIST_NET_DEFAULT_SIZE;
+
+    if(nmxptool_chanseq_resize(&channelList_Seq, number, size) != 0) {
+	return -1;
+    }
+
+#ifdef HAVE_LIBMSEED
+    if(msr_list_chan) {
+	msr_list = (MSRecord **) NMXP_MEM_MALLOC(sizeof(MSRecord *) * (size + 1));
+	if(msr_list == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating mini-SEED record list!\n");
+	    return -1;
+	}
+	memset(msr_list, 0, sizeof(MSRecord *) * (size + 1));
+	memcpy(msr_list, msr_list_chan, sizeof(MSRecord *) * number);
+	NMXP_MEM_FREE(msr_list_chan);
+	msr_list_chan = msr_list;
+    }
+    if(msr_list_chan_slink) {
+	msr_list_slink = (MSRecord **) NMXP_MEM_MALLOC(sizeof(MSRecord *) * (size + 1));
+	if(msr_list_slink == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating mini-SEED record list!\n");
+	    return -1;
+	}
+	memset(msr_list_slink, 0, sizeof(MSRecord *) * (size + 1));
+	memcpy(msr_list_slink, msr_list_chan_slink, sizeof(MSRecord *) * number);
+	NMXP_MEM_FREE(msr_list_chan_slink);
+	msr_list_chan_slink = msr_list_slink;
+    }
+    if(steim_list_chan) {
+	steim_list = (NMXPTOOL_STEIM_CHAN **) NMXP_MEM_MALLOC(sizeof(NMXPTOOL_STEIM_CHAN *) * (size + 1));
+	if(steim_list == NULL) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating Steim transcoder list!\n");
+	    return -1;
+	}
+	memset(steim_list, 0, sizeof(NMXPTOOL_STEIM_CHAN *) * (size + 1));
+	memcpy(steim_list, steim_list_chan, sizeof(NMXPTOOL_STEIM_CHAN *) * number);
+	NMXP_MEM_FREE(steim_list_chan);
+	steim_list_chan = steim_list;
+    }
+#endif
+
+    if(nmxp_timer_resize(timer, size) != 0) {
+	return -1;
+    }
+
+    channelList_Seq_size = size;
+
+    return 0;
+}
+
+
+/* Request the channels of channels_add not yet in channelList_subset.
+ * Only the new channels are sent to the servers, the others are not affected.
+ * Return the number of added channels. */
+static int nmxptool_channels_add(NMXP_CHAN_LIST_NET *channels_add, NMXP_TIMER *timer) {
+    int i_add, i_chan;
+    int32_t first = channelList_subset->number;
+    int32_t n_added;
+    NMXP_BUFFER_FLAG buffer_flag = (params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO;
+
+    nmxptool_channels_lock();
+    nmxptool_gapfill_lock_channelList();
+
+    for(i_add=0; i_add < channels_add->number; i_add++) {
+	if(nmxp_chan_lookupKeyIndex(channels_add->channel[i_add].key, channelList_subset) != -1) {
+	    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_CHANNEL, "Channel %s has been already requested.\n",
+		    NMXP_LOG_STR(channels_add->channel[i_add].name));
+	} else if(nmxptool_channels_reserve(timer) == 0
+		&&  (i_chan = nmxp_chan_list_net_add(channelList_subset, channels_add->channel[i_add].key, channels_add->channel[i_add].name)) != -1) {
+	    nmxptool_chanseq_item_init(&(channelList_Seq[i_chan]), DEFAULT_BUFFERED_TIME, params.max_tolerable_latency, params.timeoutrecv);
+	    if(params.adapt_latency_percentile > 0) {
+		nmxp_raw_stream_set_adaptive_latency(&(channelList_Seq[i_chan].raw_stream_buffer),
+			params.adapt_latency_min, params.adapt_latency_percentile);
+	    }
+	    if(params.gapfill_workers > 0) {
+		channelList_Seq[i_chan].raw_stream_buffer.func_gap = nmxptool_gapfill_raw_stream_gap;
+	    }
+#ifdef HAVE_LIBMSEED
+	    if( (msr_list_chan  &&  nmxptool_msr_init(msr_list_chan, i_chan) != 0)
+		    ||  (msr_list_chan_slink  &&  nmxptool_msr_init(msr_list_chan_slink, i_chan) != 0)
+		    ||  (steim_list_chan  &&  nmxptool_steim_init(i_chan) != 0) ) {
+		if(msr_list_chan  &&  msr_list_chan[i_chan]) {
+		    msr_free(&(msr_list_chan[i_chan]));
+		}
+		if(msr_list_chan_slink  &&  msr_list_chan_slink[i_chan]) {
+		    msr_free(&(msr_list_chan_slink[i_chan]));
+		}
+		nmxp_raw_stream_free(&(channelList_Seq[i_chan].raw_stream_buffer));
+		nmxp_chan_list_net_remove(channelList_subset, i_chan);
+		i_chan = -1;
+	    }
+#endif
+	    if(i_chan != -1) {
+		nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Channel %s added.\n",
+			NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
+	    }
+	} else {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel %s can not be added!\n",
+		    NMXP_LOG_STR(channels_add->channel[i_add].name));
+	}
+    }
+
+    nmxptool_gapfill_unlock_channelList();
+    nmxptool_channels_unlock();
+
+    n_added = channelList_subset->number - first;
+    if(n_added > 0) {
+	if(naqssock > 0) {
+	    nmxp_sendAddTimeSeriesChannel_view(naqssock, channelList_subset->channel + first, n_added, params.stc, params.rate, buffer_flag);
+	}
+	if(naqssock_standby > 0) {
+	    nmxp_sendAddTimeSeriesChannel_view(naqssock_standby, channelList_subset->channel + first, n_added, params.stc, params.rate, buffer_flag);
+	}
+    }
+
+    return n_added;
+}
+
+
+/* Stop the channels of channels_rem. Their queued packets are flushed,
+ * the last channel of the list takes the place of each removed one.
+ * Return the number of removed channels. */
+static int nmxptool_channels_remove(NMXP_CHAN_LIST_NET *channels_rem, NMXP_TIMER *timer) {
+    int i_rem, i_chan, i_moved;
+    int n_removed = 0;
+    int32_t chan_gaps, chan_missing;
+
+    if(channels_rem->number <= 0) {
+	return 0;
+    }
+
+    if(naqssock > 0) {
+	nmxp_sendRemoveTimeSeriesChannel_view(naqssock, channels_rem->channel, channels_rem->number);
+    }
+    if(naqssock_standby > 0) {
+	nmxp_sendRemoveTimeSeriesChannel_view(naqssock_standby, channels_rem->channel, channels_rem->number);
+    }
+
+    nmxptool_channels_lock();
+    nmxptool_gapfill_lock_channelList();
+
+    for(i_rem=0; i_rem < channels_rem->number; i_rem++) {
+	i_chan = nmxp_chan_lookupKeyIndex(channels_rem->channel[i_rem].key, channelList_subset);
+	if(i_chan != -1) {
+	    if(params.stc == -1) {
+		nmxp_raw_stream_manage_flush(&(channelList_Seq[i_chan].raw_stream_buffer), p_func_pd, n_func_pd,
+			&chan_gaps, &chan_missing);
+	    }
+	    nmxp_raw_stream_free(&(channelList_Seq[i_chan].raw_stream_buffer));
+#ifdef HAVE_LIBMSEED
+	    if(msr_list_chan  &&  msr_list_chan[i_chan]) {
+		if(params.type_writeseed) {
+		    /* Flush remaining samples */
+		    nmxp_data_msr_pack(NULL, &data_seed, msr_list_chan[i_chan]);
+		}
+		msr_free(&(msr_list_chan[i_chan]));
+	    }
+	    if(msr_list_chan_slink  &&  msr_list_chan_slink[i_chan]) {
+		msr_free(&(msr_list_chan_slink[i_chan]));
+	    }
+	    if(steim_list_chan) {
+		/* Flush remaining differences */
+		nmxptool_steim_free(i_chan);
+	    }
+#endif
+	    nmxp_timer_cancel(timer, i_chan);
+
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Channel %s removed.\n",
+		    NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
+
+	    i_moved = nmxp_chan_list_net_remove(channelList_subset, i_chan);
+	    if(i_moved != i_chan) {
+		channelList_Seq[i_chan] = channelList_Seq[i_moved];
+#ifdef HAVE_LIBMSEED
+		if(msr_list_chan) {
+		    msr_list_chan[i_chan] = msr_list_chan[i_moved];
+		    msr_list_chan[i_moved] = NULL;
+		}
+		if(msr_list_chan_slink) {
+		    msr_list_chan_slink[i_chan] = msr_list_chan_slink[i_moved];
+		    msr_list_chan_slink[i_moved] = NULL;
+		}
+		if(steim_list_chan) {
+		    steim_list_chan[i_chan] = steim_list_chan[i_moved];
+		    steim_list_chan[i_moved] = NULL;
+		}
+#endif
+		nmxp_timer_move(timer, i_moved, i_chan);
+	    }
+	    n_removed++;
+	}
+    }
+
+    nmxptool_gapfill_unlock_channelList();
+    nmxptool_channels_unlock();
+
+    return n_removed;
+}
+
+
+/* Add the channels of the server matching patterns */
+static void nmxptool_chanmod_add(const char *patterns, NMXP_TIMER *timer) {
+    NMXP_CHAN_LIST_NET *channels_add = NULL;
+
+    if(channelList == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel list of the server is not available!\n");
+	return;
+    }
+
+    channels_add = nmxp_chan_subset(channelList, NMXP_DATA_TIMESERIES, (char *) patterns, CURRENT_NETWORK, CURRENT_LOCATION);
+    if(channels_add) {
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Added %d channels for %s, %d channels requested.\n",
+		nmxptool_channels_add(channels_add, timer), NMXP_LOG_STR(patterns), channelList_subset->number);
+	nmxp_chan_list_net_free(&channels_add);
+    }
+}
+
+
+/* Remove the requested channels matching patterns */
+static void nmxptool_chanmod_remove(const char *patterns, NMXP_TIMER *timer) {
+    NMXP_CHAN_PATTERN_LIST plist;
+    NMXP_CHAN_LIST_NET *channels_rem = NULL;
+    NMXP_CHAN_KEY_NET *chan;
+    int i_chan, i_pat, found;
+
+    if(nmxp_chan_pattern_compile(&plist, patterns) == -1) {
+	return;
+    }
+
+    channels_rem = nmxp_chan_list_net_new(0);
+    if(channels_rem) {
+	for(i_chan=0; i_chan < channelList_subset->number; i_chan++) {
+	    chan = &(channelList_subset->channel[i_chan]);
+	    found = 0;
+	    i_pat = -1;
+	    while(!found  &&  (i_pat = nmxp_chan_pattern_match_next(&plist, chan->station, chan->channel, i_pat)) != -1) {
+		found = (plist.pattern[i_pat].network[0] == 0  ||  strcasecmp(plist.pattern[i_pat].network, chan->network) == 0);
+	    }
+	    if(found) {
+		nmxp_chan_list_net_add(channels_rem, chan->key, chan->name);
+	    }
+	}
+
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Removed %d channels for %s, %d channels requested.\n",
+		nmxptool_channels_remove(channels_rem, timer), NMXP_LOG_STR(patterns), channelList_subset->number);
+	nmxp_chan_list_net_free(&channels_rem);
+    }
+
+    nmxp_chan_pattern_free(&plist);
+}
+
+
+/* Read again the channel patterns of the state file and request only the differences */
+static void nmxptool_chanmod_reload(NMXP_TIMER *timer) {
+    char *channels = NULL;
+    NMXP_CHAN_LIST_NET *channels_new = NULL;
+    NMXP_CHAN_LIST_NET *channels_rem = NULL;
+    int i_chan, i_new;
+    int n_removed, n_added;
+
+    if(params.statefile == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channels can be reloaded only from a state file, option -F!\n");
+	return;
+    }
+    if(channelList == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Channel list of the server is not available!\n");
+	return;
+    }
+
+    channels = get_channel_list_argument_from_state_file(params.statefile);
+    if(channels == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "State file %s not found or unable to read!\n", NMXP_LOG_STR(params.statefile));
+	return;
+    }
+
+    channels_new = nmxp_chan_subset(channelList, NMXP_DATA_TIMESERIES, channels, CURRENT_NETWORK, CURRENT_LOCATION);
+    channels_rem = nmxp_chan_list_net_new(0);
+    if(channels_new  &&  channels_rem) {
+	/* Channels not in the state file anymore, or with a different name */
+	for(i_chan=0; i_chan < channelList_subset->number; i_chan++) {
+	    i_new = nmxp_chan_lookupKeyIndex(channelList_subset->channel[i_chan].key, channels_new);
+	    if(i_new == -1  ||  strcmp(channels_new->channel[i_new].name, channelList_subset->channel[i_chan].name) != 0) {
+		nmxp_chan_list_net_add(channels_rem, channelList_subset->channel[i_chan].key, channelList_subset->channel[i_chan].name);
+	    }
+	}
+
+	n_removed = nmxptool_channels_remove(channels_rem, timer);
+	n_added = nmxptool_channels_add(channels_new, timer);
+
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CHANNEL, "Reloaded %s: %d channels removed, %d added, %d channels requested.\n",
+		NMXP_LOG_STR(params.statefile), n_removed, n_added, channelList_subset->number);
+
+	if(params.channels) {
+	    NMXP_MEM_FREE(params.channels);
+	}
+	params.channels = channels;
+	channels = NULL;
+    }
+
+    if(channels_new) {
+	nmxp_chan_list_net_free(&channels_new);
+    }
+    if(channels_rem) {
+	nmxp_chan_list_net_free(&channels_rem);
+    }
+    if(channels) {
+	NMXP_MEM_FREE(channels);
+    }
+}
+
+
+/* Apply the pending changes of the channel list. Called by the main thread
+ * within the PDS loop, after the initial requests of the channels. */
+void nmxptool_chanmod_apply(NMXP_TIMER *timer) {
+    int action;
+    char *patterns = NULL;
+
+    if(flag_reload_statefile) {
+	flag_reload_statefile = 0;
+	nmxptool_chanmod_request(NMXPTOOL_CHANMOD_RELOAD, NULL);
+    }
+
+    if(n_chanmod <= 0) {
+	return;
+    }
+
+#ifdef HAVE_PTHREAD_H
+    /* Initial requests of the channels are still running */
+    if(pthread_mutex_trylock(&mutex_sendAddTimeSeriesChannel) != 0) {
+	return;
+    }
+#endif
+
+    while(nmxptool_chanmod_get(&action, &patterns)) {
+	switch(action) {
+	    case NMXPTOOL_CHANMOD_ADD:
+		nmxptool_chanmod_add(patterns, timer);
+		break;
+	    case NMXPTOOL_CHANMOD_REMOVE:
+		nmxptool_chanmod_remove(patterns, timer);
+		break;
+	    case NMXPTOOL_CHANMOD_RELOAD:
+		nmxptool_chanmod_reload(timer);
+		break;
+	    default:
+		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Unknown change of the channel list %d!\n", action);
+		break;
+	}
+	if(patterns) {
+	    NMXP_MEM_FREE(patterns);
+	}
+    }
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&mutex_sendAddTimeSeriesChannel);
+#endif
+}
+
+
+int nmxptool_exitcondition_on_open_socket() {
+    int ret = nmxptool_sigcondition_read();
+#ifdef HAVE_EARTHWORMOBJS
+    if(!ret) {
+	if(params.ew_configuration_file) {
+
+	    /* Check if we are being asked to terminate */
+	    if( (ret  = nmxptool_ew_check_flag_terminate()) ) {
+
+		logit ("t", "nmxptool terminating on request\n");
+		nmxptool_ew_send_error(NMXPTOOL_EW_ERR_TERMREQ, NULL, params.hostname);
+
+		nmxptool_sigcondition_write(15);
+	    }
+
+	    /* Check if we need to send heartbeat message */
+	    nmxptool_ew_send_heartbeat_if_needed();
+
+	}
+    }
+#endif
+    return ret;
+}
+
+
+
+void flushing_raw_data_stream() {
+    int to_cur_chan;
+    int32_t n_packets = 0, n_gaps = 0, n_missing = 0;
+    int32_t chan_gaps, chan_missing;
+
+    if(channelList_subset == NULL  || channelList_Seq == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, " flushing_raw_data_stream() channel lists are NULL.\n");
+	return ;
+    }
+
+    /* Flush raw data stream for each channel */
+    if(params.stc == -1) {
+	to_cur_chan = 0;
+	while(to_cur_chan < channelList_subset->number) {
+
+#ifdef HAVE_EARTHWORMOBJS
+	    if(params.ew_configuration_file) {
+
+		/* Check if we are being asked to terminate */
+		if( (ew_check_flag_terminate = nmxptool_ew_check_flag_terminate()) ) {
+		    logit ("t", "nmxptool terminating on request\n");
+		    nmxptool_ew_send_error(NMXPTOOL_EW_ERR_TERMREQ, NULL, params.hostname);
+		}
+
+		/* Check if we need to send heartbeat message */
+		nmxptool_ew_send_heartbeat_if_needed();
+
+	    }
+#endif
+
+	    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_RAWSTREAM, "Flushing data for channel %s\n",
+		    NMXP_LOG_STR(channelList_subset->channel[to_cur_chan].name));
+	    n_packets += nmxp_raw_stream_manage_flush(&(channelList_Seq[to_cur_chan].raw_stream_buffer), p_func_pd, n_func_pd,
+		    &chan_gaps, &chan_missing);
+	    n_gaps += chan_gaps;
+	    n_missing += chan_missing;
+	    to_cur_chan++;
+	}
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_RAWSTREAM, "Flushed %d queued packets, skipped %d gaps (%d packets).\n",
+		n_packets, n_gaps, n_missing);
+    }
+}
+
+
+void *nmxptool_print_params(void *arg) {
+    /* nmxptool_log_params(&params); */
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+    char *hostname: %s\n\
+    char *hostname_standby: %s\n\
+    int portnumberdap: %d\n\
+    int portnumberpds: %d\n\
+",
+    NMXP_LOG_STR(params.hostname),
+    NMXP_LOG_STR(params.hostname_standby),
+    params.portnumberdap,
+    params.portnumberpds
+);
+
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+    char *channels: %s\n\
+",
+    NMXP_LOG_STR(params.channels)
+);
+
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+    char *network: %s\n\
+    char *location: %s\n\
+    double start_time: %f\n\
+    double end_time: %f\n\
+    int32_t interval: %d\n\
+",
+    NMXP_LOG_STR(params.network),
+    NMXP_LOG_STR(params.location),
+    params.start_time,
+    params.end_time,
+    params.interval
+);
+
+
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+    char *datas_username: %s\n\
+    char *datas_password: %s\n\
+",
+    NMXP_LOG_STR(params.datas_username),
+    NMXP_LOG_STR(params.datas_password)
+);
+
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+    int32_t stc: %d\n\
+    int32_t rate: %d\n\
+    char *plugin_slink: %s\n\
+    int32_t delay: %d\n\
     int32_t max_tolerable_latency: %d\n\
     int32_t timeoutrecv: %d\n\
     int32_t verbose_level: %d\n\
@@ -1409,6 +2362,67 @@ void *nmxptool_print_params(void *arg) {
     return NULL;
 }
 
+/* Time before which samples of channel cur_chan are not sent */
+double nmxptool_after_start_time(int cur_chan) {
+    double ret = DEFAULT_BUFFERED_TIME;
+
+    if(params.statefile && channelList_Seq[cur_chan].after_start_time > 0.0) {
+	ret = channelList_Seq[cur_chan].after_start_time;
+    } else if(params.buffered_time) {
+	ret = params.buffered_time;
+    }
+
+    return ret;
+}
+
+
+/* Decide from the packet header alone whether the packet would be skipped
+ * or discarded after unpacking. Same conditions as in the main PDS loop. */
+int nmxptool_drop_packet(NMXP_PACKET_HEADER *hdr) {
+    int ret = 0;
+    int cur_chan;
+    double cur_after_start_time;
+    int first_nsample_to_remove;
+
+    /* Unknown channel is logged while unpacking */
+    cur_chan = nmxp_chan_lookupKeyIndex(hdr->key, channelList_subset);
+    if(cur_chan == -1  ||  hdr->sampRate <= 0) {
+	return 0;
+    }
+
+    if( (params.statefile  ||  params.buffered_time) && params.timeoutrecv <= 0 ) {
+	cur_after_start_time = nmxptool_after_start_time(cur_chan);
+	if(hdr->time + ((double) hdr->nSamp / (double) hdr->sampRate) >= cur_after_start_time) {
+	    if(hdr->time < cur_after_start_time) {
+		first_nsample_to_remove = (cur_after_start_time - hdr->time) * (double) hdr->sampRate;
+		first_nsample_to_remove++;
+		if(hdr->nSamp <= first_nsample_to_remove) {
+		    ret = 1;
+		}
+	    }
+	} else {
+	    ret = 1;
+	}
+    }
+
+    if(!ret  &&  params.stc == -1) {
+	ret = nmxp_raw_stream_seq_no_is_redundant(&(channelList_Seq[cur_chan].raw_stream_buffer), hdr->seq_no);
+	if(ret) {
+	    /* It could be a retransmission arrived too late */
+	    nmxp_raw_stream_late_packet(&(channelList_Seq[cur_chan].raw_stream_buffer), hdr->seq_no,
+		    (double) nmxp_data_gmtime_now() - (hdr->time + ((double) hdr->nSamp / (double) hdr->sampRate)));
+	}
+    }
+
+    if(ret) {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_PACKETMAN, "Packet %d for %s dropped before unpacking.\n",
+		hdr->seq_no, NMXP_LOG_STR(channelList_subset->channel[cur_chan].name));
+    }
+
+    return ret;
+}
+
+
 void *nmxptool_print_info_raw_stream(void *arg) {
     int chan_index;
     char last_time_str[30];
@@ -1481,6 +2495,13 @@ Channel      Ind S      SeqNo        x-1  nIt    lat     LastSampleTime
 
 	    chan_index++;
 	}
+
+	if(params.hostname_standby) {
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "Packets from %s: %d used, %d redundant.\n",
+		    NMXP_LOG_STR(params.hostname), pds_server_packets[0], pds_server_dropped[0]);
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "Packets from %s: %d used, %d redundant.\n",
+		    NMXP_LOG_STR(params.hostname_standby), pds_server_packets[1], pds_server_dropped[1]);
+	}
     } else {
 	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Channel list is NULL!\n");
     }
@@ -1536,26 +2557,134 @@ static void CloseConnectionHandler(int sig) {
 } /* End of CloseConnectionHandler() */
 
 
+/* Reload the channel patterns of the state file, applied by the main thread */
+static void ReloadHandler(int sig) {
+
+    flag_reload_statefile = 1;
+
+    nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "%s received signal %d! Reload channels from the state file.\n", NMXP_LOG_STR(PACKAGE_NAME), sig);
+
+} /* End of ReloadHandler() */
+
+
+
+int nmxptool_chan_index(NMXP_DATA_PROCESS *pd) {
+    /* pd->chan_index is set by the decoders, check it refers to channelList_subset */
+    if(pd->chan_index >= 0  &&  pd->chan_index < channelList_subset->number
+	    &&  channelList_subset->channel[pd->chan_index].key == pd->key) {
+	return pd->chan_index;
+    }
+    return nmxp_chan_lookupKeyIndex(pd->key, channelList_subset);
+}
+
 
 #ifdef HAVE_SEEDLINK
-int seedlink_station_id(NMXP_DATA_PROCESS *pd, NMXPTOOL_PARAMS *params, char *station_id, int size) {
-	int ret = 0;
+const char *seedlink_station_id(NMXP_DATA_PROCESS *pd, NMXPTOOL_PARAMS *params, char *station_id, int size) {
+	int cur_chan = nmxptool_chan_index(pd);
+	NMXP_CHAN_KEY_NET *chan = NULL;
+
+	/* Station ID built when channelList_subset has been indexed */
+	if(cur_chan != -1) {
+		chan = &(channelList_subset->channel[cur_chan]);
+		if(chan->network[0] != 0  &&  chan->station[0] != 0) {
+			return (params->flag_slink_network_id)? chan->station_id : chan->station_id + chan->i_station_id;
+		}
+	}
+
 	if(params->flag_slink_network_id) {
-		ret = snprintf(station_id, size, "%s.%s", pd->network, pd->station);
+		snprintf(station_id, size, "%s.%s", pd->network, pd->station);
 	} else {
-		ret = snprintf(station_id, size, "%s", pd->station);
+		snprintf(station_id, size, "%s", pd->station);
 	}
-	return ret;
+	return station_id;
 }
 #endif
 
 
 #ifdef HAVE_LIBMSEED
+/* Init msr_list[i_chan], the mini-SEED record of channelList_subset->channel[i_chan] */
+int nmxptool_msr_init(MSRecord **msr_list, int i_chan) {
+    char station_code[20] = "", channel_code[20] = "", network_code[20] = "", location_code[20] = "";
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA,
+	    "Init mini-SEED record for %s\n", NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
+
+    msr_list[i_chan] = msr_init(NULL);
+
+    /* Separate station_code and channel_code */
+    if(nmxp_chan_cpy_sta_chan(channelList_subset->channel[i_chan].name, station_code, channel_code, network_code, location_code)) {
+
+	nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_EXTRA, "%s.%s.%s\n",
+		NMXP_LOG_STR(NETCODE_OR_CURRENT_NETWORK), NMXP_LOG_STR(station_code), NMXP_LOG_STR(channel_code));
+	strncpy(msr_list[i_chan]->network, NETCODE_OR_CURRENT_NETWORK, 11);
+	strncpy(msr_list[i_chan]->station, station_code, 11);
+	strncpy(msr_list[i_chan]->channel, channel_code, 11);
+	if(location_code[0] != 0) {
+	  if(strcmp(location_code, DEFAULT_NULL_LOCATION) != 0) {
+	    strncpy(msr_list[i_chan]->location, location_code, 11);
+	  }
+	}
+
+	msr_list[i_chan]->reclen   = params.reclen;     /* Byte record length */
+	msr_list[i_chan]->encoding = params.encoding;  /* Steim 1 compression by default */
+
+	/* Reset some values */
+	msr_list[i_chan]->sequence_number = 0;
+	msr_list[i_chan]->datasamples = NULL;
+	msr_list[i_chan]->numsamples = 0;
+
+    } else {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL,
+		"Channels %s error in format!\n", NMXP_LOG_STR(channelList_subset->channel[i_chan].name));
+	msr_free(&(msr_list[i_chan]));
+	return -1;
+    }
+
+    return 0;
+}
+
+
+/* Allocate and init a mini-SEED record for each channel of channelList_subset */
+int nmxptool_msr_list_init(MSRecord ***pmsr_list) {
+    int i_chan;
+
+    *pmsr_list = (MSRecord **) NMXP_MEM_MALLOC(sizeof(MSRecord *) * (channelList_subset->number + 1));
+    if(*pmsr_list == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating mini-SEED record list!\n");
+	exit(-1);
+    }
+    memset(*pmsr_list, 0, sizeof(MSRecord *) * (channelList_subset->number + 1));
+    for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
+	if(nmxptool_msr_init(*pmsr_list, i_chan) != 0) {
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+
+/* Free a list allocated by nmxptool_msr_list_init() */
+void nmxptool_msr_list_free(MSRecord ***pmsr_list) {
+    int i_chan;
+
+    if(*pmsr_list) {
+	for(i_chan = 0; i_chan < channelList_subset->number; i_chan++) {
+	    if((*pmsr_list)[i_chan]) {
+		msr_free(&((*pmsr_list)[i_chan]));
+	    }
+	}
+	NMXP_MEM_FREE(*pmsr_list);
+	*pmsr_list = NULL;
+    }
+}
+
+
 int nmxptool_write_miniseed(NMXP_DATA_PROCESS *pd) {
     int cur_chan;
 
     int ret = 0;
-    if( (cur_chan = nmxp_chan_lookupKeyIndex(pd->key, channelList_subset)) != -1) {
+    if( (cur_chan = nmxptool_chan_index(pd)) != -1) {
 
 	ret = nmxp_data_msr_pack(pd, &data_seed, msr_list_chan[cur_chan]);
 
@@ -1564,6 +2693,169 @@ int nmxptool_write_miniseed(NMXP_DATA_PROCESS *pd) {
     }
     return ret;
 }
+
+
+/* Compare the samples unpacked by libmseed with the decoded ones fed to the transcoder */
+static void nmxptool_steim_check(NMXPTOOL_STEIM_CHAN *sc) {
+    MSRecord *msr = sc->msr;
+    int32_t *samples = msr->datasamples;
+    int32_t n = (int32_t) msr->numsamples;
+    double starttime = (double) msr->starttime / (double) HPTMODULUS;
+    int32_t i = 0;
+    int err = 0;
+
+    steim_check_records++;
+
+    if(n > sc->check_n) {
+	err++;
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Transcoded record %s.%s.%s has %d samples, only %d have been fed!\n",
+		msr->network, msr->station, msr->channel, n, sc->check_n);
+	n = sc->check_n;
+    } else if(n > 0  &&  fabs(starttime - sc->check_time[0]) >= 1.0 / (2.0 * msr->samprate)) {
+	err++;
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Transcoded record %s.%s.%s starts at %.4f instead of %.4f!\n",
+		msr->network, msr->station, msr->channel, starttime, sc->check_time[0]);
+    }
+
+    while(i < n  &&  samples[i] == sc->check_samples[i]) {
+	i++;
+    }
+    if(i < n) {
+	err++;
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Transcoded record %s.%s.%s sample %d is %d instead of %d!\n",
+		msr->network, msr->station, msr->channel, i, samples[i], sc->check_samples[i]);
+    }
+
+    if(err) {
+	steim_check_errors++;
+    }
+
+    /* Samples of the next records */
+    sc->check_n -= n;
+    memmove(sc->check_samples, sc->check_samples + n, sizeof(int32_t) * sc->check_n);
+    memmove(sc->check_time, sc->check_time + n, sizeof(double) * sc->check_n);
+}
+
+
+/* Called by nmxp_steim for each record of a channel */
+static int nmxptool_steim_record(char *record, int reclen, void *handlerdata) {
+    NMXPTOOL_STEIM_CHAN *sc = handlerdata;
+    int ret;
+
+    ret = msr_unpack(record, reclen, &(sc->msr), (params.flag_transcode_check)? 1 : 0, 0);
+    if(ret != MS_NOERROR) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_PACKETMAN, "Transcoded record %.5s.%.3s is not valid: %s\n",
+		record + 8, record + 15, ms_errorstr(ret));
+	return -1;
+    }
+
+    if(params.flag_transcode_check) {
+	nmxptool_steim_check(sc);
+    }
+
+    return nmxp_data_seed_write_record(&data_seed, sc->msr, record, reclen);
+}
+
+
+/* Init the Steim transcoder of channelList_subset->channel[i_chan] from its mini-SEED record */
+int nmxptool_steim_init(int i_chan) {
+    NMXPTOOL_STEIM_CHAN *sc = NULL;
+    MSRecord *msr = msr_list_chan[i_chan];
+
+    sc = (NMXPTOOL_STEIM_CHAN *) NMXP_MEM_MALLOC(sizeof(NMXPTOOL_STEIM_CHAN));
+    if(sc == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating Steim transcoder!\n");
+	return -1;
+    }
+    memset(sc, 0, sizeof(NMXPTOOL_STEIM_CHAN));
+
+    if(nmxp_steim_init(&(sc->st), msr->network, msr->station, msr->channel, msr->location,
+		(params.encoding == DE_STEIM2)? NMXP_STEIM2 : NMXP_STEIM1, params.reclen,
+		nmxptool_steim_record, sc) != 0) {
+	NMXP_MEM_FREE(sc);
+	return -1;
+    }
+    sc->st.quality_indicator = params.quality_indicator;
+
+    steim_list_chan[i_chan] = sc;
+
+    return 0;
+}
+
+
+/* Flush and free the Steim transcoder of channelList_subset->channel[i_chan] */
+void nmxptool_steim_free(int i_chan) {
+    NMXPTOOL_STEIM_CHAN *sc = steim_list_chan[i_chan];
+
+    if(sc) {
+	nmxp_steim_free(&(sc->st));
+	if(sc->msr) {
+	    msr_free(&(sc->msr));
+	}
+	if(sc->check_samples) {
+	    NMXP_MEM_FREE(sc->check_samples);
+	}
+	if(sc->check_time) {
+	    NMXP_MEM_FREE(sc->check_time);
+	}
+	NMXP_MEM_FREE(sc);
+	steim_list_chan[i_chan] = NULL;
+    }
+}
+
+
+/* Feed the compressed packet decoded into pd to the transcoder of its channel */
+int nmxptool_steim_feed(NMXP_DATA_PROCESS *pd, char *buffer_data, int length_data, const NMXP_PACKET_HEADER *hdr) {
+    NMXPTOOL_STEIM_CHAN *sc;
+    int32_t *samples = NULL;
+    double *times = NULL;
+    int32_t size;
+    int cur_chan;
+    int i;
+
+    if( (cur_chan = nmxptool_chan_index(pd)) == -1  ||  (sc = steim_list_chan[cur_chan]) == NULL) {
+	return -1;
+    }
+
+    if(params.flag_transcode_check  &&  pd->nSamp > 0) {
+	/* Keep the decoded samples until libmseed unpacks the record containing them */
+	if(sc->check_n + pd->nSamp > sc->check_size) {
+	    size = (sc->check_n + pd->nSamp) * 2;
+	    samples = (int32_t *) NMXP_MEM_MALLOC(sizeof(int32_t) * size);
+	    times = (double *) NMXP_MEM_MALLOC(sizeof(double) * size);
+	    if(samples == NULL  ||  times == NULL) {
+		nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Error allocating samples for --transcode_check!\n");
+		if(samples) {
+		    NMXP_MEM_FREE(samples);
+		}
+		if(times) {
+		    NMXP_MEM_FREE(times);
+		}
+		return -1;
+	    }
+	    if(sc->check_n > 0) {
+		memcpy(samples, sc->check_samples, sizeof(int32_t) * sc->check_n);
+		memcpy(times, sc->check_time, sizeof(double) * sc->check_n);
+	    }
+	    if(sc->check_samples) {
+		NMXP_MEM_FREE(sc->check_samples);
+	    }
+	    if(sc->check_time) {
+		NMXP_MEM_FREE(sc->check_time);
+	    }
+	    sc->check_samples = samples;
+	    sc->check_time = times;
+	    sc->check_size = size;
+	}
+	for(i=0; i < pd->nSamp; i++) {
+	    sc->check_samples[sc->check_n] = pd->pDataPtr[i];
+	    sc->check_time[sc->check_n] = pd->time + ((double) i / (double) pd->sampRate);
+	    sc->check_n++;
+	}
+    }
+
+    return nmxp_steim_feed_compressed(&(sc->st), buffer_data, length_data, hdr);
+}
 #endif
 
 #ifdef HAVE_LIBMSEED
@@ -1572,9 +2864,8 @@ int nmxptool_write_miniseed(NMXP_DATA_PROCESS *pd) {
 void nmxptool_msr_send_mseed_handler (char *record, int reclen, void *handlerdata) {
     int ret = 0;
     NMXP_DATA_PROCESS *pd = handlerdata;
-	char station_id[MAX_LEN_STATION_ID];
-
-	seedlink_station_id(pd, &params, station_id, MAX_LEN_STATION_ID);
+	char station_id_buf[MAX_LEN_STATION_ID];
+	const char *station_id = seedlink_station_id(pd, &params, station_id_buf, MAX_LEN_STATION_ID);
 
     ret = send_mseed(station_id, record, reclen);
     if ( ret <= 0 ) {
@@ -1592,9 +2883,9 @@ int nmxptool_msr_send_mseed(NMXP_DATA_PROCESS *pd) {
     int precords;
     flag verbose = 0;
 
-    if( (cur_chan = nmxp_chan_lookupKeyIndex(pd->key, channelList_subset)) != -1) {
+    if( (cur_chan = nmxptool_chan_index(pd)) != -1) {
 
-	msr = msr_list_chan[cur_chan];
+	msr = msr_list_chan_slink[cur_chan];
 
 	if(pd) {
 	    if(pd->nSamp > 0) {
@@ -1669,9 +2960,8 @@ int nmxptool_print_seq_no(NMXP_DATA_PROCESS *pd) {
 int nmxptool_send_raw_depoch(NMXP_DATA_PROCESS *pd) {
     /* TODO Set values */
     const int usec_correction = 0;
-	char station_id[MAX_LEN_STATION_ID];
-
-	seedlink_station_id(pd, &params, station_id, MAX_LEN_STATION_ID);
+	char station_id_buf[MAX_LEN_STATION_ID];
+	const char *station_id = seedlink_station_id(pd, &params, station_id_buf, MAX_LEN_STATION_ID);
 
     return send_raw_depoch(station_id, pd->channel, pd->time, usec_correction, pd->timing_quality,
 	    pd->pDataPtr, pd->nSamp);
@@ -1706,13 +2996,13 @@ int nmxptool_logerr_miniseed(const char *s) {
 #endif
 
 
-#ifdef HAVE_PTHREAD_H
-void *p_nmxp_sendAddTimeSeriesChannel(void *arg) {
+/* Request the channels of channelList_subset to isock, params.n_channel every params.usec,
+ * within NMXP_MAX_MSCHAN_MSEC. The caller holds mutex_sendAddTimeSeriesChannel. */
+int nmxptool_sendAddTimeSeriesChannel(int isock, NMXP_BUFFER_FLAG buffer_flag) {
     int i = 0;
     int times_channel = 0;
     double estimated_time = 0.0;
-
-    pthread_mutex_lock (&mutex_sendAddTimeSeriesChannel);
+    int ret = NMXP_SOCKET_OK;
 
     if(params.n_channel == 0) {
 	times_channel = 1;
@@ -1730,17 +3020,27 @@ void *p_nmxp_sendAddTimeSeriesChannel(void *arg) {
     }
 
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Begin requests of channels!\n");
-    while(times_channel > 0  &&  !nmxptool_sigcondition_read()) {
-	nmxp_sendAddTimeSeriesChannel(naqssock, channelList_subset, params.stc, params.rate,
-		(params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO, params.n_channel, params.usec, (i==0)? 1 : 0);
+    while(ret == NMXP_SOCKET_OK  &&  times_channel > 0  &&  !nmxptool_sigcondition_read()) {
+	ret = nmxp_sendAddTimeSeriesChannel(isock, channelList_subset, params.stc, params.rate,
+		buffer_flag, params.n_channel, params.usec, (i==0)? 1 : 0);
 	times_channel--;
 	i++;
-	if(times_channel > 0) {
+	if(ret == NMXP_SOCKET_OK  &&  times_channel > 0) {
 	    nmxp_usleep(params.usec);
 	}
     }
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "End requests of channels!\n");
 
+    return ret;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+void *p_nmxp_sendAddTimeSeriesChannel(void *arg) {
+    pthread_mutex_lock (&mutex_sendAddTimeSeriesChannel);
+
+    nmxptool_sendAddTimeSeriesChannel(naqssock, (params.flag_buffered)? NMXP_BUFFER_YES : NMXP_BUFFER_NO);
+
     pthread_mutex_unlock (&mutex_sendAddTimeSeriesChannel);
 
     pthread_exit(NULL);
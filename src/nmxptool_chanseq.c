@@ -22,6 +22,17 @@
 #include "nmxptool_chanseq.h"
 #include "nmxptool_getoptlong.h"
 
+void nmxptool_chanseq_item_init(NMXPTOOL_CHAN_SEQ *chan_list_seq_item, double default_after_start_time, int32_t max_tolerable_latency, int32_t timeoutrecv) {
+    chan_list_seq_item->significant = 0;
+    chan_list_seq_item->last_time = 0.0;
+    chan_list_seq_item->last_time_call_raw_stream = 0;
+    chan_list_seq_item->last_seq_no_first = -1;
+    chan_list_seq_item->x_1 = 0;
+    chan_list_seq_item->after_start_time = default_after_start_time;
+    nmxp_raw_stream_init(&(chan_list_seq_item->raw_stream_buffer), max_tolerable_latency, timeoutrecv);
+}
+
+
 void nmxptool_chanseq_init(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number, double default_after_start_time, int32_t max_tolerable_latency, int32_t timeoutrecv) {
     int i_chan;
     NMXPTOOL_CHAN_SEQ *chan_list_seq;
@@ -31,18 +42,33 @@ void nmxptool_chanseq_init(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number, doubl
     /* init chan_list_seq */
     chan_list_seq = (NMXPTOOL_CHAN_SEQ *) NMXP_MEM_MALLOC(sizeof(NMXPTOOL_CHAN_SEQ) * number);
     for(i_chan = 0; i_chan < number; i_chan++) {
-	chan_list_seq[i_chan].significant = 0;
-	chan_list_seq[i_chan].last_time = 0.0;
-	chan_list_seq[i_chan].last_time_call_raw_stream = 0;
-	chan_list_seq[i_chan].x_1 = 0;
-	chan_list_seq[i_chan].after_start_time = default_after_start_time;
-	nmxp_raw_stream_init(&(chan_list_seq[i_chan].raw_stream_buffer), max_tolerable_latency, timeoutrecv);
+	nmxptool_chanseq_item_init(&(chan_list_seq[i_chan]), default_after_start_time, max_tolerable_latency, timeoutrecv);
     }
 
     *pchan_list_seq = chan_list_seq;
 }
 
 
+int nmxptool_chanseq_resize(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number, int size) {
+    NMXPTOOL_CHAN_SEQ *chan_list_seq;
+
+    chan_list_seq = (NMXPTOOL_CHAN_SEQ *) NMXP_MEM_MALLOC(sizeof(NMXPTOOL_CHAN_SEQ) * size);
+    if(chan_list_seq == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CHANNEL, "Error allocating chan_list_seq of %d items.\n", size);
+	return -1;
+    }
+
+    /* Raw stream states do not point into themselves, items can be moved */
+    if(*pchan_list_seq) {
+	memcpy(chan_list_seq, *pchan_list_seq, sizeof(NMXPTOOL_CHAN_SEQ) * number);
+	NMXP_MEM_FREE(*pchan_list_seq);
+    }
+    *pchan_list_seq = chan_list_seq;
+
+    return 0;
+}
+
+
 void nmxptool_chanseq_free(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number) {
     int i_chan;
     NMXPTOOL_CHAN_SEQ *chan_list_seq = NULL;
@@ -21,11 +21,15 @@ typedef struct {
     double last_time;
     time_t last_time_call_raw_stream;
     int32_t x_1;
+    int32_t last_seq_no_first;
     double after_start_time;
     NMXP_RAW_STREAM_DATA raw_stream_buffer;
 } NMXPTOOL_CHAN_SEQ;
 
+void nmxptool_chanseq_item_init(NMXPTOOL_CHAN_SEQ *chan_list_seq_item, double default_after_start_time, int32_t max_tolerable_latency, int32_t timeoutrecv);
 void nmxptool_chanseq_init(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number, double default_after_start_time, int32_t max_tolerable_latency, int32_t timeoutrecv);
+/* Reallocate for size items, the first number items are kept */
+int nmxptool_chanseq_resize(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number, int size);
 void nmxptool_chanseq_free(NMXPTOOL_CHAN_SEQ **pchan_list_seq, int number);
 int  nmxptool_chanseq_check_and_log_gap(double time1, double time2, const double gap_tollerance, const char *station, const char *channel, const char *network);
 int nmxptool_chanseq_gap(NMXPTOOL_CHAN_SEQ *chan_list_seq_item, NMXP_DATA_PROCESS *pd);
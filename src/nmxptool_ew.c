@@ -391,6 +391,17 @@ int nmxptool_ew_proc_configfile (char * configfile, NMXPTOOL_PARAMS *params) {
 		}
 	    }
 
+	    else if (k_its ("NmxpHostStandby")) {
+		if ( (str = k_str ()) ) {
+		    if (strlen(str) >= MAXADDRLEN) {
+			logit("et", "nmxphoststandby too long; max is %d characters\n",
+				MAXADDRLEN);
+			return EW_FAILURE;
+		    }
+		    params->hostname_standby = NMXP_MEM_STRDUP(str);
+		}
+	    }
+
 	    else if ( k_its ("NmxpPortPDS")) {
 		params->portnumberpds = k_int();
 	    }
@@ -428,6 +439,36 @@ int nmxptool_ew_proc_configfile (char * configfile, NMXPTOOL_PARAMS *params) {
 		}
 	    }
 
+	    else if (k_its ("AdaptiveLatency")) {
+		if ( (str = k_str ()) ) {
+		    sep = strstr(str, "/");
+		    if(sep) {
+			sep[0] = 0;
+			sep++;
+			params->adapt_latency_min = atoi(str);
+			params->adapt_latency_percentile = atoi(sep);
+		    } else {
+			nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
+				"Syntax error in parameter 'AdaptiveLatency' %s!\n", NMXP_LOG_STR(str));
+			return EW_FAILURE;
+		    }
+		}
+	    }
+
+	    else if (k_its ("GapFill")) {
+		if ( (str = k_str ()) ) {
+		    if(sscanf(str, "%d/%d/%d", &(params->gapfill_workers), &(params->gapfill_queue), &(params->gapfill_msec)) != 3) {
+			nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
+				"Syntax error in parameter 'GapFill' %s!\n", NMXP_LOG_STR(str));
+			return EW_FAILURE;
+		    }
+		}
+	    }
+
+	    else if (k_its ("DualOutput")) {
+		params->flag_dualoutput = k_int();
+	    }
+
 	    else if (k_its ("ShortTermCompletion")) {
 		params->stc = k_int();
 		params->rate = 0; // original sample rate
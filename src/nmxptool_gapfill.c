@@ -0,0 +1,424 @@
+/*! \file
+ *
+ * \brief Nanometrics Protocol Tool
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#include "config.h"
+#include "nmxp.h"
+#include "nmxp_memory.h"
+
+#include "nmxptool_gapfill.h"
+#include "nmxptool_sigcondition.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+
+/* A hole to request to DataServer */
+typedef struct {
+    int32_t key;
+    double start_time;
+    double end_time;
+    time_t not_before;
+} NMXPTOOL_GAPFILL_REQUEST;
+
+static struct {
+    NMXPTOOL_PARAMS *params;
+    NMXP_CHAN_LIST_NET *channelList;
+    pthread_mutex_t mutex_channelList;	/* Held while decoding, channelList can be changed at runtime */
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_request;		/* Signaled on new request or stop */
+    pthread_cond_t cond_recovered;		/* Signaled when recovered packets have been handled or on stop */
+    int n_workers;
+    pthread_t workers[NMXPTOOL_GAPFILL_MAX_WORKERS];
+    /* Ring of holes */
+    NMXPTOOL_GAPFILL_REQUEST *requests;
+    int size_requests;
+    int n_requests;
+    int i_requests;
+    /* Ring of recovered packets */
+    NMXP_DATA_PROCESS *recovered[NMXPTOOL_GAPFILL_MAX_RECOVERED];
+    int n_recovered;
+    int i_recovered;
+    /* Statistics */
+    int32_t n_holes;
+    int32_t n_holes_dropped;
+    int32_t n_holes_failed;
+    int32_t n_packets;
+} gapfill;
+
+static int gapfill_initialized = 0;
+
+
+static int nmxptool_gapfill_exitcondition() {
+    int ret;
+
+    pthread_mutex_lock(&gapfill.mutex);
+    ret = gapfill.stop;
+    pthread_mutex_unlock(&gapfill.mutex);
+
+    return (ret  ||  nmxptool_sigcondition_read());
+}
+
+
+/* Queue a copy of pd for the main thread, wait while the queue is full */
+static int nmxptool_gapfill_push_recovered(NMXP_DATA_PROCESS *pd) {
+    NMXP_DATA_PROCESS *pd_copy;
+    int *pDataPtr;
+    int ret = -1;
+
+    pd_copy = nmxp_raw_stream_pd_get_size(pd->nSamp);
+    if(pd_copy == NULL) {
+	return -1;
+    }
+    pDataPtr = pd_copy->pDataPtr;
+    memcpy(pd_copy, pd, sizeof(NMXP_DATA_PROCESS));
+    pd_copy->pDataPtr = pDataPtr;
+    memcpy(pd_copy->pDataPtr, pd->pDataPtr, pd->nSamp * sizeof(int));
+
+    pthread_mutex_lock(&gapfill.mutex);
+    while(!gapfill.stop  &&  gapfill.n_recovered >= NMXPTOOL_GAPFILL_MAX_RECOVERED) {
+	pthread_cond_wait(&gapfill.cond_recovered, &gapfill.mutex);
+    }
+    if(!gapfill.stop) {
+	gapfill.recovered[(gapfill.i_recovered + gapfill.n_recovered) % NMXPTOOL_GAPFILL_MAX_RECOVERED] = pd_copy;
+	gapfill.n_recovered++;
+	gapfill.n_packets++;
+	ret = 0;
+    }
+    pthread_mutex_unlock(&gapfill.mutex);
+
+    if(ret != 0) {
+	nmxp_raw_stream_pd_put(pd_copy);
+    }
+
+    return ret;
+}
+
+
+/* Request a hole to DataServer within a new DAP session */
+static int nmxptool_gapfill_fetch(NMXPTOOL_GAPFILL_REQUEST *req) {
+    NMXPTOOL_PARAMS *params = gapfill.params;
+    int isock;
+    int32_t connection_time;
+    NMXP_MSG_SERVER type;
+    int32_t length;
+    int recv_errno = 0;
+    int ret;
+    int ret_process;
+    int n_packets = 0;
+    char *buffer;
+    NMXP_DATA_PROCESS pd;
+    int32_t pd_samples[NMXP_MAX_OUTDATA];
+    char str_start_time[NMXP_DATA_MAX_SIZE_DATE];
+    char str_end_time[NMXP_DATA_MAX_SIZE_DATE];
+
+    buffer = (char *) NMXP_MEM_MALLOC(NMXP_MAX_LENGTH_DATA_BUFFER);
+    if(buffer == NULL) {
+	return -1;
+    }
+
+    nmxp_data_to_str(str_start_time, req->start_time);
+    nmxp_data_to_str(str_end_time, req->end_time);
+
+    /* DAP Step 1: Open a socket */
+    isock = nmxp_openSocket(params->hostname, params->portnumberdap, nmxptool_gapfill_exitcondition);
+    if(isock == NMXP_SOCKET_ERROR) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_CONNFLOW, "Gap-fill: error opening socket to DataServer!\n");
+	NMXP_MEM_FREE(buffer);
+	return -1;
+    }
+
+    /* DAP Step 2, 3, 4 and 5: Connection, Ready message and Data Request */
+    ret = nmxp_readConnectionTime(isock, &connection_time);
+    if(ret == NMXP_SOCKET_OK) {
+	ret = nmxp_sendConnectRequest(isock, params->datas_username, params->datas_password, connection_time);
+    }
+    if(ret == NMXP_SOCKET_OK) {
+	ret = nmxp_waitReady(isock);
+    }
+    if(ret == NMXP_SOCKET_OK) {
+	ret = nmxp_sendDataRequest(isock, req->key, (int32_t) req->start_time, (int32_t) (req->end_time + 1.0));
+    }
+
+    /* DAP Step 6: Receive Data until receiving a Ready message */
+    if(ret == NMXP_SOCKET_OK) {
+	ret = nmxp_receiveMessage(isock, &type, buffer, &length, NMXPTOOL_GAPFILL_TIMEOUT, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+	while(ret == NMXP_SOCKET_OK  &&  type != NMXP_MSG_READY  &&  !nmxptool_gapfill_exitcondition()) {
+	    pthread_mutex_lock(&gapfill.mutex_channelList);
+	    ret_process = nmxp_processCompressedData_r(buffer, length, gapfill.channelList,
+			(params->network)? params->network : DEFAULT_NETWORK,
+			(params->location)? params->location : DEFAULT_NULL_LOCATION,
+			&pd, pd_samples, NMXP_MAX_OUTDATA);
+	    pthread_mutex_unlock(&gapfill.mutex_channelList);
+	    if(ret_process == 0  &&  pd.key == req->key) {
+		if(params->timing_quality != -1) {
+		    pd.timing_quality = params->timing_quality;
+		}
+		pd.quality_indicator = params->quality_indicator;
+		/* The first sample of the packet handled by force is not part of the hole */
+		nmxp_data_trim(&pd, req->start_time, req->end_time, NMXP_DATA_TRIM_EXCLUDE_LAST);
+		if(pd.nSamp > 0  &&  nmxptool_gapfill_push_recovered(&pd) == 0) {
+		    n_packets++;
+		}
+	    }
+	    ret = nmxp_receiveMessage(isock, &type, buffer, &length, NMXPTOOL_GAPFILL_TIMEOUT, &recv_errno, NMXP_MAX_LENGTH_DATA_BUFFER);
+	}
+	if(ret == NMXP_SOCKET_OK) {
+	    /* DAP Step 7: Send Terminate Subscription */
+	    nmxp_sendTerminateSubscription(isock, NMXP_SHUTDOWN_NORMAL, "Good Bye!");
+	}
+    }
+
+    /* DAP Step 8: Close the socket */
+    nmxp_closeSocket(isock);
+    NMXP_MEM_FREE(buffer);
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_CONNFLOW, "Gap-fill: key %d from %s to %s, %d packets recovered%s.\n",
+	    req->key, NMXP_LOG_STR(str_start_time), NMXP_LOG_STR(str_end_time), n_packets,
+	    (ret == NMXP_SOCKET_OK)? "" : ", DataServer error");
+
+    return (ret == NMXP_SOCKET_OK)? 0 : -1;
+}
+
+
+static void *nmxptool_gapfill_worker(void *arg) {
+    NMXPTOOL_GAPFILL_REQUEST req;
+    struct timeval tv;
+    struct timespec ts;
+    time_t now;
+    int have_request;
+
+    pthread_mutex_lock(&gapfill.mutex);
+    while(!gapfill.stop) {
+	have_request = 0;
+	if(gapfill.n_requests > 0) {
+	    now = time(NULL);
+	    if(gapfill.requests[gapfill.i_requests].not_before <= now) {
+		req = gapfill.requests[gapfill.i_requests];
+		gapfill.i_requests = (gapfill.i_requests + 1) % gapfill.size_requests;
+		gapfill.n_requests--;
+		have_request = 1;
+	    } else {
+		/* Holes are queued in chronological order, wait for the first one */
+		ts.tv_sec = gapfill.requests[gapfill.i_requests].not_before;
+		ts.tv_nsec = 0;
+		pthread_cond_timedwait(&gapfill.cond_request, &gapfill.mutex, &ts);
+	    }
+	} else {
+	    pthread_cond_wait(&gapfill.cond_request, &gapfill.mutex);
+	}
+
+	if(have_request) {
+	    pthread_mutex_unlock(&gapfill.mutex);
+
+	    if(nmxptool_gapfill_fetch(&req) != 0) {
+		pthread_mutex_lock(&gapfill.mutex);
+		gapfill.n_holes_failed++;
+		pthread_mutex_unlock(&gapfill.mutex);
+	    }
+
+	    /* Rate limit of the requests of this worker */
+	    if(gapfill.params->gapfill_msec > 0) {
+		gettimeofday(&tv, NULL);
+		ts.tv_sec = tv.tv_sec + (gapfill.params->gapfill_msec / 1000);
+		ts.tv_nsec = (tv.tv_usec + (gapfill.params->gapfill_msec % 1000) * 1000) * 1000;
+		if(ts.tv_nsec >= 1000000000) {
+		    ts.tv_sec++;
+		    ts.tv_nsec -= 1000000000;
+		}
+		pthread_mutex_lock(&gapfill.mutex);
+		while(!gapfill.stop
+			&&  pthread_cond_timedwait(&gapfill.cond_request, &gapfill.mutex, &ts) == 0) {
+		    /* Woken up by a new request, keep waiting */
+		}
+	    } else {
+		pthread_mutex_lock(&gapfill.mutex);
+	    }
+	}
+    }
+    pthread_mutex_unlock(&gapfill.mutex);
+
+    return NULL;
+}
+
+#endif
+
+
+int nmxptool_gapfill_init(NMXPTOOL_PARAMS *params, NMXP_CHAN_LIST_NET *channelList) {
+#ifdef HAVE_PTHREAD_H
+    int i;
+
+    memset(&gapfill, 0, sizeof(gapfill));
+    gapfill.params = params;
+    gapfill.channelList = channelList;
+    gapfill.size_requests = params->gapfill_queue;
+    gapfill.requests = (NMXPTOOL_GAPFILL_REQUEST *) NMXP_MEM_MALLOC(gapfill.size_requests * sizeof(NMXPTOOL_GAPFILL_REQUEST));
+    if(gapfill.requests == NULL) {
+	nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "nmxptool_gapfill_init(): Error allocating memory\n");
+	return -1;
+    }
+    pthread_mutex_init(&gapfill.mutex, NULL);
+    pthread_mutex_init(&gapfill.mutex_channelList, NULL);
+    pthread_cond_init(&gapfill.cond_request, NULL);
+    pthread_cond_init(&gapfill.cond_recovered, NULL);
+    gapfill_initialized = 1;
+
+    for(i=0; i < params->gapfill_workers  &&  i < NMXPTOOL_GAPFILL_MAX_WORKERS; i++) {
+	if(pthread_create(&gapfill.workers[i], NULL, nmxptool_gapfill_worker, NULL) != 0) {
+	    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Gap-fill: error creating worker thread!\n");
+	    nmxptool_gapfill_free();
+	    return -1;
+	}
+	gapfill.n_workers++;
+    }
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Gap-fill: %d workers, %d holes at most, %d ms between requests.\n",
+	    gapfill.n_workers, gapfill.size_requests, params->gapfill_msec);
+
+    return 0;
+#else
+    nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY, "Gap-fill needs threads, it is not available!\n");
+    return -1;
+#endif
+}
+
+
+void nmxptool_gapfill_raw_stream_gap(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd) {
+#ifdef HAVE_PTHREAD_H
+    NMXPTOOL_GAPFILL_REQUEST *req;
+    double span = pd->time - p->last_sample_time;
+
+    if(!gapfill_initialized  ||  span <= 0.0) {
+	return;
+    }
+
+    if(span > NMXPTOOL_GAPFILL_MAX_SPAN) {
+	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "Gap-fill: %s.%s.%s hole of %.0f sec. is too long, not requested.\n",
+		NMXP_LOG_STR(pd->network), NMXP_LOG_STR(pd->station), NMXP_LOG_STR(pd->channel), span);
+	return;
+    }
+
+    /* Never block the live path, drop the hole if the queue is full */
+    pthread_mutex_lock(&gapfill.mutex);
+    gapfill.n_holes++;
+    if(gapfill.n_requests < gapfill.size_requests) {
+	req = &gapfill.requests[(gapfill.i_requests + gapfill.n_requests) % gapfill.size_requests];
+	req->key = pd->key;
+	req->start_time = p->last_sample_time;
+	req->end_time = pd->time;
+	req->not_before = time(NULL) + NMXPTOOL_GAPFILL_DELAY;
+	gapfill.n_requests++;
+	pthread_cond_broadcast(&gapfill.cond_request);
+    } else {
+	gapfill.n_holes_dropped++;
+    }
+    pthread_mutex_unlock(&gapfill.mutex);
+#endif
+}
+
+
+int nmxptool_gapfill_inject(int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd) {
+    int ret = 0;
+#ifdef HAVE_PTHREAD_H
+    NMXP_DATA_PROCESS *pd;
+    int i_func_pd;
+
+    if(!gapfill_initialized) {
+	return 0;
+    }
+
+    pthread_mutex_lock(&gapfill.mutex);
+    while(gapfill.n_recovered > 0) {
+	pd = gapfill.recovered[gapfill.i_recovered];
+	gapfill.i_recovered = (gapfill.i_recovered + 1) % NMXPTOOL_GAPFILL_MAX_RECOVERED;
+	gapfill.n_recovered--;
+	pthread_mutex_unlock(&gapfill.mutex);
+
+	for(i_func_pd=0; i_func_pd<n_func_pd; i_func_pd++) {
+	    (*p_func_pd[i_func_pd])(pd);
+	}
+	nmxp_raw_stream_pd_put(pd);
+	ret++;
+
+	pthread_mutex_lock(&gapfill.mutex);
+    }
+    if(ret > 0) {
+	pthread_cond_broadcast(&gapfill.cond_recovered);
+    }
+    pthread_mutex_unlock(&gapfill.mutex);
+#endif
+
+    return ret;
+}
+
+
+void nmxptool_gapfill_lock_channelList() {
+#ifdef HAVE_PTHREAD_H
+    if(gapfill_initialized) {
+	pthread_mutex_lock(&gapfill.mutex_channelList);
+    }
+#endif
+}
+
+
+void nmxptool_gapfill_unlock_channelList() {
+#ifdef HAVE_PTHREAD_H
+    if(gapfill_initialized) {
+	pthread_mutex_unlock(&gapfill.mutex_channelList);
+    }
+#endif
+}
+
+
+void nmxptool_gapfill_free() {
+#ifdef HAVE_PTHREAD_H
+    int i;
+
+    if(!gapfill_initialized) {
+	return;
+    }
+
+    pthread_mutex_lock(&gapfill.mutex);
+    gapfill.stop = 1;
+    pthread_cond_broadcast(&gapfill.cond_request);
+    pthread_cond_broadcast(&gapfill.cond_recovered);
+    pthread_mutex_unlock(&gapfill.mutex);
+
+    for(i=0; i < gapfill.n_workers; i++) {
+	pthread_join(gapfill.workers[i], NULL);
+    }
+
+    nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Gap-fill: %d holes, %d dropped, %d failed, %d packets recovered, %d holes not requested.\n",
+	    gapfill.n_holes, gapfill.n_holes_dropped, gapfill.n_holes_failed, gapfill.n_packets, gapfill.n_requests);
+
+    while(gapfill.n_recovered > 0) {
+	nmxp_raw_stream_pd_put(gapfill.recovered[gapfill.i_recovered]);
+	gapfill.i_recovered = (gapfill.i_recovered + 1) % NMXPTOOL_GAPFILL_MAX_RECOVERED;
+	gapfill.n_recovered--;
+    }
+    NMXP_MEM_FREE(gapfill.requests);
+    gapfill.requests = NULL;
+
+    pthread_cond_destroy(&gapfill.cond_recovered);
+    pthread_cond_destroy(&gapfill.cond_request);
+    pthread_mutex_destroy(&gapfill.mutex_channelList);
+    pthread_mutex_destroy(&gapfill.mutex);
+    gapfill_initialized = 0;
+#endif
+}
@@ -0,0 +1,75 @@
+/*! \file
+ *
+ * \brief Nanometrics Protocol Tool
+ *
+ * Gap-fill from DataServer of the holes skipped by the raw streams.
+ *
+ * When a raw stream handles a packet by force, the missing time span is
+ * queued and requested to DataServer by a pool of worker threads. The
+ * recovered packets are executed as late data by the main thread, so the
+ * output functions are never called concurrently.
+ *
+ * Author:
+ * 	Matteo Quintiliani
+ * 	Istituto Nazionale di Geofisica e Vulcanologia - Italy
+ *	quintiliani@ingv.it
+ *
+ * $Id $
+ *
+ */
+
+#ifndef NMXPTOOL_GAPFILL_H
+#define NMXPTOOL_GAPFILL_H 1
+
+#include "nmxp.h"
+#include "nmxptool_getoptlong.h"
+
+/*! \brief Max number of worker threads */
+#define NMXPTOOL_GAPFILL_MAX_WORKERS 4
+
+/*! \brief Max number of holes waiting for a worker */
+#define NMXPTOOL_GAPFILL_MAX_QUEUE 4096
+
+/*! \brief Max number of recovered packets waiting for the main thread */
+#define NMXPTOOL_GAPFILL_MAX_RECOVERED 256
+
+/*! \brief Seconds to wait after a hole before requesting it, DataServer has to store the packets */
+#define NMXPTOOL_GAPFILL_DELAY 30
+
+/*! \brief Holes longer than this number of seconds are not requested */
+#define NMXPTOOL_GAPFILL_MAX_SPAN 3600
+
+/*! \brief Time-out in seconds waiting for DataServer */
+#define NMXPTOOL_GAPFILL_TIMEOUT 10
+
+
+/*! \brief Start the worker threads
+ *
+ * \param params Parameters, params->gapfill_workers, gapfill_queue and gapfill_msec are used.
+ * \param channelList Channel list, it has to stay allocated until nmxptool_gapfill_free().
+ *                    Changes have to be done between nmxptool_gapfill_lock_channelList() and nmxptool_gapfill_unlock_channelList().
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int nmxptool_gapfill_init(NMXPTOOL_PARAMS *params, NMXP_CHAN_LIST_NET *channelList);
+
+/*! \brief Function for NMXP_RAW_STREAM_DATA.func_gap, it queues the hole without blocking */
+void nmxptool_gapfill_raw_stream_gap(NMXP_RAW_STREAM_DATA *p, NMXP_DATA_PROCESS *pd);
+
+/*! \brief Execute the functions on the recovered packets, called by the main thread
+ *
+ * \return Number of recovered packets handled.
+ */
+int nmxptool_gapfill_inject(int (*p_func_pd[NMXP_MAX_FUNC_PD]) (NMXP_DATA_PROCESS *), int n_func_pd);
+
+/*! \brief Lock the channel list used by the workers, before changing it at runtime */
+void nmxptool_gapfill_lock_channelList();
+
+/*! \brief Unlock the channel list used by the workers */
+void nmxptool_gapfill_unlock_channelList();
+
+/*! \brief Stop the worker threads and free the queues */
+void nmxptool_gapfill_free();
+
+#endif
@@ -26,6 +26,7 @@
 
 const NMXPTOOL_PARAMS NMXPTOOL_PARAMS_DEFAULT =
 {
+    NULL,
     NULL,
     DEFAULT_PORT_DAP,
     DEFAULT_PORT_PDS,
@@ -43,6 +44,11 @@ const NMXPTOOL_PARAMS NMXPTOOL_PARAMS_DEFAULT =
     DEFAULT_DELAY,
     DEFAULT_SPANINTERVAL,
     DEFAULT_MAX_TOLERABLE_LATENCY,
+    DEFAULT_ADAPT_LATENCY_MIN,
+    DEFAULT_ADAPT_LATENCY_PERCENTILE,
+    DEFAULT_GAPFILL_WORKERS,
+    DEFAULT_GAPFILL_QUEUE,
+    DEFAULT_GAPFILL_MSEC,
     DEFAULT_TIMEOUTRECV,
     DEFAULT_VERBOSE_LEVEL,
     NULL,
@@ -68,6 +74,9 @@ const NMXPTOOL_PARAMS NMXPTOOL_PARAMS_DEFAULT =
     0,
     0,
     0,
+    0,
+    0,
+    0,
     0
 };
 
@@ -198,8 +207,8 @@ Main arguments:\n\
   -H, --hostname=HOST     NaqsServer/DataServer hostname or IP address.\n\
   -C, --channels=LIST     List of NET.STA.CHAN.LOC separated by comma.\n\
                           NET  is optional and used only for output.\n\
-                          STA  can be '*', it stands for all stations.\n\
-                          CHAN can contain '?', it stands for any character.\n\
+                          STA and CHAN are globs: '*' stands for any sequence,\n\
+                          '?' for any character, [AB] and [!AB] for a class.\n\
                           LOC  is optional and used only for output.\n\
                           Network and location code will be assigned from the\n\
                           first pattern that include station and channel.\n\
@@ -243,6 +252,10 @@ Main arguments:\n\
     nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
 PDS arguments for NaqsServer:\n\
   -P, --portpds=PORT      NaqsServer port number (default %d).\n\
+  -Y, --standby=HOST      Hot-standby NaqsServer receiving the same telemetry.\n\
+                          Both servers are subscribed at the same time and\n\
+                          for each channel the first copy of a packet wins.\n\
+                          Usable only with Raw Stream, -S=-1.\n\
   -S, --stc=SECs          Short-Term-Completion (default %d).\n\
                           -1 is for Raw Stream, no Short-Term-Completion.\n\
                              Packets contain compressed data. Related to -M, -T.\n\
@@ -283,6 +296,21 @@ DEFAULT_USEC / 1000, DEFAULT_N_CHANNEL, NMXP_MAX_MSCHAN_MSEC / 1000);
                           for missed packets. Inside the section NetworkInterface\n\
                           of the file Naqs.ini set RetxRequest to Enabled.\n\
                           If RetxRequest is not enabled then -M is ineffective.\n\
+  -J, --adaptlatency=MIN/PERC\n\
+                          Tune -M for each channel within [MIN..maxlatency]\n\
+                          waiting for PERC percent of the retransmissions,\n\
+                          measured on the last holes. PERC within [%d..%d].\n\
+                          Disabled by default. It can not be used with -T.\n\
+  -z, --gapfill=nW/nQ/mSECs  Request to DataServer the holes skipped by -M and\n\
+                          send the recovered packets as late data. nW threads\n\
+                          [%d..%d], at most nQ holes queued [%d..%d] and mSECs\n\
+                          between two requests of a thread [%d..%d].\n\
+                          Disabled by default. Related to -D, -u, -p.\n\
+  -O, --dualoutput        Send each packet to SeedLink and Earthworm as soon as\n\
+                          it arrives, holes are not waited for and late packets\n\
+                          are discarded. Mini-SEED files and the other outputs\n\
+                          still receive the ordered stream completed by -M.\n\
+                          Usable only with Raw Stream, -S=-1.\n\
   -T, --timeoutrecv=SECs  Time-out for flushing queued packets of each channel.\n\
                           It sets --mschan=0/0 (default %d, no time-out) [%d..%d].\n\
                           -T is useful for retrieving Data On Demand with minimum delay.\n\
@@ -294,6 +322,11 @@ DEFAULT_USEC / 1000, DEFAULT_N_CHANNEL, NMXP_MAX_MSCHAN_MSEC / 1000);
 	    DEFAULT_MAX_TOLERABLE_LATENCY,
 	    DEFAULT_MAX_TOLERABLE_LATENCY_MINIMUM,
 	    DEFAULT_MAX_TOLERABLE_LATENCY_MAXIMUM,
+	    DEFAULT_ADAPT_LATENCY_PERCENTILE_MINIMUM,
+	    DEFAULT_ADAPT_LATENCY_PERCENTILE_MAXIMUM,
+	    DEFAULT_GAPFILL_WORKERS_MINIMUM, DEFAULT_GAPFILL_WORKERS_MAXIMUM,
+	    DEFAULT_GAPFILL_QUEUE_MINIMUM, DEFAULT_GAPFILL_QUEUE_MAXIMUM,
+	    DEFAULT_GAPFILL_MSEC_MINIMUM, DEFAULT_GAPFILL_MSEC_MAXIMUM,
 	    DEFAULT_TIMEOUTRECV,
 	    DEFAULT_TIMEOUTRECV_MINIMUM,
 	    DEFAULT_TIMEOUTRECV_MAXIMUM
@@ -361,6 +394,14 @@ Mini-SEED arguments:\n");
                           which must be expressible as 2 raised to the power of X\n\
                           where X is between (and including) 8 to 20.\n\
                           (Default is %d).\n", DEFAULT_RECLEN_MINISEED);
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+  -X, --transcode         Pack the compressed packets of the PDS raw stream\n\
+                          straight into Steim records for -m, without decoding\n\
+                          and encoding the samples again. Related to -m, -x, -r.\n\
+                          (Only with --stc=-1 and reclen up to %d).\n", NMXP_STEIM_RECLEN_MAXIMUM);
+    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
+  -c, --transcode_check   Unpack by libmseed each record written by -X and\n\
+                          compare it with the decoded samples. Related to -X.\n");
 #endif
 
 
@@ -432,7 +473,9 @@ Other arguments:\n\
 #ifndef HAVE_WINDOWS_H
     nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
   -E, --testport=PORT     Accept 'telnet' connection on PORT\n\
-                          for data testing and diagnostic purposes.\n");
+                          for data testing and diagnostic purposes.\n\
+                          Commands add, remove and reload change the\n\
+                          channels without reconnecting (type 'help').\n");
 #endif
 
     nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "\
@@ -449,7 +492,10 @@ Signal handling:\n\
    USR1                   Force to close a connection and open again\n\
                           without quitting the program. Only for connection\n\
                           in near real-time to NaqsServer.\n\
-   HUP PIPE               Ignored. (SIG_IGN)\n\
+   HUP                    Reload the channel patterns of the state file -F\n\
+                          without reconnecting. Only for connection\n\
+                          in near real-time to NaqsServer.\n\
+   PIPE                   Ignored. (SIG_IGN)\n\
 \n", NMXP_LOG_STR(PACKAGE_NAME));
 
     nmxptool_author_support();
@@ -672,6 +718,7 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 	/* These options don't set a flag.
 	 *                   We distinguish them by their indices. */
 	{"hostname",     required_argument, NULL, 'H'},
+	{"standby",      required_argument, NULL, 'Y'},
 	{"portpds",      required_argument, NULL, 'P'},
 	{"portdap",      required_argument, NULL, 'D'},
 	{"channels",     required_argument, NULL, 'C'},
@@ -687,6 +734,8 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 	{"username",     required_argument, NULL, 'u'},
 	{"password",     required_argument, NULL, 'p'},
 	{"maxlatency",   required_argument, NULL, 'M'},
+	{"adaptlatency", required_argument, NULL, 'J'},
+	{"gapfill",      required_argument, NULL, 'z'},
 	{"timeoutrecv",  required_argument, NULL, 'T'},
 	{"verbose",      required_argument, NULL, 'v'},
 	{"bufferedt",    required_argument, NULL, 'B'},
@@ -695,6 +744,7 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 	{"logdata",      no_argument,       NULL, 'g'},
 	{"logsample",    no_argument,       NULL, 'G'},
 	{"buffered",     no_argument,       NULL, 'b'},
+	{"dualoutput",   no_argument,       NULL, 'O'},
 	{"listchannels", no_argument,       NULL, 'l'},
 	{"listchannelsnaqs", no_argument,   NULL, 'L'},
 	{"channelinfo",  no_argument,       NULL, 'i'},
@@ -704,6 +754,8 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 	{"quality_indicator", required_argument, NULL, 'q'},
 	{"encoding",     required_argument, NULL, 'x'},
 	{"reclen",       required_argument, NULL, 'r'},
+	{"transcode",    no_argument,       NULL, 'X'},
+	{"transcode_check", no_argument,    NULL, 'c'},
 #endif
 	{"writefile",    no_argument,       NULL, 'w'},
 #ifdef HAVE_SEEDLINK
@@ -730,7 +782,7 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 	{0, 0, 0, 0}
     };
 
-    char optstr[300] = "H:P:D:C:N:n:S:R:s:e:t:d:a:u:p:M:T:v:B:A:F:f:gGblLiwhV";
+    char optstr[300] = "H:Y:P:D:C:N:n:S:R:s:e:t:d:a:u:p:M:J:z:T:v:B:A:F:f:gGbOlLiwhV";
 
     int option_index = 0;
 
@@ -741,6 +793,8 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
     strcat(optstr, "q:");
     strcat(optstr, "x:");
     strcat(optstr, "r:");
+    strcat(optstr, "X");
+    strcat(optstr, "c");
 #endif
 
 
@@ -811,6 +865,10 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 		    params->hostname = optarg;
 		    break;
 
+		case 'Y':
+		    params->hostname_standby = optarg;
+		    break;
+
 		case 'P':
 			if(nmxptool_parse_int(optarg, &(params->portnumberpds)) == 0) {
 				nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Error parsing NaqsServer port number '%s'.\n", optarg);
@@ -910,6 +968,33 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 			}
 		    break;
 
+		case 'J':
+		    sep = strstr(optarg, "/");
+		    if(sep) {
+			sep[0] = 0;
+			sep++;
+			params->adapt_latency_min = atoi(optarg);
+			params->adapt_latency_percentile = atoi(sep);
+			nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Adaptive latency from %d sec. for %d%% of holes\n",
+				params->adapt_latency_min, params->adapt_latency_percentile);
+		    } else {
+			ret_errors++;
+			nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
+				"Syntax error in option -%c %s!\n", c, NMXP_LOG_STR(optarg));
+		    }
+		    break;
+
+		case 'z':
+		    if(sscanf(optarg, "%d/%d/%d", &(params->gapfill_workers), &(params->gapfill_queue), &(params->gapfill_msec)) == 3) {
+			nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Gap-fill %d threads, %d holes, %d ms\n",
+				params->gapfill_workers, params->gapfill_queue, params->gapfill_msec);
+		    } else {
+			ret_errors++;
+			nmxp_log(NMXP_LOG_ERR, NMXP_LOG_D_ANY,
+				"Syntax error in option -%c %s!\n", c, NMXP_LOG_STR(optarg));
+		    }
+		    break;
+
 		case 'T':
 			if(nmxptool_parse_int(optarg, &(params->timeoutrecv)) == 0) {
 				nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Error parsing Time-out receving '%s'.\n", optarg);
@@ -1052,6 +1137,10 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 		    params->flag_buffered = 1;
 		    break;
 
+		case 'O':
+		    params->flag_dualoutput = 1;
+		    break;
+
 		case 'l':
 		    params->flag_listchannels = 1;
 		    break;
@@ -1122,6 +1211,14 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 		    }
 		    break;
 
+		case 'X':
+		    params->flag_transcode = 1;
+		    break;
+
+		case 'c':
+		    params->flag_transcode_check = 1;
+		    break;
+
 		case 'r':
 			if(nmxptool_parse_int(optarg, &(params->reclen)) == 0) {
 				nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "Error parsing mini-SEED record length '%s'.\n", optarg);
@@ -1203,10 +1300,12 @@ int nmxptool_getopt_long(int argc, char **argv, NMXPTOOL_PARAMS *params)
 void nmxptool_log_params(NMXPTOOL_PARAMS *params) {
     nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_EXTRA, "\
     char *hostname: %s\n\
+    char *hostname_standby: %s\n\
     int portnumberdap: %d\n\
     int portnumberpds: %d\n\
 ",
     NMXP_LOG_STR(params->hostname),
+    NMXP_LOG_STR(params->hostname_standby),
     params->portnumberdap,
     params->portnumberpds
 );
@@ -1246,6 +1345,11 @@ void nmxptool_log_params(NMXPTOOL_PARAMS *params) {
     char *plugin_slink: %s\n\
     int32_t delay: %d\n\
     int32_t max_tolerable_latency: %d\n\
+    int32_t adapt_latency_min: %d\n\
+    int32_t adapt_latency_percentile: %d\n\
+    int32_t gapfill_workers: %d\n\
+    int32_t gapfill_queue: %d\n\
+    int32_t gapfill_msec: %d\n\
     int32_t timeoutrecv: %d\n\
     int32_t verbose_level: %d\n\
 ",
@@ -1254,6 +1358,11 @@ void nmxptool_log_params(NMXPTOOL_PARAMS *params) {
     NMXP_LOG_STR(params->plugin_slink),
     params->delay,
     params->max_tolerable_latency,
+    params->adapt_latency_min,
+    params->adapt_latency_percentile,
+    params->gapfill_workers,
+    params->gapfill_queue,
+    params->gapfill_msec,
     params->timeoutrecv,
     params->verbose_level
 );
@@ -1282,6 +1391,9 @@ void nmxptool_log_params(NMXPTOOL_PARAMS *params) {
     int flag_buffered: %d\n\
     int flag_logdata: %d\n\
     int flag_logsample: %d\n\
+    int flag_dualoutput: %d\n\
+    int flag_transcode: %d\n\
+    int flag_transcode_check: %d\n\
 ",
     params->buffered_time,
     params->type_writeseed,
@@ -1295,7 +1407,10 @@ void nmxptool_log_params(NMXPTOOL_PARAMS *params) {
     params->flag_slink_network_id,
     params->flag_buffered,
     params->flag_logdata,
-    params->flag_logsample
+    params->flag_logsample,
+    params->flag_dualoutput,
+    params->flag_transcode,
+    params->flag_transcode_check
     );
 }
 
@@ -1430,6 +1545,66 @@ int nmxptool_check_params(NMXPTOOL_PARAMS *params) {
 	nmxp_log(NMXP_LOG_WARN, NMXP_LOG_D_ANY, "<timeoutrecv> ignored since not defined --stc=-1.\n");
     }
 
+    if(params->adapt_latency_percentile != 0) {
+	if(params->stc != -1  ||  params->timeoutrecv > 0) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<adaptlatency> can be used only with --stc=-1 and without <timeoutrecv>.\n");
+	} else if(params->adapt_latency_percentile < DEFAULT_ADAPT_LATENCY_PERCENTILE_MINIMUM
+		||  params->adapt_latency_percentile > DEFAULT_ADAPT_LATENCY_PERCENTILE_MAXIMUM) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "PERC in <adaptlatency> has to be within [%d..%d].\n",
+		    DEFAULT_ADAPT_LATENCY_PERCENTILE_MINIMUM, DEFAULT_ADAPT_LATENCY_PERCENTILE_MAXIMUM);
+	} else if(params->adapt_latency_min < DEFAULT_ADAPT_LATENCY_MIN_MINIMUM
+		||  params->adapt_latency_min > params->max_tolerable_latency) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "MIN in <adaptlatency> has to be within [%d..%d].\n",
+		    DEFAULT_ADAPT_LATENCY_MIN_MINIMUM, params->max_tolerable_latency);
+	}
+    }
+
+    if(params->gapfill_workers != 0) {
+	if(params->stc != -1) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<gapfill> can be used only with --stc=-1.\n");
+	} else if(params->gapfill_workers < DEFAULT_GAPFILL_WORKERS_MINIMUM  ||  params->gapfill_workers > DEFAULT_GAPFILL_WORKERS_MAXIMUM
+		||  params->gapfill_queue < DEFAULT_GAPFILL_QUEUE_MINIMUM  ||  params->gapfill_queue > DEFAULT_GAPFILL_QUEUE_MAXIMUM
+		||  params->gapfill_msec < DEFAULT_GAPFILL_MSEC_MINIMUM  ||  params->gapfill_msec > DEFAULT_GAPFILL_MSEC_MAXIMUM) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<gapfill> nW within [%d..%d], nQ within [%d..%d], mSECs within [%d..%d].\n",
+		    DEFAULT_GAPFILL_WORKERS_MINIMUM, DEFAULT_GAPFILL_WORKERS_MAXIMUM,
+		    DEFAULT_GAPFILL_QUEUE_MINIMUM, DEFAULT_GAPFILL_QUEUE_MAXIMUM,
+		    DEFAULT_GAPFILL_MSEC_MINIMUM, DEFAULT_GAPFILL_MSEC_MAXIMUM);
+	}
+    }
+
+    if(params->flag_dualoutput  &&  params->stc != -1) {
+	ret = -1;
+	nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<dualoutput> can be used only with --stc=-1.\n");
+    }
+
+#ifdef HAVE_LIBMSEED
+    if(params->flag_transcode) {
+	if(!params->type_writeseed  ||  params->stc != -1) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<transcode> can be used only with <writeseed> and --stc=-1.\n");
+	} else if(params->reclen > NMXP_STEIM_RECLEN_MAXIMUM) {
+	    ret = -1;
+	    nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<reclen> can not be greater than %d with <transcode>.\n",
+		    NMXP_STEIM_RECLEN_MAXIMUM);
+	}
+    }
+
+    if(params->flag_transcode_check  &&  !params->flag_transcode) {
+	ret = -1;
+	nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<transcode_check> is used only by -X option.\n");
+    }
+#endif
+
+    if(params->hostname_standby  &&  params->stc != -1) {
+	ret = -1;
+	nmxp_log(NMXP_LOG_NORM_NO, NMXP_LOG_D_ANY, "<standby> can be used only with --stc=-1.\n");
+    }
+
 #ifdef HAVE_SEEDLINK
     if( params->flag_slink_network_id == 1
 			&& (
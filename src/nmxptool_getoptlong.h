@@ -49,6 +49,22 @@
 #define DEFAULT_MAX_TOLERABLE_LATENCY_MAXIMUM	600
 #define DEFAULT_MAX_TOLERABLE_LATENCY 		600
 
+#define DEFAULT_ADAPT_LATENCY_MIN		5
+#define DEFAULT_ADAPT_LATENCY_MIN_MINIMUM	1
+#define DEFAULT_ADAPT_LATENCY_PERCENTILE	0
+#define DEFAULT_ADAPT_LATENCY_PERCENTILE_MINIMUM	50
+#define DEFAULT_ADAPT_LATENCY_PERCENTILE_MAXIMUM	100
+
+#define DEFAULT_GAPFILL_WORKERS			0
+#define DEFAULT_GAPFILL_WORKERS_MINIMUM		1
+#define DEFAULT_GAPFILL_WORKERS_MAXIMUM		4
+#define DEFAULT_GAPFILL_QUEUE			256
+#define DEFAULT_GAPFILL_QUEUE_MINIMUM		1
+#define DEFAULT_GAPFILL_QUEUE_MAXIMUM		4096
+#define DEFAULT_GAPFILL_MSEC			1000
+#define DEFAULT_GAPFILL_MSEC_MINIMUM		0
+#define DEFAULT_GAPFILL_MSEC_MAXIMUM		600000
+
 #define DEFAULT_TIMEOUTRECV 			0
 #define DEFAULT_TIMEOUTRECV_MINIMUM 		10
 #define DEFAULT_TIMEOUTRECV_MAXIMUM 		300
@@ -110,6 +126,7 @@
 /*! \brief Struct that stores information about parameter of the program */
 typedef struct {
     char *hostname;
+    char *hostname_standby;	/* hot-standby NaqsServer receiving the same telemetry */
     int portnumberdap;
     int portnumberpds;
     char *channels;
@@ -126,6 +143,11 @@ typedef struct {
     int32_t delay;
     int32_t span_data;
     int32_t max_tolerable_latency;
+    int32_t adapt_latency_min;		/* lower bound of max_tolerable_latency when adaptive */
+    int32_t adapt_latency_percentile;	/* percentage of holes to wait for, 0 for fixed max_tolerable_latency */
+    int32_t gapfill_workers;		/* threads requesting the skipped holes to DataServer, 0 for no gap-fill */
+    int32_t gapfill_queue;		/* max number of holes waiting for a thread */
+    int32_t gapfill_msec;		/* milliseconds between two requests of a thread */
     int32_t timeoutrecv;
     int32_t verbose_level;
     char *ew_configuration_file;
@@ -153,6 +175,9 @@ typedef struct {
     int flag_buffered;
     int flag_logdata;
     int flag_logsample;
+    int flag_dualoutput;
+    int flag_transcode;		/* pack PDS compressed packets in Steim records without decoding them */
+    int flag_transcode_check;	/* compare the transcoded records with the decoded samples by libmseed */
 } NMXPTOOL_PARAMS;
 
 /*! \brief Print author and e-mail for support and bugs */
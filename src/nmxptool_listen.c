@@ -38,6 +38,7 @@
 
 extern void *nmxptool_print_info_raw_stream(void *arg);
 extern void *nmxptool_print_params(void *arg);
+extern NMXP_CHAN_LIST_NET *channelList_subset;
 
 /* #define MYPORT 3490	// the port users will be connecting to */
 
@@ -104,31 +105,53 @@ typedef struct {
 #define COMMAND_RAW     6
 #define COMMAND_PARAMS  7
 #define COMMAND_HELP    8
+#define COMMAND_ADD     9
+#define COMMAND_REMOVE 10
+#define COMMAND_RELOAD 11
 
-#define N_COMMAND       8
+#define N_COMMAND      11
 
 const COMMAND_ITEM list_cmd[N_COMMAND] = {
     {COMMAND_NULL,      "", 	""},
     {COMMAND_LIST,      "list", 	"List of the channels."},
+    {COMMAND_ADD,       "add", 	"Request more channels, 'add PATTERNS' where PATTERNS is as in -C."},
+    {COMMAND_REMOVE,    "remove", 	"Stop some channels, 'remove PATTERNS' where PATTERNS is as in -C."},
+    {COMMAND_RELOAD,    "reload", 	"Read again the channel patterns of the state file, -F."},
     {COMMAND_PRINT,     "print", 	"Print processed packets."},
     {COMMAND_HELP,      "help", 	"Print this help"},
-    {COMMAND_MEM,       "mem",		"Print memory size used."},
+    {COMMAND_MEM,       "mem",		"Print memory size used, for each call site with --enable-memdebug."},
     {COMMAND_RAW,       "raw",		"Print info about data buffer."},
     {COMMAND_PARAMS,    "params", 	"Print parameter values."},
     {COMMAND_EXIT,      "exit", 	"Exit."}
 };
 
-int nmxptool_command(char *str_command) {
+/* *argument is set to the text after the command name, it needs to be freed */
+int nmxptool_command(char *str_command, char **argument) {
     int ret = -1;
     int i = 0;
     int len = 0;
     char *command_clean = NULL;
+    char *arg = NULL;
+
+    *argument = NULL;
 
     command_clean = nmxptool_command_clean(str_command);
 
     /* nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY, "'%s' ==> '%s'\n", NMXP_LOG_STR(str_command), NMXP_LOG_STR(command_clean)); */
 
     if(command_clean) {
+	/* Split command name and argument */
+	arg = strchr(command_clean, ' ');
+	if(arg) {
+	    *arg = 0;
+	    arg++;
+	    while(*arg == ' ') {
+		arg++;
+	    }
+	    if(*arg != 0) {
+		*argument = NMXP_MEM_STRDUP(arg);
+	    }
+	}
 	len = strlen(command_clean);
 	i = 0;
 	while(i < N_COMMAND  &&  strcmp(command_clean, list_cmd[i].str_command) != 0) {
@@ -209,10 +232,14 @@ int nmxp_log_send_socket(char *msg) {
     return ret;
 }
 
-int nmxptool_fd_command(int new_fd, int command) {
+int nmxptool_fd_command(int new_fd, int command, char *argument) {
     int ret_occ;
     int i;
+    int action;
     char str_command_not_found[] = "Command not found!\n";
+    char str_argument_missing[] = "Channel patterns are missing!\n";
+    char str_queued[] = "Request queued, changes are logged.\n";
+    char str_not_queued[] = "Too many pending requests!\n";
     char str_tot_mem[30];
     char msg[1024];
 
@@ -231,11 +258,45 @@ int nmxptool_fd_command(int new_fd, int command) {
     switch(command) {
 
 	case COMMAND_MEM:
-	    snprintf(str_tot_mem, 30, "%d\n", NMXP_MEM_PRINT_PTR(0, 1));
+	    /* Bytes and blocks not freed of each call site, with --enable-memdebug */
+	    pthread_mutex_lock (&mutex_cur_fd);
+	    cur_fd = new_fd;
+	    nmxp_log_add(nmxp_log_send_socket, nmxp_log_send_socket);
+	    NMXP_MEM_PRINT_SFS();
+	    nmxp_log_rem(nmxp_log_send_socket, nmxp_log_send_socket);
+	    cur_fd = 0;
+	    pthread_mutex_unlock (&mutex_cur_fd);
+	    snprintf(str_tot_mem, 30, "%d\n", NMXP_MEM_PRINT_PTR(0, 0));
 	    nmxptool_send_ctrl(new_fd, str_tot_mem);
 	    break;
 
 	case COMMAND_LIST:
+	    pthread_mutex_lock (&mutex_cur_fd);
+	    cur_fd = new_fd;
+	    nmxp_log_add(nmxp_log_send_socket, nmxp_log_send_socket);
+	    nmxptool_channels_lock();
+	    if(channelList_subset) {
+		nmxp_chan_print_netchannelList(channelList_subset);
+	    }
+	    nmxptool_channels_unlock();
+	    nmxp_log_rem(nmxp_log_send_socket, nmxp_log_send_socket);
+	    cur_fd = 0;
+	    pthread_mutex_unlock (&mutex_cur_fd);
+	    break;
+
+	case COMMAND_ADD:
+	case COMMAND_REMOVE:
+	case COMMAND_RELOAD:
+	    if(command != COMMAND_RELOAD  &&  argument == NULL) {
+		nmxptool_send_ctrl(new_fd, str_argument_missing);
+	    } else {
+		action = (command == COMMAND_ADD)? NMXPTOOL_CHANMOD_ADD : ((command == COMMAND_REMOVE)? NMXPTOOL_CHANMOD_REMOVE : NMXPTOOL_CHANMOD_RELOAD);
+		if(nmxptool_chanmod_request(action, argument) == 0) {
+		    nmxptool_send_ctrl(new_fd, str_queued);
+		} else {
+		    nmxptool_send_ctrl(new_fd, str_not_queued);
+		}
+	    }
 	    break;
 
 	case COMMAND_RAW:
@@ -244,7 +305,9 @@ int nmxptool_fd_command(int new_fd, int command) {
 	    cur_fd = new_fd;
 	    nmxp_log_add(nmxp_log_send_socket, nmxp_log_send_socket);
 	    if(command == COMMAND_RAW) {
+		nmxptool_channels_lock();
 		nmxptool_print_info_raw_stream(NULL);
+		nmxptool_channels_unlock();
 	    } else {
 		nmxptool_print_params(NULL);
 	    }
@@ -287,6 +350,7 @@ void *nmxptool_p_man_sockfd(void *arg) {
     char *prompt = "> ";
     char *welcome_message = "Welcome aboard nmxptool! Type 'help' for command list.\n";
     char *last_str_command = NULL;
+    char *argument = NULL;
 
     nmxp_log(NMXP_LOG_NORM, NMXP_LOG_D_ANY,
 			"server: got connection from %s (%d) (%d)\n", fd_hc->hostclient, fd_hc->fd, nmxptool_fd_add(fd_hc->fd));
@@ -310,7 +374,7 @@ void *nmxptool_p_man_sockfd(void *arg) {
 	    /* ERROR */
 	}
 
-	if( (last_command = nmxptool_command(command)) != -1 ) {
+	if( (last_command = nmxptool_command(command, &argument)) != -1 ) {
 	    last_str_command = nmxptool_command_clean(command);
 	}
 
@@ -322,7 +386,12 @@ void *nmxptool_p_man_sockfd(void *arg) {
 	    last_str_command = NULL;
 	}
 
-	nmxptool_fd_command(fd_hc->fd, last_command);
+	nmxptool_fd_command(fd_hc->fd, last_command, argument);
+
+	if(argument) {
+	    NMXP_MEM_FREE(argument);
+	    argument = NULL;
+	}
 	
     }
 
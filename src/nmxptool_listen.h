@@ -16,6 +16,16 @@
 
 #include <nmxp.h>
 
+/* Changes of the channel list requested at runtime */
+#define NMXPTOOL_CHANMOD_ADD    1
+#define NMXPTOOL_CHANMOD_REMOVE 2
+#define NMXPTOOL_CHANMOD_RELOAD 3
+
+/* Defined in nmxptool.c */
+int nmxptool_chanmod_request(int action, const char *patterns);
+void nmxptool_channels_lock();
+void nmxptool_channels_unlock();
+
 int nmxptool_occ_inc(int inc);
 void *nmxptool_p_man_sockfd(void *arg);
 void *nmxptool_listen(void *arg);
@@ -0,0 +1,176 @@
+/*! \file
+ *
+ * \brief Per-bundle cost of nmxp_data_unpack_bundle() against the switch decoder it replaced
+ *
+ * Usage: bench_unpack_bundle [n_bundles [n_loops]]
+ *
+ * Random bundles, control byte 9 excluded, are decoded n_loops times by
+ * the previous switch-based decoder, copied below, and by
+ * nmxp_data_unpack_bundle(). The output of both is compared first.
+ * nmxp_data_unpack_bundle() uses SSE4.1 when the CPU supports it,
+ * configure with --disable-simd to time the table-driven scalar decoder.
+ *
+ * $Id $
+ *
+ */
+
+#include "config.h"
+#include "nmxp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define BENCH_N_BUNDLES 4096
+#define BENCH_N_LOOPS 2000
+
+/* nmxp_data_unpack_bundle() before the table-driven decoder */
+static int bench_unpack_bundle_switch (int32_t *outdata, unsigned char *indata, int32_t *prev)
+{
+	int32_t nsamples = 0;
+	int32_t d4[4];
+	int16_t d2[2];
+	int32_t cb[4];
+	int32_t i, j, k=0;
+	unsigned char cbits;
+	int my_host_is_bigendian = nmxp_data_bigendianhost();
+
+	cbits = (unsigned char)indata[0];
+	if (cbits == 9) return (-1);
+	++indata;
+
+	for (i=0,j=6; j>=0; i++,j-=2) {
+		cb[i] = (cbits>>j) & 3;
+	}
+
+	for (j=0; j<4; j++) {
+		switch (cb[j])
+		{
+			case 0:
+				k=0;
+				break;
+			case 1:
+				d4[0] = (signed char)indata[0];
+				d4[1] = (signed char)indata[1];
+				d4[2] = (signed char)indata[2];
+				d4[3] = (signed char)indata[3];
+				k=4;
+				break;
+			case 2:
+				memcpy (&d2[0],indata,2);
+				memcpy (&d2[1],indata+2,2);
+				if (my_host_is_bigendian) {
+					nmxp_data_swap_2b (&d2[0]);
+					nmxp_data_swap_2b (&d2[1]);
+				}
+				d4[0] = d2[0];
+				d4[1] = d2[1];
+				k=2;
+				break;
+			case 3:
+				memcpy (&d4[0],indata,4);
+				if (my_host_is_bigendian) {
+					nmxp_data_swap_4b (&d4[0]);
+				}
+				k=1;
+				break;
+		}
+		indata += 4;
+
+		for (i=0; i<k; i++) {
+			*outdata = *prev + d4[i];
+			*prev = *outdata;
+			outdata++;
+			++nsamples;
+		}
+	}
+	return (nsamples);
+}
+
+static double bench_now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+/* Decode all bundles n_loops times, return ns per bundle */
+static double bench_run(int (*func)(int32_t *, unsigned char *, int32_t *), unsigned char *bundles, int n_bundles, int n_loops, int32_t *outdata, int64_t *checksum) {
+    int i, l, n;
+    int32_t prev = 0;
+    double t0, t1;
+
+    t0 = bench_now_us();
+    for(l=0; l < n_loops; l++) {
+	n = 0;
+	for(i=0; i < n_bundles; i++) {
+	    n += func(outdata + n, bundles + i * 17, &prev);
+	}
+	*checksum += n + outdata[n - 1];
+    }
+    t1 = bench_now_us();
+
+    return (t1 - t0) * 1000.0 / ((double) n_bundles * (double) n_loops);
+}
+
+int main(int argc, char **argv) {
+    int n_bundles = BENCH_N_BUNDLES;
+    int n_loops = BENCH_N_LOOPS;
+    unsigned char *bundles;
+    int32_t *out_before, *out_after;
+    int32_t prev_before = 0, prev_after = 0;
+    int n_before = 0, n_after = 0;
+    int64_t checksum = 0;
+    double ns_before, ns_after;
+    int i;
+
+    if(argc > 1) {
+	n_bundles = atoi(argv[1]);
+    }
+    if(argc > 2) {
+	n_loops = atoi(argv[2]);
+    }
+    if(n_bundles <= 0  ||  n_loops <= 0) {
+	fprintf(stderr, "Usage: %s [n_bundles [n_loops]]\n", argv[0]);
+	return 1;
+    }
+
+    bundles = (unsigned char *) malloc(n_bundles * 17);
+    out_before = (int32_t *) malloc(n_bundles * 16 * sizeof(int32_t));
+    out_after = (int32_t *) malloc(n_bundles * 16 * sizeof(int32_t));
+
+    srand(1);
+    for(i=0; i < n_bundles * 17; i++) {
+	bundles[i] = (unsigned char) (rand() & 0xff);
+    }
+    for(i=0; i < n_bundles; i++) {
+	if(bundles[i * 17] == 9) {
+	    bundles[i * 17] = 0x55;
+	}
+    }
+
+    /* Same samples and same last value */
+    for(i=0; i < n_bundles; i++) {
+	n_before += bench_unpack_bundle_switch(out_before + n_before, bundles + i * 17, &prev_before);
+	n_after += nmxp_data_unpack_bundle(out_after + n_after, bundles + i * 17, &prev_after);
+    }
+    if(n_before != n_after  ||  prev_before != prev_after
+	    ||  memcmp(out_before, out_after, n_before * sizeof(int32_t)) != 0) {
+	printf("Decoders differ: %d samples, last %d, against %d samples, last %d\n",
+		n_before, prev_before, n_after, prev_after);
+	return 1;
+    }
+
+    ns_before = bench_run(bench_unpack_bundle_switch, bundles, n_bundles, n_loops, out_before, &checksum);
+    ns_after = bench_run(nmxp_data_unpack_bundle, bundles, n_bundles, n_loops, out_after, &checksum);
+
+    printf("%d bundles, %d samples, decoded %d times (checksum %lld)\n", n_bundles, n_before, n_loops, (long long) checksum);
+    printf("switch decoder (before)     %8.2f ns/bundle\n", ns_before);
+    printf("nmxp_data_unpack_bundle()   %8.2f ns/bundle\n", ns_after);
+
+    free(bundles);
+    free(out_before);
+    free(out_after);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*! \file
+ *
+ * \brief Decode compressed packets into outdata of exactly NMXP_COMPRESSED_OUTDATA_SIZE() samples
+ *
+ * Packets are built with known differences, with and without a trailing
+ * null bundle, and decoded by nmxp_processCompressedData_hdr() into a
+ * buffer allocated with the size given by NMXP_COMPRESSED_OUTDATA_SIZE().
+ * Run it under a memory checker to catch writes beyond the buffer.
+ *
+ * $Id $
+ *
+ */
+
+#include "nmxp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_INSTR_ID 100
+#define TEST_KEY ((TEST_INSTR_ID << 16) | (1 << 8) | 0)
+#define TEST_X0 -1234
+#define TEST_MAX_BUNDLES 18
+
+static const int32_t ndiff[4] = {0, 4, 2, 1};
+
+/* Value of the i-th difference, small enough for any compression code */
+static int32_t test_diff(int32_t i) {
+    return ((i * 37) % 201) - 100;
+}
+
+static void put_le(unsigned char *p, int32_t v, int n) {
+    int i;
+    for(i=0; i < n; i++) {
+	p[i] = (unsigned char) (((uint32_t) v >> (8 * i)) & 0xff);
+    }
+}
+
+/* Build a compressed packet of n_bundles bundles with control bytes cbits[],
+ * followed by a null bundle if null_bundle is set. Return its length. */
+static int test_build_packet(char *buffer, const unsigned char *cbits, int n_bundles, int null_bundle, int32_t *expected, int32_t *nSamp) {
+    unsigned char *p = (unsigned char *) buffer;
+    int32_t seconds = 1600000000;
+    int16_t ticks = 0;
+    int16_t instr_id = TEST_INSTR_ID;
+    int32_t seq_no = 1;
+    int32_t x = TEST_X0;
+    int32_t n = 0;
+    int32_t d;
+    int b, j, k, cb;
+
+    memset(buffer, 0, 21 + 17 * TEST_MAX_BUNDLES);
+
+    /* Oldest sequence number and header bundle */
+    put_le(p, seq_no, 4);
+    p[4] = 1;
+    put_le(p + 5, seconds, 4);
+    put_le(p + 9, ticks, 2);
+    put_le(p + 11, instr_id, 2);
+    put_le(p + 13, seq_no, 4);
+    p[17] = (9 << 3) | 0;
+    put_le(p + 18, TEST_X0, 3);
+
+    expected[0] = x;
+    p += 21;
+    for(b=0; b < n_bundles; b++) {
+	p[0] = cbits[b];
+	for(j=0; j < 4; j++) {
+	    cb = (cbits[b] >> (6 - 2 * j)) & 3;
+	    for(k=0; k < ndiff[cb]; k++) {
+		d = test_diff(n);
+		put_le(p + 1 + 4 * j + k * (4 / ndiff[cb]), d, 4 / ndiff[cb]);
+		x += d;
+		n++;
+		expected[n] = x;
+	    }
+	}
+	p += 17;
+    }
+    if(null_bundle) {
+	p[0] = 9;
+	p += 17;
+    }
+
+    *nSamp = n;
+    return (char *) p - buffer;
+}
+
+static int test_decode(const char *name, NMXP_CHAN_LIST_NET *channelList, const unsigned char *cbits, int n_bundles, int null_bundle) {
+    char buffer[21 + 17 * TEST_MAX_BUNDLES];
+    int32_t expected[16 * TEST_MAX_BUNDLES + 1];
+    int32_t nSamp;
+    int32_t *outdata;
+    int32_t i;
+    int length;
+    int ret = 0;
+    NMXP_PACKET_HEADER hdr;
+    NMXP_DATA_PROCESS pd;
+
+    length = test_build_packet(buffer, cbits, n_bundles, null_bundle, expected, &nSamp);
+
+    if(nmxp_processCompressedHeader(buffer, length, &hdr) != 0  ||  hdr.nSamp != nSamp) {
+	printf("FAIL %s: header nSamp %d, expected %d\n", name, hdr.nSamp, nSamp);
+	return 1;
+    }
+
+    outdata = (int32_t *) malloc(NMXP_COMPRESSED_OUTDATA_SIZE(hdr.nSamp) * sizeof(int32_t));
+    if(nmxp_processCompressedData_hdr(buffer, length, &hdr, channelList, "XX", "", &pd,
+		outdata, NMXP_COMPRESSED_OUTDATA_SIZE(hdr.nSamp)) != 0) {
+	printf("FAIL %s: not decoded into %d samples\n", name, NMXP_COMPRESSED_OUTDATA_SIZE(hdr.nSamp));
+	ret = 1;
+    } else if(pd.nSamp != nSamp  ||  pd.xn != expected[nSamp]) {
+	printf("FAIL %s: nSamp %d xn %d, expected %d %d\n", name, pd.nSamp, pd.xn, nSamp, expected[nSamp]);
+	ret = 1;
+    } else {
+	for(i=0; ret == 0  &&  i <= nSamp; i++) {
+	    if(outdata[i] != expected[i]) {
+		printf("FAIL %s: sample %d is %d, expected %d\n", name, i, outdata[i], expected[i]);
+		ret = 1;
+	    }
+	}
+    }
+    free(outdata);
+
+    if(ret == 0) {
+	printf("PASS %s: %d samples\n", name, nSamp);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    const unsigned char cbits_byte[17] = {
+	0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+	0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55 };
+    const unsigned char cbits_mixed[4] = { 0x55, 0xaa, 0xff, 0x1b };
+    NMXP_CHAN_LIST_NET *channelList;
+    int ret = 0;
+
+    nmxp_log(NMXP_LOG_SET, NMXP_LOG_D_NULL);
+
+    channelList = nmxp_chan_list_net_new(0);
+    nmxp_chan_list_net_add(channelList, TEST_KEY, "STA.HHZ");
+
+    ret += test_decode("3 bundles and a null bundle", channelList, cbits_byte, 3, 1);
+    ret += test_decode("mixed codes and a null bundle", channelList, cbits_mixed, 4, 1);
+    ret += test_decode("1 bundle and a null bundle", channelList, cbits_byte, 1, 1);
+    ret += test_decode("17 bundles", channelList, cbits_byte, 17, 0);
+    ret += test_decode("16 bundles and a null bundle", channelList, cbits_byte, 16, 1);
+
+    nmxp_chan_list_net_free(&channelList);
+
+    return (ret == 0)? 0 : 1;
+}